@@ -0,0 +1,129 @@
+// Replays ADC command lines through AdcCommand::parse and reports
+// heap allocations per command and parsing throughput.
+//
+// Build from this directory (Linux):
+//   g++ -O2 -std=c++14 -DNDEBUG -I../../client -I../../boost replay.cpp ../../client/AdcCommand.cpp <deps> -o adc-replay
+// Add -DADC_REPLAY_VIEW to parse with AdcCommand::PARSE_FLAG_VIEW like CommandHandler::dispatch does.
+// <deps> are ../../client/Base32.cpp ../../client/BaseUtil.cpp
+// To measure the parser from before PARSE_FLAG_VIEW, extract AdcCommand.h and AdcCommand.cpp of that
+// revision to a directory, put it first in the include path, compile its AdcCommand.cpp instead and
+// add -DADC_REPLAY_LEGACY: that version has neither the flag nor getParamCount().
+//
+// Usage: adc-replay [file] [iterations]
+// The default input is sample.txt, one command per line without the trailing newline.
+
+#include "stdinc.h"
+#include "AdcCommand.h"
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <cstdlib>
+
+static size_t allocCount;
+
+void* operator new(size_t size)
+{
+	++allocCount;
+	void* p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+#ifdef ADC_REPLAY_LEGACY
+#define PARAM_COUNT(cmd) (cmd).getParameters().size()
+#define PARSE(cmd, s) (cmd).parse((s).data(), (s).length(), false)
+#else
+#define PARAM_COUNT(cmd) (cmd).getParamCount()
+#ifdef ADC_REPLAY_VIEW
+#define PARSE(cmd, s) (cmd).parse((s).data(), (s).length(), false, AdcCommand::PARSE_FLAG_VIEW)
+#else
+#define PARSE(cmd, s) (cmd).parse((s).data(), (s).length(), false, 0)
+#endif
+#endif
+
+// Accesses typical for the handlers of these commands
+static size_t handle(const AdcCommand& cmd)
+{
+	size_t result = PARAM_COUNT(cmd);
+	string value;
+	switch (cmd.getCommand())
+	{
+		case AdcCommand::CMD_INF:
+			if (cmd.getParam(TAG('N', 'I'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('S', 'S'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('I', '4'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('S', 'U'), 0, value)) result += value.length();
+			break;
+		case AdcCommand::CMD_SCH:
+			if (cmd.getParam(TAG('T', 'R'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('A', 'N'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('T', 'O'), 0, value)) result += value.length();
+			result += cmd.hasFlag(TAG('T', 'Y'), 0);
+			break;
+		case AdcCommand::CMD_RES:
+			if (cmd.getParam(TAG('F', 'N'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('S', 'I'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('T', 'R'), 0, value)) result += value.length();
+			if (cmd.getParam(TAG('T', 'O'), 0, value)) result += value.length();
+			break;
+		case AdcCommand::CMD_CTM:
+			if (PARAM_COUNT(cmd) >= 3) result += cmd.getParam(0).length() + cmd.getParam(1).length() + cmd.getParam(2).length();
+			break;
+	}
+	return result;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* fileName = argc > 1 ? argv[1] : "sample.txt";
+	const int iterations = argc > 2 ? atoi(argv[2]) : 200000;
+	std::ifstream in(fileName);
+	if (!in)
+	{
+		std::cerr << "Can't open " << fileName << '\n';
+		return 1;
+	}
+	vector<string> lines;
+	string line;
+	while (std::getline(in, line))
+		if (!line.empty()) lines.push_back(line);
+	if (lines.empty() || iterations <= 0)
+	{
+		std::cerr << "Nothing to replay\n";
+		return 1;
+	}
+
+	size_t check = 0, errors = 0;
+	allocCount = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < iterations; ++i)
+		for (const string& s : lines)
+		{
+			AdcCommand cmd(0);
+			if (PARSE(cmd, s) != AdcCommand::PARSE_OK)
+			{
+				++errors;
+				continue;
+			}
+			check += handle(cmd);
+		}
+	auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	size_t allocs = allocCount;
+	double commands = double(iterations) * lines.size();
+	std::cout << "commands: " << commands << ", parse errors: " << errors << '\n';
+	std::cout << "allocations per command: " << allocs / commands << '\n';
+	std::cout << "commands per second: " << commands / elapsed << '\n';
+	std::cout << "checksum: " << check << '\n';
+	return 0;
+}
@@ -163,7 +163,9 @@ bool ADLSearchManager::SearchContextItem::prepare(const ADLSearch& search, const
 	typeFileSize = search.typeFileSize;
 	isAutoQueue = search.isAutoQueue;
 	isForbidden = search.isForbidden;
-	stringSearches.clear();
+	keywords.clear();
+	patterns.clear();
+	matcher = -1;
 
 	if (!search.userCommand.empty())
 		userCommandId = FavoriteManager::getInstance()->findUserCommand(search.userCommand, UserCommand::CONTEXT_FILELIST);
@@ -186,27 +188,44 @@ bool ADLSearchManager::SearchContextItem::prepare(const ADLSearch& search, const
 	{
 		try
 		{
-			re = std::regex(s, search.isCaseSensitive ? std::regex::flag_type() : std::regex_constants::icase);
+			re.assign(s, search.isCaseSensitive ? boost::regex::perl : boost::regex::perl | boost::regex::icase);
 			isRegEx = true;
 		}
 		catch (...)
 		{
-			re = std::regex();
+			re = boost::regex();
 			result = false;
 		}
 	}
 	else
 	{
-		// Split into substrings
+		// Split into substrings, they are added to the context's matcher later
 		SimpleStringTokenizer<char> st(s, ' ');
 		string tok;
 		while (st.getNextNonEmptyToken(tok))
-			stringSearches.push_back(StringSearch(tok, !search.isCaseSensitive));
+			keywords.push_back(search.isCaseSensitive ? tok : Text::toLower(tok));
+		switch (sourceType)
+		{
+			case ADLSearch::OnlyFile:
+				matcher = MATCHER_FILE;
+				break;
+			case ADLSearch::OnlyDirectory:
+				matcher = MATCHER_DIRECTORY;
+				break;
+			case ADLSearch::FullPath:
+				matcher = MATCHER_FULL_PATH;
+				break;
+			default:
+				// TTH is handled above
+				break;
+		}
+		if (matcher != -1 && search.isCaseSensitive)
+			matcher += MATCHER_TYPES;
 	}
 	return result;
 }
 
-bool ADLSearchManager::SearchContextItem::matchFile(const string& fullPath, const DirectoryListing::File* file) const noexcept
+bool ADLSearchManager::SearchContextItem::matchFile(const string& fullPath, const DirectoryListing::File* file, const KeywordMatcher* matchers) const noexcept
 {
 	if (sourceType == ADLSearch::OnlyFile || sourceType == ADLSearch::FullPath || sourceType == ADLSearch::TTH)
 	{
@@ -219,43 +238,57 @@ bool ADLSearchManager::SearchContextItem::matchFile(const string& fullPath, cons
 	switch (sourceType)
 	{
 		case ADLSearch::OnlyFile:
-			return matchString(file->getName());
+			return matchString(file->getName(), matchers);
 		case ADLSearch::FullPath:
-			return matchString(fullPath);
+			return matchString(fullPath, matchers);
 		case ADLSearch::TTH:
 			return file->getTTH() == tth;
 	}
 	return false;
 }
 
-bool ADLSearchManager::SearchContextItem::matchDirectory(const DirectoryListing::Directory* dir) const noexcept
+bool ADLSearchManager::SearchContextItem::matchDirectory(const DirectoryListing::Directory* dir, const KeywordMatcher* matchers) const noexcept
 {
-	return sourceType == ADLSearch::OnlyDirectory && matchString(dir->getName());
+	return sourceType == ADLSearch::OnlyDirectory && matchString(dir->getName(), matchers);
 }
 
-bool ADLSearchManager::SearchContextItem::matchString(const string& s) const noexcept
+bool ADLSearchManager::SearchContextItem::matchString(const string& s, const KeywordMatcher* matchers) const noexcept
 {
 	if (isRegEx)
-		return std::regex_search(s, re);
+		return boost::regex_search(s, re);
+
+	// The string has already been scanned by the matcher
+	return !patterns.empty() && matchers[matcher].hasAll(patterns);
+}
+
+void ADLSearchManager::KeywordMatcher::compile()
+{
+	keywords.compile();
+	hits.assign(keywords.size(), 0);
+	stamp = 0;
+}
 
-	if (!stringSearches.empty())
+void ADLSearchManager::KeywordMatcher::scan(const string& s) noexcept
+{
+	if (keywords.empty()) return;
+	if (++stamp == 0)
 	{
-		if (stringSearches[0].getIgnoreCase())
-		{
-			string ls = Text::toLower(s);
-			for (const auto& ss : stringSearches)
-				if (!ss.matchKeepCase(ls))
-					return false;
-		}
-		else
-		{
-			for (const auto& ss : stringSearches)
-				if (!ss.matchKeepCase(s))
-					return false;
-		}
-		return true;
+		std::fill(hits.begin(), hits.end(), 0);
+		stamp = 1;
 	}
-	return false;
+	auto f = [this](uint32_t index) { hits[index] = stamp; };
+	if (ignoreCase)
+		keywords.match(Text::toLower(s), f);
+	else
+		keywords.match(s, f);
+}
+
+bool ADLSearchManager::KeywordMatcher::hasAll(const vector<uint32_t>& patterns) const noexcept
+{
+	for (uint32_t index : patterns)
+		if (hits[index] != stamp)
+			return false;
+	return true;
 }
 
 ADLSearchManager::ADLSearchManager() : csCollection(RWLock::create()), modified(false)
@@ -435,11 +468,20 @@ void ADLSearchManager::prepare(ADLSearchManager::SearchContext& ctx, DirectoryLi
 
 	ctx.destDir.emplace_back(DestDir{ defDestDir, new DirectoryListing::AdlDirectory(Util::emptyString, root, "<<<" + defDestDir + ">>>") });
 
+	for (int i = 0; i < MATCHER_TYPES; ++i)
+		ctx.matchers[i].ignoreCase = true;
+
 	SearchContextItem item;
 	READ_LOCK(*csCollection);
 	for (const ADLSearch& search : collection)
 		if (search.isActive && item.prepare(search, params))
 		{
+			if (item.matcher != -1)
+			{
+				KeywordMatcher& matcher = ctx.matchers[item.matcher];
+				for (const string& keyword : item.keywords)
+					item.patterns.push_back(static_cast<uint32_t>(matcher.keywords.addPattern(keyword)));
+			}
 			if (item.sourceType == ADLSearch::FullPath)
 				ctx.wantFullPath = true;
 			if (search.destDir.empty())
@@ -469,6 +511,8 @@ void ADLSearchManager::prepare(ADLSearchManager::SearchContext& ctx, DirectoryLi
 			}
 			ctx.collection.emplace_back(std::move(item));
 		}
+	for (KeywordMatcher& matcher : ctx.matchers)
+		matcher.compile();
 }
 
 void ADLSearchManager::SearchContext::match() noexcept
@@ -578,11 +622,16 @@ bool ADLSearchManager::SearchContext::matchFile(const DirectoryListing::File* fi
 	bool result = false;
 	string fullPath;
 	UserCommand uc;
+	if (wantFullPath) fullPath = dl->getPath(file) + file->getName();
+	for (int i = 0; i < MATCHER_TYPES * 2; i += MATCHER_TYPES)
+	{
+		matchers[i + MATCHER_FILE].scan(file->getName());
+		if (wantFullPath) matchers[i + MATCHER_FULL_PATH].scan(fullPath);
+	}
 	for (const auto& item : collection)
 	{
 		if (item.sourceType == ADLSearch::OnlyDirectory) continue;
-		if (wantFullPath) fullPath = dl->getPath(file) + file->getName();
-		if (!item.matchFile(fullPath, file)) continue;
+		if (!item.matchFile(fullPath, file, matchers)) continue;
 		DirectoryListing::AdlDirectory* dir = destDir[item.destDirIndex].dir;
 		if (!dir) continue;
 		DirectoryListing::AdlFile* newFile = new DirectoryListing::AdlFile(dl->getPath(file->getParent()), *file);
@@ -621,9 +670,11 @@ bool ADLSearchManager::SearchContext::matchFile(const DirectoryListing::File* fi
 bool ADLSearchManager::SearchContext::matchDirectory(const DirectoryListing::Directory* dir) noexcept
 {
 	bool result = false;
+	matchers[MATCHER_DIRECTORY].scan(dir->getName());
+	matchers[MATCHER_TYPES + MATCHER_DIRECTORY].scan(dir->getName());
 	for (const auto& item : collection)
 	{
-		if (!item.matchDirectory(dir)) continue;
+		if (!item.matchDirectory(dir, matchers)) continue;
 		if (destDir[item.destDirIndex].dir)
 			ADLSearchManager::copyDirectory(destDir[item.destDirIndex].dir, dir, dl);
 #if 0
@@ -27,9 +27,11 @@
 #include "Singleton.h"
 #include "SettingsManager.h"
 #include "StringSearch.h"
+#include "MultiStringSearch.h"
 #include "DirectoryListing.h"
 #include "RWLock.h"
 #include <atomic>
+#include <boost/regex.hpp>
 
 class ADLSearch
 {
@@ -130,16 +132,40 @@ class ADLSearchManager : public Singleton<ADLSearchManager>
 		bool modified;
 		uint64_t nextSaveTime;
 
+		// Finds the keywords of all plain text searches with the same source type and
+		// case sensitivity in one pass over the string
+		struct KeywordMatcher
+		{
+			MultiStringSearch keywords;
+			bool ignoreCase = false;
+			vector<uint32_t> hits; // stamp of the last string containing the keyword
+			uint32_t stamp = 0;
+
+			void compile();
+			void scan(const string& s) noexcept;
+			bool hasAll(const vector<uint32_t>& patterns) const noexcept;
+		};
+
+		enum
+		{
+			MATCHER_FILE,
+			MATCHER_DIRECTORY,
+			MATCHER_FULL_PATH,
+			MATCHER_TYPES
+		};
+
 		struct SearchContextItem
 		{
 			bool prepare(const ADLSearch& search, const StringMap& params) noexcept;
-			bool matchFile(const string& fullPath, const DirectoryListing::File* file) const noexcept;
-			bool matchDirectory(const DirectoryListing::Directory* dir) const noexcept;
-			bool matchString(const string& s) const noexcept;
+			bool matchFile(const string& fullPath, const DirectoryListing::File* file, const KeywordMatcher* matchers) const noexcept;
+			bool matchDirectory(const DirectoryListing::Directory* dir, const KeywordMatcher* matchers) const noexcept;
+			bool matchString(const string& s, const KeywordMatcher* matchers) const noexcept;
 
 			ADLSearch::SourceType sourceType;
-			StringSearch::List stringSearches;
-			std::regex re;
+			StringList keywords;
+			vector<uint32_t> patterns; // indices of keywords in the matcher
+			int matcher;
+			boost::regex re;
 			bool isRegEx;
 			bool isAutoQueue;
 			bool isForbidden;
@@ -161,6 +187,7 @@ class ADLSearchManager : public Singleton<ADLSearchManager>
 		{
 			vector<SearchContextItem> collection;
 			vector<DestDir> destDir;
+			KeywordMatcher matchers[MATCHER_TYPES * 2]; // case insensitive, then case sensitive
 			bool breakOnFirst = false;
 			bool wantFullPath = false;
 			DirectoryListing* dl = nullptr;
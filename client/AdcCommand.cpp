@@ -20,19 +20,27 @@
 #include "AdcCommand.h"
 #include "StrUtil.h"
 
-AdcCommand::AdcCommand(uint32_t cmd, char type /* = TYPE_CLIENT */) : cmdInt(cmd), from(0), to(0), type(type)
+enum
+{
+	HEADER_FIELD_NONE,
+	HEADER_FIELD_FROM,
+	HEADER_FIELD_TO,
+	HEADER_FIELD_FEATURES
+};
+
+AdcCommand::AdcCommand(uint32_t cmd, char type /* = TYPE_CLIENT */) : buf(nullptr), indexValid(false), cmdInt(cmd), from(0), to(0), type(type)
 {
 	dcassert(cmdChar[3] == 0);
 	cmdChar[3] = 0;
 }
 
-AdcCommand::AdcCommand(uint32_t cmd, const uint32_t target, char type) : cmdInt(cmd), from(0), to(target), type(type)
+AdcCommand::AdcCommand(uint32_t cmd, const uint32_t target, char type) : buf(nullptr), indexValid(false), cmdInt(cmd), from(0), to(target), type(type)
 {
 	dcassert(cmdChar[3] == 0);
 	cmdChar[3] = 0;
 }
 
-AdcCommand::AdcCommand(Severity sev, Error err, const string& desc, char type /* = TYPE_CLIENT */) : cmdInt(CMD_STA), from(0), to(0), type(type)
+AdcCommand::AdcCommand(Severity sev, Error err, const string& desc, char type /* = TYPE_CLIENT */) : buf(nullptr), indexValid(false), cmdInt(CMD_STA), from(0), to(0), type(type)
 {
 	addParam((sev == SEV_SUCCESS && err == SUCCESS) ? "000" : Util::toString(sev * 100 + err));
 	addParam(desc);
@@ -40,8 +48,13 @@ AdcCommand::AdcCommand(Severity sev, Error err, const string& desc, char type /*
 	cmdChar[3] = 0;
 }
 
-int AdcCommand::parse(const char* buf, size_t len, bool nmdc /* = false */) noexcept
+int AdcCommand::parse(const char* buf, size_t len, bool nmdc /* = false */, int flags /* = 0 */) noexcept
 {
+	parameters.clear();
+	tokens.clear();
+	this->buf = nullptr;
+	indexValid = false;
+
 	size_t i = 5;
 	if (nmdc)
 	{
@@ -71,90 +84,86 @@ int AdcCommand::parse(const char* buf, size_t len, bool nmdc /* = false */) noex
 	if (type == TYPE_INFO)
 		from = HUB_SID;
 
-	string cur;
-	cur.reserve(128);
-
 	bool toSet = false;
 	bool featureSet = false;
 	bool fromSet = nmdc; // $ADCxxx never have a from CID...
 
-	while (i < len)
+	if (i < len)
+		tokens.reserve(std::count(buf + i, buf + len, ' ') + 1);
+
+	Token token;
+	token.materialized = false;
+	string tmp;
+	size_t start = i;
+	bool escaped = false;
+	while (i <= len)
 	{
-		switch (buf[i])
+		if (i < len && buf[i] != ' ')
 		{
-			case '\\':
+			if (buf[i] == '\\')
+			{
 				++i;
 				if (i == len)
 					return PARSE_ERROR_ESCAPE_AT_EOL;
-				if (buf[i] == 's')
-					cur += ' ';
-				else if (buf[i] == 'n')
-					cur += '\n';
-				else if (buf[i] == '\\')
-					cur += '\\';
-				else if (buf[i] == ' ' && nmdc) // $ADCGET escaping, leftover from old specs
-					cur += ' ';
-				else
+				if (!(buf[i] == 's' || buf[i] == 'n' || buf[i] == '\\' || (buf[i] == ' ' && nmdc))) // $ADCGET escaping, leftover from old specs
 					return PARSE_ERROR_ESCAPE_AT_EOL;
-				break;
-			case ' ': // New parameter...
+				escaped = true;
+			}
+			++i;
+			continue;
+		}
+		// New parameter, the last one is only added when it's not empty
+		if (i < len || i > start)
+		{
+			token.offset = static_cast<uint32_t>(start);
+			token.length = static_cast<uint32_t>(i - start);
+			token.escaped = escaped;
+			int field = HEADER_FIELD_NONE;
+			if ((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet)
+				field = HEADER_FIELD_FROM;
+			else if ((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet)
+				field = HEADER_FIELD_TO;
+			else if (type == TYPE_FEATURE && !featureSet)
+				field = HEADER_FIELD_FEATURES;
+			if (field == HEADER_FIELD_NONE)
+			{
+				tokens.push_back(token);
+			}
+			else
 			{
-				if ((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet)
+				const char* data = buf + start;
+				size_t dataLen = token.length;
+				if (escaped)
+				{
+					this->buf = buf;
+					unescape(token, tmp);
+					data = tmp.data();
+					dataLen = tmp.length();
+				}
+				if (field == HEADER_FIELD_FROM)
 				{
-					from = toSID(cur);
+					from = toSID(data, dataLen);
 					if (!from) return PARSE_ERROR_INVALID_SID_LENGTH;
 					fromSet = true;
 				}
-				else if ((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet)
+				else if (field == HEADER_FIELD_TO)
 				{
-					to = toSID(cur);
+					to = toSID(data, dataLen);
 					if (!to) return PARSE_ERROR_INVALID_SID_LENGTH;
 					toSet = true;
 				}
-				else if (type == TYPE_FEATURE && !featureSet)
+				else
 				{
-					if (cur.length() % 5 != 0)
+					if (dataLen % 5 != 0)
 						return PARSE_ERROR_INVALID_FEATURE_LENGTH;
 					// Skip...
 					featureSet = true;
 				}
-				else
-				{
-					parameters.push_back(cur);
-				}
-				cur.clear();
 			}
-			break;
-			default:
-				cur += buf[i];
 		}
 		++i;
-	}
-	if (!cur.empty())
-	{
-		if ((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet)
-		{
-			from = toSID(cur);
-			if (!from) return PARSE_ERROR_INVALID_SID_LENGTH;
-			fromSet = true;
-		}
-		else if ((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet)
-		{
-			to = toSID(cur);
-			if (!to) return PARSE_ERROR_INVALID_SID_LENGTH;
-			toSet = true;
-		}
-		else if (type == TYPE_FEATURE && !featureSet)
-		{
-			if (cur.length() % 5 != 0)
-				return PARSE_ERROR_INVALID_FEATURE_LENGTH;
-			// Skip...
-			featureSet = true;
-		}
-		else
-		{
-			parameters.push_back(cur);
-		}
+		start = i;
+		escaped = false;
 	}
 
 	if ((type == TYPE_BROADCAST || type == TYPE_DIRECT || type == TYPE_ECHO || type == TYPE_FEATURE) && !fromSet)
@@ -166,9 +175,126 @@ int AdcCommand::parse(const char* buf, size_t len, bool nmdc /* = false */) noex
 	if ((type == TYPE_DIRECT || type == TYPE_ECHO) && !toSet)
 		return PARSE_ERROR_MISSING_TO_SID;
 
+	this->buf = buf;
+	if (!(flags & PARSE_FLAG_VIEW))
+		materializeAll();
 	return PARSE_OK;
 }
 
+void AdcCommand::unescape(const Token& token, string& out) const noexcept
+{
+	const char* p = buf + token.offset;
+	const char* end = p + token.length;
+	out.clear();
+	out.reserve(token.length);
+	while (p < end)
+	{
+		char c = *p++;
+		if (c == '\\' && p < end)
+		{
+			c = *p++;
+			if (c == 's')
+				c = ' ';
+			else if (c == 'n')
+				c = '\n';
+		}
+		out += c;
+	}
+}
+
+void AdcCommand::materialize(size_t n) const noexcept
+{
+	if (parameters.size() != tokens.size())
+		parameters.resize(tokens.size());
+	Token& token = tokens[n];
+	if (token.escaped)
+		unescape(token, parameters[n]);
+	else
+		parameters[n].assign(buf + token.offset, token.length);
+	token.materialized = true;
+}
+
+void AdcCommand::materializeAll() const noexcept
+{
+	parameters.resize(tokens.size());
+	for (size_t n = 0; n < tokens.size(); ++n)
+		if (!tokens[n].materialized)
+			materialize(n);
+	tokens.clear();
+	buf = nullptr;
+}
+
+const char* AdcCommand::getParamData(size_t n, size_t& len) const noexcept
+{
+	if (buf && !tokens[n].materialized)
+	{
+		const Token& token = tokens[n];
+		if (!token.escaped)
+		{
+			len = token.length;
+			return buf + token.offset;
+		}
+		materialize(n);
+	}
+	len = parameters[n].length();
+	return parameters[n].data();
+}
+
+static inline size_t getCodeSlot(uint16_t code)
+{
+	return (code ^ (code >> 5) ^ (code >> 10));
+}
+
+void AdcCommand::buildIndex() const noexcept
+{
+	memset(codeIndex, 0, sizeof(codeIndex));
+	const size_t count = getParamCount();
+	for (size_t n = 0; n < count; ++n)
+	{
+		size_t len;
+		const char* data = getParamData(n, len);
+		if (len < 2) continue;
+		uint16_t code = toCode(data);
+		size_t slot = getCodeSlot(code) & (CODE_INDEX_SIZE - 1);
+		while (codeIndex[slot] && codeKeys[slot] != code)
+			slot = (slot + 1) & (CODE_INDEX_SIZE - 1);
+		if (!codeIndex[slot])
+		{
+			codeIndex[slot] = static_cast<uint8_t>(n + 1);
+			codeKeys[slot] = code;
+		}
+	}
+	indexValid = true;
+}
+
+size_t AdcCommand::findParam(uint16_t name, size_t start) const noexcept
+{
+	const size_t count = getParamCount();
+	if (start >= count) return string::npos;
+	if (count <= CODE_INDEX_MAX_PARAMS)
+	{
+		if (!indexValid) buildIndex();
+		size_t slot = getCodeSlot(name) & (CODE_INDEX_SIZE - 1);
+		while (true)
+		{
+			if (!codeIndex[slot]) return string::npos;
+			if (codeKeys[slot] == name) break;
+			slot = (slot + 1) & (CODE_INDEX_SIZE - 1);
+		}
+		size_t first = codeIndex[slot] - 1;
+		if (first >= start) return first;
+		// The same code appears again after start
+	}
+	for (size_t n = start; n < count; ++n)
+	{
+		size_t len;
+		const char* data = getParamData(n, len);
+		if (len >= 2 && toCode(data) == name)
+			return n;
+	}
+	return string::npos;
+}
+
 string AdcCommand::toString(const CID& cid, bool nmdc /* = false */) const noexcept
 {
 	return getHeaderString(cid) + getParamString(nmdc);
@@ -253,6 +379,7 @@ string AdcCommand::getHeaderString(const CID& cid) const noexcept
 
 string AdcCommand::getParamString(bool nmdc) const noexcept
 {
+	if (buf) materializeAll();
 	string tmp;
 	tmp.reserve(65);
 	for (auto i = parameters.cbegin(); i != parameters.cend(); ++i)
@@ -269,13 +396,12 @@ string AdcCommand::getParamString(bool nmdc) const noexcept
 
 bool AdcCommand::getParam(uint16_t name, size_t start, string& value) const noexcept
 {
-	for (string::size_type i = start; i < parameters.size(); ++i)
-		if (parameters[i].length() >= 2 && name == toCode(parameters[i].c_str()))
-		{
-			value = parameters[i].substr(2);
-			return true;
-		}
-	return false;
+	size_t n = findParam(name, start);
+	if (n == string::npos) return false;
+	size_t len;
+	const char* data = getParamData(n, len);
+	value.assign(data + 2, len - 2);
+	return true;
 }
 
 bool AdcCommand::getParam(const char* name, size_t start, string& value) const noexcept
@@ -285,9 +411,13 @@ bool AdcCommand::getParam(const char* name, size_t start, string& value) const n
 
 bool AdcCommand::hasFlag(uint16_t name, size_t start) const noexcept
 {
-	for (string::size_type i = start; i < parameters.size(); ++i)
-		if (parameters[i].length() == 3 && name == toCode(parameters[i].c_str()) && parameters[i][2] == '1')
+	for (size_t n = findParam(name, start); n != string::npos; n = findParam(name, n + 1))
+	{
+		size_t len;
+		const char* data = getParamData(n, len);
+		if (len == 3 && data[2] == '1')
 			return true;
+	}
 	return false;
 }
 
@@ -87,6 +87,13 @@ class AdcCommand
 			PARSE_ERROR_MISSING_FEATURE
 		};
 
+		enum
+		{
+			// Parameters keep pointing into the parsed buffer and are unescaped when first accessed.
+			// The buffer must stay unchanged while the command is in use.
+			PARSE_FLAG_VIEW = 1
+		};
+
 		static const char TYPE_BROADCAST = 'B';
 		static const char TYPE_CLIENT = 'C';
 		static const char TYPE_DIRECT = 'D';
@@ -157,7 +164,7 @@ class AdcCommand
 			return tmp;
 		}
 
-		int parse(const char* buf, size_t len, bool nmdc = false) noexcept;
+		int parse(const char* buf, size_t len, bool nmdc = false, int flags = 0) noexcept;
 
 		const string& getFeatures() const noexcept
 		{
@@ -170,33 +177,51 @@ class AdcCommand
 			return *this;
 		}
 
-		StringList& getParameters() noexcept { return parameters; }
-		const StringList& getParameters() const noexcept { return parameters; }
+		StringList& getParameters() noexcept
+		{
+			if (buf) materializeAll();
+			indexValid = false;
+			return parameters;
+		}
+		const StringList& getParameters() const noexcept
+		{
+			if (buf) materializeAll();
+			return parameters;
+		}
+		size_t getParamCount() const noexcept { return buf ? tokens.size() : parameters.size(); }
 
 		string toString(const CID& cid, bool nmdc = false) const noexcept;
 		string toString(uint32_t sid, bool nmdc = false) const noexcept;
 
 		AdcCommand& addParam(uint16_t name, const string& value) noexcept
 		{
+			if (buf) materializeAll();
+			indexValid = false;
 			parameters.emplace_back(reinterpret_cast<const char*>(&name), 2);
 			parameters.back() += value;
 			return *this;
 		}
 		AdcCommand& addParam(const string& name, const string& value) noexcept
 		{
+			if (buf) materializeAll();
+			indexValid = false;
 			parameters.push_back(name);
 			parameters.back() += value;
 			return *this;
 		}
 		AdcCommand& addParam(const string& str) noexcept
 		{
+			if (buf) materializeAll();
+			indexValid = false;
 			parameters.push_back(str);
 			return *this;
 		}
 		const string& getParam(size_t n) const noexcept
 		{
-			dcassert(parameters.size() > n);
-			return parameters.size() > n ? parameters[n] : Util::emptyString;
+			dcassert(getParamCount() > n);
+			if (n >= getParamCount()) return Util::emptyString;
+			if (buf && !tokens[n].materialized) materialize(n);
+			return parameters[n];
 		}
 		// Return a named parameter where the name is a two-letter code
 		bool getParam(uint16_t name, size_t start, string& value) const noexcept;
@@ -223,8 +248,14 @@ class AdcCommand
 		}
 		static uint32_t toSID(const string& sid) noexcept
 		{
-			if (sid.length() != 4) return 0;
-			return *reinterpret_cast<const uint32_t*>(sid.data());
+			return toSID(sid.data(), sid.length());
+		}
+		static uint32_t toSID(const char* sid, size_t len) noexcept
+		{
+			if (len != 4) return 0;
+			uint32_t result;
+			memcpy(&result, sid, sizeof(result));
+			return result;
 		}
 		static string fromSID(const uint32_t sid) noexcept
 		{
@@ -234,9 +265,34 @@ class AdcCommand
 		string getParamString(bool nmdc) const noexcept;
 
 	private:
+		struct Token
+		{
+			uint32_t offset;
+			uint32_t length;
+			bool escaped;
+			bool materialized;
+		};
+
+		// Open addressing table: two-letter code -> index of its first parameter + 1
+		static const size_t CODE_INDEX_SIZE = 64;
+		static const size_t CODE_INDEX_MAX_PARAMS = 48;
+
 		string getHeaderString(const CID& cid) const noexcept;
 		string getHeaderString(uint32_t sid, bool nmdc) const noexcept;
-		StringList parameters;
+		void materialize(size_t n) const noexcept;
+		void materializeAll() const noexcept;
+		void unescape(const Token& token, string& out) const noexcept;
+		const char* getParamData(size_t n, size_t& len) const noexcept;
+		void buildIndex() const noexcept;
+		size_t findParam(uint16_t name, size_t start) const noexcept;
+
+		// While buf is set, parameters are allocated on first use and only valid where tokens[n].materialized is set
+		mutable StringList parameters;
+		mutable vector<Token> tokens;
+		mutable const char* buf;
+		mutable bool indexValid;
+		mutable uint8_t codeIndex[CODE_INDEX_SIZE];
+		mutable uint16_t codeKeys[CODE_INDEX_SIZE];
 		string features;
 		union
 		{
@@ -256,7 +312,7 @@ class CommandHandler
 		void dispatch(const char* buf, size_t len, bool nmdc = false)
 		{
 			AdcCommand cmd(0);
-			int parseResult = cmd.parse(buf, len, nmdc);
+			int parseResult = cmd.parse(buf, len, nmdc, AdcCommand::PARSE_FLAG_VIEW);
 
 			if (parseResult != AdcCommand::PARSE_OK)
 			{
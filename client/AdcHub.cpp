@@ -199,19 +199,20 @@ void AdcHub::clearUsers()
 			bytesShared.store(0);
 		}
 		
+		OnlineUserList offline;
+		offline.reserve(tmp.size());
 		for (auto i = tmp.cbegin(); i != tmp.cend(); ++i)
 		{
 			if (i->first != AdcCommand::HUB_SID)
-			{
-				ClientManager::getInstance()->putOffline(i->second);
-			}
+				offline.push_back(i->second);
 		}
+		ClientManager::getInstance()->putOffline(offline);
 	}
 }
 
 void AdcHub::handle(AdcCommand::INF, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty()) return;
+	if (c.getParamCount() == 0) return;
 	OnlineUserPtr ou;
 	bool newUser = false;
 	string cidStr;
@@ -483,7 +484,7 @@ void AdcHub::handle(AdcCommand::SUP, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::SID, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty())
+	if (c.getParamCount() == 0)
 		return;
 		
 	{
@@ -502,7 +503,7 @@ void AdcHub::handle(AdcCommand::SID, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::MSG, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty())
+	if (c.getParamCount() == 0)
 		return;
 	auto user = findUser(c.getFrom());
 	if (!user)
@@ -554,7 +555,7 @@ void AdcHub::handle(AdcCommand::MSG, const AdcCommand& c) noexcept
 
 void AdcHub::processCCPMMessage(const AdcCommand& c, const OnlineUserPtr& ou) noexcept
 {
-	dcassert(!c.getParameters().empty());
+	dcassert(c.getParamCount() != 0);
 	unique_ptr<ChatMessage> message(new ChatMessage(c.getParam(0), ou, nullptr, nullptr, c.hasFlag(TAG('M', 'E'), 1)));
 	message->to = getMyOnlineUser();
 	message->replyTo = ou;
@@ -566,7 +567,7 @@ void AdcHub::processCCPMMessage(const AdcCommand& c, const OnlineUserPtr& ou) no
 
 void AdcHub::handle(AdcCommand::GPA, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty())
+	if (c.getParamCount() == 0)
 		return;
 
 	setRegistered();
@@ -646,7 +647,7 @@ void AdcHub::handle(AdcCommand::CTM, const AdcCommand& c) noexcept
 	OnlineUserPtr ou = findUser(c.getFrom());
 	if (!ou || ou->getUser()->isMe())
 		return;
-	if (c.getParameters().size() < 3)
+	if (c.getParamCount() < 3)
 		return;
 		
 	const string& protocol = c.getParam(0);
@@ -699,7 +700,7 @@ void AdcHub::handle(AdcCommand::ZOF, const AdcCommand&) noexcept
 
 void AdcHub::handle(AdcCommand::RCM, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().size() < 2)
+	if (c.getParamCount() < 2)
 		return;
 
 	{
@@ -762,7 +763,7 @@ void AdcHub::handle(AdcCommand::RCM, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::CMD, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty())
+	if (c.getParamCount() == 0)
 		return;
 	if (!isFeatureSupported(FEATURE_FLAG_USER_COMMANDS))
 		return;
@@ -825,7 +826,7 @@ void AdcHub::sendUDP(const AdcCommand& cmd) noexcept
 
 void AdcHub::handle(AdcCommand::STA, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().size() < 2)
+	if (c.getParamCount() < 2)
 		return;
 		
 	OnlineUserPtr ou;
@@ -942,7 +943,7 @@ void AdcHub::handle(AdcCommand::PSR, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::GET, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().empty())
+	if (c.getParamCount() == 0)
 	{
 		send(AdcCommand(AdcCommand::SEV_FATAL, AdcCommand::ERROR_PROTOCOL_GENERIC, "Too few parameters for GET", AdcCommand::TYPE_HUB));
 		return;
@@ -955,7 +956,7 @@ void AdcHub::handle(AdcCommand::GET, const AdcCommand& c) noexcept
 	}
 	
 	string sk, sh;
-	if (c.getParameters().size() < 5 || !c.getParam(TAG('B', 'K'), 4, sk) || !c.getParam(TAG('B', 'H'), 4, sh))
+	if (c.getParamCount() < 5 || !c.getParam(TAG('B', 'K'), 4, sk) || !c.getParam(TAG('B', 'H'), 4, sh))
 	{
 		send(AdcCommand(AdcCommand::SEV_FATAL, AdcCommand::ERROR_PROTOCOL_GENERIC, "Too few parameters for blom", AdcCommand::TYPE_HUB));
 		return;
@@ -1002,7 +1003,7 @@ void AdcHub::handle(AdcCommand::GET, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::NAT, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().size() < 3)
+	if (c.getParamCount() < 3)
 		return;
 
 	{
@@ -1059,7 +1060,7 @@ void AdcHub::handle(AdcCommand::NAT, const AdcCommand& c) noexcept
 
 void AdcHub::handle(AdcCommand::RNT, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().size() < 3)
+	if (c.getParamCount() < 3)
 		return;
 
 	{
@@ -1659,7 +1660,7 @@ void AdcHub::info(bool/* forceUpdate*/)
 
 	addInfoParam(c, TAG('S', 'U'), su);
 
-	if (!c.getParameters().empty())
+	if (c.getParamCount() != 0)
 		send(c);
 }
 
@@ -25,7 +25,9 @@
 #include "ShareManager.h"
 #include "DownloadManager.h"
 #include "UploadManager.h"
+#include "ThrottleManager.h"
 #include "Socket.h"
+#include "CryptoManager.h"
 #include "Client.h"
 #include "FormatUtil.h"
 #include "Util.h"
@@ -158,6 +160,15 @@ string AppStats::getSpeedInfo()
 	s += "Upload speed\t";
 	s += Util::formatBytes(UploadManager::getRunningAverage()) + "/s  (";
 	s += Util::toString(UploadManager::getInstance()->getUploadCount()) + " fls.)\n";
+	auto tm = ThrottleManager::getInstance();
+	if (tm->isEnabled())
+	{
+		TokenBucket::Stats stats;
+		tm->getDownloadBucket().getStats(stats);
+		s += "Download limiter\t" + Util::toString(stats.throttled) + " of " + Util::toString(stats.requests) + " requests throttled\n";
+		tm->getUploadBucket().getStats(stats);
+		s += "Upload limiter\t" + Util::toString(stats.throttled) + " of " + Util::toString(stats.requests) + " requests throttled\n";
+	}
 	return s;
 }
 
@@ -233,7 +244,21 @@ string AppStats::getNetworkStats()
 		Util::formatBytes(Socket::g_stats.tcp.downloaded).c_str(), Util::formatBytes(Socket::g_stats.tcp.uploaded).c_str(),
 		Util::formatBytes(Socket::g_stats.udp.downloaded).c_str(), Util::formatBytes(Socket::g_stats.udp.uploaded).c_str(),
 		Util::formatBytes(Socket::g_stats.ssl.downloaded).c_str(), Util::formatBytes(Socket::g_stats.ssl.uploaded).c_str());
-	return buf;
+	string s = buf;
+	if (CryptoManager::isValidInstance())
+	{
+		CryptoManager::SessionCacheStats stats;
+		CryptoManager::getInstance()->getSessionCacheStats(stats);
+		snprintf(buf, sizeof(buf),
+			"TLS sessions resumed (outgoing)\t%llu of %llu\n"
+			"TLS sessions resumed (incoming)\t%llu of %llu\n"
+			"TLS session cache\t%u\n",
+			(unsigned long long) stats.clientResumed, (unsigned long long) (stats.clientResumed + stats.clientFull),
+			(unsigned long long) stats.serverResumed, (unsigned long long) (stats.serverResumed + stats.serverFull),
+			(unsigned) stats.cachedSessions);
+		s += buf;
+	}
+	return s;
 }
 
 string AppStats::getGlobalMemoryStatusMessage()
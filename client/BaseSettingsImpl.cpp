@@ -14,6 +14,8 @@
 
 using std::string;
 
+const string SettingsSnapshot::emptyString;
+
 void BaseSettingsImpl::addInt(int id, const string& name, int def, int flags, Validator<int>* validator)
 {
 	ValueHolder<int> vh;
@@ -253,3 +255,29 @@ void BaseSettingsImpl::initMaps(NameToInfoMap& nameMap, IdToInfoMap& idMap)
 		idMap.insert(std::make_pair(i.first, si));
 	}
 }
+
+void BaseSettingsImpl::makeSnapshot(SettingsSnapshot& snapshot) const
+{
+	int maxId = -1;
+	if (!is.empty()) maxId = std::max(maxId, is.rbegin()->first);
+	if (!ss.empty()) maxId = std::max(maxId, ss.rbegin()->first);
+	size_t size = maxId + 1;
+	snapshot.types.assign(size, SettingsSnapshot::VALUE_NONE);
+	snapshot.ints.assign(size, 0);
+	snapshot.strings.clear();
+	snapshot.strings.resize(size);
+	for (const auto& i : is)
+	{
+		if (i.first < 0) continue;
+		const auto& data = i.second;
+		snapshot.types[i.first] = SettingsSnapshot::VALUE_INT;
+		snapshot.ints[i.first] = (data.flags & FLAG_VALUE_CHANGED) ? data.val : data.def;
+	}
+	for (const auto& i : ss)
+	{
+		if (i.first < 0) continue;
+		const auto& data = i.second;
+		snapshot.types[i.first] = SettingsSnapshot::VALUE_STRING;
+		snapshot.strings[i.first] = (data.flags & FLAG_VALUE_CHANGED) ? data.val : data.def;
+	}
+}
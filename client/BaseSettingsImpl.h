@@ -2,6 +2,7 @@
 #define BASE_SETTINGS_IMPL_H_
 
 #include "Settings.h"
+#include "SettingsSnapshot.h"
 #include <map>
 
 class BaseSettingsImpl : public Settings
@@ -158,6 +159,7 @@ public:
 	void unlockWrite() override {}
 
 	void initMaps(NameToInfoMap& nameMap, IdToInfoMap& idMap);
+	void makeSnapshot(SettingsSnapshot& snapshot) const;
 };
 
 #endif // BASE_SETTINGS_IMPL_H_
@@ -70,6 +70,28 @@ class BloomFilter
 			used = total;
 		}
 
+		size_t size() const
+		{
+			return table.size();
+		}
+		// Bits are packed into (size() + 63) / 64 words
+		void copyTo(uint64_t* data) const
+		{
+			for (size_t i = 0; i < table.size(); i += 64)
+			{
+				uint64_t word = 0;
+				size_t end = std::min(table.size(), i + 64);
+				for (size_t j = i; j < end; ++j)
+					if (table[j]) word |= (uint64_t) 1 << (j - i);
+				data[i / 64] = word;
+			}
+		}
+		void copyFrom(const uint64_t* data)
+		{
+			for (size_t i = 0; i < table.size(); ++i)
+				table[i] = (data[i / 64] >> (i % 64) & 1) != 0;
+		}
+
 	private:
 		void xadd(const string& s, size_t n)
 		{
@@ -33,6 +33,7 @@
 #include "NetworkDevices.h"
 #include "SettingsManager.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 #ifdef _WIN32
 #include "CompatibilityManager.h"
@@ -49,6 +50,9 @@ static const int THROTTLE_TIMEOUT = 100;
 
 #ifdef FLYLINKDC_USE_SOCKET_COUNTER
 static std::atomic<int> socketCounter(0);
+
+static Metrics::Callback metricSockets("sockets", "Number of buffered sockets", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return socketCounter.load(); });
 #endif
 
 BufferedSocket::Buffer::Buffer()
@@ -146,12 +150,9 @@ void BufferedSocket::Buffer::clear() noexcept
 }
 
 BufferedSocket::BufferedSocket(char separator, BufferedSocketListener* listener) :
-	stopFlag(false), separator(separator), listener(listener)
+	stopFlag(false), separator(separator), listener(listener), throttlePriority(TokenBucket::PRIORITY_NORMAL)
 {
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	maxLineSize = ss->getInt(Conf::MAX_COMMAND_LENGTH);
-	ss->unlockRead();
+	maxLineSize = SettingsManager::instance.getCoreSnapshot().getInt(Conf::MAX_COMMAND_LENGTH);
 
 	protocol = Socket::PROTO_DEFAULT;
 	state = STARTING;
@@ -1126,42 +1127,51 @@ int BufferedSocket::writeThrottled(const void* data, int len)
 	int64_t maxSpeed = sock->getMaxSpeed();
 	if (maxSpeed < 0) // Bypass limit
 		return sock->write(data, len);
-	if (maxSpeed == 0)
+	const uint64_t tick = Util::getTick();
+	if (maxSpeed > 0)
 	{
-		maxSpeed = ThrottleManager::getInstance()->getSocketUploadLimit();
-		if (!maxSpeed)
-			return sock->write(data, len);
+		// Per-connection limit
+		if (!writeLimiter) writeLimiter.reset(new ThrottleState);
+		writeLimiter->setCurrentTick(tick);
+		int maxSize = writeLimiter->getAvailSize(maxSpeed);
+		if (!maxSize)
+		{
+			pollState |= Socket::WAIT_THROTTLE;
+			return -1;
+		}
+		if (len > maxSize) len = maxSize;
 	}
-	if (!writeLimiter) writeLimiter.reset(new ThrottleState);
-	writeLimiter->setCurrentTick(Util::getTick());
-	int maxSize = writeLimiter->getAvailSize(maxSpeed);
-	if (!maxSize)
+	TokenBucket& bucket = ThrottleManager::getInstance()->getUploadBucket();
+	if (bucket.getRate())
 	{
-		pollState |= Socket::WAIT_THROTTLE;
-		return -1;
+		int allowed = bucket.consume(len, throttlePriority, tick);
+		if (!allowed)
+		{
+			pollState |= Socket::WAIT_THROTTLE;
+			return -1;
+		}
+		len = sock->write(data, allowed);
+		if (len < allowed) bucket.refund(len > 0 ? allowed - len : allowed);
 	}
-	if (len > maxSize) len = maxSize;
-	len = sock->write(data, len);
-	if (len > 0) writeLimiter->addSize(len);
+	else
+		len = sock->write(data, len);
+	if (len > 0 && writeLimiter) writeLimiter->addSize(len);
 	return len;
 }
 
 int BufferedSocket::readThrottled(void* data, int len)
 {
-	int64_t maxSpeed = ThrottleManager::getInstance()->getSocketDownloadLimit();
-	if (!maxSpeed)
+	TokenBucket& bucket = ThrottleManager::getInstance()->getDownloadBucket();
+	if (!bucket.getRate())
 		return sock->read(data, len);
-	if (!readLimiter) readLimiter.reset(new ThrottleState);
-	readLimiter->setCurrentTick(Util::getTick());
-	int maxSize = readLimiter->getAvailSize(maxSpeed);
-	if (!maxSize)
+	int allowed = bucket.consume(len, throttlePriority, Util::getTick());
+	if (!allowed)
 	{
 		pollState |= Socket::WAIT_THROTTLE;
 		return -1;
 	}
-	if (len > maxSize) len = maxSize;
-	len = sock->read(data, len);
-	if (len > 0) readLimiter->addSize(len);
+	len = sock->read(data, allowed);
+	if (len < allowed) bucket.refund(len > 0 ? allowed - len : allowed);
 	return len;
 }
 
@@ -6,6 +6,7 @@
 #include "Thread.h"
 #include "Locks.h"
 #include "ThrottleState.h"
+#include "TokenBucket.h"
 
 class UnZFilter;
 class InputStream;
@@ -96,6 +97,7 @@ class BufferedSocket : private Thread
 			if (hasSocket())
 				sock->setMaxSpeed(maxSpeed);
 		}
+		void setThrottlePriority(int priority) { throttlePriority = priority; }
 
 		void write(const string& data)
 		{
@@ -207,7 +209,8 @@ class BufferedSocket : private Thread
 		uint64_t gracefulDisconnectTimeout;
 		BufferedSocketListener* listener;
 		int ipVersion;
-		std::unique_ptr<ThrottleState> readLimiter, writeLimiter;
+		std::unique_ptr<ThrottleState> writeLimiter;
+		std::atomic<int> throttlePriority;
 
 		BufferedSocket(char separator, BufferedSocketListener* listener);
 		virtual ~BufferedSocket();
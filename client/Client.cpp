@@ -774,15 +774,6 @@ void Client::on(Second, uint64_t tick) noexcept
 	}
 }
 
-#if 0 // Not used
-OnlineUserPtr Client::getUser(const UserPtr& user)
-{
-	// for generic client, use ClientManager, but it does not correctly handle ClientManager::me
-	ClientManager::LockInstanceOnlineUsers lockedInstance;
-	return lockedInstance->getOnlineUserL(user);
-}
-#endif
-
 bool Client::isPrivateMessageAllowed(const ChatMessage& message, string* response, bool automatic)
 {
 	if (isMe(message.replyTo))
@@ -24,6 +24,7 @@
 #include "Text.h"
 #include "TimerManager.h"
 #include "ClientListener.h"
+#include "SnapshotSpeaker.h"
 #include "SearchQueue.h"
 #include "OnlineUser.h"
 #include "BufferedSocket.h"
@@ -71,7 +72,7 @@ class ClientBase
 
 /** Yes, this should probably be called a Hub */
 class Client : public ClientBase,
-               public Speaker<ClientListener>,
+               public SnapshotSpeaker<ClientListener>,
                public BufferedSocketListener,
                protected TimerManagerListener,
                public std::enable_shared_from_this<Client>
@@ -49,12 +49,10 @@ OnlineUserList ClientManager::g_UserUpdateQueue;
 std::unique_ptr<RWLock> ClientManager::g_csOnlineUsersUpdateQueue = std::unique_ptr<RWLock>(RWLock::create());
 #endif
 
-std::unique_ptr<RWLock> ClientManager::g_csClients = std::unique_ptr<RWLock>(RWLock::create());
-std::unique_ptr<RWLock> ClientManager::g_csOnlineUsers = std::unique_ptr<RWLock> (RWLock::create());
-std::unique_ptr<RWLock> ClientManager::g_csUsers = std::unique_ptr<RWLock>(RWLock::create());
+std::unique_ptr<RWLock> ClientManager::g_csClients = std::unique_ptr<RWLock>(RWLock::create("ClientManager::g_csClients"));
 
-ClientManager::OnlineMap ClientManager::g_onlineUsers;
-ClientManager::UserMap ClientManager::g_users;
+ClientManager::UserMapShard<ClientManager::OnlineMap> ClientManager::g_onlineUsers[USER_MAP_SHARDS];
+ClientManager::UserMapShard<ClientManager::UserMap> ClientManager::g_users[USER_MAP_SHARDS];
 
 ClientManager::ClientManager()
 {
@@ -150,14 +148,15 @@ void ClientManager::shutdown()
 
 void ClientManager::clear()
 {
+	for (auto& shard : g_onlineUsers)
 	{
-		WRITE_LOCK(*g_csOnlineUsers);
-		g_onlineUsers.clear();
+		WRITE_LOCK(*shard.cs);
+		shard.data.clear();
 	}
+	for (auto& shard : g_users)
 	{
-		WRITE_LOCK(*g_csUsers);
-		//LOCK(g_csUsers);
-		g_users.clear();
+		WRITE_LOCK(*shard.cs);
+		shard.data.clear();
 	}
 }
 
@@ -180,8 +179,9 @@ void ClientManager::setUserIP(const UserPtr& user, const IpAddress& ip)
 
 	OnlineUserList users;
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		const auto p = g_onlineUsers.equal_range(user->getCID());
+		const auto& shard = getOnlineShard(user->getCID());
+		READ_LOCK(*shard.cs);
+		const auto p = shard.data.equal_range(user->getCID());
 		for (auto i = p.first; i != p.second; ++i)
 			users.push_back(i->second);
 	}
@@ -194,7 +194,8 @@ void ClientManager::setUserIP(const UserPtr& user, const IpAddress& ip)
 
 bool ClientManager::getUserParams(const UserPtr& user, OnlineUserParams& params)
 {
-	READ_LOCK(*g_csOnlineUsers);
+	if (!user) return false;
+	READ_LOCK(*getOnlineShard(user->getCID()).cs);
 	const OnlineUserPtr u = getOnlineUserL(user);
 	if (u)
 	{
@@ -268,8 +269,9 @@ StringList ClientManager::getNicks(const CID& cid, const string& hintUrl)
 
 void ClientManager::getOnlineUsers(const CID& cid, OnlineUserList& lst)
 {
-	READ_LOCK(*g_csOnlineUsers);
-	const auto op = g_onlineUsers.equal_range(cid);
+	const auto& shard = getOnlineShard(cid);
+	READ_LOCK(*shard.cs);
+	const auto op = shard.data.equal_range(cid);
 	for (auto i = op.first; i != op.second; ++i)
 		lst.push_back(i->second);
 }
@@ -279,8 +281,9 @@ StringList ClientManager::getHubs(const CID& cid, const string& hintUrl, bool pr
 	StringList lst;
 	if (!priv)
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		const auto op = g_onlineUsers.equal_range(cid);
+		const auto& shard = getOnlineShard(cid);
+		READ_LOCK(*shard.cs);
+		const auto op = shard.data.equal_range(cid);
 		for (auto i = op.first; i != op.second; ++i)
 		{
 			lst.push_back(i->second->getClientBase()->getHubUrl());
@@ -288,7 +291,7 @@ StringList ClientManager::getHubs(const CID& cid, const string& hintUrl, bool pr
 	}
 	else
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(cid).cs);
 		const OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl);
 		if (u)
 		{
@@ -303,8 +306,9 @@ StringList ClientManager::getHubNames(const CID& cid, const string& hintUrl, boo
 	StringList lst;
 	if (!priv)
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		const auto op = g_onlineUsers.equal_range(cid);
+		const auto& shard = getOnlineShard(cid);
+		READ_LOCK(*shard.cs);
+		const auto op = shard.data.equal_range(cid);
 		for (auto i = op.first; i != op.second; ++i)
 		{
 			lst.push_back(i->second->getClientBase()->getHubName());
@@ -312,7 +316,7 @@ StringList ClientManager::getHubNames(const CID& cid, const string& hintUrl, boo
 	}
 	else
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(cid).cs);
 		const OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl);
 		if (u)
 		{
@@ -327,14 +331,15 @@ StringList ClientManager::getNicks(const CID& cid, const string& hintUrl, bool p
 	StringSet ret;
 	if (!priv)
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		const auto op = g_onlineUsers.equal_range(cid);
+		const auto& shard = getOnlineShard(cid);
+		READ_LOCK(*shard.cs);
+		const auto op = shard.data.equal_range(cid);
 		for (auto i = op.first; i != op.second; ++i)
 			ret.insert(i->second->getIdentity().getNick());
 	}
 	else
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(cid).cs);
 		const OnlineUserPtr u = findOnlineUserHintL(cid, hintUrl);
 		if (u)
 			ret.insert(u->getIdentity().getNick());
@@ -365,7 +370,7 @@ string ClientManager::getNick(const UserPtr& user, const string& hintUrl)
 	{
 		OnlineUserPtr u;
 		{
-			READ_LOCK(*g_csOnlineUsers);
+			READ_LOCK(*getOnlineShard(user->getCID()).cs);
 			u = findOnlineUserHintL(user->getCID(), hintUrl);
 		}
 		if (u)
@@ -420,8 +425,9 @@ bool ClientManager::getHubUserCommands(const string& hubUrl, vector<UserCommand>
 
 bool ClientManager::isOnline(const UserPtr& user)
 {
-	READ_LOCK(*g_csOnlineUsers);
-	return g_onlineUsers.find(user->getCID()) != g_onlineUsers.end();
+	const auto& shard = getOnlineShard(user->getCID());
+	READ_LOCK(*shard.cs);
+	return shard.data.find(user->getCID()) != shard.data.end();
 }
 
 OnlineUserPtr ClientManager::findOnlineUserL(const HintedUser& user, bool priv)
@@ -457,15 +463,16 @@ OnlineUserPtr ClientManager::findOnlineUserL(const CID& cid, const string& hintU
 
 OnlineUserPtr ClientManager::findOnlineUser(const CID& cid, const string& hintUrl, bool priv)
 {
-	READ_LOCK(*g_csOnlineUsers);
+	READ_LOCK(*getOnlineShard(cid).cs);
 	return findOnlineUserL(cid, hintUrl, priv);
 }
 
 void ClientManager::findOnlineUsers(const CID& cid, OnlineUserList& res, int clientType)
 {
 	res.clear();
-	READ_LOCK(*g_csOnlineUsers);
-	auto op = g_onlineUsers.equal_range(cid);
+	const auto& shard = getOnlineShard(cid);
+	READ_LOCK(*shard.cs);
+	auto op = shard.data.equal_range(cid);
 	for (auto i = op.first; i != op.second; ++i)
 		if (!clientType || clientType == i->second->getClientBase()->getType())
 			res.push_back(i->second);
@@ -473,8 +480,9 @@ void ClientManager::findOnlineUsers(const CID& cid, OnlineUserList& res, int cli
 
 OnlineUserPtr ClientManager::findDHTNode(const CID& cid)
 {
-	READ_LOCK(*g_csOnlineUsers);
-	auto op = g_onlineUsers.equal_range(cid);
+	const auto& shard = getOnlineShard(cid);
+	READ_LOCK(*shard.cs);
+	auto op = shard.data.equal_range(cid);
 	for (auto i = op.first; i != op.second; ++i)
 	{
 		const OnlineUserPtr& ou = i->second;
@@ -491,7 +499,7 @@ OnlineUserPtr ClientManager::findDHTNode(const CID& cid)
 
 string ClientManager::getStringField(const CID& cid, const string& hint, const char* field)
 {
-	READ_LOCK(*g_csOnlineUsers);
+	READ_LOCK(*getOnlineShard(cid).cs);
 
 	OnlinePairC p;
 	const auto u = findOnlineUserHintL(cid, hint, p);
@@ -517,9 +525,10 @@ string ClientManager::getStringField(const CID& cid, const string& hint, const c
 
 bool ClientManager::getSlots(const CID& cid, uint16_t& slots)
 {
-	READ_LOCK(*g_csOnlineUsers);
-	const auto i = g_onlineUsers.find(cid);
-	if (i != g_onlineUsers.end())
+	const auto& shard = getOnlineShard(cid);
+	READ_LOCK(*shard.cs);
+	const auto i = shard.data.find(cid);
+	if (i != shard.data.end())
 	{
 		slots = i->second->getIdentity().getSlots();
 		return true;
@@ -637,11 +646,12 @@ UserPtr ClientManager::getUser(const string& nick, const string& hubUrl)
 	dcassert(!nick.empty());
 	const CID cid = makeCid(nick, hubUrl);
 	
-	g_csUsers->acquireExclusive();
-	auto p = g_users.insert(make_pair(cid, std::make_shared<User>(cid, nick)));
-	auto& user = p.first->second;
+	auto& shard = getUserShard(cid);
+	shard.cs->acquireExclusive();
+	auto p = shard.data.insert(make_pair(cid, std::make_shared<User>(cid, nick)));
+	UserPtr user = p.first->second;
 	user->setFlag(User::NMDC);
-	g_csUsers->releaseExclusive();
+	shard.cs->releaseExclusive();
 #ifdef BL_FEATURE_IP_DATABASE
 	user->addNick(nick, hubUrl);
 #endif
@@ -650,12 +660,13 @@ UserPtr ClientManager::getUser(const string& nick, const string& hubUrl)
 
 UserPtr ClientManager::createUser(const CID& cid, const string& nick, const string& hubUrl)
 {
-	g_csUsers->acquireExclusive();
-	auto p = g_users.insert(make_pair(cid, UserPtr()));
+	auto& shard = getUserShard(cid);
+	shard.cs->acquireExclusive();
+	auto p = shard.data.insert(make_pair(cid, UserPtr()));
 	if (!p.second)
 	{
 		UserPtr user = p.first->second;
-		g_csUsers->releaseExclusive();
+		shard.cs->releaseExclusive();
 		if (!nick.empty()) user->updateNick(nick);
 #ifdef BL_FEATURE_IP_DATABASE
 		user->addNick(nick, hubUrl);
@@ -664,7 +675,7 @@ UserPtr ClientManager::createUser(const CID& cid, const string& nick, const stri
 	}
 	UserPtr user = std::make_shared<User>(cid, nick);
 	p.first->second = user;
-	g_csUsers->releaseExclusive();
+	shard.cs->releaseExclusive();
 #ifdef BL_FEATURE_IP_DATABASE
 	user->addNick(nick, hubUrl);
 #endif
@@ -673,10 +684,10 @@ UserPtr ClientManager::createUser(const CID& cid, const string& nick, const stri
 
 UserPtr ClientManager::findUser(const CID& cid)
 {
-	READ_LOCK(*g_csUsers);
-	//LOCK(g_csUsers);
-	const auto& ui = g_users.find(cid);
-	if (ui != g_users.end())
+	const auto& shard = getUserShard(cid);
+	READ_LOCK(*shard.cs);
+	const auto& ui = shard.data.find(cid);
+	if (ui != shard.data.end())
 	{
 		return ui->second;
 	}
@@ -710,16 +721,51 @@ void ClientManager::putOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept
 		dcassert(ou->getIdentity().getSID() != AdcCommand::HUB_SID);
 		dcassert(!user->getCID().isZero());
 		{
-			WRITE_LOCK(*g_csOnlineUsers);
-			const auto l_res = g_onlineUsers.insert(make_pair(user->getCID(), ou));
-			dcassert(l_res->second);
+			auto& shard = getOnlineShard(user->getCID());
+			WRITE_LOCK(*shard.cs);
+			shard.data.insert(make_pair(user->getCID(), ou));
 		}
-		
-		if (!(user->setFlagEx(User::ONLINE) & User::ONLINE) && fireFlag)
+		onUserOnline(ou, fireFlag);
+	}
+}
+
+void ClientManager::putOnline(const OnlineUserList& users, bool fireFlag) noexcept
+{
+	if (GlobalState::isShuttingDown() || users.empty())
+		return;
+	vector<uint8_t> shardIndex(users.size());
+	for (size_t i = 0; i < users.size(); ++i)
+	{
+		const CID& cid = users[i]->getUser()->getCID();
+		dcassert(users[i]->getIdentity().getSID() != AdcCommand::HUB_SID);
+		dcassert(!cid.isZero());
+		shardIndex[i] = getShardIndex(cid);
+	}
+	for (unsigned index = 0; index < USER_MAP_SHARDS; ++index)
+	{
+		auto& shard = g_onlineUsers[index];
+		bool locked = false;
+		for (size_t i = 0; i < users.size(); ++i)
 		{
-			fire(ClientManagerListener::UserConnected(), user);
+			if (shardIndex[i] != index) continue;
+			if (!locked)
+			{
+				shard.cs->acquireExclusive();
+				locked = true;
+			}
+			shard.data.insert(make_pair(users[i]->getUser()->getCID(), users[i]));
 		}
+		if (locked) shard.cs->releaseExclusive();
 	}
+	for (const OnlineUserPtr& ou : users)
+		onUserOnline(ou, fireFlag);
+}
+
+void ClientManager::onUserOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept
+{
+	const auto& user = ou->getUser();
+	if (!(user->setFlagEx(User::ONLINE) & User::ONLINE) && fireFlag)
+		fire(ClientManagerListener::UserConnected(), user);
 }
 
 void ClientManager::putOffline(const OnlineUserPtr& ou, bool disconnectFlag) noexcept
@@ -735,44 +781,97 @@ void ClientManager::putOffline(const OnlineUserPtr& ou, bool disconnectFlag) noe
 		// [~] IRainman fix.
 		OnlineIter::difference_type diff = 0;
 		{
-			WRITE_LOCK(*g_csOnlineUsers);
-			auto op = g_onlineUsers.equal_range(ou->getUser()->getCID()); //    -    .
+			auto& shard = getOnlineShard(ou->getUser()->getCID());
+			WRITE_LOCK(*shard.cs);
+			auto op = shard.data.equal_range(ou->getUser()->getCID());
 			// [-] dcassert(op.first != op.second); [!] L: this is normal and means that the user is offline.
 			for (auto i = op.first; i != op.second; ++i)
 			{
 				if (ou == i->second)
 				{
 					diff = distance(op.first, op.second);
-					g_onlineUsers.erase(i);
+					shard.data.erase(i);
 					break;
 				}
 			}
 		}
-		
-		if (diff == 1) //last user
-		{
-			UserPtr& u = ou->getUser();
-			u->unsetFlag(User::ONLINE);
-			if (disconnectFlag)
-				ConnectionManager::getInstance()->disconnect(u);
-			fire(ClientManagerListener::UserDisconnected(), u);
-		}
-		else if (diff > 1)
+		onUserOffline(ou, diff, disconnectFlag);
+	}
+}
+
+void ClientManager::putOffline(const OnlineUserList& users, bool disconnectFlag) noexcept
+{
+#ifdef BL_FEATURE_IP_DATABASE
+	int options = DatabaseManager::getInstance()->getOptions();
+	for (const OnlineUserPtr& ou : users)
+		ou->getUser()->saveStats(options);
+#endif
+	if (GlobalState::isShuttingDown() || users.empty())
+		return;
+	vector<uint8_t> shardIndex(users.size());
+	vector<OnlineIter::difference_type> diff(users.size());
+	for (size_t i = 0; i < users.size(); ++i)
+	{
+		const CID& cid = users[i]->getUser()->getCID();
+		dcassert(users[i]->getIdentity().getSID() != AdcCommand::HUB_SID);
+		dcassert(!cid.isZero());
+		shardIndex[i] = getShardIndex(cid);
+	}
+	for (unsigned index = 0; index < USER_MAP_SHARDS; ++index)
+	{
+		auto& shard = g_onlineUsers[index];
+		bool locked = false;
+		for (size_t i = 0; i < users.size(); ++i)
 		{
-			addAsyncOnlineUserUpdated(ou);
+			if (shardIndex[i] != index) continue;
+			if (!locked)
+			{
+				shard.cs->acquireExclusive();
+				locked = true;
+			}
+			auto op = shard.data.equal_range(users[i]->getUser()->getCID());
+			for (auto j = op.first; j != op.second; ++j)
+			{
+				if (users[i] == j->second)
+				{
+					diff[i] = distance(op.first, op.second);
+					shard.data.erase(j);
+					break;
+				}
+			}
 		}
+		if (locked) shard.cs->releaseExclusive();
+	}
+	for (size_t i = 0; i < users.size(); ++i)
+		onUserOffline(users[i], diff[i], disconnectFlag);
+}
+
+void ClientManager::onUserOffline(const OnlineUserPtr& ou, OnlineIter::difference_type count, bool disconnectFlag) noexcept
+{
+	if (count == 1) //last user
+	{
+		UserPtr& u = ou->getUser();
+		u->unsetFlag(User::ONLINE);
+		if (disconnectFlag)
+			ConnectionManager::getInstance()->disconnect(u);
+		fire(ClientManagerListener::UserDisconnected(), u);
+	}
+	else if (count > 1)
+	{
+		addAsyncOnlineUserUpdated(ou);
 	}
 }
 
 void ClientManager::removeOnlineUser(const OnlineUserPtr& ou) noexcept
 {
-	WRITE_LOCK(*g_csOnlineUsers);
-	auto op = g_onlineUsers.equal_range(ou->getUser()->getCID());
+	auto& shard = getOnlineShard(ou->getUser()->getCID());
+	WRITE_LOCK(*shard.cs);
+	auto op = shard.data.equal_range(ou->getUser()->getCID());
 	for (auto i = op.first; i != op.second; ++i)
 	{
 		if (ou == i->second)
 		{
-			g_onlineUsers.erase(i);
+			shard.data.erase(i);
 			break;
 		}
 	}
@@ -780,7 +879,7 @@ void ClientManager::removeOnlineUser(const OnlineUserPtr& ou) noexcept
 
 OnlineUserPtr ClientManager::findOnlineUserHintL(const CID& cid, const string& hintUrl, OnlinePairC& p)
 {
-	p = g_onlineUsers.equal_range(cid);
+	p = getOnlineShard(cid).data.equal_range(cid);
 	
 	if (p.first == p.second) // no user found with the given CID.
 		return nullptr;
@@ -813,9 +912,10 @@ void ClientManager::resendMyInfo()
 OnlineUserPtr ClientManager::connect(const HintedUser& user, const string& token, bool forcePassive)
 {
 	dcassert(!token.empty());
+	if (!user.user) return OnlineUserPtr();
 	const bool priv = FavoriteManager::getInstance()->isPrivateHub(user.hint);
 
-	READ_LOCK(*g_csOnlineUsers);
+	READ_LOCK(*getOnlineShard(user.user->getCID()).cs);
 	OnlineUserPtr ou = findOnlineUserL(user, priv);
 	if (ou)
 	{
@@ -828,10 +928,11 @@ OnlineUserPtr ClientManager::connect(const HintedUser& user, const string& token
 
 int ClientManager::privateMessage(const HintedUser& user, const string& msg, int flags)
 {
+	if (!user.user) return PM_NO_USER;
 	const bool priv = FavoriteManager::getInstance()->isPrivateHub(user.hint);
 	OnlineUserPtr u;
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(user.user->getCID()).cs);
 		u = findOnlineUserL(user, priv);
 	}
 	if (!u) return PM_NO_USER;
@@ -846,7 +947,7 @@ void ClientManager::userCommand(const HintedUser& hintedUser, const UserCommand&
 {
 	OnlineUserPtr ou;
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(hintedUser.user->getCID()).cs);
 		/** @todo we allow wrong hints for now ("false" param of findOnlineUser) because users
 		 * extracted from search results don't always have a correct hint; see
 		 * SearchManager::onRES(const AdcCommand& cmd, ...). when that is done, and SearchResults are
@@ -893,9 +994,10 @@ bool ClientManager::sendAdcCommand(AdcCommand& cmd, const CID& cid, const IpAddr
 	bool sendUDP = false;
 	OnlineUserPtr u;
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		const auto i = g_onlineUsers.find(cid);
-		if (i != g_onlineUsers.end())
+		const auto& shard = getOnlineShard(cid);
+		READ_LOCK(*shard.cs);
+		const auto i = shard.data.find(cid);
+		if (i != shard.data.end())
 		{
 			u = i->second;
 			if (cmd.getType() == AdcCommand::TYPE_UDP)
@@ -1171,9 +1273,10 @@ void ClientManager::flushRatio()
 	{
 		BusyCounter<bool> busy(isBusy);
 		std::vector<UserPtr> usersToFlush;
+		for (const auto& shard : g_users)
 		{
-			READ_LOCK(*g_csUsers);
-			for (auto i = g_users.cbegin(); i != g_users.cend(); ++i)
+			READ_LOCK(*shard.cs);
+			for (auto i = shard.data.cbegin(); i != shard.data.cend(); ++i)
 			{
 				if (i->second->shouldSaveStats())
 					usersToFlush.push_back(i->second);
@@ -1191,14 +1294,17 @@ void ClientManager::flushRatio()
 
 void ClientManager::usersCleanup()
 {
-	WRITE_LOCK(*g_csUsers);
-	auto i = g_users.begin();
-	while (i != g_users.end())
+	for (auto& shard : g_users)
 	{
-		if (i->second.unique())
-			g_users.erase(i++);
-		else
-			++i;
+		WRITE_LOCK(*shard.cs);
+		auto i = shard.data.begin();
+		while (i != shard.data.end())
+		{
+			if (i->second.unique())
+				i = shard.data.erase(i);
+			else
+				++i;
+		}
 	}
 }
 
@@ -1334,8 +1440,9 @@ OnlineUserPtr ClientManager::getOnlineUserL(const UserPtr& p)
 	if (p == nullptr)
 		return nullptr;
 		
-	const auto i = g_onlineUsers.find(p->getCID());
-	if (i == g_onlineUsers.end())
+	const auto& data = getOnlineShard(p->getCID()).data;
+	const auto i = data.find(p->getCID());
+	if (i == data.end())
 		return OnlineUserPtr();
 		
 	return i->second;
@@ -1345,9 +1452,10 @@ void ClientManager::setSupports(const UserPtr& user, uint8_t knownUcSupports)
 {
 	OnlineUserPtr ou;
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		auto i = g_onlineUsers.find(user->getCID());
-		if (i != g_onlineUsers.end()) ou = i->second;
+		const auto& shard = getOnlineShard(user->getCID());
+		READ_LOCK(*shard.cs);
+		auto i = shard.data.find(user->getCID());
+		if (i != shard.data.end()) ou = i->second;
 	}
 	if (ou) ou->getIdentity().setKnownUcSupports(knownUcSupports);
 }
@@ -1356,9 +1464,10 @@ void ClientManager::setUnknownCommand(const UserPtr& user, const string& unknown
 {
 	OnlineUserPtr ou;
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		auto i = g_onlineUsers.find(user->getCID());
-		if (i != g_onlineUsers.end()) ou = i->second;
+		const auto& shard = getOnlineShard(user->getCID());
+		READ_LOCK(*shard.cs);
+		auto i = shard.data.find(user->getCID());
+		if (i != shard.data.end()) ou = i->second;
 	}
 	if (ou) ou->getIdentity().setStringParam("UC", unknownCommand);
 }
@@ -1369,7 +1478,7 @@ void ClientManager::dumpUserInfo(const HintedUser& user)
 	ClientBasePtr cb;
 	if (user.user)
 	{
-		READ_LOCK(*g_csOnlineUsers);
+		READ_LOCK(*getOnlineShard(user.user->getCID()).cs);
 		OnlineUserPtr ou = findOnlineUserL(user.user->getCID(), user.hint, true);
 		if (!ou)
 			return;
@@ -1384,9 +1493,10 @@ void ClientManager::dumpUserInfo(const HintedUser& user)
 StringList ClientManager::getNicksByIp(const IpAddress& ip)
 {
 	std::unordered_set<string> nicks;
+	for (const auto& shard : g_onlineUsers)
 	{
-		READ_LOCK(*g_csOnlineUsers);
-		for (auto i = g_onlineUsers.cbegin(); i != g_onlineUsers.cend(); ++i)
+		READ_LOCK(*shard.cs);
+		for (auto i = shard.data.cbegin(); i != shard.data.cend(); ++i)
 		{
 			const auto& user = i->second->getUser();
 			if (!user) continue;
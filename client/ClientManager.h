@@ -113,7 +113,6 @@ class ClientManager : public Speaker<ClientManagerListener>,
 				}\
 		}
 		CREATE_LOCK_INSTANCE_CM(g_clients, Clients);
-		CREATE_LOCK_INSTANCE_CM(g_onlineUsers, OnlineUsers);
 #undef CREATE_LOCK_INSTANCE_CM
 
 		static void setUserIP(const UserPtr& user, const IpAddress& ip);
@@ -125,7 +124,9 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		static CID makeCid(const string& nick, const string& hubUrl);
 
 		void putOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept;
+		void putOnline(const OnlineUserList& users, bool fireFlag) noexcept;
 		void putOffline(const OnlineUserPtr& ou, bool disconnectFlag = false) noexcept;
+		void putOffline(const OnlineUserList& users, bool disconnectFlag = false) noexcept;
 		static void removeOnlineUser(const OnlineUserPtr& ou) noexcept;
 
 		static void getOnlineClients(StringSet& onlineClients) noexcept;
@@ -169,18 +170,35 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		static ClientMap g_clients;
 		static std::unique_ptr<RWLock> g_csClients;
 
-		typedef boost::unordered_map<CID, UserPtr> UserMap;
-		static UserMap g_users;
+		// User maps are split into shards by CID so that hub threads adding
+		// and removing users don't serialize on a single lock
+		static const unsigned USER_MAP_SHARDS = 16;
 
-		static std::unique_ptr<RWLock> g_csUsers;
-		typedef std::multimap<CID, OnlineUserPtr> OnlineMap;
+		typedef boost::unordered_map<CID, UserPtr> UserMap;
+		typedef boost::unordered_multimap<CID, OnlineUserPtr> OnlineMap;
 		typedef OnlineMap::iterator OnlineIter;
 		typedef OnlineMap::const_iterator OnlineIterC;
 		typedef pair<OnlineIter, OnlineIter> OnlinePair;
 		typedef pair<OnlineIterC, OnlineIterC> OnlinePairC;
 
-		static OnlineMap g_onlineUsers;
-		static std::unique_ptr<RWLock> g_csOnlineUsers;
+		template<typename Map>
+		struct UserMapShard
+		{
+			Map data;
+			std::unique_ptr<RWLock> cs;
+			UserMapShard() : cs(RWLock::create(std::is_same<Map, OnlineMap>::value ? "ClientManager::g_onlineUsers" : "ClientManager::g_users")) {}
+		};
+
+		static UserMapShard<UserMap> g_users[USER_MAP_SHARDS];
+		static UserMapShard<OnlineMap> g_onlineUsers[USER_MAP_SHARDS];
+
+		static unsigned getShardIndex(const CID& cid)
+		{
+			// CID::toHash uses the first word, take the shard index from the last byte
+			return cid.data()[CID::SIZE - 1] & (USER_MAP_SHARDS - 1);
+		}
+		static UserMapShard<UserMap>& getUserShard(const CID& cid) { return g_users[getShardIndex(cid)]; }
+		static UserMapShard<OnlineMap>& getOnlineShard(const CID& cid) { return g_onlineUsers[getShardIndex(cid)]; }
 #ifdef FLYLINKDC_USE_ASYN_USER_UPDATE
 		static OnlineUserList g_UserUpdateQueue;
 		static std::unique_ptr<RWLock> g_csOnlineUsersUpdateQueue;
@@ -198,6 +216,8 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		~ClientManager();
 
 		static void updateNick(const OnlineUserPtr& ou);
+		void onUserOnline(const OnlineUserPtr& ou, bool fireFlag) noexcept;
+		void onUserOffline(const OnlineUserPtr& ou, OnlineIter::difference_type count, bool disconnectFlag) noexcept;
 
 		static OnlineUserPtr findOnlineUserHintL(const CID& cid, const string& hintUrl)
 		{
@@ -208,6 +228,7 @@ class ClientManager : public Speaker<ClientManagerListener>,
 		/**
 		* @param p OnlinePair of all the users found by CID, even those who don't match the hint.
 		* @return OnlineUserPtr found by CID and hint; discard any user that doesn't match the hint.
+		* The caller must hold the lock of the shard containing cid.
 		*/
 		static OnlineUserPtr findOnlineUserHintL(const CID& cid, const string& hintUrl, OnlinePairC& p);
 
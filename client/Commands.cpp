@@ -22,6 +22,8 @@
 #include "AppPaths.h"
 #include "ConfCore.h"
 #include "AppStats.h"
+#include "TimerManager.h"
+#include "LockProfiler.h"
 #include "SysInfo.h"
 #include "dht/DHT.h"
 #include "dht/DHTSearchManager.h"
@@ -110,6 +112,8 @@ static const CommandDescription desc[] =
 	{ CTX_SYSTEM | FLAG_SPLIT_ARGS,                     1, 2,        0                                             }, // COMMAND_DEBUG_MYSHARE
 	{ CTX_SYSTEM | FLAG_SPLIT_ARGS,                     0, UINT_MAX, 0                                             }, // COMMAND_DEBUG_GDI_INFO
 	{ CTX_SYSTEM | FLAG_SPLIT_ARGS,                     2, UINT_MAX, 0                                             }, // COMMAND_DEBUG_HTTP
+	{ CTX_SYSTEM,                                       0, 0,        0                                             }, // COMMAND_DEBUG_TIMERS
+	{ CTX_SYSTEM | FLAG_SPLIT_ARGS,                     0, 1,        0                                             }, // COMMAND_DEBUG_LOCKS
 	{ CTX_SYSTEM,                                       0, 0,        0                                             }, // COMMAND_DEBUG_UNKNOWN_TAGS
 	{ CTX_SYSTEM | FLAG_SPLIT_ARGS,                     2, 2,        0                                             }, // COMMAND_DEBUG_DIVIDE
 	{ CTX_GENERAL_CHAT,                                 1, 1,        ResourceManager::CMD_HELP_SAY                 }, // COMMAND_SAY
@@ -172,6 +176,7 @@ static const CommandName names[] =
 	{ "ja",             COMMAND_MEDIA_PLAYER        },
 	{ "join",           COMMAND_JOIN                },
 	{ "limit",          COMMAND_LIMIT               },
+	{ "locks",          COMMAND_DEBUG_LOCKS         },
 	{ "log",            COMMAND_OPEN_LOG            },
 	{ "makefilelist",   COMMAND_MAKE_FILE_LIST      },
 	{ "mcpm",           COMMAND_MC_PRIVATE_MESSAGE  },
@@ -206,6 +211,7 @@ static const CommandName names[] =
 	{ "switch",         COMMAND_USER_LIST_LOCATION  },
 	{ "sysinfo",        COMMAND_INFO_SYSTEM         },
 	{ "systeminfo",     COMMAND_INFO_SYSTEM         },
+	{ "timers",         COMMAND_DEBUG_TIMERS        },
 	{ "ts",             COMMAND_TIMESTAMPS          },
 	{ "tth",            COMMAND_TTH                 },
 	{ "u",              COMMAND_OPEN_URL            },
@@ -358,12 +364,13 @@ enum
 	ACTION_TTH_REMOVE_TREE
 };
 
-static const char* actionsUserConnections[] = { "list", "expect", "tokens", "suppress", nullptr };
+static const char* actionsUserConnections[] = { "list", "expect", "tokens", "sched", "suppress", nullptr };
 enum
 {
 	ACTION_UCONN_LIST = 1,
 	ACTION_UCONN_EXPECT,
 	ACTION_UCONN_TOKENS,
+	ACTION_UCONN_SCHED,
 	ACTION_UCONN_SUPPRESS
 };
 
@@ -936,6 +943,12 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 				res.what = RESULT_LOCAL_TEXT;
 				return true;
 			}
+			if (action == ACTION_UCONN_SCHED)
+			{
+				res.text = ConnectionManager::getInstance()->getDownloadSchedulerInfo();
+				res.what = RESULT_LOCAL_TEXT;
+				return true;
+			}
 #ifdef _DEBUG
 			if (action == ACTION_UCONN_SUPPRESS)
 			{
@@ -969,10 +982,23 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 				size_t nodeCount = 0;
 				{
 					dht::DHT::LockInstanceNodes lock(d);
-					const auto nodes = lock.getNodes();
-					if (nodes) nodeCount = nodes->size();
+					const auto table = lock.getRoutingTable();
+					if (table) nodeCount = table->getNodeCount();
 				}
 				res.text += "Nodes: " + Util::toString(nodeCount) + '\n';
+				auto im = dht::IndexManager::getInstance();
+				if (im)
+				{
+					const dht::PublishStats ps = im->getPublishStats();
+					res.text += "Published: " + Util::toString(ps.published) + " of " + Util::toString(ps.total) + " files";
+					if (ps.total)
+						res.text += " (" + Util::toString(ps.published * 100 / ps.total) + "%)";
+					uint64_t elapsed = GET_TICK() - ps.started;
+					if (ps.started && elapsed >= 1000)
+						res.text += ", " + Util::toString(ps.published * 60000 / elapsed) + " files/min";
+					res.text += ", lookups: " + Util::toString(ps.lookups);
+					res.text += ", packets: " + Util::toString(ps.packets) + '\n';
+				}
 				res.what = RESULT_LOCAL_TEXT;
 				return true;
 			}
@@ -984,11 +1010,13 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 				vector<dht::Node::Ptr> nv;
 				{
 					dht::DHT::LockInstanceNodes lock(d);
-					const auto nodes = lock.getNodes();
-					if (nodes)
+					const auto table = lock.getRoutingTable();
+					if (table)
 					{
-						for (const auto& node : *nodes)
+						table->forEachNode([&nv, maxType](const dht::Node::Ptr& node)
+						{
 							if (node->getType() <= maxType) nv.push_back(node);
+						});
 					}
 				}
 				std::sort(nv.begin(), nv.end(), [](const dht::Node::Ptr& n1, const dht::Node::Ptr& n2) { return n1->getUser()->getCID() < n2->getUser()->getCID(); });
@@ -1519,6 +1547,54 @@ bool Commands::processCommand(const ParsedCommand& pc, Result& res)
 			return true;
 		}
 #endif
+		case COMMAND_DEBUG_TIMERS:
+		{
+			vector<TimerManager::TaskStats> stats;
+			TimerManager::getInstance()->getTaskStats(stats);
+			if (stats.empty())
+			{
+				res.text = STRING(COMMAND_EMPTY_LIST);
+				res.what = RESULT_LOCAL_TEXT;
+				return true;
+			}
+			res.text = "Timer tasks:";
+			for (const auto& ts : stats)
+			{
+				res.text += "\n" + ts.name + ": interval " + Util::toString(ts.interval) +
+					" ms, runs " + Util::toString(ts.runs) +
+					", overruns " + Util::toString(ts.overruns) +
+					", avg time " + Util::toString(ts.runs ? ts.totalTime / ts.runs : 0) +
+					" ms, max time " + Util::toString(ts.maxTime) +
+					" ms, max delay " + Util::toString(ts.maxDelay) + " ms";
+			}
+			res.what = RESULT_LOCAL_TEXT;
+			return true;
+		}
+		case COMMAND_DEBUG_LOCKS:
+		{
+#ifdef LOCK_PROFILER
+			if (pc.args.size() >= 2)
+			{
+				if (pc.args[1] != "reset")
+				{
+					res.text = STRING(COMMAND_INVALID_ACTION);
+					res.what = RESULT_ERROR_MESSAGE;
+					return true;
+				}
+				LockProfiler::reset();
+				res.text = "Lock statistics cleared";
+				res.what = RESULT_LOCAL_TEXT;
+				return true;
+			}
+			res.text = LockProfiler::getReport();
+			if (res.text.empty()) res.text = STRING(COMMAND_EMPTY_LIST);
+			res.what = RESULT_LOCAL_TEXT;
+#else
+			res.text = "Lock profiler is not enabled in this build";
+			res.what = RESULT_ERROR_MESSAGE;
+#endif
+			return true;
+		}
 		case COMMAND_DEBUG_MYSHARE:
 		{
 			int action = getAction(pc, actionsMyShare);
@@ -72,6 +72,8 @@ enum
 	COMMAND_DEBUG_MYSHARE,
 	COMMAND_DEBUG_GDI_INFO,
 	COMMAND_DEBUG_HTTP,
+	COMMAND_DEBUG_TIMERS,
+	COMMAND_DEBUG_LOCKS,
 	COMMAND_DEBUG_UNKNOWN_TAGS,
 	COMMAND_DEBUG_DIVIDE,
 	COMMAND_SAY,
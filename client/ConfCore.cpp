@@ -46,6 +46,8 @@ static BaseSettingsImpl::MinMaxValidator<int> validateUserCheckBatch(5, 50);
 static BaseSettingsImpl::MinMaxValidator<int> validateSqliteJournalMode(0, 3);
 static BaseSettingsImpl::MinMaxValidator<int> validateDbFinishedBatch(0, 2000);
 static BaseSettingsImpl::MinMaxValidator<int> validatePort(1, 65535);
+static BaseSettingsImpl::MinMaxValidator<int> validateDhtPublishPackets(10, 5000);
+static BaseSettingsImpl::MinMaxValidator<int> validateListenerThreads(1, 16);
 static BaseSettingsImpl::MinMaxValidatorWithZero<int> validateListeningPort(1024, 65535);
 static BaseSettingsImpl::MinMaxValidator<int> validateHighPort(1024, 65535);
 static BaseSettingsImpl::MinMaxValidator<int> validateHour(0, 23);
@@ -194,7 +196,9 @@ void Conf::initCoreSettings()
 	s->addInt(SOCKS_PORT, "SocksPort", 1080, 0, &validatePort);
 	s->addBool(SOCKS_RESOLVE, "SocksResolve", true);
 	s->addBool(USE_DHT, "UseDHT");
+	s->addInt(DHT_PUBLISH_PACKETS, "DHTPublishPackets", 200, 0, &validateDhtPublishPackets);
 	s->addBool(USE_HTTP_PROXY, "UseHTTPProxy");
+	s->addInt(LISTENER_THREADS, "ListenerThreads", 1, 0, &validateListenerThreads);
 
 	// Directories
 	s->addString(DOWNLOAD_DIRECTORY, "DownloadDirectory", Util::getDownloadsPath());
@@ -414,6 +418,7 @@ void Conf::initCoreSettings()
 	s->addString(WEBSERVER_PASS, "WebServerPass");
 	s->addString(WEBSERVER_POWER_USER, "WebServerPowerUser", "admin");
 	s->addString(WEBSERVER_POWER_PASS, "WebServerPowerPass");
+	s->addString(WEBSERVER_METRICS_TOKEN, "WebServerMetricsToken", Util::emptyString, Settings::FLAG_FIX_VALUE, &trimSpaceValidator);
 	s->addBool(ENABLE_WEBSERVER, "WebServer");
 	s->addInt(WEBSERVER_PORT, "WebServerPort", 0, 0, &validateHighPort);
 
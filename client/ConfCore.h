@@ -106,7 +106,9 @@ namespace Conf
 		SOCKS_PORT,
 		SOCKS_RESOLVE,
 		USE_DHT,
+		DHT_PUBLISH_PACKETS,
 		USE_HTTP_PROXY,
+		LISTENER_THREADS,
 
 		// Directories
 		// strings
@@ -354,6 +356,7 @@ namespace Conf
 		WEBSERVER_PASS,
 		WEBSERVER_POWER_USER,
 		WEBSERVER_POWER_PASS,
+		WEBSERVER_METRICS_TOKEN,
 		// ints
 		ENABLE_WEBSERVER,
 		WEBSERVER_PORT,
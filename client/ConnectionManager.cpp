@@ -41,6 +41,7 @@
 #include "Random.h"
 #include "ConfCore.h"
 #include "SettingsUtil.h"
+#include "Metrics.h"
 
 #ifdef BL_FEATURE_IP_DATABASE
 #include "DatabaseManager.h"
@@ -55,6 +56,7 @@ extern TagCollector collAdcFeatures;
 static const unsigned RETRY_CONNECTION_DELAY = 10;
 static const unsigned RECONNECT_AFTER_ERROR_DELAY = 30;
 static const unsigned CONNECTION_TIMEOUT = 50;
+static const unsigned NO_SLOTS_CHECK_INTERVAL = 1000; // ms
 
 static const unsigned UC_IDLE_TIME = 60;
 static const unsigned UC_RETRY_TIME = 10;
@@ -375,8 +377,8 @@ static void modifyFeatures(StringList& features, const string& options)
 }
 
 ConnectionManager::ConnectionManager() : shuttingDown(false),
-	csConnections(RWLock::create()),
-	csDownloads(RWLock::create())
+	csConnections(RWLock::create("ConnectionManager::csConnections")),
+	csDownloads(RWLock::create("ConnectionManager::csDownloads"))
 {
 	servers[0] = servers[1] = servers[2] = servers[3] = nullptr;
 	ports[0] = ports[1] = 0;
@@ -413,6 +415,7 @@ ConnectionManager::~ConnectionManager()
 	dcassert(shuttingDown);
 	dcassert(userConnections.empty());
 	dcassert(downloads.empty());
+	dcassert(downloadSchedule.empty());
 	dcassert(uploads.empty());
 }
 
@@ -430,6 +433,7 @@ void ConnectionManager::startListen(int af, int type)
 	string bindAddr = ss->getString(ips.bindAddress);
 	bool autoDetect = ss->getBool(ips.autoDetect);
 	uint16_t port = ss->getInt(portSetting);
+	int acceptors = ss->getInt(Conf::LISTENER_THREADS);
 	ss->unlockRead();
 
 	IpAddressEx bindIp;
@@ -463,7 +467,7 @@ void ConnectionManager::startListen(int af, int type)
 	}
 
 	if (!bindIp.type) BufferedSocket::getBindAddress(bindIp, af, bind);
-	auto newServer = new Server(type, bindIp, port);
+	auto newServer = new Server(type, bindIp, port, acceptors);
 	ss->lockWrite();
 	ss->setInt(portSetting, newServer->getServerPort());
 	ss->unlockWrite();
@@ -495,10 +499,17 @@ void ConnectionManager::getDownloadConnection(const HintedUser& hintedUser)
 			cqi = std::make_shared<ConnectionQueueItem>(hintedUser, true,
 				tokenManager.makeToken(TokenManager::TYPE_DOWNLOAD, UINT64_MAX));
 			downloads.insert(cqi);
+			scheduleCQI_L(cqi, 0);
 			if (CMD_DEBUG_ENABLED()) DETECTION_DEBUG("[ConnectionManager][getCQI][download] " + cqi->getHintedUser().toString());
 		}
 		else
-			existingToken = (*i)->getConnectionQueueToken();
+		{
+			const ConnectionQueueItemPtr& existing = *i;
+			existingToken = existing->getConnectionQueueToken();
+			// New files may have been queued, look at the item on the next tick
+			if (existing->getState() != ConnectionQueueItem::ACTIVE)
+				scheduleCQI_L(existing, 0);
+		}
 	}
 	if (!existingToken.empty())
 	{
@@ -517,6 +528,7 @@ void ConnectionManager::putCQI_L(ConnectionQueueItemPtr& cqi)
 {
 	if (cqi->isDownload())
 	{
+		unscheduleCQI_L(cqi);
 		downloads.erase(cqi);
 		if (CMD_DEBUG_ENABLED()) DETECTION_DEBUG("[ConnectionManager][putCQI][download] " + cqi->getHintedUser().toString());
 	}
@@ -534,6 +546,26 @@ void ConnectionManager::putCQI_L(ConnectionQueueItemPtr& cqi)
 	cqi.reset();
 }
 
+// Moves the item to an earlier position in the schedule, never to a later one
+void ConnectionManager::scheduleCQI_L(const ConnectionQueueItemPtr& cqi, uint64_t when)
+{
+	if (cqi->scheduled)
+	{
+		if (cqi->nextCheck <= when) return;
+		downloadSchedule.erase(std::make_pair(cqi->nextCheck, cqi));
+	}
+	cqi->nextCheck = when;
+	cqi->scheduled = true;
+	downloadSchedule.insert(std::make_pair(when, cqi));
+}
+
+void ConnectionManager::unscheduleCQI_L(const ConnectionQueueItemPtr& cqi)
+{
+	if (!cqi->scheduled) return;
+	downloadSchedule.erase(std::make_pair(cqi->nextCheck, cqi));
+	cqi->scheduled = false;
+}
+
 ConnectionQueueItemPtr ConnectionManager::getDownloadCQI(const string& token) const noexcept
 {
 	READ_LOCK(*csDownloads);
@@ -663,11 +695,16 @@ void ConnectionManager::onUserUpdated(const UserPtr& user)
 		std::vector<TokenItem> downloadUsers;
 		std::vector<TokenItem> uploadUsers;
 		{
-			READ_LOCK(*csDownloads);
+			WRITE_LOCK(*csDownloads);
 			for (const auto& download : downloads)
 			{
 				if (download->getUser() == user) // todo - map
+				{
 					downloadUsers.emplace_back(TokenItem{download->getHintedUser(), download->getConnectionQueueToken()});
+					// User went online or offline
+					if (download->getState() != ConnectionQueueItem::ACTIVE)
+						scheduleCQI_L(download, 0);
+				}
 			}
 		}
 		{
@@ -717,128 +754,184 @@ void ConnectionManager::connectNextNmdcUser(const ExpectedNmdcMap::NextConnectio
 #endif
 }
 
-void ConnectionManager::on(TimerManagerListener::Second, uint64_t tick) noexcept
+// Returns the tick when a waiting or connecting item needs to be looked at again
+static uint64_t getNextCheck(const ConnectionQueueItem* cqi, uint64_t tick)
+{
+	const uint64_t lastAttempt = cqi->getLastAttempt();
+	switch (cqi->getState())
+	{
+		case ConnectionQueueItem::WAITING:
+			if (!lastAttempt) return 0;
+			if (cqi->getErrors() == -1) // protocol error
+				return lastAttempt + RECONNECT_AFTER_ERROR_DELAY * 1000 + 1;
+			return lastAttempt + RETRY_CONNECTION_DELAY * 1000 * getDelayFactor(cqi->getErrors()) + 1;
+		case ConnectionQueueItem::CONNECTING:
+			return lastAttempt + CONNECTION_TIMEOUT * 1000 + 1;
+		case ConnectionQueueItem::NO_DOWNLOAD_SLOTS:
+			return tick + NO_SLOTS_CHECK_INTERVAL;
+		default:
+			return UINT64_MAX;
+	}
+}
+
+void ConnectionManager::processDownloadSchedule(uint64_t tick)
 {
-	if (GlobalState::isShuttingDown())
-		return;
-	updateAverageSpeed(tick);
-	flushUpdatedUsers();
-	std::vector<ConnectionQueueItemPtr> removed;
 	auto ss = SettingsManager::instance.getCoreSettings();
 	ss->lockRead();
-	unsigned maxAttempts = 	ss->getInt(Conf::DOWNCONN_PER_SEC);
+	unsigned maxAttempts = ss->getInt(Conf::DOWNCONN_PER_SEC);
 	ss->unlockRead();
 	if (!maxAttempts) maxAttempts = UINT_MAX;
+
+	std::vector<ConnectionQueueItemPtr> due;
+	{
+		WRITE_LOCK(*csDownloads);
+		auto i = downloadSchedule.begin();
+		for (; i != downloadSchedule.end() && i->first <= tick; ++i)
+		{
+			i->second->scheduled = false;
+			due.push_back(i->second);
+		}
+		downloadSchedule.erase(downloadSchedule.begin(), i);
+	}
+	if (due.empty())
+		return;
+
+	std::vector<ConnectionQueueItemPtr> removed;
+	std::vector<std::pair<ConnectionQueueItemPtr, uint64_t>> next;
 	std::vector<TokenItem> statusChanged;
 	std::vector<ReasonItem> downloadError;
+	unsigned attempts = 0;
+	unsigned deferred = 0;
+	unsigned timeouts = 0;
 	{
 		READ_LOCK(*csDownloads);
-		unsigned attempts = 0;
-		for (auto i = downloads.cbegin(); i != downloads.cend(); ++i)
+		for (const ConnectionQueueItemPtr& cqi : due)
 		{
-			const auto cqi = *i;
-			if (cqi->getState() != ConnectionQueueItem::ACTIVE)
+			if (cqi->getState() == ConnectionQueueItem::ACTIVE)
+				continue;
+
+			if (!cqi->getUser()->isOnline())
 			{
-				if (!cqi->getUser()->isOnline())
-				{
-					// Not online anymore...remove it from the pending...
-					removed.push_back(cqi);
-					continue;
-				}
+				// Not online anymore...remove it from the pending...
+				removed.push_back(cqi);
+				continue;
+			}
+
+			QueueItem::Priority prio = QueueManager::hasDownload(cqi->getUser());
+			if (prio == QueueItem::PAUSED)
+			{
+				removed.push_back(cqi);
+				continue;
+			}
 
-				QueueItem::Priority prio = QueueManager::hasDownload(cqi->getUser());
-				if (prio == QueueItem::PAUSED)
+			if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0) // protocol error
+			{
+				if (cqi->getLastAttempt() + RECONNECT_AFTER_ERROR_DELAY * 1000 < tick)
+					cqi->setErrors(0);
+				else
 				{
-					removed.push_back(cqi);
+					next.emplace_back(cqi, getNextCheck(cqi.get(), tick));
 					continue;
 				}
+			}
 
-				if (cqi->getErrors() == -1 && cqi->getLastAttempt() != 0) // protocol error
+			int errorCount = cqi->getErrors();
+			uint64_t nextCheck = 0;
+			if (cqi->getState() == ConnectionQueueItem::WAITING)
+			{
+				if (cqi->getLastAttempt() == 0 || cqi->getLastAttempt() + RETRY_CONNECTION_DELAY * 1000 * getDelayFactor(errorCount) < tick)
 				{
-					if (cqi->getLastAttempt() + RECONNECT_AFTER_ERROR_DELAY * 1000 < tick)
-						cqi->setErrors(0);
+					if (cqi->getLastAttempt() != 0 && attempts >= maxAttempts)
+					{
+						deferred++;
+						nextCheck = tick + 1000;
+					}
+					else if (DownloadManager::getInstance()->isStartDownload(prio))
+					{
+						cqi->setLastAttempt(tick);
+						cqi->setState(ConnectionQueueItem::CONNECTING);
+						OnlineUserPtr ou = ClientManager::getInstance()->connect(cqi->getHintedUser(), cqi->getConnectionQueueToken(), false);
+						if (ou)
+							cqi->setHubHint(ou->getClientBase()->getHubUrl());
+						statusChanged.emplace_back(TokenItem{cqi->getHintedUser(), cqi->getConnectionQueueToken()});
+						attempts++;
+					}
 					else
-						continue;
-				}
-
-				int errorCount = cqi->getErrors();
-				if (cqi->getState() == ConnectionQueueItem::WAITING)
-				{
-					if (cqi->getLastAttempt() == 0 || (attempts < maxAttempts && cqi->getLastAttempt() + RETRY_CONNECTION_DELAY * 1000 * getDelayFactor(errorCount) < tick))
 					{
-						if (DownloadManager::getInstance()->isStartDownload(prio))
-						{
-							cqi->setLastAttempt(tick);
-							cqi->setState(ConnectionQueueItem::CONNECTING);
-							OnlineUserPtr ou = ClientManager::getInstance()->connect(cqi->getHintedUser(), cqi->getConnectionQueueToken(), false);
-							if (ou)
-								cqi->setHubHint(ou->getClientBase()->getHubUrl());
-							statusChanged.emplace_back(TokenItem{cqi->getHintedUser(), cqi->getConnectionQueueToken()});
-							attempts++;
-						}
-						else
-						{
-							cqi->setLastAttempt(tick);
-							cqi->setState(ConnectionQueueItem::NO_DOWNLOAD_SLOTS);
-							downloadError.emplace_back(ReasonItem{cqi->getHintedUser(), cqi->getConnectionQueueToken(), STRING(ALL_DOWNLOAD_SLOTS_TAKEN)});
-						}
+						cqi->setLastAttempt(tick);
+						cqi->setState(ConnectionQueueItem::NO_DOWNLOAD_SLOTS);
+						downloadError.emplace_back(ReasonItem{cqi->getHintedUser(), cqi->getConnectionQueueToken(), STRING(ALL_DOWNLOAD_SLOTS_TAKEN)});
 					}
 				}
-				else if (cqi->getState() == ConnectionQueueItem::NO_DOWNLOAD_SLOTS && DownloadManager::getInstance()->isStartDownload(prio))
-				{
-					cqi->setLastAttempt(tick);
-					cqi->setState(ConnectionQueueItem::WAITING);
-				}
-				else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + CONNECTION_TIMEOUT * 1000 < tick)
-				{
-					const string& token = cqi->getConnectionQueueToken();
-					int numErrors = cqi->getErrors() + 1;
-					cqi->setErrors(numErrors);
-					downloadError.emplace_back(ReasonItem{cqi->getHintedUser(), token, STRING(CONNECTION_TIMEOUT)});
-					cqi->setLastAttempt(tick);
-					cqi->setState(ConnectionQueueItem::WAITING);
-					removeExpectedToken(token);
-					QueueManager::getInstance()->userCheckProcessFailure(cqi->getUser(), numErrors, true);
+			}
+			else if (cqi->getState() == ConnectionQueueItem::NO_DOWNLOAD_SLOTS && DownloadManager::getInstance()->isStartDownload(prio))
+			{
+				cqi->setLastAttempt(tick);
+				cqi->setState(ConnectionQueueItem::WAITING);
+			}
+			else if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt() + CONNECTION_TIMEOUT * 1000 < tick)
+			{
+				const string& token = cqi->getConnectionQueueToken();
+				int numErrors = cqi->getErrors() + 1;
+				cqi->setErrors(numErrors);
+				downloadError.emplace_back(ReasonItem{cqi->getHintedUser(), token, STRING(CONNECTION_TIMEOUT)});
+				cqi->setLastAttempt(tick);
+				cqi->setState(ConnectionQueueItem::WAITING);
+				timeouts++;
+				removeExpectedToken(token);
+				QueueManager::getInstance()->userCheckProcessFailure(cqi->getUser(), numErrors, true);
 #ifdef DEBUG_NMDC_UC
-					LogManager::message("Connection timed out: user=" + cqi->getHintedUser().user->getLastNick() +
-						" token=" + cqi->getConnectionQueueToken() +
-						" errors=" + Util::toString(cqi->getErrors()), false);
+				LogManager::message("Connection timed out: user=" + cqi->getHintedUser().user->getLastNick() +
+					" token=" + cqi->getConnectionQueueToken() +
+					" errors=" + Util::toString(cqi->getErrors()), false);
 #endif
-				}
 			}
+			if (!nextCheck)
+				nextCheck = std::max(getNextCheck(cqi.get(), tick), tick + 1);
+			next.emplace_back(cqi, nextCheck);
 		}
 	}
-	if (!removed.empty())
 	{
-		for (ConnectionQueueItemPtr& cqi : removed)
+		WRITE_LOCK(*csDownloads);
+		for (const auto& item : next)
 		{
-			bool isDownload = cqi->isDownload();
-			const HintedUser hintedUser = cqi->getHintedUser();
-			const string token = cqi->getConnectionQueueToken();
-			if (isDownload)
-			{
-				removeExpectedToken(token);
-				WRITE_LOCK(*csDownloads);
-				putCQI_L(cqi);
-			}
-			else
-			{
-				LOCK(csUploads);
-				putCQI_L(cqi);
-			}
-			fire(ConnectionManagerListener::RemoveToken(), token);
-			fire(ConnectionManagerListener::Removed(), hintedUser, isDownload, token);
+			const ConnectionQueueItemPtr& cqi = item.first;
+			if (cqi->getState() != ConnectionQueueItem::ACTIVE && downloads.find(cqi) != downloads.end())
+				scheduleCQI_L(cqi, item.second);
 		}
-		removed.clear();
+		schedulerStats.processed += due.size();
+		schedulerStats.attempts += attempts;
+		schedulerStats.deferred += deferred;
+		schedulerStats.timeouts += timeouts;
 	}
-	
+
+	for (ConnectionQueueItemPtr& cqi : removed)
+	{
+		const HintedUser hintedUser = cqi->getHintedUser();
+		const string token = cqi->getConnectionQueueToken();
+		removeExpectedToken(token);
+		{
+			WRITE_LOCK(*csDownloads);
+			putCQI_L(cqi);
+		}
+		fire(ConnectionManagerListener::RemoveToken(), token);
+		fire(ConnectionManagerListener::Removed(), hintedUser, true, token);
+	}
+
 	for (auto j = statusChanged.cbegin(); j != statusChanged.cend(); ++j)
 		fire(ConnectionManagerListener::ConnectionStatusChanged(), j->hintedUser, true, j->token);
-	statusChanged.clear();
 	// TODO -        
 	for (auto k = downloadError.cbegin(); k != downloadError.cend(); ++k)
 		fire(ConnectionManagerListener::FailedDownload(), k->hintedUser, k->reason, k->token);
-	downloadError.clear();
+}
+
+void ConnectionManager::on(TimerManagerListener::Second, uint64_t tick) noexcept
+{
+	if (GlobalState::isShuttingDown())
+		return;
+	updateAverageSpeed(tick);
+	flushUpdatedUsers();
+	processDownloadSchedule(tick);
 
 	if (tick > timeRemoveExpired)
 	{
@@ -907,19 +1000,50 @@ void ConnectionManager::checkConnections(uint64_t tick)
 	}
 }
 
-ConnectionManager::Server::Server(int type, const IpAddressEx& ip, uint16_t port): type(type), bindIp(ip), stopFlag(false)
+ConnectionManager::Server::Server(int type, const IpAddressEx& ip, uint16_t port, int acceptors, int index): type(type), bindIp(ip), stopFlag(false)
 {
-	sock.create(ip.type, Socket::TYPE_TCP);
+#ifdef SO_REUSEPORT
+	reusePort = acceptors > 1;
+#else
+	reusePort = false;
+	acceptors = 1;
+#endif
+	if (index == 0)
+		LogManager::message("Starting server on " + Util::printIpAddress(ip, true) + ':' + Util::toString(port) + " type=" + Util::toString(type), false);
+	createSocket(port);
+	// The first server may have been bound to a random port, the others must share it
+	if (index + 1 < acceptors)
+		next.reset(new Server(type, ip, serverPort, acceptors, index + 1));
+	char threadName[64];
+	if (index)
+		sprintf(threadName, "Server-%d-v%d-%d", type, ip.type == AF_INET6 ? 6 : 4, index);
+	else
+		sprintf(threadName, "Server-%d-v%d", type, ip.type == AF_INET6 ? 6 : 4);
+	start(64, threadName);
+}
+
+void ConnectionManager::Server::createSocket(uint16_t port)
+{
+	sock.create(bindIp.type, Socket::TYPE_TCP);
 	sock.setSocketOpt(SOL_SOCKET, SO_REUSEADDR, 1);
-	LogManager::message("Starting server on " + Util::printIpAddress(ip, true) + ':' + Util::toString(port) + " type=" + Util::toString(type), false);
+#ifdef SO_REUSEPORT
+	if (reusePort) sock.setSocketOpt(SOL_SOCKET, SO_REUSEPORT, 1);
+#endif
 	serverPort = sock.bind(port, bindIp);
 	sock.listen();
-	char threadName[64];
-	sprintf(threadName, "Server-%d-v%d", type, ip.type == AF_INET6 ? 6 : 4);
-	start(64, threadName);
 }
 
 static const uint64_t POLL_TIMEOUT = 250;
+static const int MAX_ACCEPT_BATCH = 64;
+
+static const uint64_t acceptBatchBounds[] = { 1, 2, 4, 8, 16, 32, 64 };
+static Metrics::Histogram metricAcceptDelay("listener_accept_delay_seconds",
+	"Time from the listening socket becoming ready to the connection being accepted",
+	Metrics::LATENCY_BUCKETS, Metrics::LATENCY_BUCKETS_COUNT, Metrics::MICROSECONDS);
+static Metrics::Histogram metricAcceptBatch("listener_accept_batch_size",
+	"Connections accepted per wakeup of the listener",
+	acceptBatchBounds, _countof(acceptBatchBounds), 1);
+static Metrics::Counter metricAcceptErrors("listener_accept_errors_total", "Incoming connections that failed or were rejected when accepted");
 
 int ConnectionManager::Server::run() noexcept
 {
@@ -932,7 +1056,18 @@ int ConnectionManager::Server::run() noexcept
 				auto ret = sock.wait(POLL_TIMEOUT, Socket::WAIT_ACCEPT);
 				if (ret == Socket::WAIT_ACCEPT)
 				{
-					ConnectionManager::getInstance()->accept(sock, type, this);
+					// Drain the backlog, the batch is limited so that stopFlag is still checked
+					// during a connection storm; wait returns immediately if more are pending
+					const uint64_t readyTime = Metrics::getMicroseconds();
+					int count = 0;
+					while (count < MAX_ACCEPT_BATCH && !stopFlag)
+					{
+						if (!ConnectionManager::getInstance()->accept(sock, type, this))
+							break;
+						metricAcceptDelay.observe(Metrics::getMicroseconds() - readyTime);
+						++count;
+					}
+					if (count) metricAcceptBatch.observe(count);
 				}
 			}
 		}
@@ -947,11 +1082,9 @@ int ConnectionManager::Server::run() noexcept
 			{
 				dcassert(bindIp.type == AF_INET || bindIp.type == AF_INET6);
 				sock.disconnect();
-				sock.create(bindIp.type, Socket::TYPE_TCP);
-				serverPort = sock.bind(serverPort, bindIp);
+				createSocket(serverPort);
 				dcassert(serverPort);
 				LogManager::message("Starting to listen " + Util::printIpAddress(bindIp, true) + ':' + Util::toString(serverPort) + " type=" + Util::toString(type));
-				sock.listen();
 				if (type != SERVER_TYPE_SSL)
 					ConnectionManager::getInstance()->updateLocalIp(bindIp.type);
 				if (failed)
@@ -991,8 +1124,9 @@ int ConnectionManager::Server::run() noexcept
 /**
  * Someone's connecting, accept the connection and wait for identification...
  * It's always the other fellow that starts sending if he made the connection.
+ * Returns false when there are no more pending connections or the listening socket failed.
  */
-void ConnectionManager::accept(const Socket& sock, int type, Server* server) noexcept
+bool ConnectionManager::accept(const Socket& sock, int type, Server* server) noexcept
 {
 	uint16_t port;
 	unique_ptr<Socket> newSock;
@@ -1010,16 +1144,25 @@ void ConnectionManager::accept(const Socket& sock, int type, Server* server) noe
 	try
 	{
 		port = newSock->accept(sock);
+		if (!port) return false;
 	}
-	catch (const Exception&)
+	catch (const SocketException& e)
 	{
+		metricAcceptErrors.inc();
 		if (type == SERVER_TYPE_SSL && server)
 		{
 			// FIXME: Is it possible to get FlyLink's magic string from SSL socket buffer?
 			if (g_portTest.processInfo(AppPorts::PORT_TLS, AppPorts::PORT_TLS, getConnectionPort(AF_INET, true), Util::emptyString, Util::emptyString, false))
 				ConnectivityManager::getInstance()->processPortTestResult();
 		}
-		return;
+		// Connections refused by IPGuard and failed TLS handshakes have no error code,
+		// other errors come from accept itself and end the batch
+		return e.getErrorCode() == 0;
+	}
+	catch (const Exception&)
+	{
+		metricAcceptErrors.inc();
+		return true;
 	}
 	UserConnectionPtr ucPtr = getConnection(type == SERVER_TYPE_SSL ? UserConnection::FLAG_SECURE : 0);
 	UserConnection* uc = ucPtr.get();
@@ -1027,6 +1170,7 @@ void ConnectionManager::accept(const Socket& sock, int type, Server* server) noe
 	uc->setState(UserConnection::STATE_SUPNICK);
 	uc->updateLastActivity();
 	uc->addAcceptedSocket(newSock, port);
+	return true;
 }
 
 void ConnectionManager::updateLocalIp(int af)
@@ -1262,7 +1406,7 @@ void ConnectionManager::addDownloadConnection(UserConnection* conn)
 	ConnectionQueueItemPtr cqi;
 	bool isActive = false;
 	{
-		READ_LOCK(*csDownloads);
+		WRITE_LOCK(*csDownloads);
 		const auto i = find(downloads.begin(), downloads.end(), conn->getUser());
 		if (i != downloads.end())
 		{
@@ -1271,7 +1415,15 @@ void ConnectionManager::addDownloadConnection(UserConnection* conn)
 			conn->setConnectionQueueToken(cqi->getConnectionQueueToken());
 			if (cqi->getState() == ConnectionQueueItem::WAITING || cqi->getState() == ConnectionQueueItem::CONNECTING)
 			{
+				if (cqi->getState() == ConnectionQueueItem::CONNECTING && cqi->getLastAttempt())
+				{
+					uint64_t latency = GET_TICK() - cqi->getLastAttempt();
+					schedulerStats.connected++;
+					schedulerStats.totalLatency += latency;
+					if (latency > schedulerStats.maxLatency) schedulerStats.maxLatency = latency;
+				}
 				cqi->setState(ConnectionQueueItem::ACTIVE);
+				unscheduleCQI_L(cqi);
 				conn->setFlag(UserConnection::FLAG_ASSOCIATED);
 				
 #ifdef FLYLINKDC_USE_CONNECTED_EVENT
@@ -1519,7 +1671,7 @@ void ConnectionManager::processINF(UserConnection* source, const AdcCommand& cmd
 
 void ConnectionManager::processMSG(UserConnection* source, const AdcCommand& cmd) noexcept
 {
-	if (cmd.getParameters().empty())
+	if (cmd.getParamCount() == 0)
 		return;
 	if (!source->getUser())
 	{
@@ -1603,7 +1755,7 @@ void ConnectionManager::processMSG(UserConnection* source, const AdcCommand& cmd
 
 void ConnectionManager::force(const UserPtr& user)
 {
-	READ_LOCK(*csDownloads);
+	WRITE_LOCK(*csDownloads);
 	
 	const auto i = find(downloads.begin(), downloads.end(), user);
 	if (i != downloads.end())
@@ -1613,6 +1765,8 @@ void ConnectionManager::force(const UserPtr& user)
 		fire(ConnectionManagerListener::Forced(), *i);
 #endif
 		(*i)->setLastAttempt(0);
+		if ((*i)->getState() != ConnectionQueueItem::ACTIVE)
+			scheduleCQI_L(*i, 0);
 	}
 }
 
@@ -1652,6 +1806,7 @@ void ConnectionManager::failed(UserConnection* source, const string& error, bool
 				cqi->setState(ConnectionQueueItem::WAITING);
 				cqi->setLastAttempt(GET_TICK());
 				cqi->setErrors(protocolError ? -1 : (cqi->getErrors() + 1));
+				scheduleCQI_L(cqi, getNextCheck(cqi.get(), cqi->getLastAttempt()));
 				reasonItem.hintedUser = cqi->getHintedUser();
 				reasonItem.reason = error;
 				reasonItem.token = cqi->getConnectionQueueToken();
@@ -1936,6 +2091,7 @@ void ConnectionManager::shutdown()
 		}
 	}
 #endif
+	downloadSchedule.clear();
 	downloads.clear();
 	uploads.clear();
 }
@@ -1999,6 +2155,31 @@ string ConnectionManager::getExpectedInfo() const
 	return expectedNmdc.getInfo() + expectedAdc.getInfo();
 }
 
+string ConnectionManager::getDownloadSchedulerInfo() const
+{
+	uint64_t now = GET_TICK();
+	READ_LOCK(*csDownloads);
+	string res = "Pending: " + Util::toString(downloads.size());
+	res += ", scheduled: " + Util::toString(downloadSchedule.size());
+	if (!downloadSchedule.empty())
+	{
+		uint64_t first = downloadSchedule.begin()->first;
+		res += ", next check in " + Util::toString(first > now ? (first - now) / 1000 : 0) + "s";
+	}
+	const auto& st = schedulerStats;
+	res += "\nProcessed: " + Util::toString(st.processed);
+	res += ", attempts: " + Util::toString(st.attempts);
+	res += ", deferred: " + Util::toString(st.deferred);
+	res += ", timeouts: " + Util::toString(st.timeouts);
+	res += "\nConnected: " + Util::toString(st.connected);
+	if (st.connected)
+	{
+		res += ", average latency: " + Util::toString(st.totalLatency / st.connected) + " ms";
+		res += ", max latency: " + Util::toString(st.maxLatency) + " ms";
+	}
+	return res;
+}
+
 string ConnectionManager::getTokenInfo() const
 {
 	vector<pair<string, TokenManager::TokenData>> v;
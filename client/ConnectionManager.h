@@ -92,6 +92,11 @@ class ConnectionQueueItem
 		const string token;
 		HintedUser hintedUser;
 		const bool download;
+
+		// Position in ConnectionManager::downloadSchedule, protected by csDownloads
+		friend class ConnectionManager;
+		uint64_t nextCheck = 0;
+		bool scheduled = false;
 };
 
 typedef std::shared_ptr<ConnectionQueueItem> ConnectionQueueItemPtr;
@@ -237,6 +242,7 @@ class ConnectionManager :
 		string getUserConnectionInfo() const;
 		string getExpectedInfo() const;
 		string getTokenInfo() const;
+		string getDownloadSchedulerInfo() const;
 		ConnectionQueueItemPtr getDownloadCQI(const string& token) const noexcept;
 		ConnectionQueueItemPtr getUploadCQI(const string& token) const noexcept;
 
@@ -253,10 +259,13 @@ class ConnectionManager :
 		StringList getAdcFeatures() const;
 
 	private:
+		// Listening socket with its acceptor thread.
+		// When more than one acceptor is configured, the extra ones are chained through next
+		// and listen on the same port with SO_REUSEPORT, the kernel spreads connections between them.
 		class Server : public Thread
 		{
 			public:
-				Server(int type, const IpAddressEx& ip, uint16_t port);
+				Server(int type, const IpAddressEx& ip, uint16_t port, int acceptors = 1, int index = 0);
 				uint16_t getServerPort() const
 				{
 					dcassert(serverPort);
@@ -268,14 +277,18 @@ class ConnectionManager :
 				}
 				~Server()
 				{
-					stopFlag.store(true);
+					for (Server* s = this; s; s = s->next.get())
+						s->stopFlag.store(true);
 					join();
 				}
 				int getType() const { return type; }
 
 			private:
 				int run() noexcept;
+				void createSocket(uint16_t port);
 				std::atomic_bool stopFlag;
+				std::unique_ptr<Server> next;
+				bool reusePort;
 
 				Socket sock;
 				uint16_t serverPort;
@@ -293,6 +306,22 @@ class ConnectionManager :
 		mutable std::unique_ptr<RWLock> csDownloads;
 		mutable CriticalSection csUploads;
 
+		// Download items ordered by the tick when they need to be looked at again.
+		// ACTIVE items are not scheduled.
+		std::set<std::pair<uint64_t, ConnectionQueueItemPtr>> downloadSchedule;
+
+		struct DownloadSchedulerStats
+		{
+			uint64_t processed = 0;    // items looked at by the timer
+			uint64_t attempts = 0;     // connection requests sent
+			uint64_t deferred = 0;     // retries postponed by DOWNCONN_PER_SEC
+			uint64_t timeouts = 0;
+			uint64_t connected = 0;    // requests answered by the remote side
+			uint64_t totalLatency = 0; // ms, sum over connected requests
+			uint64_t maxLatency = 0;
+		};
+		DownloadSchedulerStats schedulerStats;
+
 		// CCPM connections
 		struct PMConnInfo
 		{
@@ -353,7 +382,10 @@ class ConnectionManager :
 		void updateAverageSpeed(uint64_t tick);
 
 		void putCQI_L(ConnectionQueueItemPtr& cqi);
-		void accept(const Socket& sock, int type, Server* server) noexcept;
+		void scheduleCQI_L(const ConnectionQueueItemPtr& cqi, uint64_t when);
+		void unscheduleCQI_L(const ConnectionQueueItemPtr& cqi);
+		void processDownloadSchedule(uint64_t tick);
+		bool accept(const Socket& sock, int type, Server* server) noexcept;
 		bool checkKeyprint(UserConnection *source);
 		void removeExpiredCCPMToken(const string& token);
 
@@ -27,6 +27,7 @@
 #include "Util.h"
 #include "SettingsManager.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 #include "version.h"
 
 #include <openssl/bn.h>
@@ -38,9 +39,27 @@
 static void* tmpKeysMap[CryptoManager::NUM_KEYS] = { nullptr, nullptr };
 
 int CryptoManager::idxVerifyData = 0;
+int CryptoManager::idxSessionKey = 0;
 CryptoManager::SSLVerifyData CryptoManager::trustedKeyprint = { false, "trusted_keyp" };
 static CriticalSection g_cs;
 
+static int64_t getSessionCacheStat(uint64_t CryptoManager::SessionCacheStats::*field)
+{
+	if (!CryptoManager::isValidInstance()) return 0;
+	CryptoManager::SessionCacheStats stats;
+	CryptoManager::getInstance()->getSessionCacheStats(stats);
+	return stats.*field;
+}
+
+static Metrics::Callback metricClientResumed("tls_handshakes_total{side=\"client\",session=\"resumed\"}", "Completed TLS handshakes", Metrics::TYPE_COUNTER,
+	[]() { return getSessionCacheStat(&CryptoManager::SessionCacheStats::clientResumed); });
+static Metrics::Callback metricClientFull("tls_handshakes_total{side=\"client\",session=\"full\"}", "Completed TLS handshakes", Metrics::TYPE_COUNTER,
+	[]() { return getSessionCacheStat(&CryptoManager::SessionCacheStats::clientFull); });
+static Metrics::Callback metricServerResumed("tls_handshakes_total{side=\"server\",session=\"resumed\"}", "Completed TLS handshakes", Metrics::TYPE_COUNTER,
+	[]() { return getSessionCacheStat(&CryptoManager::SessionCacheStats::serverResumed); });
+static Metrics::Callback metricServerFull("tls_handshakes_total{side=\"server\",session=\"full\"}", "Completed TLS handshakes", Metrics::TYPE_COUNTER,
+	[]() { return getSessionCacheStat(&CryptoManager::SessionCacheStats::serverFull); });
+
 #if OPENSSL_VERSION_NUMBER < 0x10101000
 #define USE_ASN1_TIME_TO_TM
 #endif
@@ -74,7 +93,7 @@ static const char cipherSuites[] =
 
 static const int64_t EXPIRED_CERT_TIME_DIFF = 3600; // seconds
 
-CryptoManager::CryptoManager()
+CryptoManager::CryptoManager() : clientResumed(0), clientFull(0), serverResumed(0), serverFull(0)
 {
 	updateSettings();
 	keyPairInitialized = false;
@@ -92,6 +111,7 @@ CryptoManager::CryptoManager()
 
 	sslRandCheck();
 	idxVerifyData = SSL_get_ex_new_index(0, (void *) "VerifyData", nullptr, nullptr, nullptr);
+	idxSessionKey = SSL_get_ex_new_index(0, (void *) "SessionKey", nullptr, nullptr, nullptr);
 
 	// Init temp data for DH keys
 	for (int i = 0; i < NUM_KEYS; ++i)
@@ -102,6 +122,7 @@ CryptoManager::CryptoManager()
 
 CryptoManager::~CryptoManager()
 {
+	clearSessions();
 	for (int i = 0; i < NUM_KEYS; ++i)
 		if (tmpKeysMap[i]) DH_free(static_cast<DH*>(tmpKeysMap[i]));
 
@@ -172,6 +193,21 @@ ssl::SSL_CTX CryptoManager::createContext(bool isServer) noexcept
 				EC_KEY_free(ec);
 			}
 			SSL_CTX_set_tmp_dh_callback(ctx, getTempDHCallback);
+
+			// Peers reconnect often (file lists, slot timeouts), let them resume their sessions
+			static const unsigned char sessionIdContext[] = "DCClient";
+			SSL_CTX_set_session_id_context(ctx, sessionIdContext, sizeof(sessionIdContext) - 1);
+			SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+			SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+			SSL_CTX_set_num_tickets(ctx, 1);
+#endif
+		}
+		else
+		{
+			// Client sessions are stored by newSessionCallback
+			SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+			SSL_CTX_sess_set_new_cb(ctx, newSessionCallback);
 		}
 
 		SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT, verifyCallback);
@@ -727,6 +763,8 @@ void CryptoManager::generateNewKeyPair()
 	getX509Digest(digest, cert, EVP_sha256());
 	int64_t endTime = getX509EndTime(cert);
 
+	// Cached sessions were created with the old certificate
+	clearSessions();
 	LOCK(contextLock);
 	for (int i = 0; i < 2; i++)
 		context[i] = std::move(newContext[i]);
@@ -769,6 +807,8 @@ bool CryptoManager::initializeKeyPair() noexcept
 	getX509Digest(digest, cert, EVP_sha256());
 	int64_t endTime = getX509EndTime(cert);
 
+	// Cached sessions were created with the old certificate
+	clearSessions();
 	LOCK(contextLock);
 	for (int i = 0; i < 2; i++)
 		context[i] = std::move(newContext[i]);
@@ -841,6 +881,113 @@ SSL_CTX* CryptoManager::getSSLContext(SSLContext wanted) const noexcept
 	return ctx;
 }
 
+int CryptoManager::newSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+	const string* key = static_cast<const string*>(SSL_get_ex_data(ssl, idxSessionKey));
+	if (!key || key->empty() || !isValidInstance())
+		return 0;
+#if OPENSSL_VERSION_NUMBER >= 0x10101000
+	if (!SSL_SESSION_is_resumable(session))
+		return 0;
+	// OpenSSL marks the session as not resumable if the connection is closed without close_notify,
+	// which is how most of our connections end. Keep a copy which is not affected by this.
+	SSL_SESSION* copy = SSL_SESSION_dup(session);
+	if (copy)
+		getInstance()->putSession(*key, copy);
+	return 0;
+#else
+	getInstance()->putSession(*key, session);
+	return 1;
+#endif
+}
+
+void CryptoManager::putSession(const string& key, SSL_SESSION* session) noexcept
+{
+	SSL_SESSION* oldSession = nullptr;
+	vector<SSL_SESSION*> expired;
+	{
+		LOCK(csSessions);
+		auto i = sessions.find(key);
+		if (i != sessions.end())
+		{
+			oldSession = i->second;
+			i->second = session;
+		}
+		else
+		{
+			if (sessions.size() >= MAX_CACHED_SESSIONS)
+			{
+				time_t now = time(nullptr);
+				for (auto j = sessions.begin(); j != sessions.end();)
+					if (SSL_SESSION_get_time(j->second) + SSL_SESSION_get_timeout(j->second) < now)
+					{
+						expired.push_back(j->second);
+						j = sessions.erase(j);
+					}
+					else
+						++j;
+				if (sessions.size() >= MAX_CACHED_SESSIONS)
+				{
+					expired.push_back(sessions.begin()->second);
+					sessions.erase(sessions.begin());
+				}
+			}
+			sessions.emplace(key, session);
+		}
+	}
+	if (oldSession) SSL_SESSION_free(oldSession);
+	for (SSL_SESSION* s : expired)
+		SSL_SESSION_free(s);
+}
+
+SSL_SESSION* CryptoManager::takeSession(const string& key) noexcept
+{
+	SSL_SESSION* session = nullptr;
+	{
+		LOCK(csSessions);
+		auto i = sessions.find(key);
+		if (i == sessions.end()) return nullptr;
+		session = i->second;
+		// TLS 1.3 tickets should not be used more than once
+		sessions.erase(i);
+	}
+	if (SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session) < time(nullptr))
+	{
+		SSL_SESSION_free(session);
+		return nullptr;
+	}
+	return session;
+}
+
+void CryptoManager::clearSessions() noexcept
+{
+	boost::unordered_map<string, SSL_SESSION*> oldSessions;
+	csSessions.lock();
+	oldSessions.swap(sessions);
+	csSessions.unlock();
+	for (const auto& i : oldSessions)
+		SSL_SESSION_free(i.second);
+}
+
+void CryptoManager::handshakeCompleted(bool isServer, bool resumed) noexcept
+{
+	if (isServer)
+		++(resumed ? serverResumed : serverFull);
+	else
+		++(resumed ? clientResumed : clientFull);
+}
+
+void CryptoManager::getSessionCacheStats(SessionCacheStats& stats) const noexcept
+{
+	stats.clientResumed = clientResumed.load();
+	stats.clientFull = clientFull.load();
+	stats.serverResumed = serverResumed.load();
+	stats.serverFull = serverFull.load();
+	csSessions.lock();
+	stats.cachedSessions = sessions.size();
+	csSessions.unlock();
+}
+
 SSLSocket* CryptoManager::getClientSocket(bool allowUntrusted, const string& expKP, Socket::Protocol proto) noexcept
 {
 	SSL_CTX* ctx = getSSLContext(proto == Socket::PROTO_HTTP ? SSL_UNAUTH_CLIENT : SSL_CLIENT);
@@ -25,6 +25,8 @@
 #include "Locks.h"
 
 #include <openssl/ssl.h>
+#include <boost/unordered/unordered_map.hpp>
+#include <atomic>
 
 namespace ssl
 {
@@ -94,7 +96,22 @@ class CryptoManager : public Singleton<CryptoManager>
 		void getCertFingerprint(ByteVector& fp) const noexcept;
 		void checkExpiredCert() noexcept;
 
+		struct SessionCacheStats
+		{
+			uint64_t clientResumed;
+			uint64_t clientFull;
+			uint64_t serverResumed;
+			uint64_t serverFull;
+			size_t cachedSessions;
+		};
+
+		// Returns a session for resumption and removes it from the cache, the caller must free it
+		SSL_SESSION* takeSession(const string& key) noexcept;
+		void handshakeCompleted(bool isServer, bool resumed) noexcept;
+		void getSessionCacheStats(SessionCacheStats& stats) const noexcept;
+
 		static int idxVerifyData;
+		static int idxSessionKey;
 
 	private:
 		friend class Singleton<CryptoManager>;
@@ -114,6 +131,9 @@ class CryptoManager : public Singleton<CryptoManager>
 		static DH* getTmpDH(int keyLen);
 		static DH* getTempDHCallback(SSL* /*ssl*/, int /*is_export*/, int keylength);
 		static int verifyCallback(int preverifyOk, X509_STORE_CTX *ctx);
+		static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+		void putSession(const string& key, SSL_SESSION* session) noexcept;
+		void clearSessions() noexcept;
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000
 		static void lockFunc(int mode, int n, const char *file, int line);
@@ -135,6 +155,16 @@ class CryptoManager : public Singleton<CryptoManager>
 		ByteVector certFingerprint;
 		int64_t endTime;
 
+		// Client side session cache, sessions are keyed by the expected keyprint or by the address of the peer
+		static const size_t MAX_CACHED_SESSIONS = 512;
+		static const long SESSION_TIMEOUT = 2 * 3600;
+		boost::unordered_map<string, SSL_SESSION*> sessions;
+		mutable FastCriticalSection csSessions;
+		std::atomic<uint64_t> clientResumed;
+		std::atomic<uint64_t> clientFull;
+		std::atomic<uint64_t> serverResumed;
+		std::atomic<uint64_t> serverFull;
+
 		static SSLVerifyData trustedKeyprint;
 };
 
@@ -20,6 +20,7 @@
 #include "DCPlusPlus.h"
 #include "ConnectionManager.h"
 #include "DownloadManager.h"
+#include "DiskWriter.h"
 #include "UploadManager.h"
 #include "CryptoManager.h"
 #include "ShareManager.h"
@@ -100,6 +101,7 @@ void startup(PROGRESSCALLBACKPROC pProgressCallbackProc, void* pProgressParam, G
 	HublistManager::newInstance();
 	SearchManager::newInstance();
 	ConnectionManager::newInstance();
+	DiskWriter::newInstance();
 	DownloadManager::newInstance();
 	UploadManager::newInstance();
 
@@ -227,6 +229,7 @@ void shutdown(GUIINITPROC pGuiInitProc, void *pGuiParam)
 	dht::DHT::deleteInstance();
 	ThrottleManager::deleteInstance();
 	DownloadManager::deleteInstance();
+	DiskWriter::deleteInstance();
 	UploadManager::deleteInstance();
 	QueueManager::deleteInstance();
 	ConnectionManager::deleteInstance();
@@ -657,6 +657,7 @@ void DatabaseConnection::saveLocation(const vector<LocationInfo>& data)
 			insertLocation.executenonquery();
 		}
 		trans.commit();
+		DatabaseManager::getInstance()->reloadIpRanges(IPInfo::FLAG_LOCATION);
 	}
 	catch (const database_error& e)
 	{
@@ -723,6 +724,63 @@ void DatabaseConnection::loadP2PGuard(Ip4Address ip, IPInfo& result)
 	result.known |= IPInfo::FLAG_P2P_GUARD;
 }
 
+void DatabaseConnection::loadIPInfo(vector<IPInfoQuery>& queries)
+{
+	// Neighbouring addresses are found in the same pages of the index
+	std::sort(queries.begin(), queries.end(),
+		[](const IPInfoQuery& a, const IPInfoQuery& b) { return a.ip < b.ip; });
+	try
+	{
+		// A single read transaction instead of one per statement
+		sqlite3_transaction trans(connection);
+		for (IPInfoQuery& q : queries)
+		{
+			if (q.what & IPInfo::FLAG_LOCATION)
+				loadLocation(q.ip, *q.result);
+			if (q.what & IPInfo::FLAG_P2P_GUARD)
+				loadP2PGuard(q.ip, *q.result);
+		}
+		trans.commit();
+	}
+	catch (const database_error& e)
+	{
+		DatabaseManager::getInstance()->reportError("SQLite - loadIPInfo: " + e.getError(), e.getErrorCode());
+	}
+}
+
+bool DatabaseConnection::loadIpRanges(int what, IpRangeTable& table)
+{
+	try
+	{
+		const char* query = what == IPInfo::FLAG_LOCATION ?
+			"select start_ip,stop_ip,location,flag_index from location_db.fly_location_ip" :
+			"select start_ip,stop_ip,note,0 from location_db.fly_p2pguard_ip";
+		sqlite3_command cmd(&connection, query);
+		sqlite3_reader reader = cmd.executereader();
+		std::map<std::pair<string, int>, uint64_t> entryIndex;
+		while (reader.read())
+		{
+			uint32_t start = (uint32_t) reader.getint64(0);
+			uint32_t end = (uint32_t) reader.getint64(1);
+			if (!start || end < start) continue;
+			auto p = entryIndex.insert(std::make_pair(std::make_pair(reader.getstring(2), reader.getint(3)), table.entries.size()));
+			if (p.second)
+				table.entries.push_back(IpRangeTable::Entry{p.first->first.first, p.first->first.second});
+			int error;
+			table.ranges.addRange(start, end, p.first->second, error);
+		}
+	}
+	catch (const database_error& e)
+	{
+		DatabaseManager::getInstance()->reportError("SQLite - loadIpRanges: " + e.getError(), e.getErrorCode());
+		return false;
+	}
+	table.ranges.compile();
+	table.ranges.releaseRanges();
+	table.entries.shrink_to_fit();
+	return true;
+}
+
 void DatabaseConnection::removeManuallyBlockedIP(Ip4Address ip)
 {
 	DatabaseManager* dm = DatabaseManager::getInstance();
@@ -736,6 +794,7 @@ void DatabaseConnection::removeManuallyBlockedIP(Ip4Address ip)
 		}
 		deleteManuallyBlockedIP.bind(1, ip);
 		deleteManuallyBlockedIP.executenonquery();
+		dm->reloadIpRanges(IPInfo::FLAG_P2P_GUARD);
 	}
 	catch (const database_error& e)
 	{
@@ -788,6 +847,7 @@ void DatabaseConnection::saveP2PGuardData(const vector<P2PGuardData>& data, int
 			insertP2PGuard.executenonquery();
 		}
 		trans.commit();
+		DatabaseManager::getInstance()->reloadIpRanges(IPInfo::FLAG_P2P_GUARD);
 	}
 	catch (const database_error& e)
 	{
@@ -802,6 +862,7 @@ void DatabaseConnection::clearP2PGuardData(int type)
 		sqlite3_transaction trans(connection);
 		doDeleteP2PGuard(type);
 		trans.commit();
+		DatabaseManager::getInstance()->reloadIpRanges(IPInfo::FLAG_P2P_GUARD);
 	}
 	catch (const database_error& e)
 	{
@@ -1216,6 +1277,7 @@ DatabaseManager::DatabaseManager() noexcept
 	mmdbStatus = MMDB_STATUS_MISSING;
 	geoipCheckHours = 0;
 	options = 0;
+	pendingIpRanges = 0;
 }
 
 DatabaseManager::~DatabaseManager()
@@ -1430,6 +1492,7 @@ void DatabaseManager::init(ErrorCallback errorCallback)
 	}
 	defThreadId = BaseThread::getCurrentThreadId();
 	lmdb.open();
+	reloadIpRanges(IPInfo::FLAG_LOCATION | IPInfo::FLAG_P2P_GUARD);
 	string dbInfo = getDBInfo();
 	if (!dbInfo.empty())
 		LogManager::message(dbInfo, false);
@@ -1461,41 +1524,106 @@ void DatabaseManager::updateSettings(int* journalMode) noexcept
 	geoipCheckHours = hours;
 }
 
-void DatabaseManager::getIPInfo(DatabaseConnection* conn, const IpAddress& ip, IPInfo& result, int what, bool onlyCached)
+DatabaseManager::IpCacheShard& DatabaseManager::getIpCacheShard(const IpKey& key)
 {
-	dcassert(what);
-	dcassert(Util::isValidIp(ip));
-	IpKey ipKey;
-	if (ip.type == AF_INET6)
-		ipKey.setIP(ip.data.v6);
-	else
-		ipKey.setIP(ip.data.v4);
+	// IPv4 keys differ only in the last word, mix the bits before taking the shard index
+	uint32_t hash = key.getHash() * 0x9E3779B1;
+	return ipCache[hash >> 28 & (IP_CACHE_SHARDS - 1)];
+}
 
+int DatabaseManager::getCachedIPInfo(const IpKey& key, IPInfo& result, int what)
+{
+	IpCacheShard& shard = getIpCacheShard(key);
+	LOCK(shard.cs);
+	IpCacheItem* item = shard.cache.get(key);
+	if (!item) return 0;
+	shard.cache.makeNewest(item);
+	int found = what & item->info.known;
+	if (found & IPInfo::FLAG_COUNTRY)
 	{
-		LOCK(csIpCache);
-		IpCacheItem* item = ipCache.get(ipKey);
-		if (item)
+		result.country = item->info.country;
+		result.countryCode = item->info.countryCode;
+	}
+	if (found & IPInfo::FLAG_LOCATION)
+	{
+		result.location = item->info.location;
+		result.locationImage = item->info.locationImage;
+	}
+	if (found & IPInfo::FLAG_P2P_GUARD)
+		result.p2pGuard = item->info.p2pGuard;
+	result.known |= found;
+	return found;
+}
+
+void DatabaseManager::storeIPInfo(const IpKey& key, const IPInfo& info)
+{
+	IpCacheShard& shard = getIpCacheShard(key);
+	LOCK(shard.cs);
+	IpCacheItem* storedItem;
+	IpCacheItem newItem;
+	newItem.info = info;
+	newItem.key = key;
+	if (!shard.cache.add(newItem, &storedItem))
+	{
+		if (info.known & IPInfo::FLAG_COUNTRY)
 		{
-			ipCache.makeNewest(item);
-			int found = what & item->info.known;
-			if (found & IPInfo::FLAG_COUNTRY)
-			{
-				result.country = item->info.country;
-				result.countryCode = item->info.countryCode;
-			}
-			if (found & IPInfo::FLAG_LOCATION)
-			{
-				result.location = item->info.location;
-				result.locationImage = item->info.locationImage;
-			}
-			if (found & IPInfo::FLAG_P2P_GUARD)
-				result.p2pGuard = item->info.p2pGuard;
-			result.known |= found;
-			what &= ~found;
-			if (!what) return;
+			storedItem->info.known |= IPInfo::FLAG_COUNTRY;
+			storedItem->info.country = info.country;
+			storedItem->info.countryCode = info.countryCode;
+		}
+		if (info.known & IPInfo::FLAG_LOCATION)
+		{
+			storedItem->info.known |= IPInfo::FLAG_LOCATION;
+			storedItem->info.location = info.location;
+			storedItem->info.locationImage = info.locationImage;
+		}
+		if (info.known & IPInfo::FLAG_P2P_GUARD)
+		{
+			storedItem->info.known |= IPInfo::FLAG_P2P_GUARD;
+			storedItem->info.p2pGuard = info.p2pGuard;
 		}
 	}
-	if (onlyCached) return;
+	shard.cache.removeOldest(IP_CACHE_SHARD_SIZE + 1);
+}
+
+static void findIpRange(const IpRangeTable& table, int what, Ip4Address ip, IPInfo& result)
+{
+	const IpRangeTable::Entry* entry = table.find(ip);
+	if (what == IPInfo::FLAG_LOCATION)
+	{
+		result.clearLocation();
+		if (entry)
+		{
+			result.location = entry->text;
+			result.locationImage = entry->image;
+		}
+	}
+	else
+	{
+		result.p2pGuard.clear();
+		if (entry)
+			result.p2pGuard = entry->text;
+	}
+	result.known |= what;
+}
+
+static inline void makeIpKey(IpKey& ipKey, const IpAddress& ip)
+{
+	if (ip.type == AF_INET6)
+		ipKey.setIP(ip.data.v6);
+	else
+		ipKey.setIP(ip.data.v4);
+}
+
+void DatabaseManager::getIPInfo(DatabaseConnection* conn, const IpAddress& ip, IPInfo& result, int what, bool onlyCached)
+{
+	dcassert(what);
+	dcassert(Util::isValidIp(ip));
+	IpKey ipKey;
+	makeIpKey(ipKey, ip);
+
+	what &= ~getCachedIPInfo(ipKey, result, what);
+	if (!what || onlyCached) return;
 	if (what & IPInfo::FLAG_COUNTRY)
 	{
 		result.clearCountry();
@@ -1504,11 +1632,17 @@ void DatabaseManager::getIPInfo(DatabaseConnection* conn, const IpAddress& ip, I
 		else
 			result.known |= IPInfo::FLAG_COUNTRY;
 	}
+	std::shared_ptr<const IpRangeTable> locations, p2pGuard;
+	if ((what & (IPInfo::FLAG_LOCATION | IPInfo::FLAG_P2P_GUARD)) && ip.type == AF_INET)
+		getIpRanges(locations, p2pGuard);
 	if (what & IPInfo::FLAG_LOCATION)
 	{
 		if ((options & DatabaseOptions::USE_CUSTOM_LOCATIONS) && ip.type == AF_INET)
 		{
-			if (conn) conn->loadLocation(ip.data.v4, result);
+			if (locations)
+				findIpRange(*locations, IPInfo::FLAG_LOCATION, ip.data.v4, result);
+			else if (conn)
+				conn->loadLocation(ip.data.v4, result);
 		}
 		else
 			result.known |= IPInfo::FLAG_LOCATION;
@@ -1517,45 +1651,174 @@ void DatabaseManager::getIPInfo(DatabaseConnection* conn, const IpAddress& ip, I
 	{
 		if (ip.type == AF_INET)
 		{
-			if (conn) conn->loadP2PGuard(ip.data.v4, result);
+			if (p2pGuard)
+				findIpRange(*p2pGuard, IPInfo::FLAG_P2P_GUARD, ip.data.v4, result);
+			else if (conn)
+				conn->loadP2PGuard(ip.data.v4, result);
 		}
 		else
 			result.known |= IPInfo::FLAG_P2P_GUARD;
 	}
-	LOCK(csIpCache);
-	IpCacheItem* storedItem;
-	IpCacheItem newItem;
-	newItem.info = result;
-	newItem.key = ipKey;
-	if (!ipCache.add(newItem, &storedItem))
+	storeIPInfo(ipKey, result);
+}
+
+void DatabaseManager::getIPInfo(DatabaseConnection* conn, const vector<IpAddress>& ips, vector<IPInfo>& results, int what, bool onlyCached)
+{
+	dcassert(what);
+	results.clear();
+	results.resize(ips.size());
+
+	struct Item
 	{
-		if (result.known & IPInfo::FLAG_COUNTRY)
+		IpKey key;
+		size_t index;
+		int missing;
+	};
+
+	vector<Item> items;
+	vector<size_t> firstIndex(ips.size());
+	boost::unordered_map<IpKey, size_t> indexMap;
+	items.reserve(ips.size());
+	indexMap.reserve(ips.size());
+	for (size_t i = 0; i < ips.size(); ++i)
+	{
+		const IpAddress& ip = ips[i];
+		dcassert(Util::isValidIp(ip));
+		Item item;
+		makeIpKey(item.key, ip);
+		auto p = indexMap.insert(std::make_pair(item.key, i));
+		firstIndex[i] = p.first->second;
+		if (!p.second) continue;
+		item.index = i;
+		item.missing = what & ~getCachedIPInfo(item.key, results[i], what);
+		if (item.missing) items.push_back(item);
+	}
+
+	if (!onlyCached && !items.empty())
+	{
+		const int useLocations = options & DatabaseOptions::USE_CUSTOM_LOCATIONS;
+		std::shared_ptr<const IpRangeTable> locations, p2pGuard;
+		getIpRanges(locations, p2pGuard);
+		vector<IPInfoQuery> queries;
+		bool geoIPLocked = false;
+		bool geoIPAvailable = false;
+		for (const Item& item : items)
 		{
-			storedItem->info.known |= IPInfo::FLAG_COUNTRY;
-			storedItem->info.country = result.country;
-			storedItem->info.countryCode = result.countryCode;
+			const IpAddress& ip = ips[item.index];
+			IPInfo& result = results[item.index];
+			if (item.missing & IPInfo::FLAG_COUNTRY)
+			{
+				result.clearCountry();
+				if (Util::isPublicIp(ip))
+				{
+					// Resolve all countries under a single lock
+					if (!geoIPLocked)
+					{
+						csMmdb.lock();
+						geoIPLocked = true;
+						geoIPAvailable = openGeoIPDatabaseL();
+					}
+					if (geoIPAvailable)
+						loadGeoIPInfoL(ip, result);
+				}
+				else
+					result.known |= IPInfo::FLAG_COUNTRY;
+			}
+			int queryFlags = 0;
+			if (ip.type == AF_INET)
+			{
+				if (useLocations && (item.missing & IPInfo::FLAG_LOCATION))
+				{
+					if (locations)
+						findIpRange(*locations, IPInfo::FLAG_LOCATION, ip.data.v4, result);
+					else
+						queryFlags |= IPInfo::FLAG_LOCATION;
+				}
+				if (item.missing & IPInfo::FLAG_P2P_GUARD)
+				{
+					if (p2pGuard)
+						findIpRange(*p2pGuard, IPInfo::FLAG_P2P_GUARD, ip.data.v4, result);
+					else
+						queryFlags |= IPInfo::FLAG_P2P_GUARD;
+				}
+			}
+			result.known |= item.missing & ~queryFlags & (IPInfo::FLAG_LOCATION | IPInfo::FLAG_P2P_GUARD);
+			if (queryFlags && conn)
+				queries.push_back(IPInfoQuery{ ip.data.v4, queryFlags, &result });
 		}
-		if (result.known & IPInfo::FLAG_LOCATION)
+		if (geoIPLocked) csMmdb.unlock();
+		if (!queries.empty()) conn->loadIPInfo(queries);
+		for (const Item& item : items)
+			storeIPInfo(item.key, results[item.index]);
+	}
+
+	for (size_t i = 0; i < ips.size(); ++i)
+		if (firstIndex[i] != i)
+			results[i] = results[firstIndex[i]];
+}
+
+void DatabaseManager::getIpRanges(std::shared_ptr<const IpRangeTable>& locations, std::shared_ptr<const IpRangeTable>& p2pGuard) const
+{
+	LOCK(csIpRanges);
+	locations = locationRanges;
+	p2pGuard = p2pGuardRanges;
+}
+
+void DatabaseManager::reloadIpRanges(int what) noexcept
+{
+	// A job that has not started yet will pick up the new flags
+	if (pendingIpRanges.fetch_or(what)) return;
+	LoadIpRangesJob* job = new LoadIpRangesJob;
+	if (!backgroundThread.addJob(job))
+	{
+		delete job;
+		// No job will consume the flags, let the next call queue a new one
+		pendingIpRanges.store(0);
+	}
+}
+
+void DatabaseManager::LoadIpRangesJob::run()
+{
+	auto db = DatabaseManager::getInstance();
+	int what = db->pendingIpRanges.exchange(0);
+	if (!what) return;
+	std::shared_ptr<IpRangeTable> locations, p2pGuard;
+	auto conn = db->getConnection();
+	if (conn)
+	{
+		if (what & IPInfo::FLAG_LOCATION)
 		{
-			storedItem->info.known |= IPInfo::FLAG_LOCATION;
-			storedItem->info.location = result.location;
-			storedItem->info.locationImage = result.locationImage;
+			locations = std::make_shared<IpRangeTable>();
+			if (!conn->loadIpRanges(IPInfo::FLAG_LOCATION, *locations))
+				locations.reset();
 		}
-		if (result.known & IPInfo::FLAG_P2P_GUARD)
+		if (what & IPInfo::FLAG_P2P_GUARD)
 		{
-			storedItem->info.known |= IPInfo::FLAG_P2P_GUARD;
-			storedItem->info.p2pGuard = result.p2pGuard;
+			p2pGuard = std::make_shared<IpRangeTable>();
+			if (!conn->loadIpRanges(IPInfo::FLAG_P2P_GUARD, *p2pGuard))
+				p2pGuard.reset();
 		}
+		db->putConnection(conn);
+	}
+	// Without a connection the stale tables are dropped as well
+	{
+		// Tables that failed to load are dropped, lookups fall back to SQLite
+		LOCK(db->csIpRanges);
+		if (what & IPInfo::FLAG_LOCATION)
+			db->locationRanges = std::move(locations);
+		if (what & IPInfo::FLAG_P2P_GUARD)
+			db->p2pGuardRanges = std::move(p2pGuard);
 	}
-	ipCache.removeOldest(IP_CACHE_SIZE + 1);
+	db->clearIpCache();
 }
 
 void DatabaseManager::clearCachedP2PGuardData(Ip4Address ip)
 {
 	IpKey ipKey;
 	ipKey.setIP(ip);
-	LOCK(csIpCache);
-	IpCacheItem* item = ipCache.get(ipKey);
+	IpCacheShard& shard = getIpCacheShard(ipKey);
+	LOCK(shard.cs);
+	IpCacheItem* item = shard.cache.get(ipKey);
 	if (item)
 	{
 		item->info.known &= ~IPInfo::FLAG_P2P_GUARD;
@@ -1565,8 +1828,11 @@ void DatabaseManager::clearCachedP2PGuardData(Ip4Address ip)
 
 void DatabaseManager::clearIpCache()
 {
-	LOCK(csIpCache);
-	ipCache.clear();
+	for (size_t i = 0; i < IP_CACHE_SHARDS; ++i)
+	{
+		LOCK(ipCache[i].cs);
+		ipCache[i].cache.clear();
+	}
 }
 
 #ifdef BL_FEATURE_IP_DATABASE
@@ -1961,6 +2227,11 @@ bool DatabaseManager::loadGeoIPInfo(const IpAddress& ip, IPInfo& result) noexcep
 {
 	LOCK(csMmdb);
 	if (!openGeoIPDatabaseL()) return false;
+	return loadGeoIPInfoL(ip, result);
+}
+
+bool DatabaseManager::loadGeoIPInfoL(const IpAddress& ip, IPInfo& result) noexcept
+{
 	sockaddr_u sa;
 	socklen_t size;
 	toSockAddr(sa, size, ip, 0);
@@ -19,6 +19,7 @@
 #include "CID.h"
 #include "IpAddress.h"
 #include "IpKey.h"
+#include "IpList.h"
 #include "JobExecutor.h"
 #include "HttpClientListener.h"
 #include "HashDatabaseLMDB.h"
@@ -72,6 +73,33 @@ struct LocationInfo
 		location(location), startIp(startIp), endIp(endIp), imageIndex(imageIndex) {}
 };
 
+// Custom locations or P2P guard ranges compiled into a sorted array
+struct IpRangeTable
+{
+	struct Entry
+	{
+		string text;
+		int image;
+	};
+
+	IpList ranges;
+	vector<Entry> entries;
+
+	const Entry* find(Ip4Address ip) const
+	{
+		uint64_t index;
+		if (!ranges.find(ip, index)) return nullptr;
+		return &entries[index];
+	}
+};
+
+struct IPInfoQuery
+{
+	Ip4Address ip;
+	int what;
+	IPInfo* result;
+};
+
 struct TransferHistorySummary
 {
 	time_t date;
@@ -169,6 +197,8 @@ class DatabaseConnection
 		void clearRegistry(DBRegistryType type, int64_t tick);
 		void loadLocation(Ip4Address ip, IPInfo& result);
 		void loadP2PGuard(Ip4Address ip, IPInfo& result);
+		void loadIPInfo(vector<IPInfoQuery>& queries);
+		bool loadIpRanges(int what, IpRangeTable& table);
 		void saveLocation(const vector<LocationInfo>& data);
 		void saveP2PGuardData(const vector<P2PGuardData>& data, int type, bool removeOld);
 		void clearP2PGuardData(int type);
@@ -306,8 +336,10 @@ class DatabaseManager : public Singleton<DatabaseManager>, public HttpClientList
 		};
 
 		void getIPInfo(DatabaseConnection* conn, const IpAddress& ip, IPInfo& result, int what, bool onlyCached);
+		void getIPInfo(DatabaseConnection* conn, const vector<IpAddress>& ips, vector<IPInfo>& results, int what, bool onlyCached);
 		void clearCachedP2PGuardData(Ip4Address ip);
 		void clearIpCache();
+		void reloadIpRanges(int what) noexcept;
 		void downloadGeoIPDatabase(uint64_t timestamp, bool force, const string &url) noexcept;
 
 		enum
@@ -324,6 +356,7 @@ class DatabaseManager : public Singleton<DatabaseManager>, public HttpClientList
 		bool openGeoIPDatabaseL() noexcept;
 		void closeGeoIPDatabaseL() noexcept;
 		bool loadGeoIPInfo(const IpAddress& ip, IPInfo& result) noexcept;
+		bool loadGeoIPInfoL(const IpAddress& ip, IPInfo& result) noexcept;
 		void processDownloadResult(uint64_t reqId, const string& text, bool isError) noexcept;
 		void clearDownloadRequest(bool isRetry, int newStatus) noexcept;
 		uint64_t getGeoIPTimestamp() const noexcept;
@@ -378,7 +411,8 @@ class DatabaseManager : public Singleton<DatabaseManager>, public HttpClientList
 		CriticalSection csDownloadMmdb;
 
 	private:
-		static const size_t IP_CACHE_SIZE = 3000;
+		static const size_t IP_CACHE_SHARDS = 16;
+		static const size_t IP_CACHE_SHARD_SIZE = 2048;
 
 		struct IpCacheItem
 		{
@@ -388,8 +422,29 @@ class DatabaseManager : public Singleton<DatabaseManager>, public HttpClientList
 			IpCacheItem* prev;
 		};
 
-		LruCacheEx<IpCacheItem, IpKey> ipCache;
-		mutable FastCriticalSection csIpCache;
+		struct IpCacheShard
+		{
+			LruCacheEx<IpCacheItem, IpKey> cache;
+			FastCriticalSection cs;
+		};
+
+		IpCacheShard ipCache[IP_CACHE_SHARDS];
+
+		IpCacheShard& getIpCacheShard(const IpKey& key);
+		int getCachedIPInfo(const IpKey& key, IPInfo& result, int what);
+		void storeIPInfo(const IpKey& key, const IPInfo& info);
+
+		std::shared_ptr<const IpRangeTable> locationRanges;
+		std::shared_ptr<const IpRangeTable> p2pGuardRanges;
+		mutable FastCriticalSection csIpRanges;
+		std::atomic_int pendingIpRanges;
+
+		void getIpRanges(std::shared_ptr<const IpRangeTable>& locations, std::shared_ptr<const IpRangeTable>& p2pGuard) const;
+
+		struct LoadIpRangesJob : public JobExecutor::Job
+		{
+			void run() override;
+		};
 
 		struct SaveTransfersJob : public JobExecutor::Job
 		{
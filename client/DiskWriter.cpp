@@ -0,0 +1,256 @@
+#include "stdinc.h"
+#include "DiskWriter.h"
+
+DiskWriter::DiskWriter() : stopFlag(false)
+{
+	event.create();
+	int started = 0;
+	for (int i = 0; i < WORKER_THREADS; ++i)
+	{
+		workers[i].reset(new Worker(this));
+		try
+		{
+			workers[i]->start(0, "DiskWriter");
+			++started;
+		}
+		catch (const ThreadException&)
+		{
+			workers[i].reset();
+			break;
+		}
+	}
+	// Without workers addStream fails and streams write synchronously
+	if (!started) stopFlag = true;
+}
+
+DiskWriter::~DiskWriter()
+{
+	cs.lock();
+	stopFlag = true;
+	event.notify();
+	cs.unlock();
+	for (int i = 0; i < WORKER_THREADS; ++i)
+		if (workers[i]) workers[i]->join();
+
+	// Streams still waiting must not be left with pending data
+	for (AsyncOutputStream* stream : readyQueue)
+		while (stream->processNext()) {}
+	readyQueue.clear();
+}
+
+bool DiskWriter::addStream(AsyncOutputStream* stream) noexcept
+{
+	LOCK(cs);
+	if (stopFlag) return false;
+	readyQueue.push_back(stream);
+	event.notify();
+	return true;
+}
+
+int DiskWriter::Worker::run()
+{
+	for (;;)
+	{
+		AsyncOutputStream* stream = nullptr;
+		dw->cs.lock();
+		if (dw->stopFlag)
+		{
+			dw->cs.unlock();
+			break;
+		}
+		if (!dw->readyQueue.empty())
+		{
+			stream = dw->readyQueue.front();
+			dw->readyQueue.pop_front();
+		}
+		else
+			dw->event.reset();
+		dw->cs.unlock();
+		if (!stream)
+		{
+			dw->event.wait();
+			continue;
+		}
+		// Write one buffer at a time so that a slow file doesn't hold up other downloads
+		if (stream->processNext())
+		{
+			LOCK(dw->cs);
+			dw->readyQueue.push_back(stream);
+		}
+	}
+	return 0;
+}
+
+AsyncOutputStream::AsyncOutputStream(OutputStream* os, size_t bufSize) :
+	s(os), bufSize(bufSize), scheduled(false), hasError(false), writtenBytes(0)
+{
+	dcassert(bufSize > 0);
+	current.data = nullptr;
+	current.size = 0;
+	event.create();
+}
+
+AsyncOutputStream::~AsyncOutputStream()
+{
+	// Write the remaining data in order not to lose bytes when a download
+	// is disconnected prematurely
+	if (current.size)
+		submit(false);
+	waitQueue(0);
+	try
+	{
+		if (!hasError)
+			s->flushBuffers(true);
+	}
+	catch (const Exception&)
+	{
+	}
+	delete s;
+	delete[] current.data;
+	for (const Buffer& buf : queue)
+		delete[] buf.data;
+	for (uint8_t* data : freeBuffers)
+		delete[] data;
+}
+
+uint8_t* AsyncOutputStream::getBuffer()
+{
+	{
+		LOCK(cs);
+		if (!freeBuffers.empty())
+		{
+			uint8_t* data = freeBuffers.back();
+			freeBuffers.pop_back();
+			return data;
+		}
+	}
+	return new uint8_t[bufSize];
+}
+
+size_t AsyncOutputStream::write(const void* wbuf, size_t len)
+{
+	checkError();
+	const uint8_t* b = static_cast<const uint8_t*>(wbuf);
+	size_t result = len;
+	while (len > 0)
+	{
+		if (!current.data)
+			current.data = getBuffer();
+		size_t n = std::min(bufSize - current.size, len);
+		memcpy(current.data + current.size, b, n);
+		b += n;
+		current.size += n;
+		len -= n;
+		if (current.size == bufSize)
+			submit(true);
+	}
+	return result;
+}
+
+size_t AsyncOutputStream::flushBuffers(bool force)
+{
+	if (current.size)
+		submit(false);
+	waitQueue(0);
+	checkError();
+	return s->flushBuffers(force);
+}
+
+void AsyncOutputStream::submit(bool wait)
+{
+	bool schedule = false;
+	cs.lock();
+	queue.push_back(current);
+	if (!scheduled && !hasError)
+		scheduled = schedule = true;
+	cs.unlock();
+	current.data = nullptr;
+	current.size = 0;
+	if (schedule && !(DiskWriter::isValidInstance() && DiskWriter::getInstance()->addStream(this)))
+	{
+		// No writer threads, do it ourselves
+		while (processNext()) {}
+	}
+	if (wait)
+	{
+		waitQueue(MAX_QUEUED_BUFFERS);
+		checkError();
+	}
+}
+
+void AsyncOutputStream::waitQueue(size_t maxSize) noexcept
+{
+	for (;;)
+	{
+		cs.lock();
+		if (hasError || (maxSize ? queue.size() <= maxSize : !scheduled))
+		{
+			cs.unlock();
+			break;
+		}
+		event.reset();
+		cs.unlock();
+		event.wait();
+	}
+}
+
+int64_t AsyncOutputStream::getWrittenBytes()
+{
+	LOCK(cs);
+	return writtenBytes;
+}
+
+void AsyncOutputStream::checkError()
+{
+	LOCK(cs);
+	if (hasError)
+		throw FileException(error);
+}
+
+bool AsyncOutputStream::processNext() noexcept
+{
+	Buffer buf;
+	cs.lock();
+	if (queue.empty() || hasError)
+	{
+		scheduled = false;
+		event.notify();
+		cs.unlock();
+		return false;
+	}
+	buf = queue.front();
+	queue.pop_front();
+	cs.unlock();
+
+	string errorText;
+	bool failed = false;
+	try
+	{
+		s->write(buf.data, buf.size);
+	}
+	catch (const Exception& e)
+	{
+		errorText = e.getError();
+		failed = true;
+	}
+
+	LOCK(cs);
+	freeBuffers.push_back(buf.data);
+	if (failed)
+	{
+		hasError = true;
+		error = std::move(errorText);
+		for (const Buffer& b : queue)
+			freeBuffers.push_back(b.data);
+		queue.clear();
+	}
+	else
+		writtenBytes += buf.size;
+	event.notify();
+	if (queue.empty() || hasError)
+	{
+		scheduled = false;
+		return false;
+	}
+	return true;
+}
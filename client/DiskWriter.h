@@ -0,0 +1,95 @@
+#ifndef DISK_WRITER_H_
+#define DISK_WRITER_H_
+
+#include "Streams.h"
+#include "Thread.h"
+#include "Locks.h"
+#include "WaitableEvent.h"
+#include "Singleton.h"
+#include <deque>
+#include <memory>
+
+class AsyncOutputStream;
+
+// Worker threads writing downloaded data to disk
+class DiskWriter : public Singleton<DiskWriter>
+{
+	public:
+		static const int WORKER_THREADS = 2;
+
+		DiskWriter();
+		~DiskWriter();
+
+	private:
+		friend class Singleton<DiskWriter>;
+		friend class AsyncOutputStream;
+
+		class Worker : public Thread
+		{
+			public:
+				explicit Worker(DiskWriter* dw) : dw(dw) {}
+
+			protected:
+				virtual int run() override;
+
+			private:
+				DiskWriter* const dw;
+		};
+
+		bool addStream(AsyncOutputStream* stream) noexcept;
+
+		CriticalSection cs;
+		std::deque<AsyncOutputStream*> readyQueue;
+		WaitableEvent event;
+		bool stopFlag;
+		std::unique_ptr<Worker> workers[WORKER_THREADS];
+};
+
+// Collects data in large buffers which are written to the underlying stream
+// by DiskWriter. The number of buffers waiting to be written is limited;
+// write() blocks when the limit is reached.
+// Write errors are reported by the next call to write() or flushBuffers().
+class AsyncOutputStream : public OutputStream
+{
+	public:
+		static const size_t MAX_QUEUED_BUFFERS = 4;
+
+		AsyncOutputStream(OutputStream* os, size_t bufSize);
+		~AsyncOutputStream();
+
+		size_t write(const void* buf, size_t len) override;
+		size_t flushBuffers(bool force) override;
+
+		// Bytes successfully written to the underlying stream
+		int64_t getWrittenBytes();
+
+	private:
+		friend class DiskWriter;
+
+		struct Buffer
+		{
+			uint8_t* data;
+			size_t size;
+		};
+
+		OutputStream* const s;
+		const size_t bufSize;
+		Buffer current;
+
+		CriticalSection cs;
+		std::deque<Buffer> queue;
+		std::vector<uint8_t*> freeBuffers;
+		bool scheduled;
+		bool hasError;
+		int64_t writtenBytes;
+		string error;
+		WaitableEvent event;
+
+		uint8_t* getBuffer();
+		void submit(bool wait);
+		void waitQueue(size_t maxSize) noexcept;
+		void checkError();
+		bool processNext() noexcept;
+};
+
+#endif // DISK_WRITER_H_
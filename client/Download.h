@@ -12,6 +12,8 @@
  * Use it to retrieve information about the ongoing transfer.
  */
 class AdcCommand;
+class AsyncOutputStream;
+
 class Download : public Transfer, public Flags
 {
 	public:
@@ -75,6 +77,17 @@ class Download : public Transfer, public Flags
 			return downloadFile;
 		}
 
+		/** Set when the data goes to disk through AsyncOutputStream, which is owned by the download file chain */
+		void setAsyncFile(AsyncOutputStream* file)
+		{
+			asyncFile = file;
+		}
+
+		AsyncOutputStream* getAsyncFile()
+		{
+			return asyncFile;
+		}
+
 		GETSET(string, reasonText, ReasonText);
 		GETSET(int, reasonCode, ReasonCode);
 #ifdef DEBUG_TRANSFERS
@@ -85,6 +98,7 @@ class Download : public Transfer, public Flags
 		{
 			delete downloadFile;
 			downloadFile = nullptr;
+			asyncFile = nullptr;
 		}
 
 		int64_t getDownloadedBytes() const;
@@ -92,6 +106,7 @@ class Download : public Transfer, public Flags
 
 	private:
 		OutputStream* downloadFile;
+		AsyncOutputStream* asyncFile = nullptr;
 		const QueueItemPtr qi;
 		TigerTree tigerTree;
 		string fileListBuffer;
@@ -24,16 +24,25 @@
 #include "QueueManager.h"
 #include "Download.h"
 #include "MerkleCheckOutputStream.h"
+#include "DiskWriter.h"
 #include "UploadManager.h"
 #include "IpTrust.h"
 #include "MappingManager.h"
 #include "ZUtils.h"
 #include "FilteredFile.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 int64_t DownloadManager::g_runningAverage;
 
-DownloadManager::DownloadManager() : csDownloads(RWLock::create())
+static Metrics::Counter metricDownloadsOk("transfers_total{dir=\"download\",result=\"ok\"}", "Finished transfers (segments, lists and trees)");
+static Metrics::Counter metricDownloadsFailed("transfers_total{dir=\"download\",result=\"failed\"}", "Finished transfers (segments, lists and trees)");
+static Metrics::Callback metricDownloadsActive("transfers_active{dir=\"download\"}", "Running transfers", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return DownloadManager::isValidInstance() ? DownloadManager::getInstance()->getDownloadCount() : 0; });
+static Metrics::Callback metricDownloadSpeed("transfer_speed_bytes{dir=\"download\"}", "Average transfer speed in bytes per second", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return DownloadManager::getRunningAverage(); });
+
+DownloadManager::DownloadManager() : csDownloads(RWLock::create("DownloadManager::csDownloads"))
 {
 	updateSettings();
 	TimerManager::getInstance()->addListener(this);
@@ -297,17 +306,29 @@ void DownloadManager::startData(UserConnection* source, int64_t start, int64_t b
 		return;
 	}
 	
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	int64_t bufSize = (int64_t) ss->getInt(Conf::BUFFER_SIZE_FOR_DOWNLOADS) << 10;
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	int64_t bufSize = (int64_t) ss.getInt(Conf::BUFFER_SIZE_FOR_DOWNLOADS) << 10;
 
 	dcassert(bufSize > 0);
 	if (bufSize <= 0 || bufSize > 8192 * 1024)
 		bufSize = 1024 * 1024;
 	try
 	{
-		if (d->getType() == Transfer::TYPE_FILE || d->getType() == Transfer::TYPE_FULL_LIST)
+		if (d->getType() == Transfer::TYPE_FILE)
+		{
+			// Tree check and disk writes are done by DiskWriter, not by the socket thread
+			if (d->getTigerTree().getFileSize())
+			{
+				typedef MerkleCheckOutputStream<TigerTree, true> MerkleStream;
+				d->setDownloadFile(new MerkleStream(d->getTigerTree(), d->getDownloadFile(), d->getStartPos()));
+				d->setFlag(Download::FLAG_TTH_CHECK);
+			}
+			const int64_t fileSize = d->getSize();
+			auto file = new AsyncOutputStream(d->getDownloadFile(), (size_t) std::max<int64_t>(std::min(fileSize, bufSize), 1));
+			d->setDownloadFile(file);
+			d->setAsyncFile(file);
+		}
+		else if (d->getType() == Transfer::TYPE_FULL_LIST)
 		{
 			const int64_t fileSize = d->getSize();
 			auto file = new BufferedOutputStream<true>(d->getDownloadFile(), std::min(fileSize, bufSize));
@@ -320,13 +341,6 @@ void DownloadManager::startData(UserConnection* source, int64_t start, int64_t b
 		return;
 	}
 	
-	if (d->getType() == Transfer::TYPE_FILE && d->getTigerTree().getFileSize())
-	{
-		typedef MerkleCheckOutputStream<TigerTree, true> MerkleStream;
-		d->setDownloadFile(new MerkleStream(d->getTigerTree(), d->getDownloadFile(), d->getStartPos()));
-		d->setFlag(Download::FLAG_TTH_CHECK);
-	}
-	
 	// Check that we don't get too many bytes
 	d->setDownloadFile(new LimitedOutputStream(d->getDownloadFile(), bytes));
 	
@@ -357,6 +371,7 @@ void DownloadManager::startData(UserConnection* source, int64_t start, int64_t b
 	}
 	else
 	{
+		source->setThrottlePriority(d->getType() == Transfer::TYPE_FILE ? TokenBucket::PRIORITY_NORMAL : TokenBucket::PRIORITY_HIGH);
 		source->setDataMode();
 	}
 }
@@ -407,6 +422,7 @@ void DownloadManager::endData(UserConnection* source)
 		{
 			// This tree is for a different file, remove from queue
 			d->getTigerTree().setFileSize(0);
+			metricDownloadsFailed.inc();
 			removeDownload(d);
 			fire(DownloadManagerListener::Failed(), d, STRING(INVALID_TREE));
 			
@@ -439,6 +455,7 @@ void DownloadManager::endData(UserConnection* source)
 		dcdebug("Download finished: %s, size " I64_FMT ", pos: " I64_FMT "\n", d->getPath().c_str(), d->getSize(), d->getPos());
 	}
 
+	metricDownloadsOk.inc();
 	removeDownload(d);
 	QueueManager::getInstance()->putDownload(d, true, false);
 
@@ -472,6 +489,7 @@ void DownloadManager::failDownload(UserConnection* source, const string& reason,
 	auto d = source->getDownload();
 	if (d)
 	{
+		metricDownloadsFailed.inc();
 		removeDownload(d);
 		fire(DownloadManagerListener::Failed(), d, reason);
 		d->setReasonCode(Download::REASON_CODE_CONNECTION_FAILURE);
@@ -504,6 +522,9 @@ void DownloadManager::removeDownload(const DownloadPtr& d)
 			catch (const Exception&) {}
 #endif
 		}
+		// Data queued after a failed write is dropped, only the written part can be saved as a segment
+		if (d->getAsyncFile())
+			d->truncatePos(d->getAsyncFile()->getWrittenBytes());
 	}
 
 	{
@@ -534,13 +555,13 @@ void DownloadManager::abortDownload(const string& target)
 /** @todo Handle errors better */
 void DownloadManager::processSTA(UserConnection* source, const AdcCommand& cmd) noexcept
 {
-	if (cmd.getParameters().size() < 2)
+	if (cmd.getParamCount() < 2)
 	{
 		source->disconnect();
 		return;
 	}
 	
-	const string& err = cmd.getParameters()[0];
+	const string& err = cmd.getParam(0);
 	if (err.length() != 3)
 	{
 		source->disconnect();
@@ -578,6 +599,7 @@ void DownloadManager::fileNotAvailable(UserConnection* source)
 	dcassert(d);
 	dcdebug("File Not Available: %s\n", d->getPath().c_str());
 	
+	metricDownloadsFailed.inc();
 	removeDownload(d);
 	fire(DownloadManagerListener::Failed(), d, STRING(FILE_NOT_AVAILABLE));
 	
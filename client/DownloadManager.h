@@ -23,13 +23,14 @@
 #include "QueueItem.h"
 #include "TimerManager.h"
 #include "Singleton.h"
+#include "SnapshotSpeaker.h"
 
 /**
  * Singleton. Use its listener interface to update the download list
  * in the user interface.
  */
 
-class DownloadManager : public Speaker<DownloadManagerListener>,
+class DownloadManager : public SnapshotSpeaker<DownloadManagerListener>,
 	private TimerManagerListener,
 	public Singleton<DownloadManager>
 {
@@ -81,4 +81,7 @@
 
 #define USE_QUEUE_RWLOCK
 
+// Collect wait and hold times of named locks, see LockProfiler.h
+// #define LOCK_PROFILER
+
 #endif // FEATURE_DEF_H_
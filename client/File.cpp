@@ -33,6 +33,10 @@
 #include <unistd.h>
 #include <fnmatch.h>
 #include <sys/statvfs.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 #ifdef _DARWIN_C_SOURCE
 #define st_mtim st_mtimespec
 #endif
@@ -74,6 +78,19 @@ void File::setSize(int64_t newSize)
 	setPos(pos);
 }
 
+void File::preallocate(int64_t newSize)
+{
+#ifdef _WIN32
+	FILE_ALLOCATION_INFO info;
+	info.AllocationSize.QuadPart = newSize;
+	SetFileInformationByHandle(h, FileAllocationInfo, &info, sizeof(info));
+#elif defined(__linux__)
+	if (newSize > getSize() && fallocate(h, 0, 0, newSize) == 0)
+		return;
+#endif
+	setSize(newSize);
+}
+
 #ifdef _WIN32
 File::File(const wstring& fileName, int access, int mode, bool isAbsolutePath, int perm)
 {
@@ -276,25 +293,35 @@ bool File::deleteFile(const string& fileName) noexcept
 	return deleteFile(Text::utf8ToWide(fileName));
 }
 
-bool File::renameFile(const wstring& source, const wstring& target) noexcept
+static DWORD CALLBACK copyProgressRoutine(LARGE_INTEGER totalFileSize, LARGE_INTEGER totalBytesTransferred,
+	LARGE_INTEGER, LARGE_INTEGER, DWORD, DWORD, HANDLE, HANDLE, LPVOID data)
+{
+	const File::ProgressFunc* progress = static_cast<const File::ProgressFunc*>(data);
+	(*progress)(totalBytesTransferred.QuadPart, totalFileSize.QuadPart);
+	return PROGRESS_CONTINUE;
+}
+
+bool File::renameFile(const wstring& source, const wstring& target, const ProgressFunc* progress) noexcept
 {
-	return MoveFileExW(formatPath(source).c_str(), formatPath(target).c_str(),
+	return MoveFileWithProgressW(formatPath(source).c_str(), formatPath(target).c_str(),
+		progress ? copyProgressRoutine : nullptr, const_cast<ProgressFunc*>(progress),
 		MOVEFILE_COPY_ALLOWED | MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != FALSE;
 }
 
-bool File::renameFile(const string& source, const string& target) noexcept
+bool File::renameFile(const string& source, const string& target, const ProgressFunc* progress) noexcept
 {
-	return renameFile(Text::utf8ToWide(source), Text::utf8ToWide(target));
+	return renameFile(Text::utf8ToWide(source), Text::utf8ToWide(target), progress);
 }
 
-bool File::copyFile(const wstring& source, const wstring& target) noexcept
+bool File::copyFile(const wstring& source, const wstring& target, const ProgressFunc* progress) noexcept
 {
-	return CopyFileW(formatPath(source).c_str(), formatPath(target).c_str(), FALSE) != FALSE;
+	return CopyFileExW(formatPath(source).c_str(), formatPath(target).c_str(),
+		progress ? copyProgressRoutine : nullptr, const_cast<ProgressFunc*>(progress), nullptr, 0) != FALSE;
 }
 
-bool File::copyFile(const string& source, const string& target) noexcept
+bool File::copyFile(const string& source, const string& target, const ProgressFunc* progress) noexcept
 {
-	return copyFile(Text::utf8ToWide(source), Text::utf8ToWide(target));
+	return copyFile(Text::utf8ToWide(source), Text::utf8ToWide(target), progress);
 }
 
 bool File::isExist(const wstring& filename) noexcept
@@ -738,16 +765,65 @@ bool File::deleteFile(const string& fileName) noexcept
 	return unlink(fileName.c_str()) == 0;
 }
 
-bool File::renameFile(const string& source, const string& target) noexcept
+bool File::renameFile(const string& source, const string& target, const ProgressFunc* progress) noexcept
 {
 	if (!rename(source.c_str(), target.c_str())) return true;
 	if (errno != EXDEV) return false;
-	return copyFile(source, target) && deleteFile(source);
+	return copyFile(source, target, progress) && deleteFile(source);
+}
+
+static bool copyFileData(int in, int out, int64_t fileSize, const File::ProgressFunc* progress)
+{
+	static const size_t BUF_SIZE = 1024 * 1024;
+	static const size_t CHUNK_SIZE = 64 * 1024 * 1024;
+#ifdef __linux__
+#ifdef FICLONE
+	// Share the data extents if the file system supports reflinks
+	if (ioctl(out, FICLONE, in) == 0)
+	{
+		if (progress) (*progress)(fileSize, fileSize);
+		return true;
+	}
+#endif
+	// Let the kernel copy the data without moving it through user space
+	int64_t copied = 0;
+	while (true)
+	{
+		ssize_t size = copy_file_range(in, nullptr, out, nullptr, CHUNK_SIZE, 0);
+		if (size < 0)
+		{
+			if (errno == EINTR) continue;
+			if (copied == 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP))
+				break;
+			return false;
+		}
+		if (!size) return true;
+		copied += size;
+		if (progress) (*progress)(copied, fileSize);
+	}
+#endif
+#ifdef POSIX_FADV_SEQUENTIAL
+	posix_fadvise(in, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+	std::unique_ptr<uint8_t[]> buf(new uint8_t[BUF_SIZE]);
+	int64_t total = 0;
+	while (true)
+	{
+		ssize_t size = ::read(in, buf.get(), BUF_SIZE);
+		if (!size) return true;
+		if (size < 0)
+		{
+			if (errno == EINTR) continue;
+			return false;
+		}
+		if (::write(out, buf.get(), size) != size) return false;
+		total += size;
+		if (progress) (*progress)(total, fileSize);
+	}
 }
 
-bool File::copyFile(const string& source, const string& target) noexcept
+bool File::copyFile(const string& source, const string& target, const ProgressFunc* progress) noexcept
 {
-	static const size_t BUF_SIZE = 256 * 1024;
 	int in = open(source.c_str(), O_RDONLY);
 	if (in < 0) return false;
 	struct stat st;
@@ -762,18 +838,7 @@ bool File::copyFile(const string& source, const string& target) noexcept
 		::close(in);
 		return false;
 	}
-	std::unique_ptr<uint8_t[]> buf(new uint8_t[BUF_SIZE]);
-	bool result = false;
-	while (true)
-	{
-		ssize_t size = ::read(in, buf.get(), BUF_SIZE);
-		if (!size)
-		{
-			result = true;
-			break;
-		}
-		if (size < 0 || ::write(out, buf.get(), size) != size) break;
-	}
+	bool result = copyFileData(in, out, st.st_size, progress);
 	int err = errno;
 	::close(in);
 	::close(out);
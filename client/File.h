@@ -21,6 +21,7 @@
 
 #include "typedefs.h"
 #include "BaseStreams.h"
+#include <functional>
 
 #ifdef _WIN32
 #include "w.h"
@@ -69,6 +70,9 @@ class File : public IOStream
 			uint64_t freeBytes;
 		};
 
+		// Called during copying with the number of bytes copied so far and the file size
+		typedef std::function<void(int64_t copied, int64_t total)> ProgressFunc;
+
 		File(const string& fileName, int access, int mode, bool isAbsolutePath = true, int perm = 0644);
 #ifdef _WIN32
 		typedef HANDLE Handle;
@@ -104,6 +108,8 @@ class File : public IOStream
 		void close() noexcept;
 		int64_t getSize() const noexcept;
 		void setSize(int64_t newSize);
+		// Same as setSize, but also reserves disk space if the file system supports it
+		void preallocate(int64_t newSize);
 		uint64_t getTimeStamp() const noexcept;
 
 		int64_t getPos() const noexcept;
@@ -124,8 +130,8 @@ class File : public IOStream
 		static bool getAttributes(const string& filename, FileAttributes& attr) noexcept;
 		static int64_t getSize(const string& fileName) noexcept;
 
-		static bool copyFile(const string& src, const string& target) noexcept;
-		static bool renameFile(const string& source, const string& target) noexcept;
+		static bool copyFile(const string& src, const string& target, const ProgressFunc* progress = nullptr) noexcept;
+		static bool renameFile(const string& source, const string& target, const ProgressFunc* progress = nullptr) noexcept;
 		static bool deleteFile(const string& fileName) noexcept;
 
 #ifdef _WIN32
@@ -146,8 +152,8 @@ class File : public IOStream
 		static bool getAttributes(const wstring& filename, FileAttributes& attr) noexcept;
 		static int64_t getSize(const wstring& fileName) noexcept;
 
-		static bool copyFile(const wstring& src, const wstring& target) noexcept;
-		static bool renameFile(const wstring& source, const wstring& target) noexcept;
+		static bool copyFile(const wstring& src, const wstring& target, const ProgressFunc* progress = nullptr) noexcept;
+		static bool renameFile(const wstring& source, const wstring& target, const ProgressFunc* progress = nullptr) noexcept;
 		static bool deleteFile(const wstring& fileName) noexcept;
 
 		static void ensureDirectory(const wstring& filename) noexcept;
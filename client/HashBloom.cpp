@@ -47,7 +47,8 @@ void HashBloom::add(const TTHValue& tth)
 {
 	for (size_t i = 0; i < k; ++i)
 	{
-		bloom[pos(tth, i)] = true;
+		size_t bit = pos(tth, i, h, m);
+		bloom[bit >> 6] |= (uint64_t) 1 << (bit & 63);
 	}
 }
 
@@ -59,7 +60,8 @@ bool HashBloom::match(const TTHValue& tth) const
 	}
 	for (size_t i = 0; i < k; ++i)
 	{
-		if (!bloom[pos(tth, i)])
+		size_t bit = pos(tth, i, h, m);
+		if (!(bloom[bit >> 6] & (uint64_t) 1 << (bit & 63)))
 		{
 			return false;
 		}
@@ -67,47 +69,94 @@ bool HashBloom::match(const TTHValue& tth) const
 	return true;
 }
 
-void HashBloom::push_back(bool v)
+void HashBloom::reset(size_t k_, size_t m_, size_t h_)
 {
-	bloom.push_back(v);
-}
-
-void HashBloom::reset(size_t k_, size_t m, size_t h_)
-{
-	bloom.resize(m);
+	bloom.assign((m_ + 63) / 64, 0);
 	k = k_;
 	h = h_;
+	m = m_;
 }
 
-size_t HashBloom::pos(const TTHValue& tth, size_t n) const
+size_t HashBloom::pos(const TTHValue& tth, size_t n, size_t h, size_t m)
 {
 	if ((n + 1)*h > TTHValue::BITS)
 	{
 		return 0;
 	}
 	
-	uint64_t x = 0;
-	
+	// Bits are taken starting from the least significant bit of each byte
 	size_t start = n * h;
-	for (size_t i = 0; i < h; ++i)
+	size_t byte = start / 8;
+	size_t shift = start % 8;
+	size_t bytes = std::min<size_t>(8, TTHValue::BYTES - byte);
+	uint64_t x = 0;
+	for (size_t i = 0; i < bytes; ++i)
 	{
-		size_t bit = start + i;
-		size_t byte = bit / 8;
-		size_t pos = bit % 8;
-		
-		if (tth.data[byte] & (1 << pos))
-		{
-			x |= (uint64_t) 1 << i;
-		}
+		x |= (uint64_t) tth.data[byte + i] << (i * 8);
+	}
+	x >>= shift;
+	if (shift + h > 64)
+	{
+		x |= (uint64_t) tth.data[byte + 8] << (64 - shift);
 	}
-	return x % bloom.size();
+	if (h < 64)
+	{
+		x &= ((uint64_t) 1 << h) - 1;
+	}
+	return x % m;
 }
 
 void HashBloom::copy_to(ByteVector& v) const
 {
-	v.resize(bloom.size() / 8);
-	for (size_t i = 0; i < bloom.size(); ++i)
+	v.resize(m / 8);
+	for (size_t i = 0; i < v.size(); ++i)
+	{
+		v[i] = (uint8_t) (bloom[i / 8] >> (i % 8 * 8));
+	}
+}
+
+void CountingHashBloom::add(const TTHValue& tth)
+{
+	for (size_t i = 0; i < k; ++i)
+	{
+		uint8_t& counter = counters[HashBloom::pos(tth, i, h, counters.size())];
+		if (counter != UINT8_MAX) ++counter;
+	}
+}
+
+void CountingHashBloom::add(const TTHValue& tth, size_t first, size_t last)
+{
+	for (size_t i = 0; i < k; ++i)
+	{
+		size_t p = HashBloom::pos(tth, i, h, counters.size());
+		if (p < first || p >= last) continue;
+		uint8_t& counter = counters[p];
+		if (counter != UINT8_MAX) ++counter;
+	}
+}
+
+void CountingHashBloom::remove(const TTHValue& tth)
+{
+	for (size_t i = 0; i < k; ++i)
+	{
+		uint8_t& counter = counters[HashBloom::pos(tth, i, h, counters.size())];
+		dcassert(counter);
+		if (counter && counter != UINT8_MAX) --counter;
+	}
+}
+
+void CountingHashBloom::reset(size_t k_, size_t m, size_t h_)
+{
+	counters.assign(m, 0);
+	k = k_;
+	h = h_;
+}
+
+void CountingHashBloom::copy_to(ByteVector& v) const
+{
+	v.assign(counters.size() / 8, 0);
+	for (size_t i = 0; i < v.size() * 8; ++i)
 	{
-		v[i / 8] |= bloom[i] << (i % 8);
+		if (counters[i]) v[i / 8] |= 1 << (i % 8);
 	}
 }
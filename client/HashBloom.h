@@ -38,24 +38,46 @@
 class HashBloom
 {
 	public:
-		HashBloom() : k(0), h(0) { }
+		HashBloom() : k(0), h(0), m(0) { }
 		
 		/** Return a suitable value for k based on n */
 		static size_t get_k(size_t n, size_t h);
 		/** Optimal number of bits to allocate for n elements when using k hashes */
 		static uint64_t get_m(size_t n, size_t k);
+		/** Position of the bit number n for this TTH */
+		static size_t pos(const TTHValue& tth, size_t n, size_t h, size_t m);
 		
 		void add(const TTHValue& tth);
 		bool match(const TTHValue& tth) const;
 		void reset(size_t k, size_t m, size_t h);
-		void push_back(bool v);
 		
 		void copy_to(ByteVector& v) const;
 	private:
-	
-		size_t pos(const TTHValue& tth, size_t n) const;
-		
-		std::vector<bool> bloom;
+		std::vector<uint64_t> bloom;
+		size_t k;
+		size_t h;
+		size_t m;
+};
+
+/**
+ * Bloom filter with a counter instead of a bit, so that TTH values can be removed.
+ * Counters that reach the maximum value stay there.
+ */
+class CountingHashBloom
+{
+	public:
+		CountingHashBloom() : k(0), h(0) { }
+
+		void add(const TTHValue& tth);
+		void remove(const TTHValue& tth);
+		/** Add tth, only updating counters in range [first, last) */
+		void add(const TTHValue& tth, size_t first, size_t last);
+		void reset(size_t k, size_t m, size_t h);
+		size_t size() const { return counters.size(); }
+
+		void copy_to(ByteVector& v) const;
+	private:
+		std::vector<uint8_t> counters;
 		size_t k;
 		size_t h;
 };
@@ -30,6 +30,7 @@
 #include "FormatUtil.h"
 #include "Util.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 // Return values of fastHash and slowHash
 enum
@@ -40,6 +41,27 @@ enum
 	RESULT_STOPPED
 };
 
+static Metrics::Counter metricHashedBytes("hash_bytes_total", "Bytes read by the hasher");
+static Metrics::Counter metricHashedFiles("hash_files_total", "Files hashed successfully");
+static Metrics::Counter metricHashErrors("hash_errors_total", "Files that could not be hashed");
+
+static Metrics::Callback metricHashQueueFiles("hash_queue_files", "Files waiting to be hashed", Metrics::TYPE_GAUGE,
+	[]() -> int64_t
+	{
+		if (!HashManager::isValidInstance()) return 0;
+		HashManager::Info info;
+		HashManager::getInstance()->getInfo(info);
+		return info.filesLeft;
+	});
+static Metrics::Callback metricHashQueueBytes("hash_queue_bytes", "Bytes waiting to be hashed", Metrics::TYPE_GAUGE,
+	[]() -> int64_t
+	{
+		if (!HashManager::isValidInstance()) return 0;
+		HashManager::Info info;
+		HashManager::getInstance()->getInfo(info);
+		return info.sizeToHash - info.sizeHashed;
+	});
+
 #ifdef _WIN32
 static const uint32_t MAGIC = '++lg';
 static const string g_streamName(".gltth");
@@ -192,6 +214,7 @@ void HashManager::hashDone(uint64_t tick, int64_t fileID, const SharedFilePtr& f
 
 void HashManager::reportError(int64_t fileID, const SharedFilePtr& file, const string& fileName, const string& error)
 {
+	metricHashErrors.inc();
 	LogManager::message(STRING(ERROR_HASHING) + ' ' + fileName + ": " + error);
 	fire(HashManagerListener::HashingError(), fileID, file, fileName);
 }
@@ -388,6 +411,7 @@ int HashManager::Hasher::fastHash(const string& fileName, int64_t fileSize, uint
 			else
 				currentFileRemaining -= rsize;		
 		}
+		metricHashedBytes.inc(rsize);
 
 		fileSize -= rsize;
 		*((uint64_t*) &over.Offset) += rsize;
@@ -459,6 +483,7 @@ int HashManager::Hasher::slowHash(const string& fileName, int64_t fileSize, uint
 			else
 				currentFileRemaining -= size;
 		}
+		metricHashedBytes.inc(size);
 		tree.update(buf, size);
 		fileSize -= size;
 	}
@@ -611,6 +636,7 @@ int HashManager::Hasher::run()
 			{
 				if (mediaInfoFileTypes & currentItem.file->getFileTypes())
 					processMediaFile(currentItem);
+				metricHashedFiles.inc();
 				const uint64_t speed = end > start ? size * 1000 / (end - start) : 0;
 				hashManager->hashDone(end, currentItem.fileID, currentItem.file, filename, tree, speed, size);
 #ifdef _WIN32
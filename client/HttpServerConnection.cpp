@@ -63,6 +63,11 @@ void HttpServerConnection::sendResponse(const Http::Response& resp, const string
 	}
 }
 
+void HttpServerConnection::sendData(const string& data) noexcept
+{
+	if (socket) socket->write(data);
+}
+
 void HttpServerConnection::parseRequestHeader(const string& line) noexcept
 {
 	static const string encodingChunked = "chunked";
@@ -35,6 +35,8 @@ public:
 	uint64_t getID() const { return id; }
 	const string& getRequestBody() const { return requestBody; }
 	void sendResponse(const Http::Response& resp, const string& body, InputStream* data = nullptr) noexcept;
+	// Writes more body data after a response without Content-Length, can be called from any thread
+	void sendData(const string& data) noexcept;
 	void disconnect() noexcept;
 	bool getIp(IpAddress& ip) const noexcept;
 
@@ -72,6 +72,7 @@ void IpGrant::load() noexcept
 		LogManager::message("Could not load IPGrant.ini: " + e.getError(), false);
 		ipList.clear();
 	}
+	ipList.compile();
 }
 
 void IpGrant::clear() noexcept
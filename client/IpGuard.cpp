@@ -61,8 +61,19 @@ void IpGuard::load() noexcept
 		{
 			if (!ipList.addRange(out.start, out.end, 0, result))
 				LogManager::message("Error adding data from IPGuard.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
+			return true;
 		}
-		else if (result != IpList::ERR_LINE_SKIPPED)
+		if (result == IpList::ERR_BAD_FORMAT)
+		{
+			IpList::ParseLineResult6 out6;
+			if (!IpList::parseLine(s, out6))
+			{
+				if (!ipList.addRange(out6.start, out6.end, 0, result))
+					LogManager::message("Error adding data from IPGuard.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
+				return true;
+			}
+		}
+		if (result != IpList::ERR_LINE_SKIPPED)
 			LogManager::message("Error parsing IPGuard.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
 		return true;
 	};
@@ -76,6 +87,7 @@ void IpGuard::load() noexcept
 		LogManager::message("Could not load IPGuard.ini: " + e.getError(), false);
 		ipList.clear();
 	}
+	ipList.compile();
 }
 
 void IpGuard::clear() noexcept
@@ -92,3 +104,31 @@ bool IpGuard::isBlocked(uint32_t addr) const noexcept
 		return !isWhiteList;
 	return isWhiteList;
 }
+
+bool IpGuard::isBlocked(const Ip6Address& addr) const noexcept
+{
+	READ_LOCK(*cs);
+	uint64_t payload;
+	if (ipList.find(addr, payload))
+		return !isWhiteList;
+	// a white list of IPv4 ranges doesn't restrict IPv6 peers
+	return isWhiteList && ipList.hasIp6();
+}
+
+bool IpGuard::isBlocked(const IpAddress& addr) const noexcept
+{
+	if (addr.type == AF_INET)
+		return isBlocked(addr.data.v4);
+	if (addr.type == AF_INET6)
+		return isBlocked(addr.data.v6);
+	return false;
+}
+
+bool IpGuard::isBlocked(const IpAddressEx& addr) const noexcept
+{
+	if (addr.type == AF_INET)
+		return isBlocked(addr.data.v4);
+	if (addr.type == AF_INET6)
+		return isBlocked(static_cast<const Ip6Address&>(addr.data.v6));
+	return false;
+}
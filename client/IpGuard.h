@@ -20,6 +20,7 @@
 #define IPGUARD_H
 
 #include "IpList.h"
+#include "IpAddress.h"
 #include "RWLock.h"
 #include <atomic>
 
@@ -29,6 +30,9 @@ class IpGuard
 		IpGuard();
 		bool isEnabled() const noexcept { return enabled; }
 		bool isBlocked(uint32_t addr) const noexcept;
+		bool isBlocked(const Ip6Address& addr) const noexcept;
+		bool isBlocked(const IpAddress& addr) const noexcept;
+		bool isBlocked(const IpAddressEx& addr) const noexcept;
 		void load() noexcept;
 		void clear() noexcept;
 		void updateSettings() noexcept;
@@ -1,60 +1,173 @@
 #include "stdinc.h"
 #include "IpList.h"
 #include "Ip4Address.h"
+#include <map>
+#include <algorithm>
+#include <iterator>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <arpa/inet.h>
+#endif
 
 bool IpList::addRange(uint32_t start, uint32_t end, uint64_t payload, int& error)
 {
-	Range range;
-	range.end = end;
-	range.payload = payload;
+	if (!keys4.insert(std::make_pair(start, end)).second)
+	{
+		error = ERR_ALREADY_EXISTS;
+		return false;
+	}
+	ranges4.push_back(Range<uint32_t>{start, end, payload});
+	error = 0;
+	return true;
+}
 
-	auto i = m.find(start);
-	if (i != m.end())
+bool IpList::addRange(const Ip6Address& start, const Ip6Address& end, uint64_t payload, int& error)
+{
+	Ip6Key startKey = toKey(start);
+	Ip6Key endKey = toKey(end);
+	if (endKey < startKey)
 	{
-		auto& ranges = i->second;
-		for (const auto& r : ranges)
-			if (r.end == end)
-			{
-				error = ERR_ALREADY_EXISTS;
-				return false;
-			}
-		ranges.push_back(range);
+		error = ERR_BAD_RANGE;
+		return false;
 	}
-	else
+	if (!keys6.insert(std::make_pair(startKey, endKey)).second)
 	{
-		RangeList rangeList = { range };
-		m.insert(std::make_pair(start, rangeList));
+		error = ERR_ALREADY_EXISTS;
+		return false;
 	}
+	ranges6.push_back(Range<Ip6Key>{startKey, endKey, payload});
 	error = 0;
 	return true;
 }
 
-bool IpList::find(uint32_t addr, uint64_t& payload) const
+void IpList::compile()
+{
+	table4.build(ranges4);
+	table6.build(ranges6);
+}
+
+void IpList::releaseRanges()
+{
+	std::vector<Range<uint32_t>>().swap(ranges4);
+	std::vector<Range<Ip6Key>>().swap(ranges6);
+	keys4.clear();
+	keys6.clear();
+}
+
+void IpList::clear()
+{
+	ranges4.clear();
+	ranges6.clear();
+	keys4.clear();
+	keys6.clear();
+	table4.clear();
+	table6.clear();
+}
+
+IpList::Ip6Key IpList::toKey(const Ip6Address& addr)
+{
+	Ip6Key key = { 0, 0 };
+	for (int i = 0; i < 4; ++i)
+		key.hi = key.hi << 16 | ntohs(addr.data[i]);
+	for (int i = 4; i < 8; ++i)
+		key.lo = key.lo << 16 | ntohs(addr.data[i]);
+	return key;
+}
+
+Ip6Address IpList::fromKey(const Ip6Key& key)
+{
+	Ip6Address addr;
+	for (int i = 0; i < 4; ++i)
+		addr.data[i] = htons((uint16_t) (key.hi >> (48 - i*16)));
+	for (int i = 0; i < 4; ++i)
+		addr.data[4 + i] = htons((uint16_t) (key.lo >> (48 - i*16)));
+	return addr;
+}
+
+static inline uint32_t prevAddr(uint32_t addr) { return addr - 1; }
+static inline uint32_t nextAddr(uint32_t addr) { return addr + 1; }
+
+template<typename T>
+static inline T prevAddr(const T& addr)
+{
+	T result = addr;
+	if (!result.lo--) --result.hi;
+	return result;
+}
+
+template<typename T>
+static inline T nextAddr(const T& addr)
+{
+	T result = addr;
+	if (!++result.lo) ++result.hi;
+	return result;
+}
+
+template<typename T>
+void IpList::Table<T>::build(std::vector<Range<T>>& ranges)
 {
-	auto i = m.lower_bound(addr);
-	if ((i == m.cend() || i->first != addr) && i != m.cbegin()) --i;
-	bool result = false;
-	while (i != m.cend())
+	struct Segment
 	{
-		uint32_t start = i->first;
-		if (addr < start) break;
-		uint32_t minRangeLen = 0xFFFFFFFF;
-		const auto& ranges = i->second;
-		for (const auto& range : ranges)
-			if (addr <= range.end)
+		T end;
+		uint64_t payload;
+	};
+
+	// Paint ranges in order of increasing priority, each one overwriting
+	// the parts of the segments it covers
+	std::stable_sort(ranges.begin(), ranges.end(),
+		[](const Range<T>& a, const Range<T>& b)
+		{
+			if (a.start == b.start) return b.end < a.end;
+			return a.start < b.start;
+		});
+	std::map<T, Segment> segments;
+	for (const auto& range : ranges)
+	{
+		auto i = segments.lower_bound(range.start);
+		if (i != segments.begin())
+		{
+			auto prev = std::prev(i);
+			if (range.start <= prev->second.end)
 			{
-				uint32_t rangeLen = range.end - start;
-				if (rangeLen <= minRangeLen)
-				{
-					result = true;
-					minRangeLen = rangeLen;
-					payload = range.payload;
-				}
+				if (range.end < prev->second.end)
+					segments.insert(i, std::make_pair(nextAddr(range.end), Segment{prev->second.end, prev->second.payload}));
+				prev->second.end = prevAddr(range.start);
 			}
-		if (result) break;
-		--i;
+		}
+		while (i != segments.end() && i->first <= range.end)
+		{
+			if (range.end < i->second.end)
+			{
+				Segment tail = i->second;
+				segments.erase(i);
+				i = segments.insert(std::make_pair(nextAddr(range.end), tail)).first;
+				break;
+			}
+			i = segments.erase(i);
+		}
+		segments.insert(i, std::make_pair(range.start, Segment{range.end, range.payload}));
 	}
-	return result;
+
+	clear();
+	starts.reserve(segments.size());
+	ends.reserve(segments.size());
+	payloads.reserve(segments.size());
+	for (const auto& segment : segments)
+	{
+		if (!starts.empty() && payloads.back() == segment.second.payload && nextAddr(ends.back()) == segment.first)
+		{
+			ends.back() = segment.second.end;
+			continue;
+		}
+		starts.push_back(segment.first);
+		ends.push_back(segment.second.end);
+		payloads.push_back(segment.second.payload);
+	}
+	starts.shrink_to_fit();
+	ends.shrink_to_fit();
+	payloads.shrink_to_fit();
 }
 
 static void skipWhiteSpace(const string& s, string::size_type& i)
@@ -79,30 +192,38 @@ static bool isValidMask(uint32_t x)
 	return (x & (x+1)) == 0;
 }
 
-int IpList::parseLine(const std::string& s, IpList::ParseLineResult& res, const IpList::ParseLineOptions* options, string::size_type startPos)
+static int parseLineStart(const string& s, string::size_type& i, char& specialChar, const IpList::ParseLineOptions* options)
 {
-	string::size_type i = startPos;
-	res.start = res.end = startPos;
-	res.pos = startPos;
-	res.specialChar = 0;
+	specialChar = 0;
 	skipWhiteSpace(s, i);
 	if (i == s.length())
-		return ERR_LINE_SKIPPED;
+		return IpList::ERR_LINE_SKIPPED;
 	if (s[i] == '#')
-		return ERR_LINE_SKIPPED;
+		return IpList::ERR_LINE_SKIPPED;
 	if (i + 1 < s.length() && s[i+1] == s[i] && (s[i] == '/' || s[i] == '-'))
-		return ERR_LINE_SKIPPED;
+		return IpList::ERR_LINE_SKIPPED;
 	if (options && options->specialCharCount)
 	{
 		for (int j = 0; j < options->specialCharCount; ++j)
 			if (options->specialChars[j] == s[i])
 			{
-				res.specialChar = s[i];
+				specialChar = s[i];
 				break;
 			}
-		if (res.specialChar && ++i == s.length())
-			return ERR_BAD_FORMAT;
+		if (specialChar && ++i == s.length())
+			return IpList::ERR_BAD_FORMAT;
 	}
+	return 0;
+}
+
+int IpList::parseLine(const std::string& s, IpList::ParseLineResult& res, const IpList::ParseLineOptions* options, string::size_type startPos)
+{
+	string::size_type i = startPos;
+	res.start = res.end = startPos;
+	res.pos = startPos;
+	int error = parseLineStart(s, i, res.specialChar, options);
+	if (error)
+		return error;
 	string::size_type j = i;
 	skipIpAddress(s, j);
 	if (!Util::parseIpAddress(res.start, s, i, j))
@@ -159,6 +280,72 @@ int IpList::parseLine(const std::string& s, IpList::ParseLineResult& res, const
 	return 0;
 }
 
+static void skipIp6Address(const string& s, string::size_type& i)
+{
+	while (i < s.length() && (isxdigit((unsigned char) s[i]) || s[i] == ':' || s[i] == '.')) ++i;
+}
+
+int IpList::parseLine(const std::string& s, IpList::ParseLineResult6& res, const IpList::ParseLineOptions* options, string::size_type startPos)
+{
+	string::size_type i = startPos;
+	memset(&res.start, 0, sizeof(res.start));
+	memset(&res.end, 0, sizeof(res.end));
+	res.pos = startPos;
+	int error = parseLineStart(s, i, res.specialChar, options);
+	if (error)
+		return error;
+	string::size_type j = i;
+	skipIp6Address(s, j);
+	if (!Util::parseIpAddress(res.start, s, i, j))
+		return ERR_BAD_FORMAT;
+	i = j;
+	skipWhiteSpace(s, i);
+	if (i == s.length())
+	{
+		res.end = res.start;
+		res.pos = i;
+		return 0;
+	}
+
+	char sep = s[i];
+	++i;
+	skipWhiteSpace(s, i);
+	if (i == s.length())
+		return ERR_BAD_FORMAT;
+	if (sep == '/')
+	{
+		j = i;
+		skipNumber(s, j);
+		int bits = atoi(s.c_str() + i);
+		if (bits <= 0 || bits > 128)
+			return ERR_BAD_NETMASK;
+		Ip6Key key = toKey(res.start);
+		if (bits < 64)
+		{
+			key.hi |= UINT64_MAX >> bits;
+			key.lo = UINT64_MAX;
+		}
+		else if (bits < 128)
+			key.lo |= UINT64_MAX >> (bits - 64);
+		res.end = fromKey(key);
+	}
+	else
+	if (sep == '-')
+	{
+		j = i;
+		skipIp6Address(s, j);
+		if (!Util::parseIpAddress(res.end, s, i, j))
+			return ERR_BAD_FORMAT;
+	}
+	else
+	{
+		res.end = res.start;
+	}
+	res.pos = j;
+	if (toKey(res.end) < toKey(res.start)) return ERR_BAD_RANGE;
+	return 0;
+}
+
 string IpList::getErrorText(int error)
 {
 	switch (error)
@@ -3,21 +3,16 @@
 
 #include <stdint.h>
 #include <string>
-#include <map>
-#include <list>
+#include <vector>
+#include <set>
+#include "Ip6Address.h"
 
+// Ranges are collected with addRange and compiled into a sorted array
+// of non-overlapping intervals which is searched by find.
+// When several ranges contain an address, the one with the greatest start
+// (then the shortest one) wins.
 class IpList
 {
-	private:
-		struct Range
-		{
-			uint32_t end;
-			uint64_t payload;
-		};
-		typedef std::list<Range> RangeList;
-		typedef std::map<uint32_t, RangeList> IpListMap;
-		IpListMap m;
-
 	public:
 		enum
 		{
@@ -27,13 +22,13 @@ class IpList
 			ERR_BAD_FORMAT,
 			ERR_BAD_NETMASK
 		};
-		
+
 		struct ParseLineOptions
 		{
 			char specialChars[8];
 			int  specialCharCount;
 		};
-		
+
 		struct ParseLineResult
 		{
 			uint32_t start;
@@ -42,12 +37,89 @@ class IpList
 			char specialChar;
 		};
 
+		struct ParseLineResult6
+		{
+			Ip6Address start;
+			Ip6Address end;
+			std::string::size_type pos;
+			char specialChar;
+		};
+
 		bool addRange(uint32_t start, uint32_t end, uint64_t payload, int& error);
-		bool find(uint32_t addr, uint64_t& payload) const;
-		void clear() { m.clear(); }
+		bool addRange(const Ip6Address& start, const Ip6Address& end, uint64_t payload, int& error);
+		void compile();
+		void releaseRanges(); // keeps only the compiled table
+		bool find(uint32_t addr, uint64_t& payload) const { return table4.find(addr, payload); }
+		bool find(const Ip6Address& addr, uint64_t& payload) const { return table6.find(toKey(addr), payload); }
+		bool empty() const { return table4.starts.empty() && table6.starts.empty(); }
+		bool hasIp6() const { return !table6.starts.empty(); }
+		void clear();
 
 		static int parseLine(const std::string& s, ParseLineResult& res, const ParseLineOptions* options = nullptr, string::size_type startPos = 0);
+		static int parseLine(const std::string& s, ParseLineResult6& res, const ParseLineOptions* options = nullptr, string::size_type startPos = 0);
 		static std::string getErrorText(int error);
+
+	private:
+		struct Ip6Key
+		{
+			uint64_t hi;
+			uint64_t lo;
+
+			bool operator<(const Ip6Key& b) const { return hi < b.hi || (hi == b.hi && lo < b.lo); }
+			bool operator<=(const Ip6Key& b) const { return !(b < *this); }
+			bool operator==(const Ip6Key& b) const { return hi == b.hi && lo == b.lo; }
+		};
+
+		template<typename T>
+		struct Range
+		{
+			T start;
+			T end;
+			uint64_t payload;
+		};
+
+		template<typename T>
+		struct Table
+		{
+			std::vector<T> starts;
+			std::vector<T> ends;
+			std::vector<uint64_t> payloads;
+
+			bool find(const T& addr, uint64_t& payload) const
+			{
+				size_t n = starts.size();
+				if (!n || addr < starts[0]) return false;
+				const T* base = starts.data();
+				while (n > 1)
+				{
+					size_t half = n / 2;
+					base = base[half] <= addr ? base + half : base;
+					n -= half;
+				}
+				size_t index = base - starts.data();
+				if (ends[index] < addr) return false;
+				payload = payloads[index];
+				return true;
+			}
+
+			void build(std::vector<Range<T>>& ranges);
+			void clear()
+			{
+				starts.clear();
+				ends.clear();
+				payloads.clear();
+			}
+		};
+
+		std::vector<Range<uint32_t>> ranges4;
+		std::vector<Range<Ip6Key>> ranges6;
+		std::set<std::pair<uint32_t, uint32_t>> keys4;
+		std::set<std::pair<Ip6Key, Ip6Key>> keys6;
+		Table<uint32_t> table4;
+		Table<Ip6Key> table6;
+
+		static Ip6Key toKey(const Ip6Address& addr);
+		static Ip6Address fromKey(const Ip6Key& key);
 };
 
 #endif // IP_LIST_H_
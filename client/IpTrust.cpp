@@ -26,7 +26,7 @@
 
 IpTrust ipTrust;
 
-IpTrust::IpTrust() : cs(RWLock::create()), enabled(false), hasWhiteList(false)
+IpTrust::IpTrust() : cs(RWLock::create()), enabled(false), hasWhiteList(false), hasWhiteList6(false)
 {
 }
 
@@ -54,7 +54,7 @@ void IpTrust::load() noexcept
 	options.specialCharCount = 2;
 
 	WRITE_LOCK(*cs);
-	hasWhiteList = false;
+	hasWhiteList = hasWhiteList6 = false;
 	ipList.clear();
 	auto addLine = [this, &options](const string& s) -> bool
 	{
@@ -69,8 +69,24 @@ void IpTrust::load() noexcept
 				hasWhiteList = true;
 			if (!ipList.addRange(out.start, out.end, payload, result))
 				LogManager::message("Error adding data from IPTrust.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
+			return true;
 		}
-		else if (result != IpList::ERR_LINE_SKIPPED)
+		if (result == IpList::ERR_BAD_FORMAT)
+		{
+			IpList::ParseLineResult6 out6;
+			if (!IpList::parseLine(s, out6, &options))
+			{
+				uint64_t payload = 0;
+				if (out6.specialChar == '-')
+					payload = 1;
+				else
+					hasWhiteList = hasWhiteList6 = true;
+				if (!ipList.addRange(out6.start, out6.end, payload, result))
+					LogManager::message("Error adding data from IPTrust.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
+				return true;
+			}
+		}
+		if (result != IpList::ERR_LINE_SKIPPED)
 			LogManager::message("Error parsing IPTrust.ini: " + IpList::getErrorText(result) + " [" + s + "]", false);
 		return true;
 	};
@@ -84,13 +100,14 @@ void IpTrust::load() noexcept
 		LogManager::message("Could not load IPTrust.ini: " + e.getError(), false);
 		ipList.clear();
 	}
+	ipList.compile();
 }
 
 void IpTrust::clear() noexcept
 {
 	WRITE_LOCK(*cs);
 	ipList.clear();
-	hasWhiteList = false;
+	hasWhiteList = hasWhiteList6 = false;
 }
 
 bool IpTrust::isBlocked(uint32_t addr) const noexcept
@@ -103,3 +120,15 @@ bool IpTrust::isBlocked(uint32_t addr) const noexcept
 		return payload != 0;
 	return hasWhiteList;
 }
+
+bool IpTrust::isBlocked(const Ip6Address& addr) const noexcept
+{
+	READ_LOCK(*cs);
+	if (!enabled)
+		return false;
+	uint64_t payload;
+	if (ipList.find(addr, payload))
+		return payload != 0;
+	// a list of IPv4 ranges doesn't restrict IPv6 peers
+	return hasWhiteList6;
+}
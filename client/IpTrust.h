@@ -9,6 +9,7 @@ class IpTrust
 	public:
 		IpTrust();
 		bool isBlocked(uint32_t addr) const noexcept;
+		bool isBlocked(const Ip6Address& addr) const noexcept;
 		void load() noexcept;
 		void clear() noexcept;
 		void updateSettings() noexcept;
@@ -19,6 +20,7 @@ class IpTrust
 		mutable unique_ptr<RWLock> cs;
 		bool enabled;
 		bool hasWhiteList;
+		bool hasWhiteList6;
 };
 
 extern IpTrust ipTrust;
@@ -176,6 +176,14 @@ void Util::getIpInfo(const IpAddress& ip, IPInfo& result, int what, bool onlyCac
 	if (conn) dm->putConnection(conn);
 }
 
+void Util::getIpInfo(const vector<IpAddress>& ips, vector<IPInfo>& results, int what, bool onlyCached)
+{
+	auto dm = DatabaseManager::getInstance();
+	auto conn = dm->getConnection();
+	dm->getIPInfo(conn, ips, results, what, onlyCached);
+	if (conn) dm->putConnection(conn);
+}
+
 const string& Util::getDescription(const IPInfo& ipInfo)
 {
 	if (!ipInfo.location.empty()) return ipInfo.location;
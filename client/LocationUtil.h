@@ -31,6 +31,7 @@ namespace Util
 	void loadIBlockList();
 
 	void getIpInfo(const IpAddress& ip, IPInfo& result, int what, bool onlyCached = false);
+	void getIpInfo(const vector<IpAddress>& ips, vector<IPInfo>& results, int what, bool onlyCached = false);
 	const string& getDescription(const IPInfo& ipInfo);
 }
 
@@ -0,0 +1,165 @@
+#include "stdinc.h"
+#include "LockProfiler.h"
+#include "StrUtil.h"
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+
+uint64_t LockStats::now() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int LockStats::getBucket(uint64_t time) noexcept
+{
+	uint64_t us = time / 1000;
+	int bucket = 0;
+	while (us && bucket < HISTOGRAM_SIZE - 1)
+	{
+		us >>= 1;
+		++bucket;
+	}
+	return bucket;
+}
+
+void LockStats::updateMax(std::atomic<uint64_t>& val, uint64_t newVal) noexcept
+{
+	uint64_t oldVal = val.load(std::memory_order_relaxed);
+	while (oldVal < newVal && !val.compare_exchange_weak(oldVal, newVal, std::memory_order_relaxed)) {}
+}
+
+void LockStats::addAcquisition(uint64_t wait, bool shared) noexcept
+{
+	acquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (shared) sharedAcquisitions.fetch_add(1, std::memory_order_relaxed);
+	if (wait)
+	{
+		contended.fetch_add(1, std::memory_order_relaxed);
+		totalWait.fetch_add(wait, std::memory_order_relaxed);
+		updateMax(maxWait, wait);
+	}
+	waitHistogram[getBucket(wait)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockStats::addHold(uint64_t time) noexcept
+{
+	totalHold.fetch_add(time, std::memory_order_relaxed);
+	updateMax(maxHold, time);
+	holdHistogram[getBucket(time)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LockStats::reset() noexcept
+{
+	acquisitions = 0;
+	sharedAcquisitions = 0;
+	contended = 0;
+	totalWait = 0;
+	maxWait = 0;
+	totalHold = 0;
+	maxHold = 0;
+	for (int i = 0; i < HISTOGRAM_SIZE; ++i)
+	{
+		waitHistogram[i] = 0;
+		holdHistogram[i] = 0;
+	}
+}
+
+void LockStats::getInfo(Info& info) const noexcept
+{
+	info.name = name;
+	info.acquisitions = acquisitions.load(std::memory_order_relaxed);
+	info.sharedAcquisitions = sharedAcquisitions.load(std::memory_order_relaxed);
+	info.contended = contended.load(std::memory_order_relaxed);
+	info.totalWait = totalWait.load(std::memory_order_relaxed);
+	info.maxWait = maxWait.load(std::memory_order_relaxed);
+	info.totalHold = totalHold.load(std::memory_order_relaxed);
+	info.maxHold = maxHold.load(std::memory_order_relaxed);
+	for (int i = 0; i < HISTOGRAM_SIZE; ++i)
+	{
+		info.waitHistogram[i] = waitHistogram[i].load(std::memory_order_relaxed);
+		info.holdHistogram[i] = holdHistogram[i].load(std::memory_order_relaxed);
+	}
+}
+
+// Not using CriticalSection here: it can be profiled itself
+static std::mutex& getRegistryMutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+static std::vector<LockStats*>& getRegistry()
+{
+	static std::vector<LockStats*> registry;
+	return registry;
+}
+
+LockStats* LockProfiler::getStats(const char* name) noexcept
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	auto& registry = getRegistry();
+	for (LockStats* stats : registry)
+		if (!strcmp(stats->getName(), name))
+			return stats;
+	LockStats* stats = new LockStats(name);
+	registry.push_back(stats);
+	return stats;
+}
+
+void LockProfiler::getInfo(std::vector<LockStats::Info>& info) noexcept
+{
+	{
+		std::lock_guard<std::mutex> lock(getRegistryMutex());
+		const auto& registry = getRegistry();
+		info.resize(registry.size());
+		for (size_t i = 0; i < registry.size(); ++i)
+			registry[i]->getInfo(info[i]);
+	}
+	std::sort(info.begin(), info.end(),
+		[](const LockStats::Info& a, const LockStats::Info& b) { return a.totalWait > b.totalWait; });
+}
+
+void LockProfiler::reset() noexcept
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	for (LockStats* stats : getRegistry())
+		stats->reset();
+}
+
+uint64_t LockProfiler::getPercentile(const uint64_t histogram[], double fraction) noexcept
+{
+	uint64_t total = 0;
+	for (int i = 0; i < LockStats::HISTOGRAM_SIZE; ++i)
+		total += histogram[i];
+	if (!total) return 0;
+	uint64_t threshold = (uint64_t) (total * fraction);
+	uint64_t count = 0;
+	for (int i = 0; i < LockStats::HISTOGRAM_SIZE; ++i)
+	{
+		count += histogram[i];
+		if (count > threshold) return (uint64_t) 1 << i;
+	}
+	return (uint64_t) 1 << (LockStats::HISTOGRAM_SIZE - 1);
+}
+
+string LockProfiler::getReport() noexcept
+{
+	vector<LockStats::Info> info;
+	getInfo(info);
+	string res;
+	for (const auto& li : info)
+	{
+		if (!li.acquisitions) continue;
+		if (!res.empty()) res += '\n';
+		res += li.name;
+		res += ": acquired " + Util::toString(li.acquisitions);
+		if (li.sharedAcquisitions)
+			res += " (" + Util::toString(li.sharedAcquisitions) + " shared)";
+		res += ", contended " + Util::toString(li.contended);
+		res += ", wait total/max " + Util::toString(li.totalWait / 1000) + '/' + Util::toString(li.maxWait / 1000) + " us";
+		res += ", wait p50/p99 <" + Util::toString(getPercentile(li.waitHistogram, 0.5)) + "/<" + Util::toString(getPercentile(li.waitHistogram, 0.99)) + " us";
+		res += ", hold avg/max " + Util::toString(li.totalHold / li.acquisitions / 1000) + '/' + Util::toString(li.maxHold / 1000) + " us";
+		res += ", hold p99 <" + Util::toString(getPercentile(li.holdHistogram, 0.99)) + " us";
+	}
+	return res;
+}
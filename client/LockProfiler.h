@@ -0,0 +1,107 @@
+#ifndef LOCK_PROFILER_H_
+#define LOCK_PROFILER_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Contention statistics for named locks, collected when LOCK_PROFILER is defined.
+// Locks get a name when they are constructed; locks with the same name share their statistics.
+// Only acquisitions made through LOCK, READ_LOCK and WRITE_LOCK are counted.
+class LockStats
+{
+	public:
+		// Bucket 0 counts times below 1 microsecond, bucket i counts times in [2^(i-1), 2^i) microseconds,
+		// the last bucket counts everything longer
+		static const int HISTOGRAM_SIZE = 24;
+
+		struct Info
+		{
+			std::string name;
+			uint64_t acquisitions;
+			uint64_t sharedAcquisitions;
+			uint64_t contended;
+			uint64_t totalWait; // ns
+			uint64_t maxWait;
+			uint64_t totalHold;
+			uint64_t maxHold;
+			uint64_t waitHistogram[HISTOGRAM_SIZE];
+			uint64_t holdHistogram[HISTOGRAM_SIZE];
+		};
+
+		explicit LockStats(const char* name) : name(name) { reset(); }
+
+		LockStats(const LockStats&) = delete;
+		LockStats& operator= (const LockStats&) = delete;
+
+		// Returns the time when the lock was acquired
+		template<typename TryLockFunc, typename LockFunc>
+		uint64_t acquire(TryLockFunc tryLock, LockFunc lock, bool shared) noexcept
+		{
+			if (tryLock())
+			{
+				addAcquisition(0, shared);
+				return now();
+			}
+			uint64_t start = now();
+			lock();
+			uint64_t acquired = now();
+			addAcquisition(acquired - start, shared);
+			return acquired;
+		}
+
+		void addHold(uint64_t time) noexcept;
+		void reset() noexcept;
+		void getInfo(Info& info) const noexcept;
+		const char* getName() const { return name; }
+
+		static uint64_t now() noexcept; // ns
+
+	private:
+		const char* const name;
+		std::atomic<uint64_t> acquisitions;
+		std::atomic<uint64_t> sharedAcquisitions;
+		std::atomic<uint64_t> contended;
+		std::atomic<uint64_t> totalWait;
+		std::atomic<uint64_t> maxWait;
+		std::atomic<uint64_t> totalHold;
+		std::atomic<uint64_t> maxHold;
+		std::atomic<uint64_t> waitHistogram[HISTOGRAM_SIZE];
+		std::atomic<uint64_t> holdHistogram[HISTOGRAM_SIZE];
+
+		void addAcquisition(uint64_t wait, bool shared) noexcept;
+		static int getBucket(uint64_t time) noexcept;
+		static void updateMax(std::atomic<uint64_t>& val, uint64_t newVal) noexcept;
+};
+
+class LockProfiler
+{
+	public:
+		// Returns the statistics object for this name, creating it if necessary.
+		// The objects are never deleted.
+		static LockStats* getStats(const char* name) noexcept;
+
+		// Sorted by total wait time, longest first
+		static void getInfo(std::vector<LockStats::Info>& info) noexcept;
+		static void reset() noexcept;
+		static std::string getReport() noexcept;
+
+		// Upper bound of the bucket containing the given fraction of samples, in microseconds
+		static uint64_t getPercentile(const uint64_t histogram[], double fraction) noexcept;
+};
+
+// Used in the lock classes
+#ifdef LOCK_PROFILER
+#define LOCK_PROFILER_MEMBERS \
+	public: \
+		LockStats* getProfile() const { return profile; } \
+	private: \
+		LockStats* profile = nullptr;
+#define LOCK_PROFILER_SET_NAME(name) profile = LockProfiler::getStats(name)
+#else
+#define LOCK_PROFILER_MEMBERS
+#define LOCK_PROFILER_SET_NAME(name) (void) name
+#endif
+
+#endif // LOCK_PROFILER_H_
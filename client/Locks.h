@@ -5,6 +5,8 @@
 #include "debug.h"
 #include <atomic>
 
+#include "LockProfiler.h"
+
 #ifdef _WIN32
 class CriticalSection
 {
@@ -30,6 +32,11 @@ class CriticalSection
 #endif
 		}
 
+		explicit CriticalSection(const char* name) : CriticalSection()
+		{
+			LOCK_PROFILER_SET_NAME(name);
+		}
+
 		~CriticalSection()
 		{
 			DeleteCriticalSection(&cs);
@@ -60,12 +67,20 @@ class CriticalSection
 #endif
 		}
 
+#ifdef LOCK_PROFILER
+		bool tryLock()
+		{
+			return TryEnterCriticalSection(&cs) != FALSE;
+		}
+#endif
+
 	private:
 		CRITICAL_SECTION cs;
 #ifdef LOCK_DEBUG
 		const char* ownerFile = nullptr;
 		int ownerLine = 0;
 #endif
+		LOCK_PROFILER_MEMBERS
 };
 
 typedef CriticalSection RecursiveMutex;
@@ -74,6 +89,10 @@ class CriticalSection
 {
 	public:
 		CriticalSection() {}
+		explicit CriticalSection(const char* name)
+		{
+			LOCK_PROFILER_SET_NAME(name);
+		}
 		CriticalSection(const CriticalSection&) = delete;
 		CriticalSection& operator= (const CriticalSection&) = delete;
 
@@ -99,12 +118,20 @@ class CriticalSection
 #endif
 		}
 
+#ifdef LOCK_PROFILER
+		bool tryLock()
+		{
+			return pthread_mutex_trylock(&mutex) == 0;
+		}
+#endif
+
 	private:
 		pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 #ifdef LOCK_DEBUG
 		const char* ownerFile = nullptr;
 		int ownerLine = 0;
 #endif
+		LOCK_PROFILER_MEMBERS
 };
 
 class RecursiveMutex
@@ -118,6 +145,10 @@ class RecursiveMutex
 			pthread_mutex_init(&mutex, &ma);
 			pthread_mutexattr_destroy(&ma);
 		}
+		explicit RecursiveMutex(const char* name) : RecursiveMutex()
+		{
+			LOCK_PROFILER_SET_NAME(name);
+		}
 		RecursiveMutex(const RecursiveMutex&) = delete;
 		RecursiveMutex& operator= (const RecursiveMutex&) = delete;
 
@@ -143,12 +174,20 @@ class RecursiveMutex
 #endif
 		}
 
+#ifdef LOCK_PROFILER
+		bool tryLock()
+		{
+			return pthread_mutex_trylock(&mutex) == 0;
+		}
+#endif
+
 	private:
 		pthread_mutex_t mutex;
 #ifdef LOCK_DEBUG
 		const char* ownerFile = nullptr;
 		int ownerLine = 0;
 #endif
+		LOCK_PROFILER_MEMBERS
 };
 #endif
 
@@ -169,6 +208,11 @@ class SpinLock
 			state.clear();
 		}
 
+		explicit SpinLock(const char* name) : SpinLock()
+		{
+			LOCK_PROFILER_SET_NAME(name);
+		}
+
 		SpinLock(const SpinLock&) = delete;
 		SpinLock& operator= (const SpinLock&) = delete;
 
@@ -187,8 +231,16 @@ class SpinLock
 			state.clear();
 		}
 
+#ifdef LOCK_PROFILER
+		bool tryLock()
+		{
+			return !state.test_and_set();
+		}
+#endif
+
 	private:
 		std::atomic_flag state;
+		LOCK_PROFILER_MEMBERS
 };
 
 #ifdef USE_SPIN_LOCK
@@ -203,22 +255,48 @@ template<class T> class LockBase
 #ifdef LOCK_DEBUG
 		LockBase(T& cs, const char* filename = nullptr, int line = 0) : cs(cs)
 		{
+#ifdef LOCK_PROFILER
+			if (cs.getProfile())
+			{
+				acquireTime = cs.getProfile()->acquire([&cs] { return cs.tryLock(); }, [&] { cs.lock(filename, line); }, false);
+				return;
+			}
+#endif
 			cs.lock(filename, line);
 		}
 #else
 		LockBase(T& cs) : cs(cs)
 		{
+#ifdef LOCK_PROFILER
+			if (cs.getProfile())
+			{
+				acquireTime = cs.getProfile()->acquire([&cs] { return cs.tryLock(); }, [&cs] { cs.lock(); }, false);
+				return;
+			}
+#endif
 			cs.lock();
 		}
 #endif
 
 		~LockBase()
 		{
+#ifdef LOCK_PROFILER
+			if (cs.getProfile())
+			{
+				uint64_t holdTime = LockStats::now() - acquireTime;
+				cs.unlock();
+				cs.getProfile()->addHold(holdTime);
+				return;
+			}
+#endif
 			cs.unlock();
 		}
 
 	private:
 		T& cs;
+#ifdef LOCK_PROFILER
+		uint64_t acquireTime = 0;
+#endif
 };
 
 #ifdef LOCK_DEBUG
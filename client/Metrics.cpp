@@ -0,0 +1,188 @@
+#include "stdinc.h"
+#include "Metrics.h"
+#include "StrUtil.h"
+#include "version.h"
+#include <chrono>
+#include <mutex>
+#include <algorithm>
+
+const uint64_t Metrics::LATENCY_BUCKETS[] =
+{
+	50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000, 2500000
+};
+
+const int Metrics::LATENCY_BUCKETS_COUNT = _countof(LATENCY_BUCKETS);
+const double Metrics::MICROSECONDS = 1e-6;
+
+// Not using CriticalSection here: metrics can be constructed before any other static object
+static std::mutex& getRegistryMutex()
+{
+	static std::mutex m;
+	return m;
+}
+
+static std::vector<Metrics::Metric*>& getRegistry()
+{
+	static std::vector<Metrics::Metric*> registry;
+	return registry;
+}
+
+static size_t getFamilyLength(const char* name)
+{
+	const char* p = strchr(name, '{');
+	return p ? p - name : strlen(name);
+}
+
+static void printName(string& out, const string& prefix, const char* name, const char* suffix, const char* extraLabel)
+{
+	size_t len = getFamilyLength(name);
+	out += prefix;
+	out.append(name, len);
+	out += suffix;
+	const char* labels = name + len;
+	if (*labels)
+	{
+		// strip the closing brace
+		size_t labelsLen = strlen(labels) - 1;
+		out.append(labels, labelsLen);
+		if (extraLabel)
+		{
+			out += ',';
+			out += extraLabel;
+		}
+		out += '}';
+	}
+	else if (extraLabel)
+	{
+		out += '{';
+		out += extraLabel;
+		out += '}';
+	}
+}
+
+static void printDouble(string& out, double val)
+{
+	char buf[64];
+	snprintf(buf, sizeof(buf), "%.15g", val);
+	out += buf;
+}
+
+Metrics::Metric::Metric(const char* name, const char* help, Type type) noexcept : name(name), help(help), type(type)
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	getRegistry().push_back(this);
+}
+
+Metrics::Metric::~Metric() noexcept
+{
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	auto& registry = getRegistry();
+	auto i = std::find(registry.begin(), registry.end(), this);
+	if (i != registry.end()) registry.erase(i);
+}
+
+void Metrics::Counter::print(string& out, const string& prefix) const noexcept
+{
+	printName(out, prefix, getName(), "", nullptr);
+	out += ' ';
+	out += Util::toString(get());
+	out += '\n';
+}
+
+void Metrics::Gauge::print(string& out, const string& prefix) const noexcept
+{
+	printName(out, prefix, getName(), "", nullptr);
+	out += ' ';
+	out += Util::toString(get());
+	out += '\n';
+}
+
+void Metrics::Callback::print(string& out, const string& prefix) const noexcept
+{
+	printName(out, prefix, getName(), "", nullptr);
+	out += ' ';
+	out += Util::toString(func());
+	out += '\n';
+}
+
+Metrics::Histogram::Histogram(const char* name, const char* help, const uint64_t bounds[], int count, double scale) noexcept :
+	Metric(name, help, TYPE_HISTOGRAM), bounds(bounds), count(count < MAX_BUCKETS ? count : MAX_BUCKETS), scale(scale), sum(0)
+{
+	for (int i = 0; i <= MAX_BUCKETS; ++i)
+		buckets[i] = 0;
+}
+
+void Metrics::Histogram::observe(uint64_t value) noexcept
+{
+	int i = static_cast<int>(std::lower_bound(bounds, bounds + count, value) - bounds);
+	buckets[i].fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+}
+
+void Metrics::Histogram::print(string& out, const string& prefix) const noexcept
+{
+	char label[64];
+	uint64_t total = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		total += buckets[i].load(std::memory_order_relaxed);
+		snprintf(label, sizeof(label), "le=\"%g\"", bounds[i] * scale);
+		printName(out, prefix, getName(), "_bucket", label);
+		out += ' ';
+		out += Util::toString(total);
+		out += '\n';
+	}
+	total += buckets[count].load(std::memory_order_relaxed);
+	printName(out, prefix, getName(), "_bucket", "le=\"+Inf\"");
+	out += ' ';
+	out += Util::toString(total);
+	out += '\n';
+	printName(out, prefix, getName(), "_sum", nullptr);
+	out += ' ';
+	printDouble(out, sum.load(std::memory_order_relaxed) * scale);
+	out += '\n';
+	printName(out, prefix, getName(), "_count", nullptr);
+	out += ' ';
+	out += Util::toString(total);
+	out += '\n';
+}
+
+uint64_t Metrics::getMicroseconds() noexcept
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Metrics::print(string& out) noexcept
+{
+	static const char* typeNames[] = { "counter", "gauge", "histogram" };
+	static const string prefix = APPNAME_LC "_";
+
+	std::lock_guard<std::mutex> lock(getRegistryMutex());
+	vector<const Metric*> metrics(getRegistry().begin(), getRegistry().end());
+	std::sort(metrics.begin(), metrics.end(),
+		[](const Metric* a, const Metric* b) { return strcmp(a->getName(), b->getName()) < 0; });
+	const char* family = nullptr;
+	size_t familyLen = 0;
+	for (const Metric* m : metrics)
+	{
+		const char* name = m->getName();
+		size_t len = getFamilyLength(name);
+		if (!family || len != familyLen || memcmp(name, family, len))
+		{
+			family = name;
+			familyLen = len;
+			out += "# HELP ";
+			out += prefix;
+			out.append(name, len);
+			out += ' ';
+			out += m->getHelp();
+			out += "\n# TYPE ";
+			out += prefix;
+			out.append(name, len);
+			out += ' ';
+			out += typeNames[m->getType()];
+			out += '\n';
+		}
+		m->print(out, prefix);
+	}
+}
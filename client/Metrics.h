@@ -0,0 +1,133 @@
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <functional>
+
+// Process-wide counters, gauges and histograms exported in the Prometheus text format.
+// Metrics are usually static objects defined next to the code they measure,
+// they register themselves when constructed. Updating a metric is a relaxed atomic operation.
+// A name may include labels, e.g. "network_received_bytes_total{proto=\"tcp\"}";
+// all metrics sharing the name before the labels must have the same type and help text.
+class Metrics
+{
+	public:
+		enum Type
+		{
+			TYPE_COUNTER,
+			TYPE_GAUGE,
+			TYPE_HISTOGRAM
+		};
+
+		class Metric
+		{
+			public:
+				Metric(const char* name, const char* help, Type type) noexcept;
+				virtual ~Metric() noexcept;
+
+				Metric(const Metric&) = delete;
+				Metric& operator= (const Metric&) = delete;
+
+				const char* getName() const { return name; }
+				const char* getHelp() const { return help; }
+				Type getType() const { return type; }
+
+				// Appends the sample lines, without HELP and TYPE
+				virtual void print(std::string& out, const std::string& prefix) const noexcept = 0;
+
+			private:
+				const char* const name;
+				const char* const help;
+				const Type type;
+		};
+
+		class Counter : public Metric
+		{
+			public:
+				Counter(const char* name, const char* help) noexcept : Metric(name, help, TYPE_COUNTER), value(0) {}
+
+				void inc(uint64_t n = 1) noexcept { value.fetch_add(n, std::memory_order_relaxed); }
+				uint64_t get() const noexcept { return value.load(std::memory_order_relaxed); }
+				void print(std::string& out, const std::string& prefix) const noexcept override;
+
+			private:
+				std::atomic<uint64_t> value;
+		};
+
+		class Gauge : public Metric
+		{
+			public:
+				Gauge(const char* name, const char* help) noexcept : Metric(name, help, TYPE_GAUGE), value(0) {}
+
+				void set(int64_t n) noexcept { value.store(n, std::memory_order_relaxed); }
+				void add(int64_t n) noexcept { value.fetch_add(n, std::memory_order_relaxed); }
+				int64_t get() const noexcept { return value.load(std::memory_order_relaxed); }
+				void print(std::string& out, const std::string& prefix) const noexcept override;
+
+			private:
+				std::atomic<int64_t> value;
+		};
+
+		// Counter or gauge whose value is read from its owner when the metrics are exported.
+		// The function is called with the registry lock held and must not create metrics.
+		class Callback : public Metric
+		{
+			public:
+				typedef std::function<int64_t()> Func;
+
+				Callback(const char* name, const char* help, Type type, Func func) noexcept : Metric(name, help, type), func(func) {}
+
+				void print(std::string& out, const std::string& prefix) const noexcept override;
+
+			private:
+				const Func func;
+		};
+
+		// Bounds are upper limits of the buckets in the units of observed values,
+		// scale converts them to the exported units (e.g. 1e-6 for microseconds exported as seconds)
+		class Histogram : public Metric
+		{
+			public:
+				static const int MAX_BUCKETS = 24;
+
+				Histogram(const char* name, const char* help, const uint64_t bounds[], int count, double scale) noexcept;
+
+				void observe(uint64_t value) noexcept;
+				void print(std::string& out, const std::string& prefix) const noexcept override;
+
+			private:
+				const uint64_t* const bounds;
+				const int count;
+				const double scale;
+				std::atomic<uint64_t> buckets[MAX_BUCKETS + 1];
+				std::atomic<uint64_t> sum;
+		};
+
+		// Observes the time in microseconds between construction and destruction
+		class ScopedTimer
+		{
+			public:
+				explicit ScopedTimer(Histogram& h) noexcept : h(h), start(getMicroseconds()) {}
+				~ScopedTimer() noexcept { h.observe(getMicroseconds() - start); }
+
+				ScopedTimer(const ScopedTimer&) = delete;
+				ScopedTimer& operator= (const ScopedTimer&) = delete;
+
+			private:
+				Histogram& h;
+				const uint64_t start;
+		};
+
+		// 50 us to 2.5 s
+		static const uint64_t LATENCY_BUCKETS[];
+		static const int LATENCY_BUCKETS_COUNT;
+		static const double MICROSECONDS;
+
+		static uint64_t getMicroseconds() noexcept;
+		static void print(std::string& out) noexcept;
+		static const char* getContentType() { return "text/plain; version=0.0.4; charset=utf-8"; }
+};
+
+#endif // METRICS_H_
@@ -0,0 +1,92 @@
+#include "stdinc.h"
+#include "MultiStringSearch.h"
+
+size_t MultiStringSearch::addPattern(const std::string& pattern)
+{
+	dcassert(!compiled && !pattern.empty());
+	uint32_t state = 0;
+	for (char c : pattern)
+	{
+		uint8_t b = static_cast<uint8_t>(c);
+		uint32_t child = 0;
+		for (const auto& edge : trie[state].children)
+			if (edge.first == b)
+			{
+				child = edge.second;
+				break;
+			}
+		if (!child)
+		{
+			child = static_cast<uint32_t>(trie.size());
+			trie[state].children.emplace_back(b, child);
+			trie.push_back(Node{{}, NO_PATTERN});
+		}
+		state = child;
+	}
+	if (trie[state].pattern == NO_PATTERN)
+		trie[state].pattern = static_cast<uint32_t>(patternCount++);
+	return trie[state].pattern;
+}
+
+void MultiStringSearch::compile()
+{
+	dcassert(!compiled);
+	const uint32_t stateCount = static_cast<uint32_t>(trie.size());
+
+	bool used[256] = {};
+	for (const Node& node : trie)
+		for (const auto& edge : node.children)
+			used[edge.first] = true;
+	classCount = 1;
+	for (int i = 0; i < 256; ++i)
+		byteClass[i] = used[i] ? static_cast<uint16_t>(classCount++) : 0;
+
+	next.assign(static_cast<size_t>(stateCount) * classCount, 0);
+	terminal.resize(stateCount);
+	output.assign(stateCount, 0);
+	outputLink.assign(stateCount, 0);
+	std::vector<uint32_t> fail(stateCount, 0);
+	std::vector<uint32_t> queue;
+	queue.reserve(stateCount);
+	queue.push_back(0);
+
+	// States are visited in order of depth, so the row of the suffix state is complete
+	for (size_t i = 0; i < queue.size(); ++i)
+	{
+		const uint32_t u = queue[i];
+		uint32_t* row = &next[static_cast<size_t>(u) * classCount];
+		if (u)
+		{
+			const uint32_t* failRow = &next[static_cast<size_t>(fail[u]) * classCount];
+			std::copy(failRow, failRow + classCount, row);
+		}
+		for (const auto& edge : trie[u].children)
+		{
+			const uint32_t v = edge.second;
+			fail[v] = u ? row[byteClass[edge.first]] : 0;
+			row[byteClass[edge.first]] = v;
+			queue.push_back(v);
+		}
+		terminal[u] = trie[u].pattern;
+		if (u)
+		{
+			outputLink[u] = output[fail[u]];
+			output[u] = terminal[u] != NO_PATTERN ? u : output[fail[u]];
+		}
+	}
+	std::vector<Node>().swap(trie);
+	compiled = true;
+}
+
+void MultiStringSearch::clear()
+{
+	trie.clear();
+	trie.push_back(Node{{}, NO_PATTERN});
+	patternCount = 0;
+	compiled = false;
+	classCount = 0;
+	next.clear();
+	terminal.clear();
+	output.clear();
+	outputLink.clear();
+}
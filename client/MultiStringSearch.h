@@ -0,0 +1,72 @@
+#ifndef MULTI_STRING_SEARCH_H_
+#define MULTI_STRING_SEARCH_H_
+
+#include "debug.h"
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Aho-Corasick automaton finding all occurrences of a set of substrings
+// in a single pass over the text.
+// Bytes that don't occur in any pattern are mapped to one input class,
+// so the transition table has a row of (number of classes) entries per state.
+// Patterns are matched as is; callers lowercase both sides for case insensitive search.
+class MultiStringSearch
+{
+	public:
+		MultiStringSearch() { clear(); }
+
+		// Returns the index of the pattern; equal patterns get the same index
+		size_t addPattern(const std::string& pattern);
+		void compile();
+		void clear();
+		size_t size() const { return patternCount; }
+		bool empty() const { return patternCount == 0; }
+
+		// Calls f(patternIndex) for every occurrence of a pattern in the text
+		template<typename F>
+		void match(const std::string& text, F f) const
+		{
+			dcassert(compiled);
+			uint32_t state = 0;
+			const uint8_t* p = reinterpret_cast<const uint8_t*>(text.data());
+			const uint8_t* end = p + text.length();
+			for (; p != end; ++p)
+			{
+				state = next[state * classCount + byteClass[*p]];
+				for (uint32_t s = output[state]; s; s = outputLink[s])
+					f(terminal[s]);
+			}
+		}
+
+		// Returns a mask with bit i set when pattern i occurs in the text, requires size() <= 64
+		uint64_t matchMask(const std::string& text) const
+		{
+			dcassert(patternCount <= 64);
+			uint64_t mask = 0;
+			match(text, [&mask](uint32_t index) { mask |= (uint64_t) 1 << index; });
+			return mask;
+		}
+
+	private:
+		static const uint32_t NO_PATTERN = 0xFFFFFFFF;
+
+		struct Node
+		{
+			std::vector<std::pair<uint8_t, uint32_t>> children;
+			uint32_t pattern;
+		};
+
+		std::vector<Node> trie; // released by compile
+		size_t patternCount;
+		bool compiled;
+
+		uint16_t byteClass[256];
+		uint32_t classCount;
+		std::vector<uint32_t> next;
+		std::vector<uint32_t> terminal;   // pattern ending in the state
+		std::vector<uint32_t> output;     // the state itself or the nearest state reachable by suffix links that ends a pattern, 0 if none
+		std::vector<uint32_t> outputLink; // next state ending a pattern along the suffix links, 0 if none
+};
+
+#endif // MULTI_STRING_SEARCH_H_
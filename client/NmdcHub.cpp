@@ -142,7 +142,7 @@ void NmdcHub::refreshUserList(bool refreshOnly)
 	}
 }
 
-OnlineUserPtr NmdcHub::getUser(const string& nick)
+OnlineUserPtr NmdcHub::getUser(const string& nick, OnlineUserList* newUsers)
 {
 	bool addMyUser = false;
 	OnlineUserPtr ou;
@@ -210,7 +210,12 @@ OnlineUserPtr NmdcHub::getUser(const string& nick)
 		if (!Util::isEmpty(ip6)) getMyIdentity().setIP6(ip6);
 	}
 	if (!ou->getUser()->getCID().isZero())
-		ClientManager::getInstance()->putOnline(ou, true);
+	{
+		if (newUsers)
+			newUsers->push_back(ou);
+		else
+			ClientManager::getInstance()->putOnline(ou, true);
+	}
 	return ou;
 }
 
@@ -259,14 +264,17 @@ void NmdcHub::clearUsers()
 			u2.swap(users);
 			bytesShared.store(0);
 		}
+		OnlineUserList offline;
+		offline.reserve(u2.size());
 		for (auto i = u2.cbegin(); i != u2.cend(); ++i)
 		{
 			//i->second->getIdentity().setBytesShared(0);
 			if (!i->second->getUser()->getCID().isZero())
-				ClientManager::getInstance()->putOffline(i->second);
+				offline.push_back(i->second);
 			else
 				dcassert(0);
 		}
+		ClientManager::getInstance()->putOffline(offline);
 	}
 }
 
@@ -1354,13 +1362,15 @@ void NmdcHub::nickListParse(const string& param)
 		const StringTokenizer<string> t(param, "$$");
 		const StringList& sl = t.getTokens();
 		{
+			OnlineUserList newUsers;
 			for (auto it = sl.cbegin(); it != sl.cend(); ++it)
 			{
 				if (it->empty())
 					continue;
-				OnlineUserPtr ou = getUser(*it);
+				OnlineUserPtr ou = getUser(*it, &newUsers);
 				v.push_back(ou);
 			}
+			ClientManager::getInstance()->putOnline(newUsers, true);
 			
 			csState.lock();
 			auto supportFlags = hubSupportFlags;
@@ -155,7 +155,7 @@ class NmdcHub : public Client, private Flags
 		void clearUsers();
 		void onLine(const char* buf, size_t len);
 
-		OnlineUserPtr getUser(const string& nick);
+		OnlineUserPtr getUser(const string& nick, OnlineUserList* newUsers = nullptr);
 		OnlineUserPtr findUser(const string& nick) const override;
 		void putUser(const string& nick);
 		bool getShareGroup(const string& seeker, CID& shareGroup, bool& hideShare) const;
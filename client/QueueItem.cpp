@@ -30,9 +30,9 @@
 #include "version.h"
 
 #ifdef USE_QUEUE_RWLOCK
-std::unique_ptr<RWLock> QueueItem::g_cs = std::unique_ptr<RWLock>(RWLock::create());
+std::unique_ptr<RWLock> QueueItem::g_cs = std::unique_ptr<RWLock>(RWLock::create("QueueItem::g_cs"));
 #else
-std::unique_ptr<CriticalSection> QueueItem::g_cs = std::unique_ptr<CriticalSection>(new CriticalSection);
+std::unique_ptr<CriticalSection> QueueItem::g_cs = std::unique_ptr<CriticalSection>(new CriticalSection("QueueItem::g_cs"));
 #endif
 std::atomic_bool QueueItem::checkTempDir(true);
 
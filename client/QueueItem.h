@@ -88,7 +88,8 @@ class QueueItem
 			XFLAG_TEXT_VIEW         = 0x0080, // File should be viewed as a text file (used with XFLAG_CLIENT_VIEW)
 			XFLAG_AUTODROP          = 0x0100, // Slow sources autodrop is enabled for this file
 			XFLAG_DOWNLOAD_CONTENTS = 0x0200,
-			XFLAG_ALLOW_SEGMENTS    = 0x0400
+			XFLAG_ALLOW_SEGMENTS    = 0x0400,
+			XFLAG_RECHECKING        = 0x0800  // Blocks are being verified, partial data must not be shared
 		};
 
 		// return values for QueueManager::getNextL
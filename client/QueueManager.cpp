@@ -36,6 +36,7 @@
 #include "MerkleCheckOutputStream.h"
 #include "SearchResult.h"
 #include "PathUtil.h"
+#include "FormatUtil.h"
 #include "Util.h"
 #include "SharedFileStream.h"
 #include "ADLSearch.h"
@@ -68,7 +69,7 @@ static string getQueueFile()
 
 QueueManager::FileQueue::FileQueue() :
 #ifdef USE_QUEUE_RWLOCK
-	csFQ(RWLock::create())
+	csFQ(RWLock::create("QueueManager::csFQ"))
 #else
 	csFQ(new CriticalSection)
 #endif
@@ -678,6 +679,7 @@ QueueItemPtr QueueManager::UserQueue::findItemByFlag(const UserPtr& user, int fl
 }
 
 QueueManager::QueueManager() :
+	nextRechecker(0),
 	nextSearch(0),
 	listMatcherAbortFlag(false),
 	dclstLoaderAbortFlag(false),
@@ -712,7 +714,8 @@ void QueueManager::shutdown()
 	listMatcher.shutdown();
 	dclstLoader.shutdown();
 	fileMover.shutdown();
-	rechecker.shutdown();
+	for (int i = 0; i < RECHECKER_JOBS; ++i)
+		rechecker[i].shutdown();
 }
 
 static void getOldFiles(StringList& delList, const string& path, uint64_t currentTime, unsigned days)
@@ -1867,7 +1870,7 @@ void QueueManager::setFile(const DownloadPtr& d)
 			{
 				try
 				{
-					f->setSize(fileSize);
+					f->preallocate(fileSize);
 					qi->setLastSize(fileSize);
 				}
 				catch (Exception&)
@@ -1965,7 +1968,7 @@ void QueueManager::keepFileInTempDir(const string& source, const string& target)
 		LogManager::message(STRING_F(UNABLE_TO_RENAME_FMT, source % newTarget % Util::translateError()));
 }
 
-void QueueManager::copyFile(const string& source, const string& target, QueueItemPtr& qi)
+void QueueManager::copyFile(const string& source, const string& target, QueueItemPtr& qi, const File::ProgressFunc* progress)
 {
 	auto flags = qi->getExtraFlags();
 	dcassert(flags & QueueItem::XFLAG_COPYING);
@@ -1973,7 +1976,7 @@ void QueueManager::copyFile(const string& source, const string& target, QueueIte
 		return;
 	string tempTarget = QueueItem::getDCTempName(target, nullptr);
 	File::ensureDirectory(tempTarget);
-	if (!File::copyFile(source, tempTarget))
+	if (!File::copyFile(source, tempTarget, progress))
 	{
 		LogManager::message(STRING_F(ERROR_COPYING_FILE, target % Util::translateError()));
 		return;
@@ -3169,7 +3172,7 @@ void QueueManager::on(ClientManagerListener::UserDisconnected, const UserPtr& us
 bool QueueManager::isChunkDownloaded(const TTHValue& tth, int64_t startPos, int64_t& bytes, string& target)
 {
 	QueueItemPtr qi = fileQueue.findQueueItem(tth);
-	if (!qi || !qi->isChunkDownloaded(startPos, bytes))
+	if (!qi || (qi->getExtraFlags() & QueueItem::XFLAG_RECHECKING) || !qi->isChunkDownloaded(startPos, bytes))
 		return false;
 	if (!qi->isFinished())
 	{
@@ -3373,6 +3376,8 @@ bool QueueManager::handlePartialSearch(const TTHValue& tth, QueueItem::PartsInfo
 		return false;
 	if (qi->getSize() < QueueItem::PFS_MIN_FILE_SIZE || !qi->getDownloadedBytes())
 		return false;
+	if (qi->getExtraFlags() & QueueItem::XFLAG_RECHECKING)
+		return false;
 
 	// don't share when file does not exist
 	if (qi->isFinished())
@@ -3477,22 +3482,53 @@ bool QueueManager::addDclstFile(const string& path)
 	return true;
 }
 
+void QueueManager::FileMoverJob::onProgress(int64_t copied, int64_t total) noexcept
+{
+	bytesCopied = copied;
+	bytesTotal = total;
+	uint64_t tick = GET_TICK();
+	if (tick < nextReportTick || copied >= total)
+		return;
+	nextReportTick = tick + 30000;
+	if (tick == startTick) return;
+	int64_t speed = copied * 1000 / (int64_t) (tick - startTick);
+	LogManager::message("Copying " + target + ": " + Util::toString(copied * 100 / total) + "% (" +
+		Util::formatBytes(speed) + "/s)", false);
+}
+
+void QueueManager::FileMoverJob::reportCompleted() const noexcept
+{
+	if (bytesTotal < MOVER_LIMIT || bytesCopied != bytesTotal) return;
+	uint64_t elapsed = GET_TICK() - startTick;
+	string text = "Copied " + target + " (" + Util::formatBytes(bytesTotal) + ")";
+	if (elapsed)
+		text += ", " + Util::formatBytes(bytesCopied * 1000 / (int64_t) elapsed) + "/s";
+	LogManager::message(text, false);
+}
+
 void QueueManager::FileMoverJob::run()
 {
+	startTick = GET_TICK();
+	nextReportTick = startTick + 30000;
+	File::ProgressFunc progress = [this](int64_t copied, int64_t total) { onProgress(copied, total); };
 	switch (type)
 	{
 		case MOVE_FILE:
 		case MOVE_FILE_RETRY:
 			if (type == MOVE_FILE)
 			{
-				if (File::renameFile(source, target))
+				if (File::renameFile(source, target, &progress))
+				{
+					reportCompleted();
 					return;
+				}
 				LogManager::message(STRING_F(UNABLE_TO_RENAME_FMT, source % target % Util::translateError()));
 			}
 			if (!File::isExist(source))
 				return;
-			if (File::copyFile(source, target))
+			if (File::copyFile(source, target, &progress))
 			{
+				reportCompleted();
 				File::deleteFile(source);
 				return;
 			}
@@ -3502,36 +3538,210 @@ void QueueManager::FileMoverJob::run()
 
 		case COPY_QI_FILE:
 			dcassert(qi);
-			manager.copyFile(source, target, qi);
+			manager.copyFile(source, target, qi, &progress);
+			reportCompleted();
 			break;
 	}
 }
 
 bool QueueManager::recheck(const string& target)
 {
+	// Two jobs must not check the same file at once
+	string key = Text::toLower(target);
+	{
+		LOCK(csRechecks);
+		if (!pendingRechecks.insert(key).second) return true;
+	}
 	RecheckerJob* job = new RecheckerJob(*this, target);
-	if (!rechecker.addJob(job))
+	unsigned index = nextRechecker++ % RECHECKER_JOBS;
+	if (!rechecker[index].addJob(job))
 	{
 		delete job;
+		LOCK(csRechecks);
+		pendingRechecks.erase(key);
 		return false;
 	}
 	return true;
 }
 
-struct DummyOutputStream : OutputStream
+// Verifies the blocks of one temp file.
+// The file is split into ranges of several blocks which are taken by the
+// job thread and helper threads; each thread reads its range with large
+// sequential requests and marks good blocks as downloaded right away.
+class QueueManager::RecheckContext
+{
+	public:
+		static const size_t READ_AHEAD_SIZE = 4 * 1024 * 1024;
+		static const int HELPER_THREADS = 2;
+
+		RecheckContext(QueueManager& manager, const QueueItemPtr& q, const TigerTree& tt, const string& path, int64_t size,
+		               TokenBucket& budget, const std::atomic_bool& abortFlag) :
+			hasBadBlocks(false), fileError(false), manager(manager), q(q), tt(tt), path(path), size(size),
+			budget(budget), abortFlag(abortFlag), nextPos(0), nextReportTick(0)
+		{
+			int64_t blockSize = tt.getBlockSize();
+			rangeSize = std::max(blockSize, ((int64_t) READ_AHEAD_SIZE + blockSize - 1) / blockSize * blockSize);
+		}
+
+		class HelperThread : public Thread
+		{
+			public:
+				explicit HelperThread(RecheckContext& ctx) : ctx(ctx) {}
+
+			protected:
+				virtual int run() override
+				{
+					ctx.process();
+					return 0;
+				}
+
+			private:
+				RecheckContext& ctx;
+		};
+
+		void process() noexcept;
+		bool isAborted() const { return abortFlag.load(); }
+
+		std::atomic_bool hasBadBlocks;
+		std::atomic_bool fileError;
+
+	private:
+		QueueManager& manager;
+		const QueueItemPtr q;
+		const TigerTree& tt;
+		const string& path;
+		const int64_t size;
+		int64_t rangeSize;
+		TokenBucket& budget;
+		const std::atomic_bool& abortFlag;
+		std::atomic<int64_t> nextPos;
+		std::atomic<uint64_t> nextReportTick;
+
+		bool throttle(int64_t bytes) const noexcept;
+		void processRange(File& f, vector<uint8_t>& buf, int64_t start) noexcept;
+		void blockVerified(int64_t start, int64_t len, bool good) noexcept;
+};
+
+bool QueueManager::RecheckContext::throttle(int64_t bytes) const noexcept
+{
+	while (bytes > 0 && budget.getRate())
+	{
+		int allowed = budget.consume((int) std::min<int64_t>(bytes, READ_AHEAD_SIZE), TokenBucket::PRIORITY_NORMAL, GET_TICK());
+		if (!allowed)
+		{
+			if (isAborted()) return false;
+			BaseThread::sleep(10);
+			continue;
+		}
+		bytes -= allowed;
+	}
+	return !isAborted();
+}
+
+void QueueManager::RecheckContext::blockVerified(int64_t start, int64_t len, bool good) noexcept
 {
-	size_t write(const void*, size_t n) override
+	if (!good)
 	{
-		return n;
+		hasBadBlocks.store(true);
+		dcdebug("Found bad block at " I64_FMT "\n", start);
+		return;
 	}
-	size_t flushBuffers(bool force) override
+	q->addSegment(Segment(start, len));
+	q->updateDownloadedBytes();
+	uint64_t tick = GET_TICK();
+	uint64_t reportTick = nextReportTick.load();
+	if (tick >= reportTick && nextReportTick.compare_exchange_strong(reportTick, tick + 1000))
+		manager.fireStatusUpdated(q);
+}
+
+void QueueManager::RecheckContext::processRange(File& f, vector<uint8_t>& buf, int64_t start) noexcept
+{
+	const int64_t blockSize = tt.getBlockSize();
+	const auto& leaves = tt.getLeaves();
+	const int64_t end = std::min(start + rangeSize, size);
+	int64_t pos = start;
+	int64_t blockStart = start;
+	size_t blockIndex = (size_t) (start / blockSize);
+	unique_ptr<TigerTree> hasher(new TigerTree(blockSize));
+	try
 	{
-		return 0;
+		f.setPos(start);
+		while (pos < end)
+		{
+			size_t toRead = (size_t) std::min<int64_t>(buf.size(), end - pos);
+			if (!throttle(toRead)) return;
+			size_t total = 0;
+			while (total < toRead)
+			{
+				size_t len = toRead - total;
+				size_t n = f.read(buf.data() + total, len);
+				if (n == 0) break;
+				total += n;
+			}
+			if (total == 0) break;
+			size_t offset = 0;
+			while (offset < total)
+			{
+				int64_t blockEnd = std::min(blockStart + blockSize, size);
+				size_t n = (size_t) std::min<int64_t>(total - offset, blockEnd - pos);
+				hasher->update(buf.data() + offset, n);
+				offset += n;
+				pos += n;
+				if (pos == blockEnd)
+				{
+					hasher->finalize();
+					blockVerified(blockStart, blockEnd - blockStart, blockIndex < leaves.size() && hasher->getRoot() == leaves[blockIndex]);
+					blockStart = blockEnd;
+					++blockIndex;
+					hasher.reset(new TigerTree(blockSize));
+				}
+			}
+			if (total < toRead) break;
+		}
 	}
-};
+	catch (const FileException&)
+	{
+		fileError.store(true);
+		return;
+	}
+	// The rest of the range couldn't be read
+	for (; blockStart < end; blockStart += blockSize)
+		blockVerified(blockStart, 0, false);
+}
+
+void QueueManager::RecheckContext::process() noexcept
+{
+	try
+	{
+		File f(path, File::READ, File::OPEN);
+		vector<uint8_t> buf(READ_AHEAD_SIZE);
+		for (;;)
+		{
+			if (isAborted() || fileError.load()) break;
+			int64_t start = nextPos.fetch_add(rangeSize);
+			if (start >= size) break;
+			processRange(f, buf, start);
+		}
+	}
+	catch (const FileException&)
+	{
+		fileError.store(true);
+	}
+}
 
 void QueueManager::RecheckerJob::run()
 {
+	struct PendingGuard
+	{
+		QueueManager& manager;
+		const string& file;
+		~PendingGuard()
+		{
+			LOCK(manager.csRechecks);
+			manager.pendingRechecks.erase(Text::toLower(file));
+		}
+	} pendingGuard { manager, file };
+
 	QueueItemPtr q;
 	int64_t tempSize;
 
@@ -3601,64 +3811,84 @@ void QueueManager::RecheckerJob::run()
 	tempTarget = q->getTempTargetL();
 	q->unlockAttributes();
 
-	//Merklecheck
-	int64_t startPos = 0;
-	DummyOutputStream dummy;
-	int64_t blockSize = tt.getBlockSize();
-	bool hasBadBlocks = false;
-	vector<uint8_t> buf((size_t)min((int64_t)1024 * 1024, blockSize));
-	vector< pair<int64_t, int64_t> > sizes;
+	// The hashing speed limit is used as the disk budget shared by all rechecks
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockRead();
+	int64_t maxSpeed = ss->getInt(Conf::MAX_HASH_SPEED);
+	ss->unlockRead();
+	manager.recheckerBudget.setRate(maxSpeed > 0 ? maxSpeed << 20 : 0);
 
-	try
+	// Good blocks are added back as they are verified,
+	// none of the partial data is shared until the check is done
+	struct RecheckingFlag
+	{
+		const QueueItemPtr& q;
+		RecheckingFlag(const QueueItemPtr& q) : q(q) { q->changeExtraFlags(QueueItem::XFLAG_RECHECKING, QueueItem::XFLAG_RECHECKING); }
+		~RecheckingFlag() { q->changeExtraFlags(0, QueueItem::XFLAG_RECHECKING); }
+	} recheckingFlag(q);
+	vector<Segment> oldSegments;
+	q->getDoneSegments(oldSegments);
+	q->resetDownloaded();
+
+	//Merklecheck
+	RecheckContext ctx(manager, q, tt, tempTarget, std::min(tempSize, tt.getFileSize()), manager.recheckerBudget, manager.recheckerAbortFlag);
+	RecheckContext::HelperThread* helpers[RecheckContext::HELPER_THREADS];
+	int helperCount = 0;
+	for (int i = 0; i < RecheckContext::HELPER_THREADS; ++i)
 	{
-		File inFile(tempTarget, File::READ, File::OPEN);
-		while (startPos < tempSize)
+		helpers[helperCount] = new RecheckContext::HelperThread(ctx);
+		try
 		{
-			try
-			{
-				MerkleCheckOutputStream<TigerTree, false> os(tt, &dummy, startPos);
+			helpers[helperCount]->start(0, "RecheckHelper");
+			++helperCount;
+		}
+		catch (const ThreadException&)
+		{
+			delete helpers[helperCount];
+			break;
+		}
+	}
+	ctx.process();
+	for (int i = 0; i < helperCount; ++i)
+	{
+		helpers[i]->join();
+		delete helpers[i];
+	}
 
-				inFile.setPos(startPos);
-				int64_t bytesLeft = min(tempSize - startPos, blockSize); //Take care of the last incomplete block
-				int64_t segmentSize = bytesLeft;
-				while (bytesLeft > 0)
-				{
-					if (manager.recheckerAbortFlag.load())
-						return;
-					size_t n = (size_t)min((int64_t)buf.size(), bytesLeft);
-					size_t nr = inFile.read(&buf[0], n);
-					os.write(&buf[0], nr);
-					bytesLeft -= nr;
-					if (bytesLeft > 0 && nr == 0)
-					{
-						// Huh??
-						throw Exception();
-					}
-				}
-				os.flushBuffers(true);
-				sizes.push_back(make_pair(startPos, segmentSize));
-			}
-			catch (const Exception&)
+	if (ctx.isAborted() || ctx.fileError.load())
+	{
+		// Don't lose the progress if the check was not completed,
+		// keep the blocks verified or downloaded while it was running too
+		LOCK(q->csSegments);
+		vector<Segment> segments(q->doneSegments.cbegin(), q->doneSegments.cend());
+		segments.insert(segments.end(), oldSegments.cbegin(), oldSegments.cend());
+		std::sort(segments.begin(), segments.end());
+		vector<Segment> merged;
+		for (const Segment& segment : segments)
+		{
+			if (!merged.empty() && segment.getStart() <= merged.back().getEnd())
 			{
-				hasBadBlocks = true;
-				dcdebug("Found bad block at " I64_FMT "\n", startPos);
+				const Segment& last = merged.back();
+				if (segment.getEnd() > last.getEnd())
+					merged.back() = Segment(last.getStart(), segment.getEnd() - last.getStart());
 			}
-			startPos += blockSize;
+			else
+				merged.push_back(segment);
 		}
-	}
-	catch (const FileException&)
-	{
+		q->resetDownloadedL();
+		for (const Segment& segment : merged)
+			q->addSegmentL(segment);
+		q->downloadedBytes = q->doneSegmentsSize;
 		return;
 	}
 
 	// get q again in case it has been (re)moved
-	q = fileQueue.findTarget(file);
-
-	if (!q)
+	QueueItemPtr current = fileQueue.findTarget(file);
+	if (current != q)
 		return;
 
 	//If no bad blocks then the file probably got stuck in the temp folder for some reason
-	if (!hasBadBlocks && q->isFinished())
+	if (!ctx.hasBadBlocks.load() && q->isFinished())
 	{
 		manager.moveFile(tempTarget, file, -1);
 		userQueue.removeQueueItem(q);
@@ -3666,14 +3896,6 @@ void QueueManager::RecheckerJob::run()
 		return;
 	}
 
-	{
-		LOCK(q->csSegments);
-		q->resetDownloadedL();
-		for (auto i = sizes.cbegin(); i != sizes.cend(); ++i)
-			q->addSegmentL(Segment(i->first, i->second));
-		q->downloadedBytes = q->doneSegmentsSize;
-	}
-
 	manager.rechecked(q);
 }
 
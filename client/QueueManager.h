@@ -26,6 +26,7 @@
 #include "QueueItem.h"
 #include "SharedFileStream.h"
 #include "JobExecutor.h"
+#include "TokenBucket.h"
 #include <regex>
 
 class QueueException : public Exception
@@ -177,7 +178,8 @@ class QueueManager : public Singleton<QueueManager>,
 				};
 
 				FileMoverJob(QueueManager& manager, JobType type, const string& source, const string& target, bool moveToOtherDir, const QueueItemPtr& qi) :
-					manager(manager), type(type), source(source), target(target), moveToOtherDir(moveToOtherDir), qi(qi) {}
+					manager(manager), type(type), source(source), target(target), moveToOtherDir(moveToOtherDir), qi(qi),
+					startTick(0), nextReportTick(0), bytesCopied(0), bytesTotal(0) {}
 				virtual void run();
 
 			private:
@@ -187,6 +189,13 @@ class QueueManager : public Singleton<QueueManager>,
 				const bool moveToOtherDir;
 				const JobType type;
 				QueueItemPtr qi;
+				uint64_t startTick;
+				uint64_t nextReportTick;
+				int64_t bytesCopied;
+				int64_t bytesTotal;
+
+				void onProgress(int64_t copied, int64_t total) noexcept;
+				void reportCompleted() const noexcept;
 		};
 
 		JobExecutor fileMover;
@@ -201,7 +210,14 @@ class QueueManager : public Singleton<QueueManager>,
 				virtual void run();
 		};
 
-		JobExecutor rechecker;
+		class RecheckContext;
+
+		static const int RECHECKER_JOBS = 2;
+		JobExecutor rechecker[RECHECKER_JOBS];
+		std::atomic<unsigned> nextRechecker;
+		StringSet pendingRechecks; // lower case targets of queued and running rechecks
+		FastCriticalSection csRechecks;
+		TokenBucket recheckerBudget; // shared by all files being rechecked
 
 	public:
 		void shutdown();
@@ -433,7 +449,7 @@ class QueueManager : public Singleton<QueueManager>,
 
 		void moveFile(const string& source, const string& target, int64_t moverLimit);
 		static void keepFileInTempDir(const string& source, const string& target);
-		void copyFile(const string& source, const string& target, QueueItemPtr& qi);
+		void copyFile(const string& source, const string& target, QueueItemPtr& qi, const File::ProgressFunc* progress = nullptr);
 		void rechecked(const QueueItemPtr& qi);
 
 		static void setDirty();
@@ -4,6 +4,9 @@
 #ifdef _WIN32
 #include "w.h"
 #ifdef OSVER_WIN_XP
+#ifdef LOCK_PROFILER
+#error LOCK_PROFILER is not supported with OSVER_WIN_XP
+#endif
 #include "RWLockWrapper.h"
 typedef RWLockWrapper RWLock;
 #else
@@ -15,6 +18,77 @@ typedef RWLockWin RWLock;
 typedef RWLockPosix RWLock;
 #endif
 
+#ifdef LOCK_PROFILER
+class ReadLockScoped
+{
+	public:
+#ifdef LOCK_DEBUG
+		explicit ReadLockScoped(RWLock& rwLock, const char* filename, int line) : rwLock(rwLock)
+		{
+			LockStats* profile = rwLock.getProfile();
+			if (profile)
+				acquireTime = profile->acquire([&rwLock] { return rwLock.tryAcquireShared(); }, [&] { rwLock.acquireShared(filename, line); }, true);
+			else
+				rwLock.acquireShared(filename, line);
+		}
+#else
+		explicit ReadLockScoped(RWLock& rwLock) : rwLock(rwLock)
+		{
+			LockStats* profile = rwLock.getProfile();
+			if (profile)
+				acquireTime = profile->acquire([&rwLock] { return rwLock.tryAcquireShared(); }, [&rwLock] { rwLock.acquireShared(); }, true);
+			else
+				rwLock.acquireShared();
+		}
+#endif
+		~ReadLockScoped()
+		{
+			LockStats* profile = rwLock.getProfile();
+			uint64_t holdTime = profile ? LockStats::now() - acquireTime : 0;
+			rwLock.releaseShared();
+			if (profile) profile->addHold(holdTime);
+		}
+
+	private:
+		RWLock& rwLock;
+		uint64_t acquireTime = 0;
+};
+
+class WriteLockScoped
+{
+	public:
+#ifdef LOCK_DEBUG
+		explicit WriteLockScoped(RWLock& rwLock, const char* filename, int line) : rwLock(rwLock)
+		{
+			LockStats* profile = rwLock.getProfile();
+			if (profile)
+				acquireTime = profile->acquire([&rwLock] { return rwLock.tryAcquireExclusive(); }, [&] { rwLock.acquireExclusive(filename, line); }, false);
+			else
+				rwLock.acquireExclusive(filename, line);
+		}
+#else
+		explicit WriteLockScoped(RWLock& rwLock) : rwLock(rwLock)
+		{
+			LockStats* profile = rwLock.getProfile();
+			if (profile)
+				acquireTime = profile->acquire([&rwLock] { return rwLock.tryAcquireExclusive(); }, [&rwLock] { rwLock.acquireExclusive(); }, false);
+			else
+				rwLock.acquireExclusive();
+		}
+#endif
+		~WriteLockScoped()
+		{
+			LockStats* profile = rwLock.getProfile();
+			uint64_t holdTime = profile ? LockStats::now() - acquireTime : 0;
+			rwLock.releaseExclusive();
+			if (profile) profile->addHold(holdTime);
+		}
+
+	private:
+		RWLock& rwLock;
+		uint64_t acquireTime = 0;
+};
+#else
 class ReadLockScoped
 {
 	public:
@@ -42,6 +116,7 @@ class WriteLockScoped
 	private:
 		RWLock& rwLock;
 };
+#endif
 
 #ifdef LOCK_DEBUG
 #define READ_LOCK(cs)  ReadLockScoped  lock(cs, __FUNCTION__, __LINE__);
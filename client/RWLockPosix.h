@@ -2,6 +2,7 @@
 #define RW_LOCK_POSIX_H_
 
 #include <pthread.h>
+#include "LockProfiler.h"
 
 class RWLockPosix
 {
@@ -22,7 +23,18 @@ class RWLockPosix
 		void releaseExclusive();
 		void releaseShared();
 
+#ifdef LOCK_PROFILER
+		bool tryAcquireExclusive() { return pthread_rwlock_trywrlock(&lock) == 0; }
+		bool tryAcquireShared() { return pthread_rwlock_tryrdlock(&lock) == 0; }
+#endif
+
 		static RWLockPosix* create() { return new RWLockPosix; }
+		static RWLockPosix* create(const char* name)
+		{
+			RWLockPosix* lock = new RWLockPosix;
+			lock->setName(name);
+			return lock;
+		}
 
 	private:
 		pthread_rwlock_t lock;
@@ -31,6 +43,9 @@ class RWLockPosix
 		const char* ownerFile = nullptr;
 		int ownerLine = 0;
 #endif
+		LOCK_PROFILER_MEMBERS
+
+		void setName(const char* name) { LOCK_PROFILER_SET_NAME(name); }
 };
 
 #endif // RW_LOCK_POSIX_H_
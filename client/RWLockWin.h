@@ -2,6 +2,7 @@
 #define RW_LOCK_WIN_H_
 
 #include "w.h"
+#include "LockProfiler.h"
 
 #ifndef OSVER_WIN_XP
 
@@ -23,7 +24,18 @@ class RWLockWin
 		void releaseExclusive();
 		void releaseShared();
 
+#ifdef LOCK_PROFILER
+		bool tryAcquireExclusive() { return TryAcquireSRWLockExclusive(&lock) != FALSE; }
+		bool tryAcquireShared() { return TryAcquireSRWLockShared(&lock) != FALSE; }
+#endif
+
 		static RWLockWin* create() { return new RWLockWin; }
+		static RWLockWin* create(const char* name)
+		{
+			RWLockWin* lock = new RWLockWin;
+			lock->setName(name);
+			return lock;
+		}
 
 	private:
 		SRWLOCK lock;
@@ -32,6 +44,9 @@ class RWLockWin
 		const char* ownerFile = nullptr;
 		int ownerLine = 0;
 #endif
+		LOCK_PROFILER_MEMBERS
+
+		void setName(const char* name) { LOCK_PROFILER_SET_NAME(name); }
 };
 
 #endif // OSVER_WIN_XP
@@ -22,6 +22,7 @@ class RWLockWrapper
 		virtual void releaseShared() = 0;
 
 		static RWLockWrapper *create();
+		static RWLockWrapper *create(const char* name) { return create(); } // lock profiling is not supported
 
 #ifdef LOCK_DEBUG
 		int lockType = 0;
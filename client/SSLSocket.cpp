@@ -54,6 +54,18 @@ SSLSocket::SSLSocket(CryptoManager::SSLContext context) noexcept : ctx(nullptr),
 
 void SSLSocket::connect(const IpAddressEx& ip, uint16_t port, const string& host)
 {
+	if (sessionKey.empty())
+	{
+		// A session may only be resumed by a connection with the same context and verification mode,
+		// otherwise a session made without verification would let a verified connection skip it
+		char prefix[32];
+		sprintf(prefix, "%p/%c/", static_cast<void*>(ctx), !verifyData ? 'n' : verifyData->first ? 'u' : 'v');
+		sessionKey = prefix;
+		if (verifyData && !verifyData->second.empty())
+			sessionKey += verifyData->second;
+		else
+			sessionKey += (host.empty() ? Util::printIpAddress(ip, true) : host) + ':' + Util::toString(port);
+	}
 	Socket::connect(ip, port, host);
 	waitConnected(0);
 }
@@ -122,6 +134,16 @@ bool SSLSocket::waitConnected(unsigned millis)
 		}
 #endif
 #endif
+		if (!sessionKey.empty() && !SSL_is_server(ssl))
+		{
+			SSL_set_ex_data(ssl, CryptoManager::idxSessionKey, &sessionKey);
+			SSL_SESSION* session = CryptoManager::getInstance()->takeSession(sessionKey);
+			if (session)
+			{
+				SSL_set_session(ssl, session);
+				SSL_SESSION_free(session);
+			}
+		}
 	}
 
 	if (SSL_is_init_finished(ssl))
@@ -134,6 +156,7 @@ bool SSLSocket::waitConnected(unsigned millis)
 		if (ret == 1)
 		{
 			logInfo(isServer);
+			CryptoManager::getInstance()->handshakeCompleted(isServer != 0, SSL_session_reused(ssl) != 0);
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
 			if (isServer) return true;
 			const unsigned char* protocol = 0;
@@ -166,7 +189,7 @@ bool SSLSocket::waitConnected(unsigned millis)
 uint16_t SSLSocket::accept(const Socket& listeningSocket)
 {
 	auto ret = Socket::accept(listeningSocket);
-	waitAccepted(0);
+	if (ret) waitAccepted(0);
 	return ret;
 }
 
@@ -202,6 +225,7 @@ bool SSLSocket::waitAccepted(unsigned millis)
 		if (ret == 1)
 		{
 			logInfo(true);
+			CryptoManager::getInstance()->handshakeCompleted(true, SSL_session_reused(ssl) != 0);
 			dcdebug("SSLSocket accepted using %s\n", SSL_get_cipher(ssl));
 #ifdef _WIN32
 			BIO* bio = SSL_get_rbio(ssl);
@@ -88,6 +88,7 @@ class SSLSocket : public Socket
 		Socket::Protocol nextProto;
 		mutable bool isTrustedCached;
 		string serverName;
+		string sessionKey; // key in the session cache of CryptoManager
 
 		std::unique_ptr<CryptoManager::SSLVerifyData> verifyData;    // application data used by CryptoManager::verify_callback(...)
 
@@ -446,7 +446,7 @@ bool SearchManager::processRES(const char* buf, int len, const IpAddress& remote
 	if (isRES(buf, len))
 	{
 		AdcCommand c(0);
-		int parseResult = c.parse(buf, len-1);
+		int parseResult = c.parse(buf, len-1, false, AdcCommand::PARSE_FLAG_VIEW);
 		if (parseResult != AdcCommand::PARSE_OK)
 		{
 #ifdef _DEBUG
@@ -454,7 +454,7 @@ bool SearchManager::processRES(const char* buf, int len, const IpAddress& remote
 #endif
 			return false;
 		}
-		if (c.getParameters().empty()) return false;
+		if (c.getParamCount() == 0) return false;
 		const string& cid = c.getParam(0);
 		if (cid.size() != 39) return false;
 		UserPtr user = ClientManager::findUser(CID(cid));
@@ -470,7 +470,7 @@ bool SearchManager::processPSR(const char* buf, int len, const IpAddress& remote
 	if (isPSR(buf, len))
 	{
 		AdcCommand c(0);
-		int parseResult = c.parse(buf, len-1);
+		int parseResult = c.parse(buf, len-1, false, AdcCommand::PARSE_FLAG_VIEW);
 		if (parseResult != AdcCommand::PARSE_OK)
 		{
 #ifdef _DEBUG
@@ -478,7 +478,7 @@ bool SearchManager::processPSR(const char* buf, int len, const IpAddress& remote
 #endif
 			return false;
 		}
-		if (c.getParameters().empty()) return false;
+		if (c.getParamCount() == 0) return false;
 		const string& cid = c.getParam(0);
 		if (cid.size() != 39) return false;
 		UserPtr user;
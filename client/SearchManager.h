@@ -27,7 +27,7 @@
 #include "AdcCommand.h"
 #include "Socket.h"
 #include "QueueItem.h"
-#include "Speaker.h"
+#include "SnapshotSpeaker.h"
 #include "Singleton.h"
 
 #ifdef _WIN32
@@ -36,7 +36,7 @@
 
 struct AdcSearchParam;
 
-class SearchManager : public Speaker<SearchManagerListener>, public Singleton<SearchManager>, public Thread
+class SearchManager : public SnapshotSpeaker<SearchManagerListener>, public Singleton<SearchManager>, public Thread
 {
 	public:
 		enum
@@ -37,6 +37,7 @@ void SettingsManager::initSettings()
 	if (!nameMap.empty()) return;
 	coreSettings->initMaps(nameMap, idMap);
 	uiSettings->initMaps(nameMap, idMap);
+	coreSettings->publishSnapshot();
 }
 
 static const string& pathToRelative(const string& path, const string& prefix, string& tmp)
@@ -97,6 +98,7 @@ void SettingsManager::loadSettings(SimpleXML& xml)
 	}
 	xml.stepOut();
 	xml.resetCurrentChild();
+	coreSettings->publishSnapshot();
 }
 
 void SettingsManager::saveSettings(SimpleXML& xml, BaseSettingsImpl* settings) const
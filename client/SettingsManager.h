@@ -22,6 +22,8 @@ public:
 
 	BaseSettingsImpl* getCoreSettings() const { return coreSettings.get(); }
 	BaseSettingsImpl* getUiSettings() const { return uiSettings.get(); }
+	// See ThreadSafeSettingsImpl::getSnapshot for the lifetime of the result
+	const SettingsSnapshot& getCoreSnapshot() const { return coreSettings->getSnapshot(); }
 
 	Settings::SettingInfoPtr getSettingByName(const std::string& name) const;
 	Settings::SettingInfoPtr getSettingById(int id) const;
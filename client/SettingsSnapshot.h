@@ -0,0 +1,60 @@
+#ifndef SETTINGS_SNAPSHOT_H_
+#define SETTINGS_SNAPSHOT_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+// Immutable copy of all values of a settings object, indexed by setting id.
+// A new snapshot is published each time the values are changed,
+// readers holding an older one can keep using it without locking.
+class SettingsSnapshot
+{
+	friend class BaseSettingsImpl;
+	friend class ThreadSafeSettingsImpl;
+
+public:
+	typedef std::shared_ptr<const SettingsSnapshot> Ptr;
+
+	SettingsSnapshot() = default;
+	SettingsSnapshot(const SettingsSnapshot&) = delete;
+	SettingsSnapshot& operator= (const SettingsSnapshot&) = delete;
+
+	int getInt(int id, int defVal = 0) const
+	{
+		if (id < 0 || (size_t) id >= types.size() || types[id] != VALUE_INT) return defVal;
+		return ints[id];
+	}
+
+	bool getBool(int id, bool defVal = false) const
+	{
+		if (id < 0 || (size_t) id >= types.size() || types[id] != VALUE_INT) return defVal;
+		return ints[id] != 0;
+	}
+
+	const std::string& getString(int id) const
+	{
+		if (id < 0 || (size_t) id >= types.size() || types[id] != VALUE_STRING) return emptyString;
+		return strings[id];
+	}
+
+	uint64_t getVersion() const { return version; }
+
+private:
+	enum
+	{
+		VALUE_NONE,
+		VALUE_INT,
+		VALUE_STRING
+	};
+
+	std::vector<uint8_t> types;
+	std::vector<int> ints;
+	std::vector<std::string> strings;
+	uint64_t version = 0;
+
+	static const std::string emptyString;
+};
+
+#endif // SETTINGS_SNAPSHOT_H_
@@ -27,7 +27,6 @@
 #include "FilteredFile.h"
 #include "BZUtils.h"
 #include "ClientManager.h"
-#include "HashBloom.h"
 #include "HashManager.h"
 #include "Wildcards.h"
 #include "StringTokenizer.h"
@@ -45,7 +44,10 @@
 #include "MediaInfoUtil.h"
 #include "Tag16.h"
 #include "unaligned.h"
+#include "Metrics.h"
 #include "version.h"
+#include <thread>
+#include <zlib.h>
 
 STANDARD_EXCEPTION(ShareLoaderException);
 STANDARD_EXCEPTION(ShareWriterException);
@@ -69,6 +71,7 @@ static const string attrTS = "TS";
 static const string attrShared = "Shared";
 
 static const string fileShareData("Share.dat");
+static const string fileShareSnapshot("ShareTree.snap");
 static const string fileBZXml("files.xml.bz2");
 static const string fileAttrXml("FileAttr.xml");
 
@@ -98,6 +101,21 @@ enum
 
 static const size_t MAX_PARTIAL_LIST_SIZE = 512 * 1024;
 
+static Metrics::Histogram metricSearchNmdc("share_search_duration_seconds{proto=\"nmdc\"}", "Time spent searching the share",
+	Metrics::LATENCY_BUCKETS, Metrics::LATENCY_BUCKETS_COUNT, Metrics::MICROSECONDS);
+static Metrics::Histogram metricSearchAdc("share_search_duration_seconds{proto=\"adc\"}", "Time spent searching the share",
+	Metrics::LATENCY_BUCKETS, Metrics::LATENCY_BUCKETS_COUNT, Metrics::MICROSECONDS);
+static Metrics::Counter metricSearchCacheHits("share_search_cache_total{result=\"hit\"}", "Lookups in the search result cache");
+static Metrics::Counter metricSearchCacheMisses("share_search_cache_total{result=\"miss\"}", "Lookups in the search result cache");
+static Metrics::Counter metricSearchBloomRejected("share_search_bloom_rejected_total", "Searches rejected by the share bloom filter");
+
+static Metrics::Callback metricSearchResults("share_search_results_total", "Search results returned from the share", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return ShareManager::isValidInstance() ? ShareManager::getInstance()->getHits() : 0; });
+static Metrics::Callback metricSharedFiles("share_files", "Number of shared files", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return ShareManager::isValidInstance() ? ShareManager::getInstance()->getTotalSharedFiles() : 0; });
+static Metrics::Callback metricSharedSize("share_size_bytes", "Total size of shared files", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return ShareManager::isValidInstance() ? ShareManager::getInstance()->getTotalSharedSize() : 0; });
+
 class ShareLoader : public SimpleXMLReader::CallBack
 {
 	public:
@@ -232,7 +250,7 @@ void ShareManager::loadSharedFile(SharedDir* current, const SharedItemAttribs& a
 	ShareManager::TTHMapItem tthItem;
 	tthItem.dir = current;
 	tthItem.file = file;
-	tthIndex.insert(make_pair(attr.tth, tthItem));
+	tthIndex.insert(attr.tth, tthItem);
 }
 
 void ShareManager::loadSharedDir(SharedDir* &current, const string& filename) noexcept
@@ -367,7 +385,7 @@ bool ShareManager::ShareGroup::hasShare(const ShareManager::ShareListItem& share
 }
 
 ShareManager::ShareManager() :
-	csShare(RWLock::create()),
+	csShare(RWLock::create("ShareManager::csShare")),
 	shareListVersion(1), fileListVersion(1),
 	totalSize(0),
 	totalFiles(0),
@@ -428,7 +446,7 @@ ShareManager::ShareManager() :
 		tickRefresh = std::numeric_limits<uint64_t>::max();
 
 	HashManager::getInstance()->addListener(this);
-	TimerManager::getInstance()->addListener(this);
+	TimerManager::getInstance()->addTask(this, "ShareManager", 1000);
 	SettingsManager::instance.addListener(this);
 }
 
@@ -1224,7 +1242,8 @@ void ShareManager::addFile(const string& path, const TTHValue& root)
 	TTHMapItem tthItem;
 	tthItem.file = file;
 	tthItem.dir = dir;
-	tthIndex.insert(make_pair(root, tthItem));
+	if (!tthIndex.contains(root)) addToHashBloomsL(root);
+	tthIndex.insert(root, tthItem);
 
 	bloom.add(file->getLowerName());
 }
@@ -1372,7 +1391,7 @@ bool ShareManager::parseVirtualPathL(const string& virtualPath, const SharedDir*
 bool ShareManager::isTTHShared(const TTHValue& tth) const noexcept
 {
 	READ_LOCK(*csShare);
-	return tthIndex.find(tth) != tthIndex.end();
+	return tthIndex.contains(tth);
 }
 
 bool ShareManager::getFilePath(const TTHValue& tth, string& path, const CID& shareGroup) const noexcept
@@ -1380,12 +1399,12 @@ bool ShareManager::getFilePath(const TTHValue& tth, string& path, const CID& sha
 	READ_LOCK(*csShare);
 	auto i = shareGroups.find(shareGroup);
 	if (i == shareGroups.cend()) return false;
-	auto p = tthIndex.equal_range(tth);
-	if (p.first == p.second)
+	auto it = tthIndex.find(tth);
+	if (!it)
 		return false;
-	while (p.first != p.second)
+	for (; it; ++it)
 	{
-		const TTHMapItem& item = p.first->second;
+		const TTHMapItem& item = *it;
 		const ShareListItem* share;
 		path = getFilePathL(item.dir, share);
 		if (!path.empty() && i->second.hasShare(*share))
@@ -1393,7 +1412,6 @@ bool ShareManager::getFilePath(const TTHValue& tth, string& path, const CID& sha
 			path += item.file->getName();
 			return true;
 		}
-		++p.first;
 	}
 	path.clear();
 	return false;
@@ -1403,9 +1421,9 @@ bool ShareManager::getFileInfo(const TTHValue& tth, string& path, int64_t& size)
 {
 	READ_LOCK(*csShare);
 	auto it = tthIndex.find(tth);
-	if (it == tthIndex.end())
+	if (!it)
 		return false;
-	const TTHMapItem& item = it->second;
+	const TTHMapItem& item = *it;
 	const ShareListItem* share;
 	path = getFilePathL(item.dir, share);
 	if (!path.empty()) path += item.file->getName();
@@ -1417,9 +1435,9 @@ bool ShareManager::getFileInfo(const TTHValue& tth, string& path) const noexcept
 {
 	READ_LOCK(*csShare);
 	auto it = tthIndex.find(tth);
-	if (it == tthIndex.end())
+	if (!it)
 		return false;
-	const TTHMapItem& item = it->second;
+	const TTHMapItem& item = *it;
 	const ShareListItem* share;
 	path = getFilePathL(item.dir, share);
 	if (!path.empty()) path += item.file->getName();
@@ -1430,12 +1448,24 @@ bool ShareManager::getFileInfo(const TTHValue& tth, int64_t& size) const noexcep
 {
 	READ_LOCK(*csShare);
 	auto it = tthIndex.find(tth);
-	if (it == tthIndex.end())
+	if (!it)
 		return false;
-	size = it->second.file->getSize();
+	size = it->file->getSize();
 	return true;
 }
 
+void ShareManager::getHashes(vector<pair<TTHValue, int64_t>>& files, int64_t minSize) const noexcept
+{
+	READ_LOCK(*csShare);
+	files.reserve(files.size() + tthIndex.size());
+	tthIndex.forEachKey([this, &files, minSize](const TTHValue& tth)
+	{
+		auto item = tthIndex.find(tth);
+		int64_t size = item->file->getSize();
+		if (size > minSize) files.emplace_back(tth, size);
+	});
+}
+
 bool ShareManager::getXmlFileInfo(const CID& id, bool compressed, TTHValue& tth, int64_t& size) const noexcept
 {
 	READ_LOCK(*csShare);
@@ -1490,11 +1520,11 @@ bool ShareManager::getFileInfo(AdcCommand& cmd, const string& filename, bool hid
 		
 	READ_LOCK(*csShare);
 	const auto i = tthIndex.find(tth);
-	if (i == tthIndex.end())
+	if (!i)
 		return false;
 		
-	const SharedDir* dir = i->second.dir;
-	const SharedFilePtr& f = i->second.file;
+	const SharedDir* dir = i->dir;
+	const SharedFilePtr& f = i->file;
 	cmd.addParam(TAG('F', 'N'), getADCPathL(dir) + f->getName());
 	cmd.addParam(TAG('S', 'I'), Util::toString(f->getSize()));
 	cmd.addParam(TAG('T', 'R'), f->getTTH().toBase32());
@@ -1714,43 +1744,154 @@ MemoryInputStream* ShareManager::getTree(const string& virtualFile, const CID& s
 	return getTreeFromStore(tth);
 }
 
+namespace
+{
+	// Fills the counters in range [first, last) of a hash bloom
+	template<typename Index>
+	class HashBloomBuilder : public Thread
+	{
+		public:
+			HashBloomBuilder(const Index& index, CountingHashBloom& bloom, size_t first, size_t last) :
+				index(index), bloom(bloom), first(first), last(last) {}
+
+			void process() noexcept
+			{
+				index.forEachKey([this](const TTHValue& tth) { bloom.add(tth, first, last); });
+			}
+
+		protected:
+			virtual int run() override
+			{
+				process();
+				return 0;
+			}
+
+		private:
+			const Index& index;
+			CountingHashBloom& bloom;
+			const size_t first;
+			const size_t last;
+	};
+}
+
+void ShareManager::buildHashBloomL(CountingHashBloom& bloom) const noexcept
+{
+	const size_t m = bloom.size();
+	unsigned threadCount = 1;
+	if (tthIndex.size() >= 100000)
+		threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), MAX_HASH_BLOOM_THREADS);
+	typedef HashBloomBuilder<TTHIndex<TTHMapItem>> Builder;
+	std::unique_ptr<Builder> builders[MAX_HASH_BLOOM_THREADS];
+	// Each thread owns its own part of the counters, parts are aligned to cache lines
+	size_t partSize = (m / threadCount + 63) & ~(size_t) 63;
+	unsigned started = 0;
+	bool startFailed = false;
+	for (unsigned i = 1; i < threadCount; ++i)
+	{
+		size_t first = std::min(partSize * i, m);
+		size_t last = i == threadCount - 1 ? m : std::min(partSize * (i + 1), m);
+		builders[i].reset(new Builder(tthIndex, bloom, first, last));
+		try
+		{
+			builders[i]->start(0, "HashBloomBuilder");
+			started = i;
+		}
+		catch (const ThreadException&)
+		{
+			builders[i].reset();
+			startFailed = true;
+			break;
+		}
+	}
+	// Parts of the threads that failed to start are processed here, the running threads keep their own parts
+	Builder(tthIndex, bloom, 0, threadCount > 1 ? std::min(partSize, m) : m).process();
+	if (startFailed)
+		Builder(tthIndex, bloom, std::min(partSize * (started + 1), m), m).process();
+	for (unsigned i = 1; i <= started; ++i)
+		builders[i]->join();
+}
+
 void ShareManager::getHashBloom(ByteVector& v, size_t k, size_t m, size_t h) noexcept
 {
 	HashBloomCacheKey key;
 	key.params[0] = k;
 	key.params[1] = m;
 	key.params[2] = h;
-	csHashBloom.lock();
-	const HashBloomCacheItem* item = hashBloom.get(key);
-	if (item)
+
+	READ_LOCK(*csShare);
 	{
-		v.resize(item->size);
-		memcpy(&v[0], item->data.get(), item->size);
-		csHashBloom.unlock();
-		return;
+		LOCK(csHashBloom);
+		for (auto& item : hashBlooms)
+			if (item->key == key)
+			{
+				item->lastUsed = GET_TICK();
+				item->bloom.copy_to(v);
+				return;
+			}
 	}
-	csHashBloom.unlock();
 
 	dcdebug("Creating bloom filter, k=%u, m=%u, h=%u\n", unsigned(k), unsigned(m), unsigned(h));
-	HashBloom bloom;
-	bloom.reset(k, m, h);
+	if (m > MAX_LIVE_HASH_BLOOM_MEMORY)
 	{
-		READ_LOCK(*csShare);
-		for (auto i = tthIndex.cbegin(); i != tthIndex.cend(); ++i)
-			bloom.add(i->first);
+		// Too large to keep updated
+		HashBloom bloom;
+		bloom.reset(k, m, h);
+		tthIndex.forEachKey([&bloom](const TTHValue& tth) { bloom.add(tth); });
+		bloom.copy_to(v);
+		return;
 	}
-	bloom.copy_to(v);
 
-	HashBloomCacheItem newItem;
-	newItem.key = key;
-	newItem.size = v.size();
-	newItem.data.reset(new uint8_t[newItem.size]);
-	memcpy(newItem.data.get(), &v[0], newItem.size);
+	std::unique_ptr<LiveHashBloom> newItem(new LiveHashBloom);
+	newItem->key = key;
+	newItem->bloom.reset(k, m, h);
+	buildHashBloomL(newItem->bloom);
+	newItem->bloom.copy_to(v);
+	newItem->lastUsed = GET_TICK();
 
-	csHashBloom.lock();
-	hashBloom.removeOldest(HASH_BLOOM_CACHE_SIZE);
-	hashBloom.add(newItem);
-	csHashBloom.unlock();
+	// The share can't be changed while csShare is locked, so the new bloom is up to date
+	{
+		LOCK(csHashBloom);
+		size_t memory = m;
+		for (const auto& item : hashBlooms)
+		{
+			if (item->key == key) return;
+			memory += item->bloom.size();
+		}
+		while (!hashBlooms.empty() && (hashBlooms.size() >= MAX_LIVE_HASH_BLOOMS || memory > MAX_LIVE_HASH_BLOOM_MEMORY))
+		{
+			auto oldest = hashBlooms.begin();
+			for (auto i = hashBlooms.begin() + 1; i != hashBlooms.end(); ++i)
+				if ((*i)->lastUsed < (*oldest)->lastUsed) oldest = i;
+			memory -= (*oldest)->bloom.size();
+			hashBlooms.erase(oldest);
+		}
+		hashBlooms.push_back(std::move(newItem));
+	}
+}
+
+void ShareManager::addToHashBloomsL(const TTHValue& tth) noexcept
+{
+	LOCK(csHashBloom);
+	for (auto& item : hashBlooms)
+		item->bloom.add(tth);
+}
+
+void ShareManager::updateHashBloomsL(const TTHIndex<TTHMapItem>& oldIndex) noexcept
+{
+	LOCK(csHashBloom);
+	if (hashBlooms.empty()) return;
+	oldIndex.forEachKey([this](const TTHValue& tth)
+	{
+		if (!tthIndex.contains(tth))
+			for (auto& item : hashBlooms)
+				item->bloom.remove(tth);
+	});
+	tthIndex.forEachKey([this, &oldIndex](const TTHValue& tth)
+	{
+		if (!oldIndex.contains(tth))
+			for (auto& item : hashBlooms)
+				item->bloom.add(tth);
+	});
 }
 
 void ShareManager::writeShareDataL(const SharedDir* dir, OutputStream* shareDataFile, uint8_t tempBuf[]) const
@@ -1768,6 +1909,403 @@ void ShareManager::writeShareDataL(const SharedDir* dir, OutputStream* shareData
 	writeShareDataDirEnd(shareDataFile);
 }
 
+// Share tree snapshot.
+// Unlike Share.dat it consists of fixed size records which are loaded without parsing:
+// header, file records, directory records, names and the name bloom filter.
+// Sections are aligned to 8 bytes. Directories are stored in pre-order,
+// the files of each directory follow the files of the previous one.
+// Names are stored in a separate area, each one prefixed with its 16-bit length.
+static const uint32_t SHARE_SNAPSHOT_MAGIC   = 0x53534C42; // "BLSS"
+static const uint32_t SHARE_SNAPSHOT_VERSION = 1;
+static const uint32_t SHARE_SNAPSHOT_NO_PARENT = 0xFFFFFFFF;
+static const uint32_t SHARE_SNAPSHOT_NO_MEDIA_INFO = 0xFFFFFFFF;
+
+struct ShareSnapshotHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t fileSize;
+	uint64_t shareDataSize; // size of Share.dat written at the same time
+	uint64_t shareListHash;
+	uint64_t fileOffset;
+	uint64_t dirOffset;
+	uint64_t namesOffset;
+	uint64_t namesSize;
+	uint64_t bloomOffset;
+	uint64_t bloomBits;
+	uint32_t fileCount;
+	uint32_t dirCount;
+	uint32_t checksum; // CRC32 of everything after the header
+	uint32_t reserved;
+};
+
+struct ShareSnapshotFile
+{
+	uint8_t tth[TTHValue::BYTES];
+	int64_t size;
+	uint64_t timestamp;
+	uint64_t timeShared;
+	uint32_t name;
+	uint32_t lowerName;
+	uint32_t mediaInfo; // offset of bitrate, width, height, audio and video in names
+	uint16_t typesMask;
+	uint16_t reserved;
+};
+
+struct ShareSnapshotDir
+{
+	uint32_t parent;
+	uint32_t name;
+	uint32_t lowerName;
+	uint32_t fileCount;
+};
+
+static uint32_t updateCrc32(uint32_t crc, const void* data, size_t size)
+{
+	const uint8_t* p = static_cast<const uint8_t*>(data);
+	while (size)
+	{
+		uInt part = (uInt) std::min<size_t>(size, 1 << 30);
+		crc = crc32(crc, p, part);
+		p += part;
+		size -= part;
+	}
+	return crc;
+}
+
+static bool readSnapshotString(const uint8_t* names, uint64_t namesSize, uint64_t offset, string* s)
+{
+	if (offset + 2 > namesSize) return false;
+	size_t len = loadUnaligned16(names + offset);
+	if (offset + 2 + len > namesSize) return false;
+	if (s) s->assign((const char*) names + offset + 2, len);
+	return true;
+}
+
+struct ShareManager::SnapshotWriter
+{
+	BufferedOutputStream<false> stream;
+	uint32_t crc;
+	uint64_t pos;
+	string names;
+	vector<ShareSnapshotDir> dirs;
+	uint32_t fileCount;
+
+	SnapshotWriter(OutputStream* os) : stream(os, 256 * 1024), crc(crc32(0, nullptr, 0)), pos(0), fileCount(0) {}
+
+	void write(const void* data, size_t size)
+	{
+		stream.write(data, size);
+		crc = updateCrc32(crc, data, size);
+		pos += size;
+	}
+
+	void align()
+	{
+		static const uint8_t zero[8] = {};
+		if (pos & 7) write(zero, 8 - (pos & 7));
+	}
+
+	uint32_t addString(const string& s)
+	{
+		if (s.length() > 0xFFFF || names.length() + s.length() + 2 > 0xFFFFFFFF)
+			throw ShareWriterException("Name is too long");
+		uint32_t offset = (uint32_t) names.length();
+		uint8_t len[2];
+		storeUnaligned16(len, (uint16_t) s.length());
+		names.append((const char*) len, 2);
+		names.append(s);
+		return offset;
+	}
+
+	void addNames(const BaseDirItem* item, uint32_t& name, uint32_t& lowerName)
+	{
+		name = addString(item->getName());
+		lowerName = &item->getLowerName() == &item->getName() ? name : addString(item->getLowerName());
+	}
+
+	uint32_t addMediaInfo(const MediaInfoUtil::Info& info)
+	{
+		uint32_t offset = (uint32_t) names.length();
+		uint8_t buf[6];
+		storeUnaligned16(buf, info.bitrate);
+		storeUnaligned16(buf + 2, info.width);
+		storeUnaligned16(buf + 4, info.height);
+		names.append((const char*) buf, sizeof(buf));
+		addString(info.audio);
+		addString(info.video);
+		return offset;
+	}
+};
+
+uint64_t ShareManager::getShareListHashL() const noexcept
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	auto update = [&hash](const string& s)
+	{
+		for (size_t i = 0; i <= s.length(); ++i)
+		{
+			hash ^= (uint8_t) s.c_str()[i];
+			hash *= 0x100000001b3;
+		}
+	};
+	for (const ShareListItem& sli : shares)
+		if (!(sli.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
+		{
+			update(sli.dir->getName());
+			update(sli.realPath.getName());
+		}
+	return hash;
+}
+
+void ShareManager::writeShareSnapshotDirL(const SharedDir* dir, uint32_t parent, SnapshotWriter& writer) const
+{
+	const uint32_t index = (uint32_t) writer.dirs.size();
+	ShareSnapshotDir rec;
+	rec.parent = parent;
+	writer.addNames(dir, rec.name, rec.lowerName);
+	rec.fileCount = 0;
+	for (auto i = dir->files.cbegin(); i != dir->files.cend(); ++i)
+	{
+		const SharedFilePtr& file = i->second;
+		if (file->flags & BaseDirItem::FLAG_HASH_FILE)
+			continue;
+		ShareSnapshotFile fileRec;
+		memcpy(fileRec.tth, file->tth.data, TTHValue::BYTES);
+		fileRec.size = file->size;
+		fileRec.timestamp = file->timestamp;
+		fileRec.timeShared = file->timeShared;
+		writer.addNames(file.get(), fileRec.name, fileRec.lowerName);
+		const MediaInfoUtil::Info* mediaInfo = file->getMediaInfo();
+		fileRec.mediaInfo = mediaInfo ? writer.addMediaInfo(*mediaInfo) : SHARE_SNAPSHOT_NO_MEDIA_INFO;
+		fileRec.typesMask = file->typesMask;
+		fileRec.reserved = 0;
+		writer.write(&fileRec, sizeof(fileRec));
+		rec.fileCount++;
+	}
+	writer.fileCount += rec.fileCount;
+	writer.dirs.push_back(rec);
+	for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
+		writeShareSnapshotDirL(i->second, index, writer);
+}
+
+void ShareManager::writeShareSnapshotL(const string& path, int64_t shareDataSize) const
+{
+	File file(path, File::WRITE, File::TRUNCATE | File::CREATE);
+	ShareSnapshotHeader header;
+	memset(&header, 0, sizeof(header));
+	file.write(&header, sizeof(header));
+
+	SnapshotWriter writer(&file);
+	writer.pos = sizeof(header);
+	header.fileOffset = writer.pos;
+	for (const ShareListItem& sli : shares)
+		if (!(sli.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
+			writeShareSnapshotDirL(sli.dir, SHARE_SNAPSHOT_NO_PARENT, writer);
+	header.dirOffset = writer.pos;
+	if (!writer.dirs.empty())
+		writer.write(writer.dirs.data(), writer.dirs.size() * sizeof(ShareSnapshotDir));
+	header.namesOffset = writer.pos;
+	header.namesSize = writer.names.length();
+	writer.write(writer.names.data(), writer.names.length());
+	writer.align();
+	header.bloomOffset = writer.pos;
+	header.bloomBits = bloom.size();
+	vector<uint64_t> bloomData((bloom.size() + 63) / 64);
+	bloom.copyTo(bloomData.data());
+	writer.write(bloomData.data(), bloomData.size() * sizeof(uint64_t));
+	writer.stream.flushBuffers(false);
+
+	header.magic = SHARE_SNAPSHOT_MAGIC;
+	header.version = SHARE_SNAPSHOT_VERSION;
+	header.fileSize = writer.pos;
+	header.shareDataSize = shareDataSize;
+	header.shareListHash = getShareListHashL();
+	header.fileCount = writer.fileCount;
+	header.dirCount = (uint32_t) writer.dirs.size();
+	header.checksum = writer.crc;
+	file.setPos(0);
+	file.write(&header, sizeof(header));
+}
+
+bool ShareManager::loadShareSnapshot(const string& path, int64_t shareDataSize) noexcept
+{
+	std::unique_ptr<uint64_t[]> buf;
+	size_t size;
+	try
+	{
+		File file(path, File::READ, File::OPEN);
+		int64_t fileSize = file.getSize();
+		if (fileSize < (int64_t) sizeof(ShareSnapshotHeader) || (uint64_t) fileSize > std::numeric_limits<size_t>::max() / 2)
+			return false;
+		size = (size_t) fileSize;
+		buf.reset(new uint64_t[(size + 7) / 8]);
+		size_t len = size;
+		file.read(buf.get(), len);
+		if (len != size) return false;
+	}
+	catch (const Exception&)
+	{
+		return false;
+	}
+	catch (std::bad_alloc&)
+	{
+		return false;
+	}
+
+	const uint8_t* data = reinterpret_cast<const uint8_t*>(buf.get());
+	const ShareSnapshotHeader* header = reinterpret_cast<const ShareSnapshotHeader*>(data);
+	if (header->magic != SHARE_SNAPSHOT_MAGIC || header->version != SHARE_SNAPSHOT_VERSION ||
+	    header->fileSize != size || header->shareDataSize != (uint64_t) shareDataSize ||
+	    header->shareListHash != getShareListHashL())
+		return false;
+	if (header->fileOffset != sizeof(ShareSnapshotHeader) ||
+	    header->dirOffset != header->fileOffset + (uint64_t) header->fileCount * sizeof(ShareSnapshotFile) ||
+	    header->namesOffset != header->dirOffset + (uint64_t) header->dirCount * sizeof(ShareSnapshotDir) ||
+	    header->namesOffset + header->namesSize > header->bloomOffset || (header->bloomOffset & 7) ||
+	    header->bloomOffset + (header->bloomBits + 63) / 64 * sizeof(uint64_t) != size)
+		return false;
+	if (updateCrc32(crc32(0, nullptr, 0), data + sizeof(ShareSnapshotHeader), size - sizeof(ShareSnapshotHeader)) != header->checksum)
+	{
+		LogManager::message("Share snapshot " + fileShareSnapshot + " is corrupted", false);
+		return false;
+	}
+
+	// Check the records before anything is modified
+	const ShareSnapshotFile* files = reinterpret_cast<const ShareSnapshotFile*>(data + header->fileOffset);
+	const ShareSnapshotDir* dirs = reinterpret_cast<const ShareSnapshotDir*>(data + header->dirOffset);
+	const uint8_t* names = data + header->namesOffset;
+	const uint64_t namesSize = header->namesSize;
+	uint64_t totalFiles = 0;
+	for (uint32_t i = 0; i < header->dirCount; ++i)
+	{
+		const ShareSnapshotDir& rec = dirs[i];
+		if (rec.parent == SHARE_SNAPSHOT_NO_PARENT)
+		{
+			string name;
+			if (!readSnapshotString(names, namesSize, rec.name, &name) || getByVirtualL(name) == shares.cend())
+				return false;
+		}
+		else if (rec.parent >= i || !readSnapshotString(names, namesSize, rec.name, nullptr))
+			return false;
+		if (!readSnapshotString(names, namesSize, rec.lowerName, nullptr))
+			return false;
+		totalFiles += rec.fileCount;
+	}
+	if (totalFiles != header->fileCount)
+		return false;
+	for (uint32_t i = 0; i < header->fileCount; ++i)
+	{
+		const ShareSnapshotFile& rec = files[i];
+		if (!readSnapshotString(names, namesSize, rec.name, nullptr) ||
+		    !readSnapshotString(names, namesSize, rec.lowerName, nullptr))
+			return false;
+		if (rec.mediaInfo != SHARE_SNAPSHOT_NO_MEDIA_INFO)
+		{
+			uint64_t offset = (uint64_t) rec.mediaInfo + 6;
+			if (offset > namesSize || !readSnapshotString(names, namesSize, offset, nullptr)) return false;
+			offset += 2 + loadUnaligned16(names + offset);
+			if (!readSnapshotString(names, namesSize, offset, nullptr)) return false;
+		}
+	}
+
+	tthIndex.reserve(header->fileCount);
+	vector<SharedDir*> loadedDirs(header->dirCount);
+	vector<int64_t> fileCounts(header->dirCount);
+	const ShareSnapshotFile* fileRec = files;
+	string name, lowerName;
+	for (uint32_t i = 0; i < header->dirCount; ++i)
+	{
+		const ShareSnapshotDir& rec = dirs[i];
+		readSnapshotString(names, namesSize, rec.name, &name);
+		SharedDir* dir;
+		if (rec.parent == SHARE_SNAPSHOT_NO_PARENT)
+			dir = getByVirtualL(name)->dir;
+		else
+		{
+			SharedDir* parent = loadedDirs[rec.parent];
+			dir = new SharedDir(Util::emptyString, parent);
+			dir->name = name;
+			if (rec.lowerName != rec.name)
+				readSnapshotString(names, namesSize, rec.lowerName, &dir->lowerName);
+			parent->dirs.insert(make_pair(dir->getLowerName(), dir));
+		}
+		loadedDirs[i] = dir;
+		fileCounts[i] = rec.fileCount;
+		dir->files.reserve(dir->files.size() + rec.fileCount);
+
+		TTHMapItem tthItem;
+		tthItem.dir = dir;
+		for (uint32_t j = 0; j < rec.fileCount; ++j, ++fileRec)
+		{
+			readSnapshotString(names, namesSize, fileRec->name, &name);
+			lowerName.clear();
+			if (fileRec->lowerName != fileRec->name)
+				readSnapshotString(names, namesSize, fileRec->lowerName, &lowerName);
+			SharedFilePtr file = std::make_shared<SharedFile>(name, lowerName, fileRec->size, fileRec->timestamp, fileRec->typesMask);
+			memcpy(file->tth.data, fileRec->tth, TTHValue::BYTES);
+			file->timeShared = fileRec->timeShared;
+			if (fileRec->mediaInfo != SHARE_SNAPSHOT_NO_MEDIA_INFO)
+			{
+				const uint8_t* p = names + fileRec->mediaInfo;
+				MediaInfoUtil::Info mediaInfo;
+				mediaInfo.bitrate = loadUnaligned16(p);
+				mediaInfo.width = loadUnaligned16(p + 2);
+				mediaInfo.height = loadUnaligned16(p + 4);
+				uint64_t offset = (uint64_t) fileRec->mediaInfo + 6;
+				readSnapshotString(names, namesSize, offset, &mediaInfo.audio);
+				offset += 2 + mediaInfo.audio.length();
+				readSnapshotString(names, namesSize, offset, &mediaInfo.video);
+				if (mediaInfo.hasData())
+					file->setMediaInfo(mediaInfo);
+			}
+			dir->files.insert(make_pair(file->getLowerName(), file));
+			dir->filesTypesMask |= file->getFileTypes();
+			dir->totalSize += file->getSize();
+			tthItem.file = std::move(file);
+			tthIndex.insert(tthItem.file->tth, tthItem);
+		}
+	}
+
+	// Children follow their parents, so totals can be summed up in reverse order
+	for (uint32_t i = header->dirCount; i--; )
+	{
+		const SharedDir* dir = loadedDirs[i];
+		uint32_t parent = dirs[i].parent;
+		if (parent != SHARE_SNAPSHOT_NO_PARENT)
+		{
+			SharedDir* parentDir = loadedDirs[parent];
+			parentDir->dirsTypesMask |= dir->getTypes();
+			parentDir->totalSize += dir->totalSize;
+			fileCounts[parent] += fileCounts[i];
+		}
+		else
+		{
+			for (ShareListItem& sli : shares)
+				if (sli.dir == dir)
+				{
+					sli.totalFiles = fileCounts[i];
+					break;
+				}
+		}
+	}
+
+	if (header->bloomBits == bloom.size())
+	{
+		bloom.copyFrom(reinterpret_cast<const uint64_t*>(data + header->bloomOffset));
+	}
+	else
+	{
+		for (SharedDir* dir : loadedDirs)
+		{
+			bloom.add(dir->getLowerName());
+			for (const auto& file : dir->files)
+				bloom.add(file.first);
+		}
+	}
+	return true;
+}
+
 class BufferedTigerTreeHasher
 {
 	private:
@@ -2097,6 +2635,9 @@ bool ShareManager::generateFileList(uint64_t tick) noexcept
 		// Write Share.dat
 		++tempFileCount;
 		string newShareDataName = Util::getConfigPath() + "Share" + Util::toString(tempFileCount) + ".dat";
+		const string snapshotFileName = Util::getConfigPath() + fileShareSnapshot;
+		const string newSnapshotName = snapshotFileName + ".tmp";
+		bool snapshotWritten = false;
 		{
 			File outFileShareData(newShareDataName, File::WRITE, File::TRUNCATE | File::CREATE);
 			BufferedOutputStream<false> newShareDataFile(&outFileShareData, 256 * 1024);
@@ -2105,11 +2646,26 @@ bool ShareManager::generateFileList(uint64_t tick) noexcept
 				if (!(i->dir->flags & BaseDirItem::FLAG_SHARE_REMOVED))
 					writeShareDataL(i->dir, &newShareDataFile, tempBuf);
 			newShareDataFile.flushBuffers(true);
+			// Written under the same lock, so it matches Share.dat
+			try
+			{
+				writeShareSnapshotL(newSnapshotName, outFileShareData.getSize());
+				snapshotWritten = true;
+			}
+			catch (const Exception& e)
+			{
+				LogManager::message("Error writing share snapshot: " + e.getError(), false);
+			}
 		}
 		if (File::renameFile(newShareDataName, shareDataFileName))
 			tempShareDataFile.clear();
 		else
 			tempShareDataFile = Util::getFileName(newShareDataName);
+		if (!snapshotWritten || !File::renameFile(newSnapshotName, snapshotFileName))
+		{
+			File::deleteFile(newSnapshotName);
+			File::deleteFile(snapshotFileName);
+		}
 
 		boost::unordered_set<CID> updateGroups;
 		{
@@ -2282,8 +2838,11 @@ void ShareManager::load(SimpleXML& xml)
 		string shareDataFile = Util::getConfigPath() + fileShareData;
 		if (File::isExist(shareDataFile))
 		{
-			File file(shareDataFile, File::READ, File::OPEN);
-			loadShareData(file);
+			if (!loadShareSnapshot(Util::getConfigPath() + fileShareSnapshot, File::getSize(shareDataFile)))
+			{
+				File file(shareDataFile, File::READ, File::OPEN);
+				loadShareData(file);
+			}
 		}
 		else
 		{
@@ -2337,10 +2896,9 @@ bool ShareManager::searchTTH(const TTHValue& tth, vector<SearchResultCore>& resu
 		csShare->releaseShared();
 		return false;
 	}
-	auto p = tthIndex.equal_range(tth);
-	while (p.first != p.second)
+	for (auto it = tthIndex.find(tth); it; ++it)
 	{
-		const auto& item = p.first->second;
+		const auto& item = *it;
 		const SharedDir* topDir;
 		name = getNMDCPathL(item.dir, topDir);
 		if (topDir)
@@ -2359,7 +2917,6 @@ bool ShareManager::searchTTH(const TTHValue& tth, vector<SearchResultCore>& resu
 			incHits();
 			break;
 		}
-		++p.first;
 	}
 	csShare->releaseShared();
 
@@ -2375,7 +2932,7 @@ bool ShareManager::searchTTH(const TTHValue& tth, vector<SearchResultCore>& resu
  * has been matched in the directory name. This new stringlist should also be used in all descendants,
  * but not the parents...
  */
-void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& results, const StringSearch::List& strings, const SearchParamBase& sp) noexcept
+void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& results, const MultiStringSearch& terms, uint64_t remaining, const SearchParamBase& sp) noexcept
 {
 	if (GlobalState::isShuttingDown())
 		return;
@@ -2384,25 +2941,11 @@ void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& resul
 	if (!dir->hasType(sp.fileType))
 		return;
 		
-	const StringSearch::List* cur = &strings;
-	unique_ptr<StringSearch::List> newStr;
-	
-	// Find any matches in the directory name
-	for (auto k = strings.cbegin(); k != strings.cend(); ++k)
-	{
-		if (k->matchKeepCase(dir->getLowerName()))
-		{
-			if (!newStr.get())
-				newStr = std::make_unique<StringSearch::List>(strings);
-			newStr->erase(remove(newStr->begin(), newStr->end(), *k), newStr->end());
-		}
-	}
-	
-	if (newStr.get())
-		cur = newStr.get();
+	// Terms found in the directory name are satisfied for all descendants
+	remaining &= ~terms.matchMask(dir->getLowerName());
 	
 	const bool sizeOk = sp.sizeMode != SIZE_ATLEAST || sp.size == 0;
-	if (cur->empty() &&
+	if (!remaining &&
 	    ((sp.fileType == FILE_TYPE_ANY && sizeOk) || sp.fileType == FILE_TYPE_DIRECTORY))
 	{
 		// We satisfied all the search words! Add the directory...(NMDC searches don't support directory size)
@@ -2422,10 +2965,7 @@ void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& resul
 			if (!file->hasType(sp.fileType))
 				continue;
 
-			const string& name = file->getLowerName();
-			auto j = cur->cbegin();
-			while (j != cur->cend() && j->matchKeepCase(name)) ++j;
-			if (j != cur->cend())
+			if (remaining && (terms.matchMask(file->getLowerName()) & remaining) != remaining)
 				continue;
 			
 			results.emplace_back(SearchResult::TYPE_FILE, file->getSize(), getNMDCPathL(dir) + file->getName(), file->getTTH());
@@ -2437,7 +2977,7 @@ void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& resul
 	if (sp.fileType == FILE_TYPE_ANY || (dir->dirsTypesMask & 1<<sp.fileType))
 		for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
 		{
-			searchL(i->second, results, *cur, sp);
+			searchL(i->second, results, terms, remaining, sp);
 			if (results.size() >= sp.maxResults) break;
 		}
 }
@@ -2446,6 +2986,7 @@ void ShareManager::search(vector<SearchResultCore>& results, const NmdcSearchPar
 {
 	if (GlobalState::isShuttingDown())
 		return;
+	Metrics::ScopedTimer timer(metricSearchNmdc);
 	if (sp.fileType == FILE_TYPE_TTH)
 	{
 		if (Util::isTTHBase32(sp.filter))
@@ -2462,9 +3003,11 @@ void ShareManager::search(vector<SearchResultCore>& results, const NmdcSearchPar
 		const CacheItem* item = searchCache.get(sp.cacheKey);
 		if (item)
 		{
+			metricSearchCacheHits.inc();
 			results = item->results;
 			return;
 		}
+		metricSearchCacheMisses.inc();
 	}
 	
 	const StringTokenizer<string> t(Text::toLower(sp.filter), '$');
@@ -2476,18 +3019,23 @@ void ShareManager::search(vector<SearchResultCore>& results, const NmdcSearchPar
 			bloomMatch = bloom.match(sl);
 		}
 		if (!bloomMatch)
+		{
+			metricSearchBloomRejected.inc();
 			return;
+		}
 	}
 	
-	StringSearch::List ssl;
-	ssl.reserve(sl.size());
+	// All terms are checked in one pass over each name
+	MultiStringSearch terms;
 	for (auto i = sl.cbegin(); i != sl.cend(); ++i)
 	{
 		if (!i->empty())
-			ssl.push_back(StringSearch(*i));
+			terms.addPattern(*i);
 	}
-	if (!ssl.empty())
+	if (!terms.empty() && terms.size() <= MAX_SEARCH_TERMS)
 	{
+		terms.compile();
+		const uint64_t allTerms = terms.size() == 64 ? ~(uint64_t) 0 : ((uint64_t) 1 << terms.size()) - 1;
 		READ_LOCK(*csShare);
 		auto i = shareGroups.find(sp.shareGroup);
 		if (i == shareGroups.cend()) return;
@@ -2497,7 +3045,7 @@ void ShareManager::search(vector<SearchResultCore>& results, const NmdcSearchPar
 		{
 			if (sli.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED) continue;
 			if (!shareGroup.hasShare(sli)) continue;
-			searchL(sli.dir, results, ssl, sp);
+			searchL(sli.dir, results, terms, allTerms, sp);
 			if (results.size() >= sp.maxResults) break;
 		}
 	}
@@ -2649,30 +3197,18 @@ string AdcSearchParam::getDescription() const noexcept
 }
 
 // ADC search
-void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& results, AdcSearchParam& sp, const StringSearch::List* replaceInclude) noexcept
+void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& results, AdcSearchParam& sp, const MultiStringSearch& terms, uint64_t remaining, uint64_t excludeMask) noexcept
 {
 	if (GlobalState::isShuttingDown())
 		return;
 		
-	const StringSearch::List* cur = replaceInclude ? replaceInclude : &sp.include;
-	unique_ptr<StringSearch::List> newStr;
-	
 	// Find any matches in the directory name
-	for (auto k = cur->cbegin(); k != cur->cend(); ++k)
-	{
-		if (k->matchKeepCase(dir->getLowerName()) && !sp.isExcluded(dir->getLowerName()))
-		{
-			if (!newStr.get())
-				newStr = std::make_unique<StringSearch::List>(*cur);
-			newStr->erase(remove(newStr->begin(), newStr->end(), *k), newStr->end());
-		}
-	}
-	
-	if (newStr.get())
-		cur = newStr.get();
+	const uint64_t dirMask = terms.matchMask(dir->getLowerName());
+	if (!(dirMask & excludeMask))
+		remaining &= ~dirMask;
 	
 	const bool sizeOk = sp.gt == 0;
-	if (cur->empty() && sp.exts.empty() && sizeOk)
+	if (!remaining && sp.exts.empty() && sizeOk)
 	{
 		// We satisfied all the search words! Add the directory...
 		results.emplace_back(SearchResult::TYPE_DIRECTORY, dir->totalSize, getNMDCPathL(dir), TTHValue());
@@ -2686,18 +3222,17 @@ void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& resul
 			const SharedFilePtr& file = i->second;
 			if (file->getSize() < sp.gt || file->getSize() > sp.lt) continue;
 			
-			if (sp.isExcluded(file->getLowerName()))
-				continue;
-				
 			// Check file type...
 			const string& name = file->getLowerName();
 			if (!sp.hasExt(name))
 				continue;
 
-			auto j = cur->cbegin();
-			while (j != cur->cend() && j->matchKeepCase(name)) ++j;
-			if (j != cur->cend())
-				continue;
+			if (remaining || excludeMask)
+			{
+				const uint64_t mask = terms.matchMask(name);
+				if ((mask & excludeMask) || (mask & remaining) != remaining)
+					continue;
+			}
 
 			results.emplace_back(SearchResult::TYPE_FILE, file->getSize(), getNMDCPathL(dir) + file->getName(), file->getTTH());
 			incHits();
@@ -2707,7 +3242,7 @@ void ShareManager::searchL(const SharedDir* dir, vector<SearchResultCore>& resul
 	}	
 	for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
 	{
-		searchL(i->second, results, sp, newStr.get());
+		searchL(i->second, results, sp, terms, remaining, excludeMask);
 		if (results.size() >= sp.maxResults) break;
 	}
 }
@@ -2717,6 +3252,7 @@ void ShareManager::search(vector<SearchResultCore>& results, AdcSearchParam& sp)
 {
 	if (GlobalState::isShuttingDown())
 		return;
+	Metrics::ScopedTimer timer(metricSearchAdc);
 		
 	if (sp.hasRoot)
 	{
@@ -2730,26 +3266,46 @@ void ShareManager::search(vector<SearchResultCore>& results, AdcSearchParam& sp)
 		const CacheItem* item = searchCache.get(sp.cacheKey);
 		if (item)
 		{
+			metricSearchCacheHits.inc();
 			results = item->results;
 			return;
 		}
+		metricSearchCacheMisses.inc();
 	}
 
 	{
 		READ_LOCK(*csShare);
 		for (auto i = sp.include.cbegin(); i != sp.include.cend(); ++i)
 			if (!bloom.match(i->getPattern()))
+			{
+				metricSearchBloomRejected.inc();
 				return;
+			}
 
 		auto j = shareGroups.find(sp.shareGroup);
 		if (j == shareGroups.cend()) return;
 		const auto& shareGroup = j->second;
 
+		// Include and exclude terms are checked in one pass over each name
+		MultiStringSearch terms;
+		uint64_t includeMask = 0, excludeMask = 0;
+		if (sp.include.size() + sp.exclude.size() > MAX_SEARCH_TERMS) return;
+		for (const StringSearch& ss : sp.include)
+			if (!ss.getPattern().empty())
+				includeMask |= (uint64_t) 1 << terms.addPattern(ss.getPattern());
+		for (const StringSearch& ss : sp.exclude)
+		{
+			// Empty pattern matches any name
+			if (ss.getPattern().empty()) return;
+			excludeMask |= (uint64_t) 1 << terms.addPattern(ss.getPattern());
+		}
+		terms.compile();
+
 		for (const ShareListItem& sli : shares)
 		{
 			if (sli.dir->flags & BaseDirItem::FLAG_SHARE_REMOVED) continue;
 			if (!shareGroup.hasShare(sli)) continue;
-			searchL(sli.dir, results, sp, nullptr);
+			searchL(sli.dir, results, sp, terms, includeMask, excludeMask);
 			if (results.size() >= sp.maxResults) break;
 		}
 	}
@@ -2801,14 +3357,6 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 	for (auto i = dir->files.begin(); i != dir->files.end(); ++i)
 		i->second->flags |= BaseDirItem::FLAG_NOT_FOUND;
 
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	string tempDownloadDir = ss->getString(Conf::TEMP_DOWNLOAD_DIRECTORY);
-	string logDir = ss->getString(Conf::LOG_DIRECTORY);
-	ss->unlockRead();
-	Util::appendPathSeparator(tempDownloadDir);
-	Util::appendPathSeparator(logDir);
-
 	string lowerName;
 	for (FileFindIter i(path + '*'); i != FileFindIter::end; ++i)
 	{
@@ -2831,9 +3379,9 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 			if (Util::locatedInSysPath(fullPath))
 				continue;
 				
-			if (stricmp(fullPath, tempDownloadDir) == 0 ||
+			if (stricmp(fullPath, scanTempDownloadDir) == 0 ||
 			    stricmp(fullPath, Util::getConfigPath()) == 0 ||
-			    stricmp(fullPath, logDir) == 0 ||
+			    stricmp(fullPath, scanLogDir) == 0 ||
 			    isDirectoryExcludedL(fullPath)) continue;
 
 			SharedDir* subdir;
@@ -2903,7 +3451,7 @@ void ShareManager::scanDir(SharedDir* dir, const string& path)
 					TTHMapItem tthItem;
 					tthItem.file = file;
 					tthItem.dir = dir;
-					tthIndexNew.insert(make_pair(file->getTTH(), tthItem));
+					tthIndexNew.insert(file->getTTH(), tthItem);
 					continue;
 				}
 			}
@@ -2982,7 +3530,11 @@ void ShareManager::scanDirs()
 	optionUseMediaInfo = (ss->getInt(Conf::MEDIA_INFO_OPTIONS) & Conf::MEDIA_INFO_OPTION_ENABLE) != 0;
 	optionForceUpdateMediaInfo = optionUseMediaInfo ? ss->getBool(Conf::MEDIA_INFO_FORCE_UPDATE) : false;
 	ss->setBool(Conf::MEDIA_INFO_FORCE_UPDATE, false);
+	scanTempDownloadDir = ss->getString(Conf::TEMP_DOWNLOAD_DIRECTORY);
+	scanLogDir = ss->getString(Conf::LOG_DIRECTORY);
 	ss->unlockWrite();
+	Util::appendPathSeparator(scanTempDownloadDir);
+	Util::appendPathSeparator(scanLogDir);
 
 	mediaInfoFileTypes = MediaInfoUtil::getMediaInfoFileTypes();
 
@@ -3090,18 +3642,19 @@ void ShareManager::scanDirs()
 		if (updateIndex)
 		{
 			LogManager::message("TTH Index will be rebuilt", false);
+			TTHIndex<TTHMapItem> oldIndex = std::move(tthIndex);
 			tthIndex.clear();
 			tthIndexNew.clear();
 			for (auto i = shares.cbegin(); i != shares.cend(); ++i)
 				updateIndexDirL(i->dir);
+			updateHashBloomsL(oldIndex);
 		}
 		else
 		{
+			TTHIndex<TTHMapItem> oldIndex = std::move(tthIndex);
 			tthIndex = std::move(tthIndexNew);
 			tthIndexNew.clear();
-			csHashBloom.lock();
-			hashBloom.clear();
-			csHashBloom.unlock();
+			updateHashBloomsL(oldIndex);
 		}
 		if (scanAllFlags & SCAN_SHARE_FLAG_REBUILD_BLOOM)
 			updateBloomL();
@@ -3192,7 +3745,7 @@ void ShareManager::updateIndexDirL(const SharedDir* dir) noexcept
 		if (file->flags & BaseDirItem::FLAG_HASH_FILE) continue;
 		tthItem.dir = dir;
 		tthItem.file = file;
-		tthIndex.insert(make_pair(file->getTTH(), tthItem));
+		tthIndex.insert(file->getTTH(), tthItem);
 	}
 	for (auto i = dir->dirs.cbegin(); i != dir->dirs.cend(); ++i)
 		updateIndexDirL(i->second);
@@ -3435,7 +3988,8 @@ void ShareManager::on(FileHashed, int64_t fileID, const SharedFilePtr& file, con
 		TTHMapItem tthItem;
 		tthItem.file = file;
 		tthItem.dir = dir;
-		tthIndex.insert(make_pair(root, tthItem));
+		if (!tthIndex.contains(root)) addToHashBloomsL(root);
+		tthIndex.insert(root, tthItem);
 	}
 	if (fileID > maxHashedFileID)
 		maxHashedFileID = fileID;
@@ -3468,7 +4022,7 @@ void ShareManager::on(HashingAborted) noexcept
 	generateFileList(0);
 }
 
-void ShareManager::on(Second, uint64_t tick) noexcept
+void ShareManager::onTimer(uint64_t tick) noexcept
 {
 	if (doingScanDirs)
 	{
@@ -3515,7 +4069,7 @@ void ShareManager::on(ApplySettings) noexcept
 void ShareManager::shutdown()
 {
 	HashManager::getInstance()->removeListener(this);
-	TimerManager::getInstance()->removeListener(this);
+	TimerManager::getInstance()->removeTask(this);
 	if (doingScanDirs)
 	{
 		stopScanning.store(true);
@@ -29,9 +29,12 @@
 #include "SearchParam.h"
 #include "SearchResult.h"
 #include "StringSearch.h"
+#include "MultiStringSearch.h"
 #include "Streams.h"
 #include "BloomFilter.h"
+#include "HashBloom.h"
 #include "LruCache.h"
+#include "TTHIndex.h"
 #include <regex>
 
 class OutputStream;
@@ -94,7 +97,7 @@ namespace boost
 class ShareManager :
 	public Singleton<ShareManager>,
 	private HashManagerListener,
-	private TimerManagerListener,
+	private TimerManager::Task,
 	private SettingsManagerListener,
 	private Thread
 {
@@ -170,6 +173,7 @@ class ShareManager :
 		bool getFileInfo(const TTHValue& tth, string& path, int64_t& size) const noexcept;
 		bool getFileInfo(const TTHValue& tth, string& path) const noexcept;
 		bool getFileInfo(const TTHValue& tth, int64_t& size) const noexcept;
+		void getHashes(vector<pair<TTHValue, int64_t>>& files, int64_t minSize) const noexcept;
 		bool getFileInfo(AdcCommand& cmd, const string& filename, bool hideShare, const CID& shareGroup) const noexcept;
 		bool findByRealPath(const string& realPath, TTHValue* outTTH, string* outFilename, int64_t* outSize) const noexcept;
 		
@@ -291,7 +295,7 @@ class ShareManager :
 
 		FileAttr fileAttr[MAX_FILE_ATTR];
 
-		boost::unordered_multimap<TTHValue, TTHMapItem> tthIndex;
+		TTHIndex<TTHMapItem> tthIndex;
 		Bloom bloom;
 		
 		size_t hits;
@@ -302,7 +306,7 @@ class ShareManager :
 		std::atomic_bool stopScanning;
 		std::atomic_bool finishedScanDirs;
 		StringList newNotShared;
-		boost::unordered_multimap<TTHValue, TTHMapItem> tthIndexNew;
+		TTHIndex<TTHMapItem> tthIndexNew;
 		Bloom bloomNew;
 		unsigned scanShareFlags;
 		unsigned scanAllFlags;
@@ -314,6 +318,7 @@ class ShareManager :
 		bool optionShareHidden, optionShareSystem, optionShareVirtual;
 		mutable bool optionIncludeUploadCount, optionIncludeTimestamp;
 		bool optionUseMediaInfo, optionForceUpdateMediaInfo;
+		string scanTempDownloadDir, scanLogDir; // with trailing separators, set by scanDirs
 		uint16_t mediaInfoFileTypes;
 		HashDatabaseConnection* hashDb;
 
@@ -342,21 +347,28 @@ class ShareManager :
 		};
 
 		static const size_t SEARCH_CACHE_SIZE = 200;
+		static const size_t MAX_SEARCH_TERMS = 64; // terms are tracked in a bit mask
 		LruCache<CacheItem, string> searchCache;
 		CriticalSection csSearchCache;
 
-		struct HashBloomCacheItem
+		// Hash blooms requested by hubs are kept up to date when the index changes
+		struct LiveHashBloom
 		{
 			HashBloomCacheKey key;
-			std::unique_ptr<uint8_t[]> data;
-			size_t size;
-			HashBloomCacheItem* next;
+			CountingHashBloom bloom;
+			uint64_t lastUsed;
 		};
 
-		static const size_t HASH_BLOOM_CACHE_SIZE = 50;
-		LruCache<HashBloomCacheItem, HashBloomCacheKey> hashBloom;
+		static const size_t MAX_LIVE_HASH_BLOOMS = 4;
+		static const size_t MAX_LIVE_HASH_BLOOM_MEMORY = 64 * 1024 * 1024;
+		static const unsigned MAX_HASH_BLOOM_THREADS = 4;
+		vector<std::unique_ptr<LiveHashBloom>> hashBlooms;
 		CriticalSection csHashBloom;
 
+		void buildHashBloomL(CountingHashBloom& bloom) const noexcept;
+		void addToHashBloomsL(const TTHValue& tth) noexcept;
+		void updateHashBloomsL(const TTHIndex<TTHMapItem>& oldIndex) noexcept;
+
 		ShareManager();
 		~ShareManager();
 
@@ -376,6 +388,12 @@ class ShareManager :
 		static void writeShareDataDirEnd(OutputStream* os);
 		static void writeShareDataFile(OutputStream* os, const SharedFilePtr& file, uint8_t tempBuf[]);
 		void writeShareDataL(const SharedDir* dir, OutputStream* shareDataFile, uint8_t tempBuf[]) const;
+
+		struct SnapshotWriter;
+		bool loadShareSnapshot(const string& path, int64_t shareDataSize) noexcept;
+		void writeShareSnapshotL(const string& path, int64_t shareDataSize) const;
+		void writeShareSnapshotDirL(const SharedDir* dir, uint32_t parent, SnapshotWriter& writer) const;
+		uint64_t getShareListHashL() const noexcept;
 		void writeXmlL(const SharedDir* dir, OutputStream& xmlFile, string& indent, string& tmp, int mode) const;
 		void writeXmlFilesL(const SharedDir* dir, OutputStream& xmlFile, string& indent, string& tmp) const;
 		bool renameXmlFiles() noexcept;
@@ -393,8 +411,8 @@ class ShareManager :
 		bool findByRealPathL(const string& pathLower, SharedDir* &dir, string& filename) const noexcept;
 		bool findByRealPathL(const string& pathLower, SharedDir* &dir, SharedFilePtr& file) const noexcept;
 		
-		void searchL(const SharedDir* dir, vector<SearchResultCore>& results, const StringSearch::List& ssl, const SearchParamBase& sp) noexcept;
-		void searchL(const SharedDir* dir, vector<SearchResultCore>& results, AdcSearchParam& sp, const StringSearch::List* replaceInclude) noexcept;
+		void searchL(const SharedDir* dir, vector<SearchResultCore>& results, const MultiStringSearch& terms, uint64_t remaining, const SearchParamBase& sp) noexcept;
+		void searchL(const SharedDir* dir, vector<SearchResultCore>& results, AdcSearchParam& sp, const MultiStringSearch& terms, uint64_t remaining, uint64_t excludeMask) noexcept;
 
 		void scanDirs();
 		void scanDir(SharedDir* dir, const string& path);
@@ -418,8 +436,8 @@ class ShareManager :
 		virtual void on(HashingError, int64_t fileID, const SharedFilePtr& file, const string& fileName) noexcept override;
 		virtual void on(HashingAborted) noexcept override;
 
-		// TimerManagerListener
-		virtual void on(Second, uint64_t tick) noexcept override;
+		// TimerManager::Task
+		virtual void onTimer(uint64_t tick) noexcept override;
 
 		// SettingsManagerListener
 		virtual void on(Save, SimpleXML& xml) noexcept override;
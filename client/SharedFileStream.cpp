@@ -31,7 +31,7 @@ static const int64_t MAX_MAPPED_FILE_SIZE = 2ll << 30;
 std::vector<bool> SharedFileStream::badDrives(26, false);
 #endif
 
-CriticalSection SharedFileStream::csPool;
+CriticalSection SharedFileStream::csPool("SharedFileStream::csPool");
 std::map<std::string, unsigned > SharedFileStream::filesToDelete;
 SharedFileStream::SharedFileHandleMap SharedFileStream::readPool;
 SharedFileStream::SharedFileHandleMap SharedFileStream::writePool;
@@ -300,10 +300,10 @@ int64_t SharedFileStream::getFastFileSize()
 	return sfh->lastFileSize;
 }
 
-void SharedFileStream::setSize(int64_t newSize)
+void SharedFileStream::preallocate(int64_t newSize)
 {
 	LOCK(sfh->cs);
-	sfh->file.setSize(newSize); // FIXME: this fails when file is memory mapped
+	sfh->file.preallocate(newSize); // FIXME: this fails when file is memory mapped
 	sfh->lastFileSize = newSize;
 }
 
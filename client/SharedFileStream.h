@@ -61,7 +61,7 @@ class SharedFileStream : public IOStream
 
 		//int64_t getFileSize();
 		int64_t getFastFileSize();
-		void setSize(int64_t newSize);
+		void preallocate(int64_t newSize);
 
 		size_t flushBuffers(bool force) override;
 
@@ -0,0 +1,162 @@
+#ifndef SNAPSHOT_SPEAKER_H_
+#define SNAPSHOT_SPEAKER_H_
+
+#include "Locks.h"
+#include "BaseThread.h"
+#include <atomic>
+#include <utility>
+#include <vector>
+#include <algorithm>
+
+class SnapshotSpeakerBase
+{
+	protected:
+		struct FireFrame
+		{
+			const SnapshotSpeakerBase* speaker;
+			FireFrame* prev;
+		};
+
+		static FireFrame*& getFireFrame() noexcept
+		{
+			static thread_local FireFrame* frame = nullptr;
+			return frame;
+		}
+
+		// Returns true if the current thread is inside a callback of this speaker
+		bool isFiring() const noexcept
+		{
+			for (const FireFrame* frame = getFireFrame(); frame; frame = frame->prev)
+				if (frame->speaker == this) return true;
+			return false;
+		}
+};
+
+// Speaker for frequently fired events.
+// Listeners are stored in an immutable array which is replaced on every change,
+// so fire() doesn't lock or copy anything. Unlike Speaker, events may be delivered
+// to a listener from several threads at the same time.
+// addListener/removeListener wait for callbacks running on other threads to finish
+// unless they are called from a callback of the same speaker.
+template<typename Listener>
+class SnapshotSpeaker : private SnapshotSpeakerBase
+{
+		typedef std::vector<Listener*> ListenerList;
+
+	public:
+		SnapshotSpeaker() : listeners(nullptr), epoch(0)
+		{
+			readers[0] = readers[1] = 0;
+		}
+
+		~SnapshotSpeaker()
+		{
+			const ListenerList* current = listeners.load();
+			dcassert(!current || current->empty());
+			delete current;
+			for (const ListenerList* l : retired)
+				delete l;
+		}
+
+		SnapshotSpeaker(const SnapshotSpeaker&) = delete;
+		SnapshotSpeaker& operator= (const SnapshotSpeaker&) = delete;
+
+		template<typename... ArgT>
+		void fire(ArgT && ... args) noexcept
+		{
+			FireFrame frame = { this, getFireFrame() };
+			getFireFrame() = &frame;
+			unsigned slot = epoch.load() & 1;
+			++readers[slot];
+			const ListenerList* current = listeners.load();
+			if (current)
+				for (auto listener : *current)
+					listener->on(std::forward<ArgT>(args)...);
+			--readers[slot];
+			getFireFrame() = frame.prev;
+		}
+
+		void addListener(Listener* listener) noexcept
+		{
+			{
+				LOCK(csWrite);
+				const ListenerList* current = listeners.load();
+				if (current && std::find(current->begin(), current->end(), listener) != current->end())
+					return;
+				ListenerList* newList = current ? new ListenerList(*current) : new ListenerList;
+				newList->push_back(listener);
+				replaceL(current, newList);
+			}
+			if (!isFiring()) synchronize();
+		}
+
+		void removeListener(Listener* listener) noexcept
+		{
+			{
+				LOCK(csWrite);
+				const ListenerList* current = listeners.load();
+				if (!current) return;
+				auto i = std::find(current->begin(), current->end(), listener);
+				if (i == current->end()) return;
+				ListenerList* newList = new ListenerList(*current);
+				newList->erase(newList->begin() + (i - current->begin()));
+				replaceL(current, newList);
+			}
+			if (!isFiring()) synchronize();
+		}
+
+		void removeListeners() noexcept
+		{
+			{
+				LOCK(csWrite);
+				const ListenerList* current = listeners.load();
+				if (!current) return;
+				replaceL(current, nullptr);
+			}
+			if (!isFiring()) synchronize();
+		}
+
+	private:
+		std::atomic<const ListenerList*> listeners;
+		std::vector<const ListenerList*> retired;
+		std::atomic<unsigned> epoch;
+		std::atomic<unsigned> readers[2];
+		CriticalSection csWrite;
+		CriticalSection csSync;
+
+		void replaceL(const ListenerList* current, const ListenerList* newList) noexcept
+		{
+			listeners.store(newList);
+			retired.push_back(current);
+		}
+
+		// Waits until no thread can be using the arrays retired so far and deletes them.
+		// Readers register in one of two slots; flipping the epoch twice and waiting for
+		// both slots to drain can't be starved by new readers.
+		void synchronize() noexcept
+		{
+			LOCK(csSync);
+			std::vector<const ListenerList*> oldLists;
+			{
+				LOCK(csWrite);
+				oldLists.swap(retired);
+			}
+			if (oldLists.empty()) return;
+			for (int i = 0; i < 2; ++i)
+			{
+				unsigned slot = epoch.load() & 1;
+				epoch.store(slot ^ 1);
+				for (int spins = 0; readers[slot].load(); ++spins)
+				{
+					if (spins < 64)
+						BaseThread::yield();
+					else
+						BaseThread::sleep(1);
+				}
+			}
+			for (const ListenerList* l : oldLists)
+				delete l;
+		}
+};
+
+#endif // SNAPSHOT_SPEAKER_H_
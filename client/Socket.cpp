@@ -25,6 +25,7 @@
 #include "ResourceManager.h"
 #include "SettingsManager.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 #ifdef _WIN32
 #include "SysVersion.h"
@@ -52,6 +53,19 @@ SocketException::SocketException(int error) noexcept :
 
 Socket::Stats Socket::g_stats;
 
+static Metrics::Callback metricTcpReceived("network_received_bytes_total{proto=\"tcp\"}", "Bytes received from the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.tcp.downloaded; });
+static Metrics::Callback metricUdpReceived("network_received_bytes_total{proto=\"udp\"}", "Bytes received from the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.udp.downloaded; });
+static Metrics::Callback metricTlsReceived("network_received_bytes_total{proto=\"tls\"}", "Bytes received from the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.ssl.downloaded; });
+static Metrics::Callback metricTcpSent("network_sent_bytes_total{proto=\"tcp\"}", "Bytes sent to the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.tcp.uploaded; });
+static Metrics::Callback metricUdpSent("network_sent_bytes_total{proto=\"udp\"}", "Bytes sent to the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.udp.uploaded; });
+static Metrics::Callback metricTlsSent("network_sent_bytes_total{proto=\"tls\"}", "Bytes sent to the network", Metrics::TYPE_COUNTER,
+	[]() -> int64_t { return Socket::g_stats.ssl.uploaded; });
+
 static bool isAnyAddr(const sockaddr_u& sa)
 {
 	switch (((const sockaddr*) &sa)->sa_family)
@@ -153,7 +167,12 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 #else
 	do
 	{
+#ifdef SOCK_NONBLOCK
+		// Saves the fcntl calls in setBlocking
+		sock = ::accept4(listeningSocket.sock, (struct sockaddr*) &sockAddr, &sockLen, SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
 		sock = ::accept(listeningSocket.sock, (struct sockaddr*) &sockAddr, &sockLen);
+#endif
 	}
 	while (sock == SOCKET_ERROR && getLastError() == EINTR);
 #endif
@@ -161,6 +180,8 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 	if (sock == INVALID_SOCKET)
 	{
 		int error = getLastError();
+		// The queue of a non-blocking listening socket is drained until this happens
+		if (error == SE_EWOULDBLOCK) return 0;
 		if (doLog)
 			LogManager::message(sockName + ": Accept error #" + Util::toString(error), false);
 		throw SocketException(error);
@@ -169,8 +190,8 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 	IpAddress remoteIp;
 	uint16_t port;
 	fromSockAddr(remoteIp, port, sockAddr);
-	if (remoteIp.type == AF_INET && ipGuard.isEnabled() && ipGuard.isBlocked(remoteIp.data.v4))
-		throw SocketException(STRING_F(IP_BLOCKED, "IPGuard" % Util::printIpAddress(remoteIp.data.v4)));
+	if (ipGuard.isEnabled() && ipGuard.isBlocked(remoteIp))
+		throw SocketException(STRING_F(IP_BLOCKED, "IPGuard" % Util::printIpAddress(remoteIp)));
 
 #ifdef _WIN32
 	// Make sure we disable any inherited windows message things for this socket.
@@ -190,7 +211,9 @@ uint16_t Socket::accept(const Socket& listeningSocket)
 
 	// remote IP
 	setIp(remoteIp);
+#ifndef SOCK_NONBLOCK
 	setBlocking(false);
+#endif
 
 	// return the remote port
 	return port;
@@ -305,9 +328,9 @@ void Socket::connect(const IpAddressEx& ip, uint16_t port, const string& host)
 			":" + Util::toString(port) + ", secureTransport=" + Util::toString(getSecureTransport()), false);
 	}
 
-	if (ip.type == AF_INET && ipGuard.isEnabled() && ipGuard.isBlocked(ip.data.v4))
+	if (ipGuard.isEnabled() && ipGuard.isBlocked(ip))
 	{
-		string error = STRING_F(IP_BLOCKED, "IPGuard" % Util::printIpAddress(ip.data.v4));
+		string error = STRING_F(IP_BLOCKED, "IPGuard" % Util::printIpAddress(ip));
 		if (!host.empty()) error += " (" + host + ")";
 		throw SocketException(error);
 	}
@@ -210,7 +210,7 @@ class Socket
 		virtual uint16_t bind(uint16_t port, const IpAddressEx& addr);
 		virtual void listen();
 		/** Accept a socket.
-		@return remote port */
+		@return remote port, 0 if a non-blocking listening socket has no pending connections */
 		virtual uint16_t accept(const Socket& listeningSocket);
 
 		int getSocketOptInt(int level, int option) const;
@@ -0,0 +1,251 @@
+#ifndef TTH_INDEX_H_
+#define TTH_INDEX_H_
+
+#include "HashValue.h"
+#include <vector>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TTH_INDEX_USE_SSE2
+#endif
+
+// Open addressing hash table keyed by TTH.
+// Keys are stored inline next to the first item; other items with the same key
+// are kept in a separate array and linked to the first one.
+// A control byte (7 bits of the hash or EMPTY) is kept for every slot,
+// lookups compare a group of 16 control bytes at once.
+// Items can't be removed; the index is rebuilt when the share is refreshed.
+template<typename Item>
+class TTHIndex
+{
+		struct Entry
+		{
+			Item item;
+			uint32_t next; // index in overflow + 1, 0 if there are no more items
+		};
+
+		struct Slot
+		{
+			TTHValue key;
+			Entry entry;
+		};
+
+		static const size_t GROUP_SIZE = 16;
+		static const uint8_t EMPTY = 0x80;
+
+	public:
+		class ItemIterator
+		{
+			public:
+				explicit operator bool() const { return entry != nullptr; }
+				const Item& operator*() const { return entry->item; }
+				const Item* operator->() const { return &entry->item; }
+				ItemIterator& operator++()
+				{
+					entry = entry->next ? &index->overflow[entry->next - 1] : nullptr;
+					return *this;
+				}
+
+			private:
+				friend class TTHIndex;
+				ItemIterator(const TTHIndex* index, const Entry* entry) : index(index), entry(entry) {}
+
+				const TTHIndex* index;
+				const Entry* entry;
+		};
+
+		TTHIndex() : keyCount(0) {}
+
+		TTHIndex(TTHIndex&& src) noexcept :
+			ctrl(std::move(src.ctrl)), slots(std::move(src.slots)), overflow(std::move(src.overflow)), keyCount(src.keyCount)
+		{
+			src.clear();
+		}
+
+		TTHIndex& operator= (TTHIndex&& src) noexcept
+		{
+			ctrl = std::move(src.ctrl);
+			slots = std::move(src.slots);
+			overflow = std::move(src.overflow);
+			keyCount = src.keyCount;
+			src.clear();
+			return *this;
+		}
+
+		// Returns an iterator over all items with this key
+		ItemIterator find(const TTHValue& key) const
+		{
+			size_t pos;
+			if (!findSlot(key, getHash(key), pos)) return ItemIterator(this, nullptr);
+			return ItemIterator(this, &slots[pos].entry);
+		}
+
+		bool contains(const TTHValue& key) const
+		{
+			size_t pos;
+			return findSlot(key, getHash(key), pos);
+		}
+
+		void insert(const TTHValue& key, const Item& item)
+		{
+			uint64_t hash = getHash(key);
+			size_t pos;
+			if (findSlot(key, hash, pos))
+			{
+				uint32_t* next = &slots[pos].entry.next;
+				while (*next)
+					next = &overflow[*next - 1].next;
+				// Link before push_back which can move the overflow array
+				*next = static_cast<uint32_t>(overflow.size() + 1);
+				overflow.push_back(Entry{item, 0});
+				return;
+			}
+			if ((keyCount + 1) * 8 > slots.size() * 7)
+			{
+				grow();
+				findSlot(key, hash, pos);
+			}
+			ctrl[pos] = getTag(hash);
+			Slot& slot = slots[pos];
+			slot.key = key;
+			slot.entry.item = item;
+			slot.entry.next = 0;
+			++keyCount;
+		}
+
+		// Calls f once for each distinct key
+		template<typename F>
+		void forEachKey(F f) const
+		{
+			for (size_t i = 0; i < ctrl.size(); ++i)
+				if (ctrl[i] != EMPTY) f(slots[i].key);
+		}
+
+		// Allocates enough slots for the given number of distinct keys
+		void reserve(size_t keys)
+		{
+			size_t newSize = slots.empty() ? GROUP_SIZE * 4 : slots.size();
+			while (keys * 8 > newSize * 7)
+				newSize *= 2;
+			if (newSize != slots.size())
+				rehash(newSize);
+		}
+
+		size_t size() const { return keyCount + overflow.size(); }
+		bool empty() const { return keyCount == 0; }
+
+		void clear()
+		{
+			ctrl.clear();
+			slots.clear();
+			overflow.clear();
+			keyCount = 0;
+		}
+
+	private:
+		std::vector<uint8_t> ctrl;
+		std::vector<Slot> slots;
+		std::vector<Entry> overflow;
+		size_t keyCount;
+
+		static uint64_t getHash(const TTHValue& key)
+		{
+			// TTH is a cryptographic hash, its bytes are uniformly distributed
+			uint64_t hash;
+			memcpy(&hash, key.data, sizeof(hash));
+			return hash;
+		}
+
+		static uint8_t getTag(uint64_t hash) { return static_cast<uint8_t>(hash >> 57); }
+
+		// Bit i of the result is set if control byte i of the group equals tag
+		static unsigned matchTag(const uint8_t* group, uint8_t tag)
+		{
+#ifdef TTH_INDEX_USE_SSE2
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+			return static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(static_cast<char>(tag)))));
+#else
+			unsigned result = 0;
+			for (size_t i = 0; i < GROUP_SIZE; ++i)
+				if (group[i] == tag) result |= 1u << i;
+			return result;
+#endif
+		}
+
+		static unsigned matchEmpty(const uint8_t* group)
+		{
+#ifdef TTH_INDEX_USE_SSE2
+			return static_cast<unsigned>(_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group))));
+#else
+			return matchTag(group, EMPTY);
+#endif
+		}
+
+		static unsigned lowestBit(unsigned mask)
+		{
+			unsigned index = 0;
+			while (!(mask & 1))
+			{
+				mask >>= 1;
+				++index;
+			}
+			return index;
+		}
+
+		// Returns true if the key is found, otherwise pos is set to the first empty slot
+		bool findSlot(const TTHValue& key, uint64_t hash, size_t& pos) const
+		{
+			if (ctrl.empty())
+				return false;
+			const size_t groupMask = ctrl.size() / GROUP_SIZE - 1;
+			const uint8_t tag = getTag(hash);
+			size_t group = static_cast<size_t>(hash) & groupMask;
+			for (size_t step = 1;; ++step)
+			{
+				const uint8_t* p = ctrl.data() + group * GROUP_SIZE;
+				for (unsigned mask = matchTag(p, tag); mask; mask &= mask - 1)
+				{
+					size_t i = group * GROUP_SIZE + lowestBit(mask);
+					if (slots[i].key == key)
+					{
+						pos = i;
+						return true;
+					}
+				}
+				unsigned empty = matchEmpty(p);
+				if (empty)
+				{
+					pos = group * GROUP_SIZE + lowestBit(empty);
+					return false;
+				}
+				// Triangular probing visits every group when their number is a power of 2
+				group = (group + step) & groupMask;
+			}
+		}
+
+		void grow()
+		{
+			rehash(slots.empty() ? GROUP_SIZE * 4 : slots.size() * 2);
+		}
+
+		void rehash(size_t newSize)
+		{
+			std::vector<uint8_t> oldCtrl(newSize, EMPTY);
+			std::vector<Slot> oldSlots(newSize);
+			oldCtrl.swap(ctrl);
+			oldSlots.swap(slots);
+			for (size_t i = 0; i < oldCtrl.size(); ++i)
+			{
+				if (oldCtrl[i] == EMPTY) continue;
+				Slot& slot = oldSlots[i];
+				uint64_t hash = getHash(slot.key);
+				size_t pos;
+				findSlot(slot.key, hash, pos);
+				ctrl[pos] = getTag(hash);
+				slots[pos] = std::move(slot);
+			}
+		}
+};
+
+#endif // TTH_INDEX_H_
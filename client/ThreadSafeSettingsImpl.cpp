@@ -1,8 +1,45 @@
 #include "stdinc.h"
 #include "ThreadSafeSettingsImpl.h"
 
-ThreadSafeSettingsImpl::ThreadSafeSettingsImpl() : lock(RWLock::create())
+ThreadSafeSettingsImpl::ThreadSafeSettingsImpl() : lock(RWLock::create()), version(0), changed(false)
 {
+	publishSnapshot();
+}
+
+Settings::Result ThreadSafeSettingsImpl::setInt(int id, int val, int flags)
+{
+	changed = true;
+	return BaseSettingsImpl::setInt(id, val, flags);
+}
+
+void ThreadSafeSettingsImpl::unsetInt(int id)
+{
+	changed = true;
+	BaseSettingsImpl::unsetInt(id);
+}
+
+Settings::Result ThreadSafeSettingsImpl::setBool(int id, bool val)
+{
+	changed = true;
+	return BaseSettingsImpl::setBool(id, val);
+}
+
+Settings::Result ThreadSafeSettingsImpl::setString(int id, const std::string& val, int flags)
+{
+	changed = true;
+	return BaseSettingsImpl::setString(id, val, flags);
+}
+
+void ThreadSafeSettingsImpl::unsetString(int id)
+{
+	changed = true;
+	BaseSettingsImpl::unsetString(id);
+}
+
+void ThreadSafeSettingsImpl::setStringDefault(int id, const std::string& s)
+{
+	changed = true;
+	BaseSettingsImpl::setStringDefault(id, s);
 }
 
 void ThreadSafeSettingsImpl::lockRead()
@@ -22,5 +59,35 @@ void ThreadSafeSettingsImpl::lockWrite()
 
 void ThreadSafeSettingsImpl::unlockWrite()
 {
+	if (changed) publishSnapshot();
 	lock->releaseExclusive();
 }
+
+void ThreadSafeSettingsImpl::publishSnapshot()
+{
+	auto newSnapshot = std::make_shared<SettingsSnapshot>();
+	makeSnapshot(*newSnapshot);
+	uint64_t newVersion = version.load(std::memory_order_relaxed) + 1;
+	newSnapshot->version = newVersion;
+	std::atomic_store(&snapshot, std::shared_ptr<const SettingsSnapshot>(std::move(newSnapshot)));
+	version.store(newVersion, std::memory_order_release);
+	changed = false;
+}
+
+const SettingsSnapshot& ThreadSafeSettingsImpl::getSnapshot() const
+{
+	struct Cache
+	{
+		const ThreadSafeSettingsImpl* owner = nullptr;
+		uint64_t version = 0;
+		SettingsSnapshot::Ptr snapshot;
+	};
+	thread_local Cache cache;
+	if (cache.owner != this || cache.version != version.load(std::memory_order_acquire))
+	{
+		cache.snapshot = std::atomic_load(&snapshot);
+		cache.owner = this;
+		cache.version = cache.snapshot->getVersion();
+	}
+	return *cache.snapshot;
+}
@@ -4,19 +4,40 @@
 #include "BaseSettingsImpl.h"
 #include "RWLock.h"
 #include <memory>
+#include <atomic>
 
+// Values are read under lockRead or through immutable snapshots.
+// Changes made under lockWrite are published as a new snapshot by unlockWrite.
 class ThreadSafeSettingsImpl : public BaseSettingsImpl
 {
 public:
 	ThreadSafeSettingsImpl();
 
+	Result setInt(int id, int val, int flags = 0) override;
+	void unsetInt(int id) override;
+	Result setBool(int id, bool val) override;
+	Result setString(int id, const std::string& val, int flags = 0) override;
+	void unsetString(int id) override;
+	void setStringDefault(int id, const std::string& s) override;
+
 	void lockRead() override;
 	void unlockRead() override;
 	void lockWrite() override;
 	void unlockWrite() override;
 
+	// Returns the latest published values, doesn't need lockRead.
+	// The snapshot is cached per thread and the reference stays valid until the same thread
+	// calls getSnapshot again, so don't keep it. When nothing has changed the cost is one atomic load.
+	const SettingsSnapshot& getSnapshot() const;
+
+	// Must be called with the write lock held or before other threads are started
+	void publishSnapshot();
+
 private:
 	std::unique_ptr<RWLock> lock;
+	std::shared_ptr<const SettingsSnapshot> snapshot; // accessed with std::atomic_load and std::atomic_store
+	std::atomic<uint64_t> version;
+	bool changed;
 };
 
 #endif // THREAD_SAFE_SETTINGS_IMPL_H_
@@ -19,13 +19,9 @@
 #include "stdinc.h"
 #include "ThrottleManager.h"
 #include "SettingsManager.h"
-#include "DownloadManager.h"
-#include "UploadManager.h"
 #include "Util.h"
 #include "ConfCore.h"
 
-static const int64_t MIN_LIMIT = 1;
-
 ThrottleManager::ThrottleManager() : downLimit(0), upLimit(0), enabled(false)
 {
 }
@@ -62,8 +58,8 @@ void ThrottleManager::updateSettings() noexcept
 	if (!ss->getBool(Conf::THROTTLE_ENABLE))
 	{
 		ss->unlockRead();
-		downLimit = 0;
-		upLimit = 0;
+		setDownloadLimit(0);
+		setUploadLimit(0);
 		enabled = false;
 		return;
 	}
@@ -84,21 +80,3 @@ void ThrottleManager::updateSettings() noexcept
 	setDownloadLimit(optDownload);
 	enabled = optUpload != 0 || optDownload != 0;
 }
-
-int64_t ThrottleManager::getSocketUploadLimit() noexcept
-{
-	if (!upLimit) return 0;
-	size_t n = UploadManager::getInstance()->getUploadCount();
-	if (!n) return 0;
-	int64_t result = upLimit / n;
-	return result < MIN_LIMIT ? MIN_LIMIT : result;
-}
-
-int64_t ThrottleManager::getSocketDownloadLimit() noexcept
-{
-	if (!downLimit) return 0;
-	size_t n = DownloadManager::getInstance()->getDownloadCount();
-	if (!n) return 0;
-	int64_t result = downLimit / n;
-	return result < MIN_LIMIT ? MIN_LIMIT : result;
-}
@@ -20,17 +20,26 @@
 #define _THROTTLEMANAGER_H
 
 #include "TimerManager.h"
+#include "TokenBucket.h"
 
 class ThrottleManager : public Singleton<ThrottleManager>, private TimerManagerListener
 {
 	public:
 		size_t getDownloadLimitInKBytes() const { return downLimit >> 10; }
 		size_t getDownloadLimitInBytes() const { return downLimit; }
-		void setDownloadLimit(size_t limitKb) { downLimit = limitKb << 10; }
+		void setDownloadLimit(size_t limitKb)
+		{
+			downLimit = limitKb << 10;
+			downloadBucket.setRate(downLimit);
+		}
 
 		size_t getUploadLimitInKBytes() const { return upLimit >> 10; }
 		size_t getUploadLimitInBytes() const { return upLimit; }
-		void setUploadLimit(size_t limitKb) { upLimit = limitKb << 10; }
+		void setUploadLimit(size_t limitKb)
+		{
+			upLimit = limitKb << 10;
+			uploadBucket.setRate(upLimit);
+		}
 
 		void updateSettings() noexcept;
 		bool isEnabled() const { return enabled; }
@@ -41,8 +50,9 @@ class ThrottleManager : public Singleton<ThrottleManager>, private TimerManagerL
 			updateSettings();
 		}
 
-		int64_t getSocketUploadLimit() noexcept;
-		int64_t getSocketDownloadLimit() noexcept;
+		// Global limits shared by all sockets
+		TokenBucket& getUploadBucket() { return uploadBucket; }
+		TokenBucket& getDownloadBucket() { return downloadBucket; }
 
 	private:
 		friend class Singleton<ThrottleManager>;
@@ -50,6 +60,8 @@ class ThrottleManager : public Singleton<ThrottleManager>, private TimerManagerL
 		size_t downLimit;
 		size_t upLimit;
 		bool enabled;
+		TokenBucket uploadBucket;
+		TokenBucket downloadBucket;
 
 		ThrottleManager();
 		~ThrottleManager();
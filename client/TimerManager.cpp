@@ -24,9 +24,10 @@
 #include "GlobalState.h"
 #endif
 
-TimerManager::TimerManager() : ticksDisabled(false)
+TimerManager::TimerManager() : ticksDisabled(false), wheelTime(0), stopWorkersFlag(false)
 {
 	stopEvent.create();
+	readyEvent.create();
 }
 
 TimerManager::~TimerManager()
@@ -34,6 +35,8 @@ TimerManager::~TimerManager()
 #ifdef _DEBUG
 	dcassert(GlobalState::isShutdown());
 #endif
+	for (TaskEntry* entry : tasks)
+		delete entry;
 }
 
 void TimerManager::shutdown()
@@ -41,14 +44,217 @@ void TimerManager::shutdown()
 	removeListeners();
 	stopEvent.notify();
 	join();
+	stopWorkers();
+}
+
+void TimerManager::addTask(Task* task, const char* name, unsigned interval, unsigned delay) noexcept
+{
+	dcassert(interval);
+	TaskEntry* entry = new TaskEntry;
+	entry->task = task;
+	entry->name = name;
+	entry->interval = interval;
+	entry->running = entry->removed = false;
+	entry->runningThread = 0;
+	entry->runDeadline = 0;
+	entry->stats.name = name;
+	entry->stats.interval = interval;
+	entry->stats.runs = entry->stats.overruns = 0;
+	entry->stats.totalTime = entry->stats.maxTime = entry->stats.maxDelay = 0;
+	uint64_t tick = Util::getTick();
+	LOCK(csTasks);
+	if (!wheelTime) wheelTime = tick / WHEEL_RESOLUTION;
+	tasks.push_back(entry);
+	scheduleL(entry, tick + (delay ? delay : interval));
+}
+
+void TimerManager::removeTask(Task* task) noexcept
+{
+	const uintptr_t currentThread = BaseThread::getCurrentThreadId();
+	csTasks.lock();
+	auto i = std::find_if(tasks.begin(), tasks.end(), [task](const TaskEntry* entry) { return entry->task == task; });
+	if (i == tasks.end())
+	{
+		csTasks.unlock();
+		return;
+	}
+	TaskEntry* entry = *i;
+	tasks.erase(i);
+	entry->removed = true;
+	auto& slot = wheel[(entry->deadline / WHEEL_RESOLUTION) % WHEEL_SIZE];
+	auto j = std::find(slot.begin(), slot.end(), entry);
+	if (j != slot.end()) slot.erase(j);
+	auto k = std::find(readyQueue.begin(), readyQueue.end(), entry);
+	if (k != readyQueue.end())
+	{
+		readyQueue.erase(k);
+		entry->running = false;
+	}
+	while (entry->running && entry->runningThread != currentThread)
+	{
+		csTasks.unlock();
+		Thread::sleep(10);
+		csTasks.lock();
+	}
+	// A task removing itself is deleted by the worker
+	bool canDelete = !entry->running;
+	csTasks.unlock();
+	if (canDelete) delete entry;
+}
+
+void TimerManager::getTaskStats(vector<TaskStats>& res) const noexcept
+{
+	res.clear();
+	LOCK(csTasks);
+	res.reserve(tasks.size());
+	for (const TaskEntry* entry : tasks)
+		res.push_back(entry->stats);
+}
+
+void TimerManager::scheduleL(TaskEntry* entry, uint64_t time) noexcept
+{
+	uint64_t due = time / WHEEL_RESOLUTION;
+	if (due <= wheelTime) due = wheelTime + 1;
+	entry->deadline = due * WHEEL_RESOLUTION;
+	entry->rounds = (unsigned) ((due - wheelTime - 1) / WHEEL_SIZE);
+	wheel[due % WHEEL_SIZE].push_back(entry);
+}
+
+void TimerManager::advanceWheel(uint64_t tick) noexcept
+{
+	bool notify = false;
+	vector<TaskEntry*> current;
+	uint64_t now = tick / WHEEL_RESOLUTION;
+	LOCK(csTasks);
+	if (!wheelTime || now - wheelTime > WHEEL_SIZE)
+	{
+		// First call or the clock jumped, visit every slot once
+		if (now > WHEEL_SIZE) wheelTime = now - WHEEL_SIZE;
+	}
+	while (wheelTime < now)
+	{
+		++wheelTime;
+		auto& slot = wheel[wheelTime % WHEEL_SIZE];
+		if (slot.empty()) continue;
+		current.clear();
+		current.swap(slot);
+		for (TaskEntry* entry : current)
+		{
+			if (entry->rounds)
+			{
+				entry->rounds--;
+				slot.push_back(entry);
+				continue;
+			}
+			if (entry->running)
+				entry->stats.overruns++;
+			else
+			{
+				entry->running = true;
+				entry->runDeadline = entry->deadline;
+				readyQueue.push_back(entry);
+				notify = true;
+			}
+			uint64_t next = entry->deadline + entry->interval;
+			if (next <= tick) next = tick + entry->interval;
+			scheduleL(entry, next);
+		}
+	}
+	if (notify) readyEvent.notify();
+}
+
+void TimerManager::runTask(TaskEntry* entry, uint64_t tick) noexcept
+{
+	uint64_t delay = tick > entry->runDeadline ? tick - entry->runDeadline : 0;
+	entry->task->onTimer(tick);
+	uint64_t time = Util::getTick() - tick;
+	bool deleteEntry = false;
+	{
+		LOCK(csTasks);
+		entry->running = false;
+		entry->runningThread = 0;
+		entry->stats.runs++;
+		entry->stats.totalTime += time;
+		if (time > entry->stats.maxTime) entry->stats.maxTime = time;
+		if (delay > entry->stats.maxDelay) entry->stats.maxDelay = delay;
+		deleteEntry = entry->removed;
+	}
+	if (deleteEntry) delete entry;
+}
+
+int TimerManager::Worker::run()
+{
+	for (;;)
+	{
+		TimerManager::TaskEntry* entry = nullptr;
+		tm->csTasks.lock();
+		if (tm->stopWorkersFlag)
+		{
+			tm->csTasks.unlock();
+			break;
+		}
+		if (!tm->readyQueue.empty())
+		{
+			entry = tm->readyQueue.front();
+			tm->readyQueue.pop_front();
+			entry->runningThread = BaseThread::getCurrentThreadId();
+		}
+		tm->csTasks.unlock();
+		if (entry)
+		{
+			tm->runTask(entry, Util::getTick());
+			continue;
+		}
+		if (tm->readyEvent.timedWait(1000))
+			tm->readyEvent.reset();
+	}
+	return 0;
+}
+
+void TimerManager::startWorkers() noexcept
+{
+	for (int i = 0; i < WORKER_THREADS; ++i)
+	{
+		workers[i].reset(new Worker(this));
+		try
+		{
+			workers[i]->start(0, "TimerWorker");
+		}
+		catch (const ThreadException&)
+		{
+			workers[i].reset();
+		}
+	}
+}
+
+void TimerManager::stopWorkers() noexcept
+{
+	csTasks.lock();
+	stopWorkersFlag = true;
+	csTasks.unlock();
+	readyEvent.notify();
+	for (int i = 0; i < WORKER_THREADS; ++i)
+		if (workers[i])
+		{
+			workers[i]->join();
+			workers[i].reset();
+		}
 }
 
 int TimerManager::run()
 {
+	startWorkers();
+	uint64_t tick = Util::getTick();
+	uint64_t nextSecond = tick + 1000;
 	uint64_t nextMinute = 60000;
-	while (!stopEvent.timedWait(1000))
+	while (!stopEvent.timedWait(WHEEL_RESOLUTION))
 	{
-		uint64_t tick = Util::getTick();
+		tick = Util::getTick();
+		if (!ticksDisabled)
+			advanceWheel(tick);
+		if (tick < nextSecond)
+			continue;
+		nextSecond = tick + 1000;
 		if (!ticksDisabled)
 			fire(TimerManagerListener::Second(), tick);
 		if (tick >= nextMinute)
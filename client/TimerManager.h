@@ -24,6 +24,7 @@
 #include "Thread.h"
 #include "WaitableEvent.h"
 #include <atomic>
+#include <memory>
 
 class TimerManagerListener
 {
@@ -44,6 +45,27 @@ class TimerManagerListener
 class TimerManager : public Speaker<TimerManagerListener>, public Singleton<TimerManager>, public Thread
 {
 	public:
+		// Periodic task with its own interval.
+		// Tasks are run by a pool of worker threads, so a slow task doesn't delay the others.
+		// The same task is never run concurrently with itself.
+		class Task
+		{
+			public:
+				virtual ~Task() {}
+				virtual void onTimer(uint64_t tick) noexcept = 0;
+		};
+
+		struct TaskStats
+		{
+			string name;
+			unsigned interval;
+			uint64_t runs;
+			uint64_t overruns;
+			uint64_t totalTime;
+			uint64_t maxTime;
+			uint64_t maxDelay;
+		};
+
 		void shutdown();
 
 		void setTicksDisabled(bool disabled)
@@ -51,16 +73,68 @@ class TimerManager : public Speaker<TimerManagerListener>, public Singleton<Time
 			ticksDisabled.store(disabled);
 		}
 
+		void addTask(Task* task, const char* name, unsigned interval, unsigned delay = 0) noexcept;
+		// Waits for the task to finish if it's currently running
+		void removeTask(Task* task) noexcept;
+		void getTaskStats(vector<TaskStats>& res) const noexcept;
+
 	private:
+		static const unsigned WHEEL_RESOLUTION = 100;
+		static const unsigned WHEEL_SIZE = 256;
+		static const int WORKER_THREADS = 2;
+
+		struct TaskEntry
+		{
+			Task* task;
+			string name;
+			unsigned interval;
+			uint64_t deadline;
+			uint64_t runDeadline;
+			unsigned rounds;
+			bool running;
+			bool removed;
+			uintptr_t runningThread;
+			TaskStats stats;
+		};
+
+		class Worker : public Thread
+		{
+			public:
+				Worker(TimerManager* tm) : tm(tm) {}
+
+			protected:
+				virtual int run() override;
+
+			private:
+				TimerManager* tm;
+		};
+
 		friend class Singleton<TimerManager>;
+		friend class Worker;
 
 		TimerManager();
 		~TimerManager();
 
 		virtual int run() override;
 
+		void scheduleL(TaskEntry* entry, uint64_t time) noexcept;
+		void advanceWheel(uint64_t tick) noexcept;
+		void runTask(TaskEntry* entry, uint64_t tick) noexcept;
+		void startWorkers() noexcept;
+		void stopWorkers() noexcept;
+
 		WaitableEvent stopEvent;
 		std::atomic_bool ticksDisabled;
+
+		mutable CriticalSection csTasks;
+		vector<TaskEntry*> tasks;
+		vector<TaskEntry*> wheel[WHEEL_SIZE];
+		uint64_t wheelTime;
+
+		std::deque<TaskEntry*> readyQueue;
+		WaitableEvent readyEvent;
+		bool stopWorkersFlag;
+		std::unique_ptr<Worker> workers[WORKER_THREADS];
 };
 
 #endif // DCPLUSPLUS_DCPP_TIMER_MANAGER_H
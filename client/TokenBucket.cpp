@@ -0,0 +1,84 @@
+#include "stdinc.h"
+#include "TokenBucket.h"
+
+static const int64_t MIN_CAPACITY = 4096;
+static const int64_t MIN_GRANT = 1024;
+static const int64_t MAX_REFILL_TIME = 1000;
+
+TokenBucket::TokenBucket() : rate(0), capacity(0), reserve(0), maxGrant(0), tokens(0), lastTick(0), fraction(0)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+void TokenBucket::setRate(int64_t newRate)
+{
+	LOCK(cs);
+	rate = newRate;
+	// Allow bursts of up to 200 ms
+	capacity = std::max(newRate / 5, MIN_CAPACITY);
+	// Last quarter of the bucket is available only to high priority transfers
+	reserve = capacity / 4;
+	// Don't let a single socket empty the bucket
+	maxGrant = std::max(capacity / 4, MIN_GRANT);
+	if (tokens > capacity) tokens = capacity;
+}
+
+void TokenBucket::refill(int64_t tick)
+{
+	if (tick <= lastTick)
+	{
+		if (tick < lastTick) lastTick = tick;
+		return;
+	}
+	int64_t elapsed = tick - lastTick;
+	if (elapsed > MAX_REFILL_TIME) elapsed = MAX_REFILL_TIME;
+	lastTick = tick;
+	int64_t amount = rate * elapsed + fraction;
+	tokens += amount / 1000;
+	fraction = amount % 1000;
+	if (tokens >= capacity)
+	{
+		tokens = capacity;
+		fraction = 0;
+	}
+}
+
+int TokenBucket::consume(int size, int priority, int64_t tick)
+{
+	LOCK(cs);
+	stats.requests++;
+	if (!rate)
+	{
+		stats.bytes += size;
+		return size;
+	}
+	refill(tick);
+	int64_t avail = tokens;
+	if (priority != PRIORITY_HIGH) avail -= reserve;
+	if (avail > maxGrant) avail = maxGrant;
+	if (avail <= 0)
+	{
+		stats.throttled++;
+		return 0;
+	}
+	if (size > avail) size = (int) avail;
+	tokens -= size;
+	stats.bytes += size;
+	return size;
+}
+
+void TokenBucket::refund(int size)
+{
+	dcassert(size >= 0);
+	LOCK(cs);
+	stats.bytes -= size;
+	if (!rate) return;
+	tokens += size;
+	if (tokens > capacity) tokens = capacity;
+}
+
+void TokenBucket::getStats(Stats& result) const
+{
+	LOCK(cs);
+	result = stats;
+}
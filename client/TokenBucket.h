@@ -0,0 +1,55 @@
+#ifndef TOKEN_BUCKET_H_
+#define TOKEN_BUCKET_H_
+
+#include "Locks.h"
+#include <atomic>
+
+// Token bucket shared by all sockets transferring in one direction.
+// Sockets that don't transfer don't take tokens, so their share of the
+// bandwidth is automatically available to the active ones.
+class TokenBucket
+{
+	public:
+		enum
+		{
+			PRIORITY_NORMAL,
+			PRIORITY_HIGH
+		};
+
+		struct Stats
+		{
+			int64_t bytes;
+			int64_t requests;
+			int64_t throttled;
+		};
+
+		TokenBucket();
+
+		TokenBucket(const TokenBucket&) = delete;
+		TokenBucket& operator= (const TokenBucket&) = delete;
+
+		// rate is in bytes per second, 0 means no limit
+		void setRate(int64_t rate);
+		int64_t getRate() const { return rate.load(); }
+
+		// Returns the number of bytes (at most size) the caller is allowed to transfer, 0 if it must wait
+		int consume(int size, int priority, int64_t tick);
+		// Returns tokens that were granted but not used
+		void refund(int size);
+		void getStats(Stats& stats) const;
+
+	private:
+		mutable FastCriticalSection cs;
+		std::atomic<int64_t> rate;
+		int64_t capacity;
+		int64_t reserve;
+		int64_t maxGrant;
+		int64_t tokens;
+		int64_t lastTick;
+		int64_t fraction;
+		Stats stats;
+
+		void refill(int64_t tick);
+};
+
+#endif // TOKEN_BUCKET_H_
@@ -56,6 +56,10 @@ class Transfer
 			pos += addPos;
 			actual += addActual;
 		}
+		void truncatePos(int64_t value)
+		{
+			if (pos > value) pos = value;
+		}
 
 		int64_t getRunningAverage() const;
 		int64_t getActual() const { return actual; }
@@ -41,6 +41,7 @@
 #include "GlobalState.h"
 #include "ChatOptions.h"
 #include "ConfCore.h"
+#include "Metrics.h"
 
 static const unsigned WAIT_TIME_LAST_CHUNK     = 3000;
 static const unsigned WAIT_TIME_OTHER_CHUNK    = 8000;
@@ -55,6 +56,13 @@ uint32_t UploadManager::g_count_WaitingUsersFrame = 0;
 int UploadManager::g_running = 0;
 int64_t UploadManager::g_runningAverage;
 
+static Metrics::Counter metricUploadsOk("transfers_total{dir=\"upload\",result=\"ok\"}", "Finished transfers (segments, lists and trees)");
+static Metrics::Counter metricUploadsFailed("transfers_total{dir=\"upload\",result=\"failed\"}", "Finished transfers (segments, lists and trees)");
+static Metrics::Callback metricUploadsActive("transfers_active{dir=\"upload\"}", "Running transfers", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return UploadManager::isValidInstance() ? UploadManager::getInstance()->getUploadCount() : 0; });
+static Metrics::Callback metricUploadSpeed("transfer_speed_bytes{dir=\"upload\"}", "Average transfer speed in bytes per second", Metrics::TYPE_GAUGE,
+	[]() -> int64_t { return UploadManager::getRunningAverage(); });
+
 void WaitingUser::addWaitingFile(const UploadQueueFilePtr& uqi)
 {
 	if (waitingFiles.size() >= MAX_WAITING_FILES) waitingFiles.erase(waitingFiles.begin());
@@ -195,12 +203,10 @@ bool UploadManager::prepareFile(UserConnection* source, const string& typeStr, c
 		tth = TTHValue(fileName.c_str() + 4);
 
 	// read settings
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	const bool optExtraSlotToDl = ss->getBool(Conf::EXTRA_SLOT_TO_DL);
-	const int optMinislotSize = ss->getInt(Conf::MINISLOT_SIZE);
-	const int optExtraPartialSlots = ss->getInt(Conf::EXTRA_PARTIAL_SLOTS);
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	const bool optExtraSlotToDl = ss.getBool(Conf::EXTRA_SLOT_TO_DL);
+	const int optMinislotSize = ss.getInt(Conf::MINISLOT_SIZE);
+	const int optExtraPartialSlots = ss.getInt(Conf::EXTRA_PARTIAL_SLOTS);
 
 	try
 	{
@@ -516,6 +522,8 @@ bool UploadManager::prepareFile(UserConnection* source, const string& typeStr, c
 
 	u->setFileSize(fileSize);
 	u->setType(type);
+	// File lists and trees are small, don't make them wait behind file uploads
+	source->setThrottlePriority(type == Transfer::TYPE_FILE ? TokenBucket::PRIORITY_NORMAL : TokenBucket::PRIORITY_HIGH);
 	
 	{
 		WRITE_LOCK(*csFinishedUploads);
@@ -802,11 +810,8 @@ void UploadManager::processGET(UserConnection* source, const AdcCommand& c) noex
 	int compressionType = COMPRESSION_DISABLED;
 	if (c.hasFlag(TAG('Z', 'L'), 4))
 	{
-		auto ss = SettingsManager::instance.getCoreSettings();
-		ss->lockRead();
-		if (ss->getInt(Conf::MAX_COMPRESSION))
+		if (SettingsManager::instance.getCoreSnapshot().getInt(Conf::MAX_COMPRESSION))
 			compressionType = COMPRESSION_CHECK_FILE_TYPE;
-		ss->unlockRead();
 	}
 
 	if (prepareFile(source, type, fname, hideShare, shareGroup, startPos, bytes, c.hasFlag(TAG('R', 'E'), 4), compressionType, errorText))
@@ -854,7 +859,7 @@ void UploadManager::processGET(UserConnection* source, const AdcCommand& c) noex
 
 void UploadManager::processGFI(UserConnection* source, const AdcCommand& c) noexcept
 {
-	if (c.getParameters().size() < 2)
+	if (c.getParamCount() < 2)
 	{
 		source->send(AdcCommand(AdcCommand::SEV_RECOVERABLE, AdcCommand::ERROR_PROTOCOL_GENERIC, "Missing parameters"));
 		return;
@@ -887,6 +892,7 @@ void UploadManager::failed(UserConnection* source, const string& error) noexcept
 	
 	if (u)
 	{
+		metricUploadsFailed.inc();
 		fire(UploadManagerListener::Failed(), u, error);
 		dcdebug("UM::onFailed (%s): Removing upload\n", error.c_str());
 		removeUpload(u);
@@ -901,6 +907,7 @@ void UploadManager::transmitDone(UserConnection* source) noexcept
 	dcassert(source->getState() == UserConnection::STATE_RUNNING);
 	auto u = source->getUpload();
 	dcassert(u != nullptr);
+	metricUploadsOk.inc();
 	u->updateSpeed(source->getLastActivity());
 	
 	source->setState(UserConnection::STATE_GET);
@@ -1404,20 +1411,16 @@ void UploadManager::load()
 
 int UploadManager::getSlots() noexcept
 {
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	const int slots = ss->getInt(Conf::SLOTS);
-	const int hubSlots = ss->getInt(Conf::HUB_SLOTS);
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	const int slots = ss.getInt(Conf::SLOTS);
+	const int hubSlots = ss.getInt(Conf::HUB_SLOTS);
 	return std::max(slots, std::max(hubSlots, 0) * Client::getTotalCounts());
 }
 
 int UploadManager::getFreeExtraSlots() const
 {
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	const int extraSlots = ss->getInt(Conf::EXTRA_SLOTS);
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	const int extraSlots = ss.getInt(Conf::EXTRA_SLOTS);
 	return std::max(extraSlots - getExtra(), 0);
 }
 
@@ -23,6 +23,7 @@
 #include <set>
 #include "Singleton.h"
 #include "UploadManagerListener.h"
+#include "SnapshotSpeaker.h"
 #include "ClientManagerListener.h"
 #include "UserConnection.h"
 #include "Client.h"
@@ -90,7 +91,7 @@ class WaitingUser
 		GETSET(string, token, Token);
 };
 
-class UploadManager : private ClientManagerListener, public Speaker<UploadManagerListener>, private TimerManagerListener, public Singleton<UploadManager>
+class UploadManager : private ClientManagerListener, public SnapshotSpeaker<UploadManagerListener>, private TimerManagerListener, public Singleton<UploadManager>
 {
 		friend class Singleton<UploadManager>;
 
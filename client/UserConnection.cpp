@@ -117,6 +117,20 @@ void UserConnection::updateLastActivity()
 bool UserConnection::isIpBlocked(bool isDownload)
 {
 	IpAddress ip = getRemoteIp();
+	if (ip.type == AF_INET6)
+	{
+#ifdef BL_FEATURE_IPFILTER
+		if (ipTrust.isBlocked(ip.data.v6))
+		{
+			LogManager::message(STRING_F(IP_BLOCKED, "IPTrust" % Util::printIpAddress(ip.data.v6)));
+			yourIpIsBlocked();
+			getUser()->setFlag(User::PG_IPTRUST_BLOCK);
+			QueueManager::getInstance()->removeSource(getUser(), QueueItem::Source::FLAG_REMOVED);
+			return true;
+		}
+#endif
+		return false;
+	}
 	if (ip.type != AF_INET) return false;
 
 /*
@@ -354,7 +368,7 @@ void UserConnection::onDataLine(const char* buf, size_t len) noexcept
 		if (!param.empty())
 		{
 			IpAddress addr = getRemoteIp();
-			if (addr.type == AF_INET && ipGuard.isBlocked(addr.data.v4))
+			if (ipGuard.isBlocked(addr))
 			{
 				LogManager::message(STRING_F(IP_BLOCKED, "IPGuard" % Util::printIpAddress(addr)));
 				yourIpIsBlocked();
@@ -503,7 +517,7 @@ void UserConnection::addAcceptedSocket(unique_ptr<Socket>& newSock, uint16_t por
 void UserConnection::handle(AdcCommand::STA t, const AdcCommand& c)
 {
 	int status = -1;
-	if (c.getParameters().size() >= 2)
+	if (c.getParamCount() >= 2)
 	{
 		const string& code = c.getParam(0);
 		if (!code.empty())
@@ -822,10 +836,8 @@ void UserConnection::send(const string& str)
 
 void UserConnection::setDefaultLimit()
 {
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	int defaultLimit = ss->getInt(Conf::PER_USER_UPLOAD_SPEED_LIMIT);
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	int defaultLimit = ss.getInt(Conf::PER_USER_UPLOAD_SPEED_LIMIT);
 	setUploadLimit(defaultLimit ? defaultLimit : FavoriteUser::UL_NONE);
 }
 
@@ -870,10 +882,8 @@ void UserConnection::setUploadLimit(int lim)
 
 void UserConnection::maxedOut(size_t queuePosition)
 {
-	auto ss = SettingsManager::instance.getCoreSettings();
-	ss->lockRead();
-	bool sendQueuePos = ss->getBool(Conf::SEND_QP_PARAM);
-	ss->unlockRead();
+	const auto& ss = SettingsManager::instance.getCoreSnapshot();
+	bool sendQueuePos = ss.getBool(Conf::SEND_QP_PARAM);
 	if (isSet(FLAG_NMDC))
 	{
 		string cmd = "$MaxedOut";
@@ -199,6 +199,11 @@ class UserConnection :
 			if (socket)
 				socket->transmitFile(f);
 		}
+		void setThrottlePriority(int priority)
+		{
+			if (socket)
+				socket->setThrottlePriority(priority);
+		}
 		
 		const UserPtr& getUser() const { return hintedUser.user; }
 		const UserPtr& getUser() { return hintedUser.user; }
@@ -16,6 +16,7 @@
 #include "ClientManager.h"
 #include "FavoriteManager.h"
 #include "UploadManager.h"
+#include "DownloadManager.h"
 #include "ShareManager.h"
 #include "WebServerUtil.h"
 #include "MagnetLink.h"
@@ -23,9 +24,15 @@
 #include "TimeUtil.h"
 #include "FormatUtil.h"
 #include "ConfCore.h"
+#include "LockProfiler.h"
+#include "Metrics.h"
+#include "ZUtils.h"
 #include <boost/algorithm/string/trim.hpp>
 
 static const unsigned SESSION_EXPIRE_TIME = 10; // minutes
+static const size_t MIN_COMPRESS_SIZE = 1024;
+static const size_t MAX_EVENT_STREAMS = 32;
+static const uint64_t EVENT_KEEP_ALIVE_INTERVAL = 15000;
 
 static const string htmlStart1 = "<!DOCTYPE html><html><head>\n"
 "<link rel='stylesheet' type='text/css' href='/default@";
@@ -202,7 +209,7 @@ static uint64_t getIfModified(const Http::Request& req)
 	return Http::parseDateTime(t, s) ? t : 0;
 }
 
-WebServerManager::WebServerManager() noexcept : csTemplateCache(RWLock::create())
+WebServerManager::WebServerManager() noexcept : csTemplateCache(RWLock::create()), hasEventStreams(false)
 {
 	UrlInfo ui;
 	ui.type = HANDLER_TYPE_PAGE;
@@ -237,9 +244,26 @@ WebServerManager::WebServerManager() noexcept : csTemplateCache(RWLock::create()
 	urlInfo["xrefresh"] = ui;
 	ui.cf = &WebServerManager::applySettings;
 	urlInfo["xsettings"] = ui;
+#ifdef LOCK_PROFILER
+	ui.cf = &WebServerManager::getLockStats;
+	urlInfo["xlocks"] = ui;
+#endif
 	ui.type = HANDLER_TYPE_FILE;
 	ui.cf = &WebServerManager::downloadFinishedItem;
 	urlInfo["xfget"] = ui;
+	ui.type = HANDLER_TYPE_API;
+	ui.cf = &WebServerManager::getQueueJson;
+	urlInfo["api-queue"] = ui;
+	ui.cf = &WebServerManager::getFinishedDownloadsJson;
+	urlInfo["api-recent-dl"] = ui;
+	ui.cf = &WebServerManager::getFinishedUploadsJson;
+	urlInfo["api-recent-ul"] = ui;
+	ui.cf = &WebServerManager::getWaitingUsersJson;
+	urlInfo["api-waiting"] = ui;
+	ui.cf = &WebServerManager::getSearchResultsJson;
+	urlInfo["api-search"] = ui;
+	ui.cf = &WebServerManager::openEventStream;
+	urlInfo["api-events"] = ui;
 	themeAttr[0].timestamp = themeAttr[1].timestamp = 0;
 }
 
@@ -348,16 +372,29 @@ void WebServerManager::start()
 	initAuthSecret();
 	startListen(AF_INET, false);
 	SearchManager::getInstance()->addListener(this);
+	QueueManager::getInstance()->addListener(this);
+	DownloadManager::getInstance()->addListener(this);
+	UploadManager::getInstance()->addListener(this);
+	TimerManager::getInstance()->addTask(this, "WebServer", 1000);
 }
 
 void WebServerManager::shutdown() noexcept
 {
 	SearchManager::getInstance()->removeListener(this);
+	QueueManager::getInstance()->removeListener(this);
+	DownloadManager::getInstance()->removeListener(this);
+	UploadManager::getInstance()->removeListener(this);
+	TimerManager::getInstance()->removeTask(this);
 	stopServer(AF_INET);
 	//stopServer(AF_INET6);
 	csClients.lock();
 	clients.clear();
 	csClients.unlock();
+	csEvents.lock();
+	eventStreams.clear();
+	pendingEvents.clear();
+	hasEventStreams.store(false);
+	csEvents.unlock();
 	cs.lock();
 	for (auto i : connections)
 		delete i.second;
@@ -397,6 +434,7 @@ void WebServerManager::accept(const Socket& sock, bool tls, Server* server) noex
 		newSock.reset(new Socket);
 	try { port = newSock->accept(sock); }
 	catch (const Exception&) { return; }
+	if (!port) return;
 	uint64_t connId = ++nextConnId;
 	HttpServerConnection* conn = new HttpServerConnection(connId, this, newSock, port);
 
@@ -440,6 +478,52 @@ void WebServerManager::sendLoginPage(const RequestInfo& inf) noexcept
 	inf.conn->sendResponse(resp, os);
 }
 
+// Takes the same time wherever the first mismatch is
+static bool isEqualToken(const char* data, const string& token) noexcept
+{
+	unsigned char diff = 0;
+	for (size_t i = 0; i < token.length(); ++i)
+		diff |= static_cast<unsigned char>(data[i] ^ token[i]);
+	return diff == 0;
+}
+
+// Scrapers can't sign in, the metrics are protected by a separate bearer token.
+// The endpoint is disabled when the token is not set.
+void WebServerManager::sendMetrics(HttpServerConnection* conn, const Http::Request& req) noexcept
+{
+	auto ss = SettingsManager::instance.getCoreSettings();
+	ss->lockRead();
+	string token = ss->getString(Conf::WEBSERVER_METRICS_TOKEN);
+	ss->unlockRead();
+	if (token.empty())
+	{
+		sendErrorResponse(conn, 404);
+		return;
+	}
+
+	const string& auth = req.getHeaderValue(Http::HEADER_AUTHORIZATION);
+	if (!(auth.length() == token.length() + 7 && Text::isAsciiPrefix2(auth, string("bearer ")) && isEqualToken(auth.data() + 7, token)))
+	{
+		Http::Response resp;
+		resp.setResponse(401);
+		resp.addHeader(Http::HEADER_CONTENT_LENGTH, "0");
+		resp.addHeader(Http::HEADER_WWW_AUTHENTICATE, "Bearer");
+		resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+		conn->sendResponse(resp, Util::emptyString);
+		return;
+	}
+
+	string data;
+	Metrics::print(data);
+	Http::Response resp;
+	resp.setResponse(200);
+	resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(data.length()));
+	resp.addHeader(Http::HEADER_CONTENT_TYPE, Metrics::getContentType());
+	resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-store");
+	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+	conn->sendResponse(resp, data);
+}
+
 void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request& req) noexcept
 {
 	int method = req.getMethodId();
@@ -470,6 +554,12 @@ void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request
 		uri.erase(pos);
 	}
 
+	if (uri == "/metrics")
+	{
+		sendMetrics(conn, req);
+		return;
+	}
+
 	cookies.parse(req);
 	if (uri == "/signin")
 	{
@@ -570,18 +660,31 @@ void WebServerManager::onRequest(HttpServerConnection* conn, const Http::Request
 	}
 
 	const string& auth = cookies.get("auth");
+	if (filename.empty()) filename = "search";
+	auto i = urlInfo.find(filename);
 	if (!checkAuthCookie(auth, curTime, inf.clientId))
 	{
-		sendLoginPage(inf);
+		if (i != urlInfo.end() && i->second.type == HANDLER_TYPE_API)
+		{
+			// Scripts can't use the login page, tell them to authenticate
+			static const string data = "{\"error\":\"unauthorized\"}";
+			Http::Response resp;
+			resp.setResponse(401);
+			resp.addHeader(Http::HEADER_CONTENT_TYPE, "application/json;charset=utf-8");
+			resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(data.length()));
+			resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-store");
+			resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+			conn->sendResponse(resp, data);
+		}
+		else
+			sendLoginPage(inf);
 		return;
 	}
 
-	if (filename.empty()) filename = "search";
-	auto i = urlInfo.find(filename);
 	if (i != urlInfo.end())
 	{
 		int type = i->second.type;
-		if (type == HANDLER_TYPE_PAGE || type == HANDLER_TYPE_ACTION || type == HANDLER_TYPE_FILE)
+		if (type == HANDLER_TYPE_PAGE || type == HANDLER_TYPE_ACTION || type == HANDLER_TYPE_FILE || type == HANDLER_TYPE_API)
 		{
 			Query query;
 			if (req.getMethodId() == Http::METHOD_POST)
@@ -660,23 +763,105 @@ void WebServerManager::handleRequest(const RequestInfo& inf, const UrlInfo& ui)
 		sendRedirect(inf, res.data);
 	}
 	else if (res.type == HANDLER_RESULT_HTML || res.type == HANDLER_RESULT_JSON)
-	{
-		Http::Response resp;
-		resp.setResponse(200);
-		resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(res.data.length()));
-		resp.addHeader(Http::HEADER_CONTENT_TYPE,
+		sendContent(inf, res.data,
 			res.type == HANDLER_RESULT_JSON ?
-			"application/json;charset=utf-8" : "text/html;charset=utf-8");
-		resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
-		if (inf.cookies) inf.cookies->print(resp);
-		inf.conn->sendResponse(resp, res.data);
-	}
+			"application/json;charset=utf-8" : "text/html;charset=utf-8",
+			ui.type == HANDLER_TYPE_API);
 	else if (res.type == HANDLER_RESULT_FILE_PATH)
 		sendFile(inf, res.data, true, 0);
+	else if (res.type == HANDLER_RESULT_EVENT_STREAM)
+		startEventStream(inf);
 	else
 		sendErrorResponse(inf.conn, 500);
 }
 
+static uint64_t getContentHash(const string& data)
+{
+	uint64_t hash = 0xcbf29ce484222325;
+	for (size_t i = 0; i < data.length(); ++i)
+	{
+		hash ^= (uint8_t) data[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static bool acceptsGzip(const Http::Request& req)
+{
+	const string& s = req.getHeaderValue(Http::HEADER_ACCEPT_ENCODING);
+	string::size_type start = 0;
+	while (start < s.length())
+	{
+		string::size_type end = s.find(',', start);
+		if (end == string::npos) end = s.length();
+		string item = s.substr(start, end - start);
+		start = end + 1;
+		string::size_type pos = item.find(';');
+		string params;
+		if (pos != string::npos)
+		{
+			params = item.substr(pos + 1);
+			item.erase(pos);
+		}
+		boost::algorithm::trim(item);
+		if (!Text::isAsciiPrefix2(item, string("gzip")) || item.length() != 4) continue;
+		boost::algorithm::trim(params);
+		Text::asciiMakeLower(params);
+		return !(Text::isAsciiPrefix2(params, string("q=0")) && params.find_first_not_of("0.", 2) == string::npos);
+	}
+	return false;
+}
+
+// API responses get a weak ETag computed from the uncompressed content,
+// a matching If-None-Match is answered with 304 and no body.
+void WebServerManager::sendContent(const RequestInfo& inf, const string& data, const char* contentType, bool useETag) noexcept
+{
+	string etag;
+	if (useETag)
+	{
+		char buf[32];
+		sprintf(buf, "W/\"%016llx\"", (unsigned long long) getContentHash(data));
+		etag = buf;
+		const string& ifNoneMatch = inf.req->getHeaderValue(Http::HEADER_IF_NONE_MATCH);
+		if (!ifNoneMatch.empty() && (ifNoneMatch == "*" || ifNoneMatch.find(etag.c_str() + 2) != string::npos))
+		{
+			Http::Response resp;
+			resp.setResponse(304);
+			resp.addHeader(Http::HEADER_CONTENT_LENGTH, "0");
+			resp.addHeader(Http::HEADER_ETAG, etag);
+			resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-cache");
+			resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+			if (inf.cookies) inf.cookies->print(resp);
+			inf.conn->sendResponse(resp, Util::emptyString);
+			return;
+		}
+	}
+
+	Http::Response resp;
+	resp.setResponse(200);
+	resp.addHeader(Http::HEADER_CONTENT_TYPE, contentType);
+	string compressed;
+	const string* body = &data;
+	if (data.length() >= MIN_COMPRESS_SIZE)
+	{
+		resp.addHeader("Vary", "Accept-Encoding");
+		if (acceptsGzip(*inf.req) && GZip::compress(data.data(), data.length(), compressed, Z_BEST_SPEED) && compressed.length() < data.length())
+		{
+			resp.addHeader(Http::HEADER_CONTENT_ENCODING, "gzip");
+			body = &compressed;
+		}
+	}
+	resp.addHeader(Http::HEADER_CONTENT_LENGTH, Util::toString(body->length()));
+	if (useETag)
+	{
+		resp.addHeader(Http::HEADER_ETAG, etag);
+		resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-cache");
+	}
+	resp.addHeader(Http::HEADER_CONNECTION, "keep-alive");
+	if (inf.cookies) inf.cookies->print(resp);
+	inf.conn->sendResponse(resp, *body);
+}
+
 void WebServerManager::sendTemplate(const RequestInfo& inf, const string& dir, const string& name, const string& requestedName, const string& mimeType, int flags) noexcept
 {
 	CacheItem item;
@@ -1817,6 +2002,264 @@ void WebServerManager::printWaitingUsers(HandlerResult& res, const RequestInfo&
 	}
 }
 
+static int getApiPageSize(const std::map<string, string>* query, const Http::ServerCookies* cookies)
+{
+	int pageSize = WebServerUtil::getIntQueryParam(query, "n");
+	return pageSize ? checkPageSize(pageSize) : getPageSize(cookies);
+}
+
+// Starts the paged list, the caller appends the items and closes both the array and the object
+static void printApiPageStart(JsonFormatter& f, size_t total, int pageSize, const WebServerUtil::TablePageInfo& pi)
+{
+	f.setDecorate(false);
+	f.open('{');
+	f.appendKey("total");
+	f.appendInt64Value(total);
+	f.appendKey("page");
+	f.appendIntValue(pi.count ? static_cast<int>(pi.start / pageSize) + 1 : 0);
+	f.appendKey("pages");
+	f.appendIntValue(pi.pages);
+	f.appendKey("items");
+	f.open('[');
+}
+
+static void printQueueItemJson(JsonFormatter& f, const QueueItem* qi)
+{
+	f.appendKey("id");
+	f.appendStringValue(WebServerUtil::printItemId((uintptr_t) qi), false);
+	f.appendKey("name");
+	f.appendStringValue(Util::getFileName(qi->getTarget()));
+	f.appendKey("path");
+	f.appendStringValue(Util::getFilePath(qi->getTarget()));
+	f.appendKey("size");
+	f.appendInt64Value(qi->getSize());
+	f.appendKey("downloaded");
+	f.appendInt64Value(qi->getDownloadedBytes());
+	f.appendKey("tth");
+	f.appendStringValue(qi->getTTH().isZero() ? Util::emptyString : qi->getTTH().toBase32(), false);
+}
+
+static void printTransferJson(JsonFormatter& f, const TransferData& td)
+{
+	f.appendKey("token");
+	f.appendStringValue(td.token);
+	f.appendKey("path");
+	f.appendStringValue(td.path);
+	f.appendKey("user");
+	f.appendStringValue(td.hintedUser.user ? td.hintedUser.user->getLastNick() : Util::emptyString);
+	f.appendKey("hub");
+	f.appendStringValue(td.hintedUser.hint);
+	f.appendKey("pos");
+	f.appendInt64Value(td.pos);
+	f.appendKey("size");
+	f.appendInt64Value(td.size);
+	f.appendKey("speed");
+	f.appendInt64Value(td.speed);
+	f.appendKey("secondsLeft");
+	f.appendInt64Value(td.secondsLeft);
+}
+
+void WebServerManager::getQueueJson(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	res.type = HANDLER_RESULT_ERROR;
+	LOCK(csClients);
+	auto i = clients.find(state.clientId);
+	if (i == clients.end()) return;
+	int page, sortColumn;
+	WebServerUtil::TablePageInfo pi;
+	getTableParams(state, page, sortColumn);
+	int pageSize = getApiPageSize(state.query, state.cookies);
+	ClientContext& ctx = i->second;
+	ctx.getQueue();
+	WebServerUtil::getTableRange(page, ctx.queue.size(), pageSize, pi);
+	if (sortColumn) ctx.sortQueue(sortColumn);
+	JsonFormatter f;
+	printApiPageStart(f, ctx.queue.size(), pageSize, pi);
+	string tmp;
+	for (size_t j = 0; j < pi.count; ++j)
+	{
+		ClientContext::QueueItemEx& inf = ctx.queue[pi.start + j];
+		inf.updateInfo();
+		f.open('{');
+		printQueueItemJson(f, inf.qi.get());
+		f.appendKey("sources");
+		f.appendIntValue(inf.sourcesCount);
+		f.appendKey("onlineSources");
+		f.appendIntValue(inf.onlineSourcesCount);
+		f.appendKey("finished");
+		f.appendBoolValue(inf.qi->isFinished());
+		f.appendKey("status");
+		f.appendStringValue(ClientContext::getQueueItemStatus(inf, tmp));
+		f.close('}');
+	}
+	f.close(']');
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::getFinishedDownloadsJson(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	getFinishedItemsJson(res, state, FinishedManager::e_Download);
+}
+
+void WebServerManager::getFinishedUploadsJson(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	getFinishedItemsJson(res, state, FinishedManager::e_Upload);
+}
+
+void WebServerManager::getFinishedItemsJson(HandlerResult& res, const RequestInfo& state, int type) noexcept
+{
+	res.type = HANDLER_RESULT_ERROR;
+	LOCK(csClients);
+	auto i = clients.find(state.clientId);
+	if (i == clients.end()) return;
+	int page, sortColumn;
+	WebServerUtil::TablePageInfo pi;
+	getTableParams(state, page, sortColumn);
+	int pageSize = getApiPageSize(state.query, state.cookies);
+	ClientContext& ctx = i->second;
+	ctx.getFinishedItems(type);
+	const vector<FinishedItemPtr>& data = type == FinishedManager::e_Download ? ctx.finishedDownloads : ctx.finishedUploads;
+	WebServerUtil::getTableRange(page, data.size(), pageSize, pi);
+	if (sortColumn) ctx.sortFinishedItems(type, sortColumn);
+	JsonFormatter f;
+	printApiPageStart(f, data.size(), pageSize, pi);
+	for (size_t j = 0; j < pi.count; ++j)
+	{
+		const FinishedItem* fi = data[pi.start + j].get();
+		f.open('{');
+		f.appendKey("id");
+		f.appendStringValue(WebServerUtil::printItemId((uintptr_t) fi), false);
+		f.appendKey("name");
+		f.appendStringValue(Util::getFileName(fi->getTarget()));
+		f.appendKey("path");
+		f.appendStringValue(Util::getFilePath(fi->getTarget()));
+		f.appendKey("size");
+		f.appendInt64Value(fi->getSize());
+		f.appendKey("time");
+		f.appendInt64Value(fi->getTime());
+		f.appendKey("tth");
+		f.appendStringValue(fi->getTTH().isZero() ? Util::emptyString : fi->getTTH().toBase32(), false);
+		f.appendKey("user");
+		f.appendStringValue(fi->getNick());
+		f.appendKey("hub");
+		f.appendStringValue(fi->getHub());
+		f.appendKey("ip");
+		f.appendStringValue(fi->getIP());
+		f.close('}');
+	}
+	f.close(']');
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::getWaitingUsersJson(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	res.type = HANDLER_RESULT_ERROR;
+	LOCK(csClients);
+	auto i = clients.find(state.clientId);
+	if (i == clients.end()) return;
+	int page, sortColumn;
+	WebServerUtil::TablePageInfo pi;
+	getTableParams(state, page, sortColumn);
+	int pageSize = getApiPageSize(state.query, state.cookies);
+	ClientContext& ctx = i->second;
+	ctx.getWaitingUsers();
+	WebServerUtil::getTableRange(page, ctx.waitingUsers.size(), pageSize, pi);
+	if (sortColumn) ctx.sortWaitingUsers(sortColumn);
+	JsonFormatter f;
+	printApiPageStart(f, ctx.waitingUsers.size(), pageSize, pi);
+	string nick;
+	for (size_t j = 0; j < pi.count; ++j)
+	{
+		const WaitingUsersItem& wu = ctx.waitingUsers[pi.start + j];
+		Ip4Address ip4;
+		Ip6Address ip6;
+		int64_t bytesShared;
+		int slots;
+		wu.hintedUser.user->getInfo(nick, ip4, ip6, bytesShared, slots);
+		f.open('{');
+		f.appendKey("id");
+		f.appendStringValue(WebServerUtil::printItemId((uintptr_t) wu.hintedUser.user.get()), false);
+		f.appendKey("position");
+		f.appendInt64Value(wu.position);
+		f.appendKey("user");
+		f.appendStringValue(nick);
+		f.appendKey("hub");
+		f.appendStringValue(wu.hintedUser.hint);
+		f.appendKey("added");
+		f.appendInt64Value(wu.added);
+		f.appendKey("ip");
+		if (Util::isValidIp4(ip4))
+			f.appendStringValue(Util::printIpAddress(ip4), false);
+		else if (Util::isValidIp6(ip6))
+			f.appendStringValue(Util::printIpAddress(ip6), false);
+		else
+			f.appendStringValue(Util::emptyString, false);
+		f.appendKey("files");
+		f.appendInt64Value(wu.fileCount);
+		f.close('}');
+	}
+	f.close(']');
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::getSearchResultsJson(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	res.type = HANDLER_RESULT_ERROR;
+	LOCK(csClients);
+	auto i = clients.find(state.clientId);
+	if (i == clients.end()) return;
+	int page, sortColumn;
+	WebServerUtil::TablePageInfo pi;
+	getTableParams(state, page, sortColumn);
+	int pageSize = getApiPageSize(state.query, state.cookies);
+	ClientContext& ctx = i->second;
+	WebServerUtil::getTableRange(page, ctx.searchResults.size(), pageSize, pi);
+	if (sortColumn) ctx.sortSearchResults(sortColumn);
+	JsonFormatter f;
+	printApiPageStart(f, ctx.searchResults.size(), pageSize, pi);
+	for (size_t j = 0; j < pi.count; ++j)
+	{
+		const SearchResult* sr = ctx.searchResults[pi.start + j].get();
+		bool isFile = sr->getType() == SearchResult::TYPE_FILE;
+		f.open('{');
+		f.appendKey("id");
+		f.appendStringValue(WebServerUtil::printItemId((uintptr_t) sr), false);
+		f.appendKey("user");
+		f.appendStringValue(sr->getUser()->getLastNick());
+		f.appendKey("hub");
+		f.appendStringValue(sr->getHubUrl());
+		f.appendKey("type");
+		f.appendStringValue(isFile ? "file" : "directory", false);
+		f.appendKey("name");
+		f.appendStringValue(sr->getFileName());
+		f.appendKey("path");
+		f.appendStringValue(isFile ? sr->getFilePath() : sr->getFile());
+		f.appendKey("size");
+		f.appendInt64Value(sr->getSize());
+		f.appendKey("tth");
+		f.appendStringValue(isFile && !sr->getTTH().isZero() ? sr->getTTH().toBase32() : Util::emptyString, false);
+		f.close('}');
+	}
+	f.close(']');
+	f.appendKey("running");
+	f.appendBoolValue(ctx.searchParam.token && !ctx.searchParam.filter.empty() && GET_TICK() < ctx.searchEndTime);
+	f.close('}');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+
+void WebServerManager::openEventStream(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	LOCK(csClients);
+	res.type = clients.find(state.clientId) != clients.end() ? HANDLER_RESULT_EVENT_STREAM : HANDLER_RESULT_ERROR;
+}
+
 void WebServerManager::downloadFinishedItem(HandlerResult& res, const RequestInfo& state) noexcept
 {
 	res.type = HANDLER_RESULT_ERROR;
@@ -2164,6 +2607,52 @@ void WebServerManager::refreshShare(HandlerResult& res, const RequestInfo& state
 	}
 }
 
+#ifdef LOCK_PROFILER
+void WebServerManager::getLockStats(HandlerResult& res, const RequestInfo& state) noexcept
+{
+	if (WebServerUtil::getIntQueryParam(state.query, "reset"))
+		LockProfiler::reset();
+	vector<LockStats::Info> info;
+	LockProfiler::getInfo(info);
+	JsonFormatter f;
+	f.open('[');
+	for (const auto& li : info)
+	{
+		f.open('{');
+		f.appendKey("name");
+		f.appendStringValue(li.name);
+		f.appendKey("acquisitions");
+		f.appendInt64Value(li.acquisitions);
+		f.appendKey("shared");
+		f.appendInt64Value(li.sharedAcquisitions);
+		f.appendKey("contended");
+		f.appendInt64Value(li.contended);
+		f.appendKey("totalWaitNs");
+		f.appendInt64Value(li.totalWait);
+		f.appendKey("maxWaitNs");
+		f.appendInt64Value(li.maxWait);
+		f.appendKey("totalHoldNs");
+		f.appendInt64Value(li.totalHold);
+		f.appendKey("maxHoldNs");
+		f.appendInt64Value(li.maxHold);
+		f.appendKey("waitHistogram");
+		f.open('[');
+		for (int i = 0; i < LockStats::HISTOGRAM_SIZE; ++i)
+			f.appendInt64Value(li.waitHistogram[i]);
+		f.close(']');
+		f.appendKey("holdHistogram");
+		f.open('[');
+		for (int i = 0; i < LockStats::HISTOGRAM_SIZE; ++i)
+			f.appendInt64Value(li.holdHistogram[i]);
+		f.close(']');
+		f.close('}');
+	}
+	f.close(']');
+	f.moveResult(res.data);
+	res.type = HANDLER_RESULT_JSON;
+}
+#endif
+
 void WebServerManager::printSettings(HandlerResult& res, const RequestInfo& state) noexcept
 {
 	printHtmlStart(res.data, state.cookies);
@@ -2283,24 +2772,47 @@ uint64_t WebServerManager::createClientContext(uint32_t userId, uint64_t expires
 
 void WebServerManager::removeClientContext(uint64_t id) noexcept
 {
-	LOCK(csClients);
-	auto i = clients.find(id);
-	if (i != clients.end()) clients.erase(i);
+	{
+		LOCK(csClients);
+		auto i = clients.find(id);
+		if (i != clients.end()) clients.erase(i);
+	}
+	removeEventStreams(id);
 }
 
+// Sessions with an open event stream are kept alive, the stream itself can't renew the auth cookie.
+// The client has to make another request before the cookie expires or log in again once the stream is closed.
 void WebServerManager::removeExpired() noexcept
 {
 	uint64_t t = GET_TIME();
-	LOCK(csClients);
-	for (auto i = clients.begin(); i != clients.end();)
-		if (t > i->second.expires)
-		{
-			if (LogManager::getLogOptions() & LogManager::OPT_LOG_WEB_SERVER)
-				LogManager::log(LogManager::WEBSERVER, printClientId(i->first, nullptr) + ": Session expired");
-			i = clients.erase(i);
-		}
-		else
-			++i;
+	vector<uint64_t> expired;
+	vector<uint64_t> streaming;
+	if (hasEventStreams.load())
+	{
+		LOCK(csEvents);
+		for (const EventStream& es : eventStreams)
+			streaming.push_back(es.clientId);
+	}
+	{
+		LOCK(csClients);
+		for (auto i = clients.begin(); i != clients.end();)
+			if (t > i->second.expires && std::find(streaming.begin(), streaming.end(), i->first) != streaming.end())
+			{
+				i->second.expires = t + 60 * SESSION_EXPIRE_TIME;
+				++i;
+			}
+			else if (t > i->second.expires)
+			{
+				if (LogManager::getLogOptions() & LogManager::OPT_LOG_WEB_SERVER)
+					LogManager::log(LogManager::WEBSERVER, printClientId(i->first, nullptr) + ": Session expired");
+				expired.push_back(i->first);
+				i = clients.erase(i);
+			}
+			else
+				++i;
+	}
+	for (uint64_t id : expired)
+		removeEventStreams(id);
 }
 
 string WebServerManager::printClientId(uint64_t id, const HttpServerConnection* conn) noexcept
@@ -2344,3 +2856,213 @@ void WebServerManager::on(SearchManagerListener::SR, const SearchResult& sr) noe
 		}
 	}
 }
+
+// The response has no Content-Length, the stream lasts until the connection is closed.
+// Events are written under csEvents so that none of them can get ahead of the headers.
+void WebServerManager::startEventStream(const RequestInfo& inf) noexcept
+{
+	LOCK(csEvents);
+	if (eventStreams.size() >= MAX_EVENT_STREAMS)
+	{
+		sendErrorResponse(inf.conn, 503);
+		return;
+	}
+	for (const EventStream& es : eventStreams)
+		if (es.conn == inf.conn) return;
+	Http::Response resp;
+	resp.setResponse(200);
+	resp.addHeader(Http::HEADER_CONTENT_TYPE, "text/event-stream;charset=utf-8");
+	resp.addHeader(Http::HEADER_CACHE_CONTROL, "no-store");
+	if (inf.cookies) inf.cookies->print(resp);
+	inf.conn->sendResponse(resp, "retry: 5000\n\n");
+	eventStreams.push_back(EventStream{ inf.conn, inf.clientId });
+	hasEventStreams.store(true);
+}
+
+void WebServerManager::removeEventStreams(uint64_t clientId) noexcept
+{
+	LOCK(csEvents);
+	for (auto i = eventStreams.begin(); i != eventStreams.end();)
+		if (i->clientId == clientId)
+		{
+			i->conn->disconnect();
+			i = eventStreams.erase(i);
+		}
+		else
+			++i;
+	hasEventStreams.store(!eventStreams.empty());
+}
+
+void WebServerManager::onError(HttpServerConnection* conn, const string& error) noexcept
+{
+	LOCK(csEvents);
+	for (auto i = eventStreams.begin(); i != eventStreams.end(); ++i)
+		if (i->conn == conn)
+		{
+			eventStreams.erase(i);
+			hasEventStreams.store(!eventStreams.empty());
+			break;
+		}
+}
+
+void WebServerManager::addEvent(const char* type, const string& data) noexcept
+{
+	LOCK(csEvents);
+	if (eventStreams.empty()) return;
+	pendingEvents += "id: ";
+	pendingEvents += Util::toString(++nextEventId);
+	pendingEvents += "\nevent: ";
+	pendingEvents += type;
+	pendingEvents += "\ndata: ";
+	pendingEvents += data;
+	pendingEvents += "\n\n";
+}
+
+void WebServerManager::addQueueEvent(const char* type, const QueueItemPtr* items, size_t count, bool idOnly) noexcept
+{
+	JsonFormatter f;
+	f.setDecorate(false);
+	f.open('[');
+	for (size_t i = 0; i < count; ++i)
+	{
+		const QueueItem* qi = items[i].get();
+		if (idOnly)
+		{
+			f.appendStringValue(WebServerUtil::printItemId((uintptr_t) qi), false);
+			continue;
+		}
+		f.open('{');
+		printQueueItemJson(f, qi);
+		f.appendKey("finished");
+		f.appendBoolValue(qi->isFinished());
+		f.close('}');
+	}
+	f.close(']');
+	addEvent(type, f.getResult());
+}
+
+void WebServerManager::onTimer(uint64_t tick) noexcept
+{
+	if (!hasEventStreams.load()) return;
+	LOCK(csEvents);
+	if (pendingEvents.empty())
+	{
+		if (tick < lastEventTick + EVENT_KEEP_ALIVE_INTERVAL) return;
+		pendingEvents = ": keep-alive\n\n";
+	}
+	lastEventTick = tick;
+	for (const EventStream& es : eventStreams)
+		es.conn->sendData(pendingEvents);
+	pendingEvents.clear();
+}
+
+void WebServerManager::on(QueueManagerListener::Added, const QueueItemPtr& qi) noexcept
+{
+	if (hasEventStreams.load()) addQueueEvent("queue-add", &qi, 1, false);
+}
+
+void WebServerManager::on(QueueManagerListener::AddedArray, const vector<QueueItemPtr>& data) noexcept
+{
+	if (hasEventStreams.load() && !data.empty()) addQueueEvent("queue-add", data.data(), data.size(), false);
+}
+
+void WebServerManager::on(QueueManagerListener::Finished, const QueueItemPtr& qi, const string&, const DownloadPtr&) noexcept
+{
+	if (hasEventStreams.load()) addQueueEvent("queue-update", &qi, 1, false);
+}
+
+void WebServerManager::on(QueueManagerListener::Removed, const QueueItemPtr& qi) noexcept
+{
+	if (hasEventStreams.load()) addQueueEvent("queue-remove", &qi, 1, true);
+}
+
+void WebServerManager::on(QueueManagerListener::RemovedArray, const vector<QueueItemPtr>& data) noexcept
+{
+	if (hasEventStreams.load() && !data.empty()) addQueueEvent("queue-remove", data.data(), data.size(), true);
+}
+
+void WebServerManager::on(QueueManagerListener::Moved, const QueueItemPtr& qs, const QueueItemPtr& qt) noexcept
+{
+	if (!hasEventStreams.load()) return;
+	addQueueEvent("queue-remove", &qs, 1, true);
+	addQueueEvent("queue-add", &qt, 1, false);
+}
+
+void WebServerManager::on(QueueManagerListener::StatusUpdated, const QueueItemPtr& qi) noexcept
+{
+	if (hasEventStreams.load()) addQueueEvent("queue-update", &qi, 1, false);
+}
+
+void WebServerManager::on(DownloadManagerListener::Tick, const DownloadArray& data) noexcept
+{
+	if (!hasEventStreams.load() || data.empty()) return;
+	JsonFormatter f;
+	f.setDecorate(false);
+	f.open('[');
+	for (const DownloadData& td : data)
+	{
+		f.open('{');
+		printTransferJson(f, td);
+		f.appendKey("id");
+		f.appendStringValue(WebServerUtil::printItemId((uintptr_t) td.qi.get()), false);
+		f.close('}');
+	}
+	f.close(']');
+	addEvent("downloads", f.getResult());
+}
+
+static string printTransferResult(const Transfer* t, bool success, const string& error)
+{
+	JsonFormatter f;
+	f.setDecorate(false);
+	f.open('{');
+	f.appendKey("token");
+	f.appendStringValue(t->getConnectionQueueToken());
+	f.appendKey("path");
+	f.appendStringValue(t->getPath());
+	f.appendKey("success");
+	f.appendBoolValue(success);
+	if (!success)
+	{
+		f.appendKey("error");
+		f.appendStringValue(error);
+	}
+	f.close('}');
+	return f.getResult();
+}
+
+void WebServerManager::on(DownloadManagerListener::Complete, const DownloadPtr& d) noexcept
+{
+	if (hasEventStreams.load()) addEvent("download-done", printTransferResult(d.get(), true, Util::emptyString));
+}
+
+void WebServerManager::on(DownloadManagerListener::Failed, const DownloadPtr& d, const string& reason) noexcept
+{
+	if (hasEventStreams.load()) addEvent("download-done", printTransferResult(d.get(), false, reason));
+}
+
+void WebServerManager::on(UploadManagerListener::Tick, const UploadArray& data) noexcept
+{
+	if (!hasEventStreams.load() || data.empty()) return;
+	JsonFormatter f;
+	f.setDecorate(false);
+	f.open('[');
+	for (const TransferData& td : data)
+	{
+		f.open('{');
+		printTransferJson(f, td);
+		f.close('}');
+	}
+	f.close(']');
+	addEvent("uploads", f.getResult());
+}
+
+void WebServerManager::on(UploadManagerListener::Complete, const UploadPtr& u) noexcept
+{
+	if (hasEventStreams.load()) addEvent("upload-done", printTransferResult(u.get(), true, Util::emptyString));
+}
+
+void WebServerManager::on(UploadManagerListener::Failed, const UploadPtr& u, const string& reason) noexcept
+{
+	if (hasEventStreams.load()) addEvent("upload-done", printTransferResult(u.get(), false, reason));
+}
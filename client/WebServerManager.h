@@ -8,6 +8,10 @@
 #include "HttpCookies.h"
 #include "WebServerAuth.h"
 #include "SearchManagerListener.h"
+#include "QueueManagerListener.h"
+#include "DownloadManagerListener.h"
+#include "UploadManagerListener.h"
+#include "TimerManager.h"
 #include "SearchParam.h"
 #include "Locks.h"
 #include "RWLock.h"
@@ -26,6 +30,10 @@ class WebServerManager :
 	public Speaker<WebServerListener>,
 	private HttpServerCallback,
 	private SearchManagerListener,
+	private QueueManagerListener,
+	private DownloadManagerListener,
+	private UploadManagerListener,
+	private TimerManager::Task,
 	private WebServerAuth
 {
 	friend class Singleton<WebServerManager>;
@@ -169,7 +177,8 @@ private:
 		HANDLER_RESULT_REDIRECT,
 		HANDLER_RESULT_HTML,
 		HANDLER_RESULT_JSON,
-		HANDLER_RESULT_FILE_PATH
+		HANDLER_RESULT_FILE_PATH,
+		HANDLER_RESULT_EVENT_STREAM
 	};
 
 	using ContentFunc = void (WebServerManager::*)(HandlerResult& res, const RequestInfo& state);
@@ -190,7 +199,8 @@ private:
 	{
 		HANDLER_TYPE_PAGE = 1,
 		HANDLER_TYPE_ACTION,
-		HANDLER_TYPE_FILE
+		HANDLER_TYPE_FILE,
+		HANDLER_TYPE_API
 	};
 
 	enum
@@ -214,6 +224,12 @@ private:
 		uint64_t timestamp;
 	};
 
+	struct EventStream
+	{
+		HttpServerConnection* conn;
+		uint64_t clientId;
+	};
+
 	WebServerManager() noexcept;
 	static string printClientId(uint64_t id, const HttpServerConnection* conn) noexcept;
 	void stopServer(int af) noexcept;
@@ -224,7 +240,13 @@ private:
 	void sendFile(const RequestInfo& inf, const string& path, bool sendContentDisposition, uint64_t timestamp) noexcept;
 	void sendTemplate(const RequestInfo& inf, const string& dir, const string& name, const string& requestName, const string& mimeType, int flags) noexcept;
 	void sendLoginPage(const RequestInfo& inf) noexcept;
+	void sendMetrics(HttpServerConnection* conn, const Http::Request& req) noexcept;
 	void handleRequest(const RequestInfo& inf, const UrlInfo& ui) noexcept;
+	void sendContent(const RequestInfo& inf, const string& data, const char* contentType, bool useETag) noexcept;
+	void startEventStream(const RequestInfo& inf) noexcept;
+	void removeEventStreams(uint64_t clientId) noexcept;
+	void addEvent(const char* type, const string& data) noexcept;
+	void addQueueEvent(const char* type, const QueueItemPtr* items, size_t count, bool idOnly) noexcept;
 	uint32_t checkUser(const string& user, const string& password) const noexcept;
 	uint64_t createClientContext(uint32_t userId, uint64_t expires, const unsigned char iv[]) noexcept;
 	void removeClientContext(uint64_t id) noexcept;
@@ -259,14 +281,46 @@ private:
 	void addMagnet(HandlerResult& res, const RequestInfo& state) noexcept;
 	void refreshShare(HandlerResult& res, const RequestInfo& state) noexcept;
 	void applySettings(HandlerResult& res, const RequestInfo& state) noexcept;
+	void getQueueJson(HandlerResult& res, const RequestInfo& state) noexcept;
+	void getFinishedItemsJson(HandlerResult& res, const RequestInfo& state, int type) noexcept;
+	void getFinishedDownloadsJson(HandlerResult& res, const RequestInfo& state) noexcept;
+	void getFinishedUploadsJson(HandlerResult& res, const RequestInfo& state) noexcept;
+	void getWaitingUsersJson(HandlerResult& res, const RequestInfo& state) noexcept;
+	void getSearchResultsJson(HandlerResult& res, const RequestInfo& state) noexcept;
+	void openEventStream(HandlerResult& res, const RequestInfo& state) noexcept;
+#ifdef LOCK_PROFILER
+	void getLockStats(HandlerResult& res, const RequestInfo& state) noexcept;
+#endif
 
 	void onRequest(HttpServerConnection* conn, const Http::Request& req) noexcept override;
 	void onData(HttpServerConnection* conn, const uint8_t* data, size_t size) noexcept override {}
 	//void onDisconnected(HttpServerConnection* conn) noexcept override;
-	//void onError(HttpServerConnection* conn, const string& error) noexcept override;
+	void onError(HttpServerConnection* conn, const string& error) noexcept override;
 
 	void on(SearchManagerListener::SR, const SearchResult&) noexcept override;
 
+	// QueueManagerListener
+	void on(QueueManagerListener::Added, const QueueItemPtr& qi) noexcept override;
+	void on(QueueManagerListener::AddedArray, const vector<QueueItemPtr>& data) noexcept override;
+	void on(QueueManagerListener::Finished, const QueueItemPtr& qi, const string&, const DownloadPtr&) noexcept override;
+	void on(QueueManagerListener::Removed, const QueueItemPtr& qi) noexcept override;
+	void on(QueueManagerListener::RemovedArray, const vector<QueueItemPtr>& data) noexcept override;
+	void on(QueueManagerListener::Moved, const QueueItemPtr& qs, const QueueItemPtr& qt) noexcept override;
+	void on(QueueManagerListener::StatusUpdated, const QueueItemPtr& qi) noexcept override;
+
+	// DownloadManagerListener
+	void on(DownloadManagerListener::Tick, const DownloadArray& data) noexcept override;
+	void on(DownloadManagerListener::Complete, const DownloadPtr& d) noexcept override;
+	void on(DownloadManagerListener::Failed, const DownloadPtr& d, const string& reason) noexcept override;
+
+	// UploadManagerListener
+	void on(UploadManagerListener::Tick, const UploadArray& data) noexcept override;
+	void on(UploadManagerListener::Complete, const UploadPtr& u) noexcept override;
+	void on(UploadManagerListener::Failed, const UploadPtr& u, const string& reason) noexcept override;
+
+	// TimerManager::Task
+	void onTimer(uint64_t tick) noexcept override;
+
 private:
 	static const int SERVER_SECURE = 1;
 	static const int SERVER_V6     = 2;
@@ -288,6 +342,14 @@ private:
 
 	ThemeAttributes themeAttr[2];
 	CriticalSection csThemeAttr;
+
+	// Server-sent events, collected by the listeners and written to the streams once a second
+	CriticalSection csEvents;
+	vector<EventStream> eventStreams;
+	string pendingEvents;
+	uint64_t nextEventId = 0;
+	uint64_t lastEventTick = 0;
+	std::atomic_bool hasEventStreams;
 };
 
 #endif // WEB_SERVER_MANAGER_H_
@@ -197,3 +197,21 @@ void GZip::decompress(const string& gzipFile, const string& outputFile)
 	}
 	gzclose(gz);
 }
+
+bool GZip::compress(const void* data, size_t size, string& out, int level) noexcept
+{
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	// 16 selects the gzip header and trailer instead of zlib
+	if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return false;
+	out.resize(deflateBound(&zs, (uLong) size));
+	zs.next_in = (Bytef*) data;
+	zs.avail_in = (uInt) size;
+	zs.next_out = (Bytef*) &out[0];
+	zs.avail_out = (uInt) out.size();
+	int result = deflate(&zs, Z_FINISH);
+	out.resize(zs.total_out);
+	deflateEnd(&zs);
+	return result == Z_STREAM_END;
+}
@@ -68,6 +68,9 @@ class UnZFilter
 namespace GZip
 {
 	void decompress(const std::string& gzipPath, const std::string &outputPath);
+
+	// Compresses the whole buffer into a gzip stream, returns false on failure
+	bool compress(const void* data, size_t size, std::string& out, int level = Z_DEFAULT_COMPRESSION) noexcept;
 }
 
 #endif // DCPLUSPLUS_DCPP_Z_UTILS_H
@@ -48,7 +48,8 @@ static const int MIN_PUBLISH_FILESIZE          = 1024 * 1024;  // 1 MiB, files b
 
 static const unsigned REPUBLISH_TIME           = 5*60*60*1000; // when our filelist should be republished
 static const unsigned PFS_REPUBLISH_TIME       = 1*60*60*1000; // when partially downloaded files should be republished
-static const unsigned PUBLISH_TIME             = 2*1000;       // how often publishes files
+static const unsigned PUBLISH_TIME             = 1*1000;       // how often publishes files
+static const unsigned STORE_NODES_LIFETIME     = 10*60*1000;   // how long nodes found by a store lookup are reused for nearby files
 
 static const int MAX_PUBLISHES_AT_TIME         = 3;            // how many files can be published at one time
 
@@ -65,7 +65,7 @@ namespace dht
 
 	ClientBasePtr DHT::instance;
 
-	DHT::DHT() : bucket(nullptr), lastPacket(0), firewalled(true), requestFWCheck(true), dirty(false), state(STATE_IDLE), lastExternalIP(0)
+	DHT::DHT() : routingTable(nullptr), lastPacket(0), firewalled(true), requestFWCheck(true), dirty(false), state(STATE_IDLE), lastExternalIP(0)
 	{
 		IndexManager::newInstance();
 	}
@@ -105,14 +105,14 @@ namespace dht
 		firewalled = !ClientManager::isActiveMode(AF_INET, 0, true);
 		requestFWCheck = true;
 
-		if (!bucket)
+		if (!routingTable)
 		{
 #if 0
 			if (BOOLSETTING(UPDATE_IP))
 				SettingsManager::getInstance()->set(SettingsManager::EXTERNAL_IP, Util::emptyString);
 #endif
 
-			bucket = new KBucket();
+			routingTable = new RoutingTable();
 
 			BootstrapManager::newInstance();
 			SearchManager::newInstance();
@@ -125,7 +125,7 @@ namespace dht
 
 	void DHT::stop(bool exiting)
 	{
-		if (!bucket)
+		if (!routingTable)
 			return;
 
 		state = STATE_STOPPING;
@@ -143,8 +143,8 @@ namespace dht
 			SearchManager::deleteInstance();
 			BootstrapManager::deleteInstance();
 
-			delete bucket;
-			bucket = nullptr;
+			delete routingTable;
+			routingTable = nullptr;
 		}
 		state = STATE_IDLE;
 	}
@@ -412,7 +412,7 @@ namespace dht
 		UserPtr u = ClientManager::createUser(cid, Util::emptyString, Util::emptyString);
 
 		LOCK(cs);
-		return bucket->createNode(u, ip, port, update, isUdpKeyValid);
+		return routingTable->createNode(u, ip, port, update, isUdpKeyValid);
 	}
 
 	/*
@@ -423,12 +423,16 @@ namespace dht
 		bool isAcceptable = true;
 		if (!node->isOnline())
 		{
+			bool inList;
 			{
 				LOCK(cs);
-				isAcceptable = bucket->insert(node); // insert node to our routing table
+				isAcceptable = routingTable->insert(node); // insert node to our routing table
+				inList = node->isInBucket();
 			}
 
-			if (makeOnline)
+			// nodes kept only in the replacement cache go online once they get into the bucket,
+			// otherwise nothing would put them offline when they are dropped from the cache
+			if (makeOnline && inList)
 			{
 				// put him online so we can make a connection with him
 				node->setOnline(true);
@@ -446,7 +450,7 @@ namespace dht
 	void DHT::getClosestNodes(const CID& cid, std::map<CID, Node::Ptr>& closest, unsigned int max, uint8_t maxType)
 	{
 		LOCK(cs);
-		bucket->getClosestNodes(cid, closest, max, maxType);
+		routingTable->getClosestNodes(cid, closest, max, maxType);
 	}
 
 	/*
@@ -455,12 +459,25 @@ namespace dht
 	void DHT::checkExpiration(uint64_t tick)
 	{
 		OnlineUserList removedList;
+		vector<Node::Ptr> promotedList;
 		{
 			LOCK(cs);
-			if (bucket->checkExpiration(tick, removedList))
+			if (routingTable->checkExpiration(tick, removedList, promotedList))
 				setDirty();
 		}
 
+		// replacements moved into the buckets go online like nodes inserted by addNode
+		if (!promotedList.empty())
+		{
+			auto cm = ClientManager::getInstance();
+			for (const Node::Ptr& node : promotedList)
+			{
+				node->setOnline(true);
+				cm->putOnline(node, true);
+				fire(ClientListener::UserUpdated(), node);
+			}
+		}
+
 		if (!removedList.empty())
 		{
 			auto cm = ClientManager::getInstance();
@@ -584,10 +601,7 @@ namespace dht
 
 			// load nodes; when file is older than 7 days, bootstrap from database later
 			if ((int64_t) ::File::timeStampToUnixTime(f.getTimeStamp()) > (int64_t) time(nullptr) - 7 * 24 * 60 * 60)
-				bucket->loadNodes(xml);
-
-			// load indexes
-			IndexManager::getInstance()->loadIndexes(xml);
+				routingTable->loadNodes(xml);
 			xml.stepOut();
 		}
 		catch (Exception& e)
@@ -611,10 +625,7 @@ namespace dht
 		xml.stepIn();
 
 		// save nodes
-		bucket->saveNodes(xml);
-
-		// save foreign published files
-		IndexManager::getInstance()->saveIndexes(xml);
+		routingTable->saveNodes(xml);
 
 		xml.stepOut();
 
@@ -784,7 +795,7 @@ namespace dht
 	// status message
 	bool DHT::handle(AdcCommand::STA, const Node::Ptr& node, AdcCommand& c) noexcept
 	{
-		if (c.getParameters().size() < 3)
+		if (c.getParamCount() < 3)
 			return true;
 
 		Ip4Address fromIP = node->getIdentity().getIP4();
@@ -1081,7 +1092,7 @@ namespace dht
 	size_t DHT::getNodesCount() const
 	{
 		LOCK(cs);
-		return bucket ? bucket->getNodes().size() : 0;
+		return routingTable ? routingTable->getNodeCount() : 0;
 	}
 
 	bool DHT::pingNode(const CID& cid)
@@ -1089,16 +1100,8 @@ namespace dht
 		Node::Ptr node;
 		{
 			LOCK(cs);
-			if (bucket)
-			{
-				const KBucket::NodeList& nodes = bucket->getNodes();
-				for (const Node::Ptr& n : nodes)
-					if (n->getUser()->getCID() == cid)
-					{
-						node = n;
-						break;
-					}
-			}
+			if (routingTable)
+				node = routingTable->findNode(cid);
 		}
 		if (!node) return false;
 		node->setTimeout();
@@ -146,10 +146,9 @@ namespace dht
 				}
 				LockInstanceNodes(const LockInstanceNodes&) = delete;
 				LockInstanceNodes& operator= (const LockInstanceNodes&) = delete;
-				const KBucket::NodeList* getNodes() const
+				const RoutingTable* getRoutingTable() const
 				{
-					if (!instance->bucket) return nullptr;
-					return &instance->bucket->getNodes();
+					return instance->routingTable;
 				}
 
 			private:
@@ -188,7 +187,7 @@ namespace dht
 		CID myUdpKey;
 
 		/** Routing table */
-		KBucket* bucket;
+		RoutingTable* routingTable;
 
 		/** Lock to routing table */
 		mutable CriticalSection cs;
@@ -507,20 +507,7 @@ namespace dht
 		// send PUB command to K nodes
 		int n = K;
 		for (Node::Map::const_iterator i = nodes.begin(); i != nodes.end() && n > 0; i++, n--)
-		{
-			const Node::Ptr& node = i->second;
-
-			AdcCommand cmd(AdcCommand::CMD_PUB, AdcCommand::TYPE_UDP);
-			cmd.addParam(TAG('T', 'R'), tth);
-			cmd.addParam(TAG('S', 'I'), Util::toString(size));
-
-			if (partial)
-				cmd.addParam("PF1");
-
-			//i->second->setTimeout();
-			DHT::getInstance()->send(cmd, node->getIdentity().getIP4(),
-				node->getIdentity().getUdp4Port(), node->getUser()->getCID(), node->getUdpKey());
-		}
+			IndexManager::sendPublishRequest(i->second, tth, size, partial);
 	}
 
 	/*
@@ -548,6 +535,8 @@ namespace dht
 				if (s->type == DHTSearch::TYPE_STOREFILE)
 				{
 					publishFile(s->respondedNodes, s->term, s->filesize, s->partial);
+					if (!s->partial)
+						IndexManager::getInstance()->storeLookupFinished(s->term, s->respondedNodes);
 				}
 				s->onRemove();
 				delete s;
@@ -21,16 +21,44 @@
 #include "DHT.h"
 #include "IndexManager.h"
 #include "DHTSearchManager.h"
+#include "Utils.h"
 
 #include "../CID.h"
 #include "../ShareManager.h"
-#include "../SimpleXML.h"
+#include "../LogManager.h"
+#include "../SettingsManager.h"
+#include "../ConfCore.h"
 
 namespace dht
 {
 
-	IndexManager::IndexManager() : publish(false), publishing(0), nextRepublishTime(GET_TICK())
+	IndexManager::IndexManager() : publishQueueSorted(true), sentPackets(0), publish(false), publishing(0), nextRepublishTime(GET_TICK())
 	{
+		storeNodes.prefix = -1;
+		storeNodes.expires = 0;
+		storeNodes.pending = false;
+		memset(&stats, 0, sizeof(stats));
+		if (!sourceIndex.open())
+			LogManager::message("Could not open DHT index " + SourceIndex::getDBPath() + ", published sources will not be kept", false);
+	}
+
+	/*
+	 * Returns cached sources for the file, loading them from the index if needed
+	 */
+	IndexManager::SourceList& IndexManager::getSourcesL(const TTHValue& tth) const
+	{
+		CacheItem* item = hotCache.get(tth);
+		if (item)
+		{
+			hotCache.makeNewest(item);
+			return item->sources;
+		}
+		hotCache.removeOldest(HOT_CACHE_SIZE);
+		CacheItem newItem;
+		newItem.key = tth;
+		sourceIndex.get(tth, newItem.sources);
+		hotCache.add(newItem, &item);
+		return item->sources;
 	}
 
 	/*
@@ -38,45 +66,30 @@ namespace dht
 	 */
 	void IndexManager::addSource(const TTHValue& tth, const Node::Ptr& node, uint64_t size, bool partial)
 	{
+		const int64_t now = time(nullptr);
 		Source source;
 		source.setCID(node->getUser()->getCID());
 		source.setIp(node->getIdentity().getIP4());
 		source.setUdpPort(node->getIdentity().getUdp4Port());
 		source.setSize(size);
-		source.setExpires(GET_TICK() + (partial ? PFS_REPUBLISH_TIME : REPUBLISH_TIME));
+		source.setExpires(now + (partial ? PFS_REPUBLISH_TIME : REPUBLISH_TIME) / 1000);
 		source.setPartial(partial);
 
 		LOCK(cs);
+		SourceList& sources = getSourcesL(tth);
 
-		TTHMap::iterator i = tthList.find(tth);
-		if (i != tthList.end())
-		{
-			// no user duplicites
-			SourceList& sources = i->second;
-			for (SourceList::iterator s = sources.begin(); s != sources.end(); s++)
-			{
-				if (node->getUser()->getCID() == (*s).getCID())
-				{
-					// delete old item
-					sources.erase(s);
-					break;
-				}
-			}
+		// no user duplicites, drop expired sources while we are here
+		sources.erase(std::remove_if(sources.begin(), sources.end(),
+			[&source, now](const Source& s) { return s.getCID() == source.getCID() || s.getExpires() <= now; }), sources.end());
 
-			// old items in front, new items in back
-			sources.push_back(source);
+		// old items in front, new items in back
+		sources.push_back(source);
 
-			// if maximum sources reached, remove the oldest one
-			if (sources.size() > MAX_SEARCH_RESULTS)
-				sources.pop_front();
-		}
-		else
-		{
-			// new file
-			tthList.insert(std::make_pair(tth, SourceList(1, source)));
-		}
+		// if maximum sources reached, remove the oldest one
+		if (sources.size() > MAX_SEARCH_RESULTS)
+			sources.pop_front();
 
-		DHT::getInstance()->setDirty();
+		sourceIndex.put(tth, sources);
 	}
 
 	/*
@@ -85,108 +98,202 @@ namespace dht
 	bool IndexManager::findResult(const TTHValue& tth, SourceList& sources) const
 	{
 		// TODO: does file exist in my own sharelist?
-		LOCK(cs);
-		TTHMap::const_iterator i = tthList.find(tth);
-		if (i != tthList.end())
+		const int64_t now = time(nullptr);
+		sources.clear();
 		{
-			sources = i->second;
-			return true;
+			LOCK(cs);
+			// lookups don't populate hotCache, misses would evict entries that have sources
+			CacheItem* item = hotCache.get(tth);
+			if (item)
+			{
+				hotCache.makeNewest(item);
+				for (const Source& s : item->sources)
+					if (s.getExpires() > now)
+						sources.push_back(s);
+			}
+			else if (sourceIndex.get(tth, sources))
+			{
+				sources.erase(std::remove_if(sources.begin(), sources.end(),
+					[now](const Source& s) { return s.getExpires() <= now; }), sources.end());
+			}
+			else
+				sources.clear();
 		}
-
-		return false;
+		return !sources.empty();
 	}
 
 	/*
-	 * Try to publish next file in queue
+	 * Publishes queued files within the packet budget
 	 */
-	void IndexManager::publishNextFile()
+	void IndexManager::publishNextFiles(uint64_t tick)
 	{
-		File f;
+		auto ss = SettingsManager::instance.getCoreSettings();
+		ss->lockRead();
+		size_t budget = ss->getInt(Conf::DHT_PUBLISH_PACKETS) * PUBLISH_TIME / 1000;
+		ss->unlockRead();
+
+		vector<File> lookups;
+		vector<pair<File, vector<Node::Ptr>>> requests;
 		{
 			LOCK(cs);
 
-			if (publishQueue.empty() || publishing >= MAX_PUBLISHES_AT_TIME)
-				return;
+			// partial files don't have neighbours in the queue, each needs its own lookup
+			while (!partialQueue.empty() && publishing < MAX_PUBLISHES_AT_TIME)
+			{
+				incPublishing();
+				lookups.push_back(partialQueue.front());
+				partialQueue.pop_front();
+			}
+
+			if (!publishQueueSorted)
+			{
+				std::sort(publishQueue.begin(), publishQueue.end(), [](const File& a, const File& b) { return b < a; });
+				publishQueueSorted = true;
+			}
+
+			// the lookup may be dropped without reporting its result
+			if (storeNodes.pending && storeNodes.expires <= tick)
+			{
+				storeNodes.pending = false;
+				storeNodes.nodes.clear();
+			}
+
+			vector<Node::Ptr> nodes;
+			while (!publishQueue.empty())
+			{
+				const File& f = publishQueue.back();
+				if (getStoreNodesL(f.tth, tick, nodes))
+				{
+					if (nodes.size() > budget) break;
+					budget -= nodes.size();
+					stats.published++;
+					requests.emplace_back(f, std::move(nodes));
+					publishQueue.pop_back();
+					continue;
+				}
 
-			incPublishing();
+				// wait for the running lookup, the next files are probably close to its target
+				if (storeNodes.pending || publishing >= MAX_PUBLISHES_AT_TIME) break;
+
+				incPublishing();
+				storeNodes.target = CID(f.tth.data);
+				storeNodes.pending = true;
+				storeNodes.expires = tick + SEARCHSTOREFILE_LIFETIME + 2 * SEARCH_PROCESSTIME;
+				stats.lookups++;
+				lookups.push_back(f);
+				publishQueue.pop_back();
+				break;
+			}
+		}
 
-			f = publishQueue.front(); // get the first file in queue
-			publishQueue.pop_front(); // and remove it from queue
+		for (const auto& r : requests)
+		{
+			const string tth = r.first.tth.toBase32();
+			for (const Node::Ptr& node : r.second)
+				sendPublishRequest(node, tth, r.first.size, false);
 		}
-		SearchManager::getInstance()->findStore(f.tth.toBase32(), f.size, f.partial);
+
+		for (const File& f : lookups)
+			SearchManager::getInstance()->findStore(f.tth.toBase32(), f.size, f.partial);
+	}
+
+	bool IndexManager::getStoreNodesL(const TTHValue& tth, uint64_t tick, vector<Node::Ptr>& nodes) const
+	{
+		if (storeNodes.pending || storeNodes.nodes.empty() || storeNodes.expires <= tick)
+			return false;
+
+		// the lookup found all nodes sharing more than "prefix" bits with its target,
+		// they are also the closest ones to any hash having such prefix
+		const CID target(tth.data);
+		if ((int) Utils::getCommonPrefix(target, storeNodes.target) <= storeNodes.prefix)
+			return false;
+
+		nodes = storeNodes.nodes;
+		auto cmp = [&target](const Node::Ptr& a, const Node::Ptr& b)
+		{
+			return Utils::getDistance(target, a->getUser()->getCID()) < Utils::getDistance(target, b->getUser()->getCID());
+		};
+		if (nodes.size() > K)
+		{
+			std::partial_sort(nodes.begin(), nodes.begin() + K, nodes.end(), cmp);
+			nodes.resize(K);
+		}
+		return true;
 	}
 
 	/*
-	 * Loads existing indexes from disk
+	 * Remembers nodes found by the store lookup
 	 */
-	void IndexManager::loadIndexes(SimpleXML& xml)
+	void IndexManager::storeLookupFinished(const string& term, const Node::Map& nodes)
 	{
-		xml.resetCurrentChild();
-		if (xml.findChild("Indexes"))
-		{
-			xml.stepIn();
-			while (xml.findChild("Index"))
-			{
-				const TTHValue tth = TTHValue(xml.getChildAttrib("TTH"));
-				SourceList sources;
+		const CID target(term);
+		LOCK(cs);
+		if (!storeNodes.pending || storeNodes.target != target)
+			return;
 
-				xml.stepIn();
-				while (xml.findChild("Source"))
-				{
-					const string& ipStr = xml.getChildAttrib("I4");
-					Ip4Address ip;
-					if (!Util::parseIpAddress(ip, ipStr)) continue;
-
-					Source source;
-					source.setCID(CID(xml.getChildAttrib("CID")));
-					source.setIp(ip);
-					source.setUdpPort(static_cast<uint16_t>(xml.getIntChildAttrib("U4")));
-					source.setSize(xml.getInt64ChildAttrib("SI"));
-					source.setExpires(xml.getInt64ChildAttrib("EX"));
-					source.setPartial(false);
-					sources.push_back(source);
-				}
+		storeNodes.pending = false;
+		storeNodes.nodes.clear();
+		storeNodes.prefix = -1;
+		storeNodes.expires = GET_TICK() + STORE_NODES_LIFETIME;
 
-				tthList.insert(std::make_pair(tth, sources));
-				xml.stepOut();
-			}
-			xml.stepOut();
+		// keep some more nodes than needed, the closest ones differ for each file
+		for (auto i = nodes.cbegin(); i != nodes.cend() && storeNodes.nodes.size() < 2 * K; ++i)
+		{
+			storeNodes.nodes.push_back(i->second);
+			if (storeNodes.nodes.size() == K)
+				storeNodes.prefix = Utils::getCommonPrefix(target, i->second->getUser()->getCID());
 		}
+		if (!storeNodes.nodes.empty())
+			stats.published++;
 	}
 
 	/*
-	 * Save all indexes to disk
+	 * Sends publishing request to one node
 	 */
-	void IndexManager::saveIndexes(SimpleXML& xml)
+	void IndexManager::sendPublishRequest(const Node::Ptr& node, const string& tth, int64_t size, bool partial)
 	{
-		xml.addTag("Files");
-		xml.stepIn();
+		AdcCommand cmd(AdcCommand::CMD_PUB, AdcCommand::TYPE_UDP);
+		cmd.addParam(TAG('T', 'R'), tth);
+		cmd.addParam(TAG('S', 'I'), Util::toString(size));
 
-		LOCK(cs);
-		for (TTHMap::const_iterator i = tthList.begin(); i != tthList.end(); i++)
-		{
-			xml.addTag("File");
-			xml.addChildAttrib("TTH", i->first.toBase32());
+		if (partial)
+			cmd.addParam("PF1");
 
-			xml.stepIn();
-			for (SourceList::const_iterator j = i->second.begin(); j != i->second.end(); j++)
-			{
-				const Source& source = *j;
+		DHT::getInstance()->send(cmd, node->getIdentity().getIP4(),
+			node->getIdentity().getUdp4Port(), node->getUser()->getCID(), node->getUdpKey());
+		if (IndexManager::isValidInstance())
+			++IndexManager::getInstance()->sentPackets;
+	}
 
-				if (source.getPartial())
-					continue;	// don't store partial sources
+	/*
+	 * Queues all shared files for publishing
+	 */
+	void IndexManager::publishShare()
+	{
+		vector<pair<TTHValue, int64_t>> files;
+		ShareManager::getInstance()->getHashes(files, MIN_PUBLISH_FILESIZE);
 
-				xml.addTag("Source");
-				xml.addChildAttrib("CID", source.getCID().toBase32());
-				xml.addChildAttrib("I4", source.getIp());
-				xml.addChildAttrib("U4", source.getUdpPort());
-				xml.addChildAttrib("SI", source.getSize());
-				xml.addChildAttrib("EX", source.getExpires());
-			}
-			xml.stepOut();
-		}
+		LOCK(cs);
+		// files not published in the previous round are replaced
+		publishQueue.clear();
+		publishQueue.reserve(files.size());
+		for (const auto& f : files)
+			publishQueue.emplace_back(f.first, f.second, false);
+		publishQueueSorted = false;
+
+		stats.total = publishQueue.size();
+		stats.published = 0;
+		stats.lookups = 0;
+		stats.started = GET_TICK();
+		setNextPublishing();
+	}
 
-		xml.stepOut();
+	PublishStats IndexManager::getPublishStats() const
+	{
+		LOCK(cs);
+		PublishStats result = stats;
+		result.packets = sentPackets;
+		return result;
 	}
 
 	/*
@@ -226,32 +333,13 @@ namespace dht
 	{
 		LOCK(cs);
 
-		bool dirty = false;
-
-		TTHMap::iterator i = tthList.begin();
-		while (i != tthList.end())
-		{
-			SourceList::iterator j = i->second.begin();
-			while (j != i->second.end())
-			{
-				const Source& source = *j;
-				if (source.getExpires() <= tick)
-				{
-					dirty = true;
-					j = i->second.erase(j);
-				}
-				else
-					break;	// list is sorted, so finding first non-expired can stop iteration
-			}
-
-			if (i->second.empty())
-				tthList.erase(i++);
-			else
-				++i;
-		}
+		// sweep a part of the index each time so that all keys are visited about once an hour
+		const size_t maxKeys = std::max(SWEEP_MIN_KEYS, sourceIndex.getKeyCount() / 60);
+		size_t removed;
+		sourceIndex.sweep(time(nullptr), maxKeys, removed);
+		sourceIndex.sync();
 
-		if (dirty)
-			DHT::getInstance()->setDirty();
+		// expired sources in hotCache are skipped by findResult
 	}
 
 	/** Publishes shared file */
@@ -261,6 +349,8 @@ namespace dht
 		{
 			LOCK(cs);
 			publishQueue.push_back(File(tth, size, false));
+			publishQueueSorted = false;
+			stats.total++;
 		}
 	}
 
@@ -270,7 +360,7 @@ namespace dht
 	void IndexManager::publishPartialFile(const TTHValue& tth)
 	{
 		LOCK(cs);
-		publishQueue.push_front(File(tth, 0, true));
+		partialQueue.push_back(File(tth, 0, true));
 	}
 
 
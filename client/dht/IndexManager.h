@@ -21,9 +21,11 @@
 
 #include "Constants.h"
 #include "KBucket.h"
+#include "SourceIndex.h"
 
 #include "../ShareManager.h"
 #include "../Singleton.h"
+#include "../LruCache.h"
 #include <atomic>
 
 namespace dht
@@ -35,6 +37,8 @@ namespace dht
 		File(const TTHValue& tth, int64_t size, bool partial) :
 			tth(tth), size(size), partial(partial) { }
 
+		bool operator<(const File& rhs) const { return tth < rhs.tth; }
+
 		/** File hash */
 		TTHValue tth;
 
@@ -45,14 +49,13 @@ namespace dht
 		bool partial;
 	};
 
-	struct Source
+	struct PublishStats
 	{
-		GETSET(CID, cid, CID);
-		GETSET(Ip4Address, ip, Ip);
-		GETSET(uint64_t, expires, Expires);
-		GETSET(uint64_t, size, Size);
-		GETSET(uint16_t, udpPort, UdpPort);
-		GETSET(bool, partial, Partial);
+		size_t total;     // files queued in this round
+		size_t published; // files sent to the network
+		size_t lookups;   // node lookups done
+		uint64_t packets; // PUB commands sent
+		uint64_t started; // time when this round started
 	};
 
 	class IndexManager : public Singleton<IndexManager>
@@ -60,19 +63,24 @@ namespace dht
 	public:
 		IndexManager();
 
-		typedef std::deque<Source> SourceList;
+		typedef dht::SourceList SourceList;
 
 		/** Finds TTH in known indexes and returns it */
 		bool findResult(const TTHValue& tth, SourceList& sources) const;
 
-		/** Try to publish next file in queue */
-		void publishNextFile();
+		/** Publishes queued files within the packet budget */
+		void publishNextFiles(uint64_t tick);
+
+		/** Queues all shared files for publishing */
+		void publishShare();
+
+		/** Remembers nodes found by the store lookup, they are reused for files with nearby hashes */
+		void storeLookupFinished(const string& term, const Node::Map& nodes);
 
-		/** Loads existing indexes from disk */
-		void loadIndexes(SimpleXML& xml);
+		/** Sends publishing request to one node */
+		static void sendPublishRequest(const Node::Ptr& node, const string& tth, int64_t size, bool partial);
 
-		/** Save all indexes to disk */
-		void saveIndexes(SimpleXML& xml);
+		PublishStats getPublishStats() const;
 
 		/** How many files is currently being published */
 		void incPublishing() { ++publishing; }
@@ -101,13 +109,43 @@ namespace dht
 		bool isTimeForPublishing() const { return GET_TICK() >= nextRepublishTime; }
 
 	private:
+		static const size_t HOT_CACHE_SIZE = 20000;
+		static const size_t SWEEP_MIN_KEYS = 2000;
+
+		struct CacheItem
+		{
+			TTHValue key;
+			SourceList sources;
+			CacheItem* next;
+			CacheItem* prev;
+		};
+
 		/** Contains known hashes in the network and their sources */
-		typedef std::unordered_map<TTHValue, SourceList> TTHMap;
-		TTHMap tthList;
+		mutable SourceIndex sourceIndex;
+
+		/** Recently used entries of sourceIndex */
+		mutable LruCacheEx<CacheItem, TTHValue> hotCache;
 
-		/** Queue of files prepared for publishing */
-		typedef std::deque<File> FileQueue;
-		FileQueue publishQueue;
+		/** Queue of files prepared for publishing, sorted in descending order so that neighbouring hashes are published together */
+		vector<File> publishQueue;
+		bool publishQueueSorted;
+
+		/** Partially downloaded files, published first with their own lookups */
+		std::deque<File> partialQueue;
+
+		/** Closest nodes found by the last store lookup */
+		struct StoreNodes
+		{
+			CID target;
+			vector<Node::Ptr> nodes;
+			int prefix;       // bits shared by target and the K-th closest node, -1 if fewer nodes were found
+			uint64_t expires; // when the nodes become stale or when the running lookup is abandoned
+			bool pending;     // lookup is running
+		};
+		StoreNodes storeNodes;
+
+		PublishStats stats;
+		std::atomic<uint64_t> sentPackets;
 
 		/** Is publishing allowed? */
 		bool publish;
@@ -118,11 +156,17 @@ namespace dht
 		/** Time when our sharelist should be republished */
 		uint64_t nextRepublishTime;
 
-		/** Synchronizes access to tthList */
+		/** Synchronizes access to sourceIndex and hotCache */
 		mutable CriticalSection cs;
 
 		/** Add new source to tth list */
 		void addSource(const TTHValue& tth, const Node::Ptr& node, uint64_t size, bool partial);
+
+		/** Returns cached sources for the file, loading them from the index if needed; used when storing sources */
+		SourceList& getSourcesL(const TTHValue& tth) const;
+
+		/** Finds K nodes closest to the file if the last lookup covers its hash */
+		bool getStoreNodesL(const TTHValue& tth, uint64_t tick, vector<Node::Ptr>& nodes) const;
 	};
 
 } // namespace dht
@@ -83,42 +83,65 @@ namespace dht
 	}
 
 
-	KBucket::~KBucket()
+	RoutingTable::RoutingTable() : myCID(ClientManager::getMyCID()), buckets(1), nodeCount(0)
+	{
+	}
+
+	RoutingTable::~RoutingTable()
 	{
 		// empty table
-		for (auto it = nodes.begin(); it != nodes.end(); ++it)
+		for (KBucket& bucket : buckets)
 		{
-			Node::Ptr& node = *it;
-			if (node->isOnline())
-				ClientManager::getInstance()->putOffline(node);
+			for (const Node::Ptr& node : bucket.nodes)
+				if (node->isOnline())
+					ClientManager::getInstance()->putOffline(node);
+			for (const Node::Ptr& node : bucket.replacements)
+				if (node->isOnline())
+					ClientManager::getInstance()->putOffline(node);
 		}
 
-		nodes.clear();
+		buckets.clear();
+	}
+
+	size_t RoutingTable::getBucketIndex(const CID& cid) const
+	{
+		return std::min<size_t>(Utils::getCommonPrefix(myCID, cid), buckets.size() - 1);
 	}
 
 	/*
 	 * Creates new (or update existing) node which is NOT added to our routing table
 	 */
-	Node::Ptr KBucket::createNode(const UserPtr& u, Ip4Address ip, uint16_t port, bool update, bool isUdpKeyValid)
+	Node::Ptr RoutingTable::createNode(const UserPtr& u, Ip4Address ip, uint16_t port, bool update, bool isUdpKeyValid)
 	{
 		if (u->getFlags() & User::DHT) // is this user already known in DHT?
 		{
 			Node::Ptr node;
 
 			// no online node found, try get from routing table
-			for (auto it = nodes.begin(); it != nodes.end(); ++it)
+			KBucket& bucket = buckets[getBucketIndex(u->getCID())];
+			for (auto it = bucket.nodes.begin(); it != bucket.nodes.end(); ++it)
 			{
 				if (u->getCID() == (*it)->getUser()->getCID())
 				{
 					node = *it;
 
 					// put node at the end of the list
-					nodes.erase(it);
-					nodes.push_back(node);
+					bucket.nodes.erase(it);
+					bucket.nodes.push_back(node);
 					break;
 				}
 			}
 
+			if (!node)
+			{
+				for (const Node::Ptr& n : bucket.replacements)
+					if (u->getCID() == n->getUser()->getCID())
+					{
+						node = n;
+						break;
+					}
+			}
+
 			if (!node && u->isOnline())
 			{
 				// try to get node from ClientManager (user can be online but not in our routing table)
@@ -142,8 +165,11 @@ namespace dht
 						 // TODO: don't allow update when new IP already exists for different node
 
 						// erase old IP and remember new one
-						ipMap.erase(NodeAddress(oldIp, oldPort));
-						ipMap.insert(NodeAddress(ip, port));
+						if (node->isInList)
+						{
+							ipMap.erase(NodeAddress(oldIp, oldPort));
+							ipMap.insert(NodeAddress(ip, port));
+						}
 					}
 
 					if (!node->isIpVerified())
@@ -172,123 +198,225 @@ namespace dht
 	/*
 	 * Adds node to routing table
 	 */
-	bool KBucket::insert(const Node::Ptr& node)
+	bool RoutingTable::insert(const Node::Ptr& node)
 	{
 		if (node->isInList)
 			return true;	// node is already in the table
 
+		const CID& cid = node->getUser()->getCID();
+		if (cid == myCID)
+			return false;
+
 		Ip4Address ip = node->getIdentity().getIP4();
 		uint16_t port = node->getIdentity().getUdp4Port();
 		NodeAddress na(ip, port);
 
 		// allow only one same IP:port
-		bool isAcceptable = ipMap.find(na) == ipMap.end();
+		if (ipMap.find(na) != ipMap.end())
+			return false;
 
-		if ((nodes.size() < (K * ID_BITS)) && isAcceptable)
+		for (;;)
 		{
-			nodes.push_back(node);
-			node->isInList = true;
-			ipMap.insert(na);
+			size_t index = getBucketIndex(cid);
+			KBucket& bucket = buckets[index];
+			if (bucket.nodes.size() < K)
+			{
+				bucket.nodes.push_back(node);
+				node->isInList = true;
+				ipMap.insert(na);
+				nodeCount++;
+
+				if (DHT::getInstance())
+					DHT::getInstance()->setDirty();
 
-			if (DHT::getInstance())
-				DHT::getInstance()->setDirty();
+				return true;
+			}
 
+			// only the bucket containing our own ID can be split
+			if (index + 1 == buckets.size() && buckets.size() < ID_BITS)
+			{
+				splitLastBucket();
+				continue;
+			}
+
+			// keep the node in case some node from this bucket dies
+			addReplacement(bucket, node);
 			return true;
 		}
+	}
 
-		return isAcceptable;
+	void RoutingTable::splitLastBucket()
+	{
+		const size_t index = buckets.size() - 1;
+		buckets.emplace_back();
+		KBucket& oldBucket = buckets[index];
+		KBucket& newBucket = buckets.back();
+
+		// nodes sharing more than "index" bits with us move to the new bucket, order is preserved
+		auto moveNodes = [this, index](KBucket::NodeList& from, KBucket::NodeList& to)
+		{
+			KBucket::NodeList keep;
+			for (Node::Ptr& node : from)
+				if (Utils::getCommonPrefix(myCID, node->getUser()->getCID()) > index)
+					to.push_back(std::move(node));
+				else
+					keep.push_back(std::move(node));
+			from.swap(keep);
+		};
+		moveNodes(oldBucket.nodes, newBucket.nodes);
+		moveNodes(oldBucket.replacements, newBucket.replacements);
+	}
+
+	void RoutingTable::addReplacement(KBucket& bucket, const Node::Ptr& node)
+	{
+		for (auto it = bucket.replacements.begin(); it != bucket.replacements.end(); ++it)
+			if (*it == node)
+			{
+				bucket.replacements.erase(it);
+				break;
+			}
+
+		if (bucket.replacements.size() >= K)
+			bucket.replacements.pop_front();
+		bucket.replacements.push_back(node);
 	}
 
 	/*
 	 * Finds "max" closest nodes and stores them to the list
 	 */
-	void KBucket::getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const
+	void RoutingTable::getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const
 	{
-		for (NodeList::const_iterator it = nodes.begin(); it != nodes.end(); it++)
+		// Nodes in bucket p (where p is the prefix length shared by cid and our ID) are the closest to cid,
+		// then come the nodes from all following buckets, then buckets p-1, p-2, ..., 0 in this order,
+		// so we can stop once we have enough candidates
+		vector<pair<CID, const Node::Ptr*>> candidates;
+		auto addCandidates = [&](const KBucket& bucket)
+		{
+			for (const Node::Ptr& node : bucket.nodes)
+				if (node->getType() <= maxType && node->isIpVerified() && !(node->getUser()->getFlags() & User::PASSIVE))
+					candidates.emplace_back(Utils::getDistance(cid, node->getUser()->getCID()), &node);
+		};
+
+		const size_t p = getBucketIndex(cid);
+		for (size_t i = p; i < buckets.size(); i++)
+			addCandidates(buckets[i]);
+		for (size_t i = p; i > 0 && candidates.size() < max; i--)
+			addCandidates(buckets[i - 1]);
+
+		for (const auto& c : candidates)
 		{
-			const Node::Ptr& node = *it;
-			if (node->getType() <= maxType && node->isIpVerified() && !(node->getUser()->getFlags() & User::PASSIVE))
+			if (closest.size() < max)
 			{
-				CID distance = Utils::getDistance(cid, node->getUser()->getCID());
-
-				if (closest.size() < max)
-				{
-					// just insert
-					closest.insert(std::make_pair(distance, node));
-				}
-				else
+				// just insert
+				closest.insert(std::make_pair(c.first, *c.second));
+			}
+			else
+			{
+				// not enough room, so insert only closer nodes
+				if (c.first < closest.rbegin()->first)	// "closest" is sorted map, so just compare with last node
 				{
-					// not enough room, so insert only closer nodes
-					if (distance < closest.rbegin()->first)	// "closest" is sorted map, so just compare with last node
-					{
-						closest.erase(closest.rbegin()->first);
-						closest.insert(std::make_pair(distance, node));
-					}
+					closest.erase(closest.rbegin()->first);
+					closest.insert(std::make_pair(c.first, *c.second));
 				}
 			}
 		}
 	}
 
+	Node::Ptr RoutingTable::findNode(const CID& cid) const
+	{
+		const KBucket& bucket = buckets[getBucketIndex(cid)];
+		for (const Node::Ptr& node : bucket.nodes)
+			if (node->getUser()->getCID() == cid)
+				return node;
+		return Node::Ptr();
+	}
+
 	/*
 	 * Remove dead nodes
 	 */
-	bool KBucket::checkExpiration(uint64_t currentTime, OnlineUserList& removedList)
+	bool RoutingTable::checkExpiration(uint64_t currentTime, OnlineUserList& removedList, vector<Node::Ptr>& promotedList)
 	{
 		bool dirty = false;
-
-		// we should ping oldest node from every bucket here
-		// but since we have only one bucket now, simulate it by pinging more nodes
-		unsigned pingCount = max(K, min(2 * K, (unsigned)(nodes.size() / (K * 10)) + 1)); // <-- pings 10 - 20 oldest nodes
-		unsigned pinged = 0;
+		dcdrun(unsigned pinged = 0);
 		dcdrun(unsigned removed = 0);
 
-		// first, remove dead nodes
-		auto i = nodes.begin();
-		while (i != nodes.end())
+		for (KBucket& bucket : buckets)
 		{
-			Node::Ptr& node = *i;
-			if (node->getType() == 4 && node->expires > 0 && node->expires <= currentTime)
+			// ping the oldest expired nodes in every bucket
+			unsigned bucketPinged = 0;
+
+			// first, remove dead nodes
+			auto i = bucket.nodes.begin();
+			while (i != bucket.nodes.end())
 			{
-				// node is dead, remove it
-				Ip4Address ip = node->getIdentity().getIP4();
-				uint16_t port = node->getIdentity().getUdp4Port();
-				ipMap.erase(NodeAddress(ip, port));
-				if (node->isOnline())
-					removedList.push_back(node);
+				Node::Ptr& node = *i;
+				if (node->getType() == 4 && node->expires > 0 && node->expires <= currentTime)
+				{
+					// node is dead, remove it
+					Ip4Address ip = node->getIdentity().getIP4();
+					uint16_t port = node->getIdentity().getUdp4Port();
+					ipMap.erase(NodeAddress(ip, port));
+					node->isInList = false;
+					if (node->isOnline())
+						removedList.push_back(node);
+
+					i = bucket.nodes.erase(i);
+					nodeCount--;
+					dirty = true;
+					dcdrun(removed++);
+					continue;
+				}
 
-				i = nodes.erase(i);
-				dirty = true;
-				dcdrun(removed++);
-				continue;
-			}
+				if (node->expires == 0)
+					node->expires = currentTime;
 
-			if (node->expires == 0)
-				node->expires = currentTime;
+				// select the oldest expired node
+				if (bucketPinged < PINGS_PER_BUCKET && node->getType() < 4 && node->expires <= currentTime)
+				{
+					// ping the oldest (expired) node
+					node->setTimeout(currentTime);
+					DHT::getInstance()->info(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port(), DHT::PING, node->getUser()->getCID(), node->getUdpKey());
+					bucketPinged++;
+				}
 
-			// select the oldest expired node
-			if (pinged < pingCount && node->getType() < 4 && node->expires <= currentTime)
-			{
-				// ping the oldest (expired) node
-				node->setTimeout(currentTime);
-				DHT::getInstance()->info(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port(), DHT::PING, node->getUser()->getCID(), node->getUdpKey());
-				pinged++;
+				++i;
 			}
+			dcdrun(pinged += bucketPinged);
+
+			// replace dead nodes with the most recently seen ones
+			while (bucket.nodes.size() < K && !bucket.replacements.empty())
+			{
+				Node::Ptr node = std::move(bucket.replacements.back());
+				bucket.replacements.pop_back();
+				if (node->getType() == 4)
+					continue;
 
-			++i;
+				NodeAddress na(node->getIdentity().getIP4(), node->getIdentity().getUdp4Port());
+				if (ipMap.find(na) != ipMap.end())
+					continue;
+
+				bucket.nodes.push_back(node);
+				node->isInList = true;
+				ipMap.insert(na);
+				nodeCount++;
+				dirty = true;
+				if (!node->isOnline())
+					promotedList.push_back(node);
+			}
 		}
 
 #ifndef NDEBUG
 		int verified = 0; int types[5] = { 0 };
-		for (NodeList::const_iterator j = nodes.begin(); j != nodes.end(); j++)
-		{
-			Node::Ptr n = *j;
-			if (n->isIpVerified()) verified++;
+		for (const KBucket& bucket : buckets)
+			for (const Node::Ptr& n : bucket.nodes)
+			{
+				if (n->isIpVerified()) verified++;
 
-			dcassert(n->getType() >= 0 && n->getType() <= 4);
-			types[n->getType()]++;
-		}
+				dcassert(n->getType() >= 0 && n->getType() <= 4);
+				types[n->getType()]++;
+			}
 
-		dcdebug("DHT Nodes: %d (%d verified), Types: %d/%d/%d/%d/%d, pinged %d of %d, removed %d\n", nodes.size(), verified, types[0], types[1], types[2], types[3], types[4], pinged, pingCount, removed);
+		dcdebug("DHT Nodes: %d (%d verified) in %d buckets, Types: %d/%d/%d/%d/%d, pinged %d, removed %d\n", (int) nodeCount, verified, (int) buckets.size(), types[0], types[1], types[2], types[3], types[4], pinged, removed);
 #endif
 
 		return dirty;
@@ -297,7 +425,7 @@ namespace dht
 	/*
 	 * Loads existing nodes from disk
 	 */
-	void KBucket::loadNodes(SimpleXML& xml)
+	void RoutingTable::loadNodes(SimpleXML& xml)
 	{
 		xml.resetCurrentChild();
 		if (xml.findChild("Nodes"))
@@ -336,7 +464,7 @@ namespace dht
 	/*
 	 * Save bootstrap nodes to disk
 	 */
-	void KBucket::saveNodes(SimpleXML& xml)
+	void RoutingTable::saveNodes(SimpleXML& xml)
 	{
 		xml.addTag("Nodes");
 		xml.stepIn();
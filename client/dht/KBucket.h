@@ -50,6 +50,9 @@ namespace dht
 		bool isOnline() const { return online; }
 		void setOnline(bool online) { this->online = online; }
 
+		/** True if the node is in a bucket, false for nodes kept only in the replacement cache */
+		bool isInBucket() const { return isInList; }
+
 		void setAlive();
 		void setIpVerified(bool verified) { ipVerified = verified; }
 		void setTimeout(uint64_t now = GET_TICK());
@@ -60,7 +63,7 @@ namespace dht
 		const UDPKey& getUDPKey() const { return key; }
 
 	private:
-		friend class KBucket;
+		friend class RoutingTable;
 
 		UDPKey key;
 
@@ -72,12 +75,28 @@ namespace dht
 		bool     isInList;
 	};
 
-	class KBucket
+	/** Nodes sharing the same prefix length with our ID, least recently seen first */
+	struct KBucket
+	{
+		typedef std::deque<Node::Ptr> NodeList;
+
+		NodeList nodes;
+		NodeList replacements; // nodes seen while the bucket was full, most recent last
+	};
+
+	/**
+	 * Kademlia routing table.
+	 * Bucket i holds nodes whose ID shares exactly i leading bits with ours,
+	 * the last bucket holds all nodes sharing at least that many bits.
+	 * When the last bucket gets full it's split into two.
+	 */
+	class RoutingTable
 	{
 	public:
-		~KBucket();
+		RoutingTable();
+		~RoutingTable();
 
-		typedef std::deque<Node::Ptr> NodeList;
+		typedef KBucket::NodeList NodeList;
 
 		/** Creates new (or update existing) node which is NOT added to our routing table */
 		Node::Ptr createNode(const UserPtr& u, Ip4Address ip, uint16_t port, bool update, bool isUdpKeyValid);
@@ -88,11 +107,22 @@ namespace dht
 		/** Finds "max" closest nodes and stores them to the list */
 		void getClosestNodes(const CID& cid, Node::Map& closest, unsigned int max, uint8_t maxType) const;
 
-		/** Return list of all nodes in this bucket */
-		const NodeList& getNodes() const { return nodes; }
+		/** Finds node in the routing table */
+		Node::Ptr findNode(const CID& cid) const;
+
+		/** Calls f for each node in the routing table */
+		template<typename F>
+		void forEachNode(F f) const
+		{
+			for (const KBucket& bucket : buckets)
+				for (const Node::Ptr& node : bucket.nodes)
+					f(node);
+		}
+
+		size_t getNodeCount() const { return nodeCount; }
 
-		/** Removes dead nodes */
-		bool checkExpiration(uint64_t currentTime, OnlineUserList& removedList);
+		/** Removes dead nodes, replacements moved into the buckets are returned in promotedList */
+		bool checkExpiration(uint64_t currentTime, OnlineUserList& removedList, vector<Node::Ptr>& promotedList);
 
 		/** Loads existing nodes from disk */
 		void loadNodes(SimpleXML& xml);
@@ -101,11 +131,18 @@ namespace dht
 		void saveNodes(SimpleXML& xml);
 
 	private:
-		/** List of nodes in this bucket */
-		NodeList nodes;
+		static const unsigned PINGS_PER_BUCKET = 2;
+
+		const CID myCID;
+		vector<KBucket> buckets;
+		size_t nodeCount;
 
-		/** List of known IPs in this bucket */
+		/** List of known IPs in the routing table */
 		boost::unordered_set<NodeAddress> ipMap;
+
+		size_t getBucketIndex(const CID& cid) const;
+		void splitLastBucket();
+		void addReplacement(KBucket& bucket, const Node::Ptr& node);
 	};
 
 }
@@ -0,0 +1,331 @@
+#include "stdinc.h"
+#include "SourceIndex.h"
+#include "../AppPaths.h"
+#include "../StrUtil.h"
+#include "../PathUtil.h"
+#include "../File.h"
+#include "../LogManager.h"
+#include "../unaligned.h"
+
+namespace dht
+{
+
+	static const size_t TTH_SIZE = TigerTree::BYTES;
+
+	// CID, IP, port, flags, size, expiration time
+	static const size_t RECORD_SIZE = CID::SIZE + 4 + 2 + 2 + 8 + 8;
+
+	static const uint16_t RECORD_FLAG_PARTIAL = 1;
+
+#if defined(_WIN64) || defined(__LP64__)
+#define PLATFORM_TAG "x64"
+	static const mdb_size_t MIN_MAP_SIZE = 256ull*1024ull*1024ull;
+#else
+#define PLATFORM_TAG "x32"
+	static const mdb_size_t MIN_MAP_SIZE = 64ull*1024ull*1024ull;
+#endif
+
+	string SourceIndex::getDBPath() noexcept
+	{
+		string path = Util::getConfigPath();
+		path += "dht-index." PLATFORM_TAG;
+		return path;
+	}
+
+	bool SourceIndex::checkError(int error, const char* what) noexcept
+	{
+		if (!error) return true;
+		string errorText = "DHT index LMDB error: " + Util::toString(error);
+		if (what)
+		{
+			errorText += " (";
+			errorText += what;
+			errorText += ")";
+		}
+		LogManager::message(errorText);
+		return false;
+	}
+
+	bool SourceIndex::open() noexcept
+	{
+		if (env) return false;
+
+		int error = mdb_env_create(&env);
+		if (!checkError(error, "mdb_env_create")) return false;
+
+		mdb_env_set_maxdbs(env, 1);
+		string path = getDBPath();
+		path += PATH_SEPARATOR;
+		File::ensureDirectory(path);
+		// All access is serialized by the caller.
+		// The index is a cache, commits don't wait for the disk; sync() is called periodically
+		error = mdb_env_open(env, path.c_str(), MDB_NOTLS | MDB_NOSYNC | MDB_NOMETASYNC, 0664);
+		if (!checkError(error, "mdb_env_open"))
+		{
+			mdb_env_close(env);
+			env = nullptr;
+			return false;
+		}
+
+		MDB_envinfo info;
+		error = mdb_env_info(env, &info);
+		if (error || info.me_mapsize < MIN_MAP_SIZE)
+		{
+			error = mdb_env_set_mapsize(env, MIN_MAP_SIZE);
+			if (!checkError(error, "mdb_env_set_mapsize"))
+			{
+				mdb_env_close(env);
+				env = nullptr;
+				return false;
+			}
+		}
+
+		MDB_txn* txn;
+		error = mdb_txn_begin(env, nullptr, 0, &txn);
+		if (checkError(error, "mdb_txn_begin"))
+		{
+			error = mdb_dbi_open(txn, "sources", MDB_CREATE, &dbi);
+			if (checkError(error, "mdb_dbi_open"))
+			{
+				error = mdb_txn_commit(txn);
+				if (checkError(error, "mdb_txn_commit"))
+					return true;
+			}
+			else
+				mdb_txn_abort(txn);
+		}
+		mdb_env_close(env);
+		env = nullptr;
+		return false;
+	}
+
+	void SourceIndex::sync() noexcept
+	{
+		if (env)
+			checkError(mdb_env_sync(env, 1), "mdb_env_sync");
+	}
+
+	void SourceIndex::close() noexcept
+	{
+		if (env)
+		{
+			mdb_env_sync(env, 1);
+			mdb_env_close(env);
+			env = nullptr;
+		}
+	}
+
+	void SourceIndex::decode(const MDB_val& val, SourceList& sources)
+	{
+		const uint8_t* ptr = static_cast<const uint8_t*>(val.mv_data);
+		size_t count = val.mv_size / RECORD_SIZE;
+		for (size_t i = 0; i < count; i++, ptr += RECORD_SIZE)
+		{
+			Source source;
+			source.setCID(CID(ptr));
+			const uint8_t* p = ptr + CID::SIZE;
+			source.setIp(loadUnaligned32(p));
+			source.setUdpPort(loadUnaligned16(p + 4));
+			source.setPartial((loadUnaligned16(p + 6) & RECORD_FLAG_PARTIAL) != 0);
+			source.setSize(loadUnaligned64(p + 8));
+			source.setExpires(static_cast<int64_t>(loadUnaligned64(p + 16)));
+			sources.push_back(source);
+		}
+	}
+
+	void SourceIndex::encode(const SourceList& sources, std::vector<uint8_t>& data)
+	{
+		data.resize(sources.size() * RECORD_SIZE);
+		uint8_t* ptr = data.data();
+		for (const Source& source : sources)
+		{
+			memcpy(ptr, source.getCID().data(), CID::SIZE);
+			uint8_t* p = ptr + CID::SIZE;
+			storeUnaligned32(p, source.getIp());
+			storeUnaligned16(p + 4, source.getUdpPort());
+			storeUnaligned16(p + 6, source.getPartial() ? RECORD_FLAG_PARTIAL : 0);
+			storeUnaligned64(p + 8, source.getSize());
+			storeUnaligned64(p + 16, static_cast<uint64_t>(source.getExpires()));
+			ptr += RECORD_SIZE;
+		}
+	}
+
+	bool SourceIndex::get(const TTHValue& tth, SourceList& sources) noexcept
+	{
+		sources.clear();
+		if (!env) return false;
+
+		MDB_txn* txn;
+		int error = mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn);
+		if (!checkError(error, "mdb_txn_begin")) return false;
+
+		MDB_val key, val;
+		key.mv_data = const_cast<uint8_t*>(tth.data);
+		key.mv_size = TTH_SIZE;
+		error = mdb_get(txn, dbi, &key, &val);
+		if (!error)
+			decode(val, sources);
+		mdb_txn_abort(txn);
+		return !sources.empty();
+	}
+
+	bool SourceIndex::beginWrite(MDB_txn* &txn) noexcept
+	{
+		int error = mdb_txn_begin(env, nullptr, 0, &txn);
+		return checkError(error, "mdb_txn_begin");
+	}
+
+	bool SourceIndex::commitWrite(MDB_txn* txn) noexcept
+	{
+		int error = mdb_txn_commit(txn);
+		return checkError(error, "mdb_txn_commit");
+	}
+
+	bool SourceIndex::resizeMap() noexcept
+	{
+		// No transactions are active here
+		MDB_envinfo info;
+		int error = mdb_env_info(env, &info);
+		if (!checkError(error, "mdb_env_info")) return false;
+		size_t newMapSize = info.me_mapsize << 1;
+		LogManager::message("Resizing DHT index LMDB map to " + Util::toString(newMapSize), false);
+		error = mdb_env_set_mapsize(env, newMapSize);
+		return checkError(error, "mdb_env_set_mapsize");
+	}
+
+	bool SourceIndex::put(const TTHValue& tth, const SourceList& sources) noexcept
+	{
+		if (!env) return false;
+
+		std::vector<uint8_t> data;
+		encode(sources, data);
+		MDB_val key, val;
+		key.mv_data = const_cast<uint8_t*>(tth.data);
+		key.mv_size = TTH_SIZE;
+
+		for (int retryCount = 0; retryCount < 2; ++retryCount)
+		{
+			MDB_txn* txn;
+			if (!beginWrite(txn)) return false;
+			int error;
+			if (data.empty())
+			{
+				error = mdb_del(txn, dbi, &key, nullptr);
+				if (error == MDB_NOTFOUND) error = 0;
+			}
+			else
+			{
+				val.mv_data = data.data();
+				val.mv_size = data.size();
+				error = mdb_put(txn, dbi, &key, &val, 0);
+			}
+			if (!error)
+			{
+				error = mdb_txn_commit(txn);
+				if (error != MDB_MAP_FULL)
+					return checkError(error, "mdb_txn_commit");
+			}
+			else
+				mdb_txn_abort(txn);
+			if (error != MDB_MAP_FULL)
+				return checkError(error, "mdb_put");
+			if (!resizeMap()) return false;
+		}
+		return false;
+	}
+
+	bool SourceIndex::sweep(int64_t now, size_t maxKeys, size_t& removed) noexcept
+	{
+		removed = 0;
+		if (!env) return false;
+
+		MDB_txn* txn;
+		if (!beginWrite(txn)) return false;
+		MDB_cursor* cursor;
+		int error = mdb_cursor_open(txn, dbi, &cursor);
+		if (!checkError(error, "mdb_cursor_open"))
+		{
+			mdb_txn_abort(txn);
+			return false;
+		}
+
+		MDB_val key, val;
+		if (sweepPosValid)
+		{
+			key.mv_data = sweepPos.data;
+			key.mv_size = TTH_SIZE;
+			error = mdb_cursor_get(cursor, &key, &val, MDB_SET_RANGE);
+		}
+		else
+			error = mdb_cursor_get(cursor, &key, &val, MDB_FIRST);
+
+		SourceList sources;
+		std::vector<uint8_t> data;
+		size_t keys = 0;
+		while (!error && keys < maxKeys)
+		{
+			++keys;
+			if (key.mv_size == TTH_SIZE)
+			{
+				sources.clear();
+				decode(val, sources);
+				size_t oldSize = sources.size();
+				sources.erase(std::remove_if(sources.begin(), sources.end(),
+					[now](const Source& s) { return s.getExpires() <= now; }), sources.end());
+				if (sources.size() != oldSize)
+				{
+					removed += oldSize - sources.size();
+					if (sources.empty())
+						error = mdb_cursor_del(cursor, 0);
+					else
+					{
+						encode(sources, data);
+						val.mv_data = data.data();
+						val.mv_size = data.size();
+						error = mdb_cursor_put(cursor, &key, &val, MDB_CURRENT);
+					}
+					if (error) break;
+				}
+			}
+			error = mdb_cursor_get(cursor, &key, &val, MDB_NEXT);
+		}
+
+		if (error == MDB_NOTFOUND)
+		{
+			// wrap around
+			sweepPosValid = false;
+			error = 0;
+		}
+		else if (!error)
+		{
+			memcpy(sweepPos.data, key.mv_data, TTH_SIZE);
+			sweepPosValid = true;
+		}
+		mdb_cursor_close(cursor);
+
+		if (error)
+		{
+			mdb_txn_abort(txn);
+			if (error == MDB_MAP_FULL)
+				resizeMap();
+			else
+				checkError(error, "sweep");
+			removed = 0;
+			return false;
+		}
+		return commitWrite(txn);
+	}
+
+	size_t SourceIndex::getKeyCount() noexcept
+	{
+		if (!env) return 0;
+		MDB_txn* txn;
+		int error = mdb_txn_begin(env, nullptr, MDB_RDONLY, &txn);
+		if (!checkError(error, "mdb_txn_begin")) return 0;
+		MDB_stat stat;
+		error = mdb_stat(txn, dbi, &stat);
+		mdb_txn_abort(txn);
+		return error ? 0 : stat.ms_entries;
+	}
+
+}
@@ -0,0 +1,70 @@
+#ifndef SOURCE_INDEX_H_
+#define SOURCE_INDEX_H_
+
+#include <lmdb.h>
+#include "../CID.h"
+#include "../MerkleTree.h"
+#include "../Ip4Address.h"
+#include "../BaseUtil.h"
+
+namespace dht
+{
+
+	struct Source
+	{
+		GETSET(CID, cid, CID);
+		GETSET(Ip4Address, ip, Ip);
+		GETSET(int64_t, expires, Expires); // unix time
+		GETSET(uint64_t, size, Size);
+		GETSET(uint16_t, udpPort, UdpPort);
+		GETSET(bool, partial, Partial);
+	};
+
+	typedef std::deque<Source> SourceList;
+
+	// Sources published by other nodes, stored in a separate LMDB environment.
+	// Each TTH maps to a packed array of fixed-size source records.
+	// Not thread safe, the caller must serialize access.
+	class SourceIndex
+	{
+		public:
+			SourceIndex() {}
+			~SourceIndex() { close(); }
+
+			SourceIndex(const SourceIndex&) = delete;
+			SourceIndex& operator= (const SourceIndex&) = delete;
+
+			bool open() noexcept;
+			void close() noexcept;
+			bool isOpen() const { return env != nullptr; }
+			void sync() noexcept;
+
+			bool get(const TTHValue& tth, SourceList& sources) noexcept;
+
+			// Empty list removes the key
+			bool put(const TTHValue& tth, const SourceList& sources) noexcept;
+
+			// Removes expired sources from up to maxKeys keys, continuing where the previous call stopped
+			bool sweep(int64_t now, size_t maxKeys, size_t& removed) noexcept;
+
+			size_t getKeyCount() noexcept;
+
+			static string getDBPath() noexcept;
+
+		private:
+			MDB_env* env = nullptr;
+			MDB_dbi dbi = 0;
+			TTHValue sweepPos;
+			bool sweepPosValid = false;
+
+			bool beginWrite(MDB_txn* &txn) noexcept;
+			bool commitWrite(MDB_txn* txn) noexcept;
+			bool resizeMap() noexcept;
+			static bool checkError(int error, const char* what) noexcept;
+			static void decode(const MDB_val& val, SourceList& sources);
+			static void encode(const SourceList& sources, std::vector<uint8_t>& data);
+	};
+
+}
+
+#endif // SOURCE_INDEX_H_
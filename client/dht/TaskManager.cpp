@@ -41,16 +41,27 @@ namespace dht
 		nextFirewallCheck = tick + FWCHECK_TIME;
 		lastBootstrap = 0;
 		nextXmlSave = tick + 60*60*1000;
-		TimerManager::getInstance()->addListener(this);
+		nextMinute = tick + 60*1000;
+		TimerManager::getInstance()->addTask(this, "DHT", 1000);
 	}
 
 	TaskManager::~TaskManager()
 	{
-		TimerManager::getInstance()->removeListener(this);
+		TimerManager::getInstance()->removeTask(this);
 	}
 
-	// TimerManagerListener
-	void TaskManager::on(TimerManagerListener::Second, uint64_t tick) noexcept
+	// TimerManager::Task
+	void TaskManager::onTimer(uint64_t tick) noexcept
+	{
+		processSecond(tick);
+		if (tick >= nextMinute)
+		{
+			processMinute(tick);
+			nextMinute = tick + 60*1000;
+		}
+	}
+
+	void TaskManager::processSecond(uint64_t tick) noexcept
 	{
 		DHT* d = DHT::getInstance();
 		if (d->getState() == DHT::STATE_INITIALIZING)
@@ -69,10 +80,14 @@ namespace dht
 		}
 		if (d->isConnected() && d->getNodesCount() >= K)
 		{
-			if (!d->isFirewalled() && IndexManager::getInstance()->getPublish() && tick >= nextPublishTime)
+			auto im = IndexManager::getInstance();
+			if (!d->isFirewalled() && im->getPublish() && tick >= nextPublishTime)
 			{
-				// publish next file
-				IndexManager::getInstance()->publishNextFile();
+				if (im->isTimeForPublishing())
+					im->publishShare();
+
+				// publish next files
+				im->publishNextFiles(tick);
 				nextPublishTime = tick + PUBLISH_TIME;
 			}
 		}
@@ -109,7 +124,7 @@ namespace dht
 		}
 	}
 
-	void TaskManager::on(TimerManagerListener::Minute, uint64_t tick) noexcept
+	void TaskManager::processMinute(uint64_t tick) noexcept
 	{
 		Utils::cleanFlood();
 
@@ -25,7 +25,7 @@
 namespace dht
 {
 
-	class TaskManager : public Singleton<TaskManager>, private TimerManagerListener
+	class TaskManager : public Singleton<TaskManager>, private TimerManager::Task
 	{
 	public:
 		TaskManager();
@@ -49,9 +49,13 @@ namespace dht
 
 		uint64_t nextXmlSave;
 
-		// TimerManagerListener
-		void on(TimerManagerListener::Second, uint64_t tick) noexcept;
-		void on(TimerManagerListener::Minute, uint64_t tick) noexcept;
+		uint64_t nextMinute;
+
+		void processSecond(uint64_t tick) noexcept;
+		void processMinute(uint64_t tick) noexcept;
+
+		// TimerManager::Task
+		void onTimer(uint64_t tick) noexcept override;
 	};
 
 }
@@ -52,6 +52,27 @@ namespace dht
 		return CID(distance.b);
 	}
 
+	unsigned Utils::getCommonPrefix(const CID& cid1, const CID& cid2)
+	{
+		const uint8_t* a = cid1.data();
+		const uint8_t* b = cid2.data();
+		for (unsigned i = 0; i < CID::SIZE; i++)
+		{
+			uint8_t x = a[i] ^ b[i];
+			if (x)
+			{
+				unsigned bits = i * 8;
+				while (!(x & 0x80))
+				{
+					x <<= 1;
+					bits++;
+				}
+				return bits;
+			}
+		}
+		return ID_BITS;
+	}
+
 	/*
 	 * Detect whether it is correct to use IP:port in DHT network
 	 */
@@ -72,7 +93,7 @@ namespace dht
 	bool Utils::checkFlood(uint32_t ip, const AdcCommand& cmd)
 	{
 		// ignore empty commands
-		if (cmd.getParameters().empty())
+		if (cmd.getParamCount() == 0)
 			return false;
 
 		// there maximum allowed request packets from one IP per minute
@@ -43,6 +43,9 @@ namespace dht
 			return TTHValue(const_cast<uint8_t*>(getDistance(cid, CID(tth.data)).data()));
 		}
 
+		/** Returns number of leading bits shared by two IDs */
+		static unsigned getCommonPrefix(const CID& cid1, const CID& cid2);
+
 		/** Detect whether it is correct to use IP:port in DHT network */
 		static bool isGoodIPPort(uint32_t ip, uint16_t port);
 
@@ -149,7 +149,8 @@ LRESULT ADLSProperties::onCloseCmd(WORD /*wNotifyCode*/, WORD wID, HWND /*hWndCt
 		{
 			try
 			{
-				std::regex(searchString, isCaseSensitive ? std::regex::flag_type() : std::regex_constants::icase);
+				// same syntax as used by ADLSearch for matching
+				boost::regex(searchString, isCaseSensitive ? boost::regex::perl : boost::regex::perl | boost::regex::icase);
 			}
 			catch (...)
 			{
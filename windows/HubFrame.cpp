@@ -2728,19 +2728,16 @@ UserInfo* HubFrame::findUserByNick(const tstring& nick) const
 		CID cid;
 		{
 			dht::DHT::LockInstanceNodes lock(dht::DHT::getInstance());
-			const auto nodes = lock.getNodes();
-			if (nodes)
+			const auto table = lock.getRoutingTable();
+			if (table)
 			{
 				string nickUtf8 = Text::fromT(nick);
-				for (const auto& node : *nodes)
+				table->forEachNode([&cid, &nickUtf8](const dht::Node::Ptr& node)
 				{
 					const Identity& id = node->getIdentity();
-					if (id.getNick() == nickUtf8)
-					{
+					if (cid.isZero() && id.getNick() == nickUtf8)
 						cid = id.getUser()->getCID();
-						break;
-					}
-				}
+				});
 			}
 		}
 		if (!cid.isZero())
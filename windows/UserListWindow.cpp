@@ -6,6 +6,7 @@
 #include "LockRedraw.h"
 #include "UserTypeColors.h"
 #include "../client/ClientManager.h"
+#include "../client/LocationUtil.h"
 #include "../client/UserManager.h"
 #include "../client/UploadManager.h"
 #include "../client/QueueManager.h"
@@ -313,6 +314,7 @@ void UserListWindow::updateUserList()
 		dcassert(ctrlFilterSel);
 		const int sel = getFilterSelPos();
 		const bool doSizeCompare = sel == COLUMN_SHARED && parseFilter(mode, size);
+		prefetchIpInfo(sel);
 		int pos = 0;
 		for (auto i = userMap.cbegin(); i != userMap.cend(); ++i, ++pos)
 		{
@@ -322,10 +324,40 @@ void UserListWindow::updateUserList()
 		}
 	}
 	shouldSort = false;
+	prefetchIpInfo(ctrlUsers.getSortColumn());
 	ctrlUsers.resort();
 	hubFrame->updateUserCount();
 }
 
+void UserListWindow::prefetchIpInfo(int column)
+{
+	if (column != COLUMN_GEO_LOCATION && column != COLUMN_P2P_GUARD) return;
+	vector<IpAddress> ips;
+	for (auto i = userMap.cbegin(); i != userMap.cend(); ++i)
+	{
+		const UserInfo* ui = i->second;
+		if (column == COLUMN_GEO_LOCATION)
+		{
+			if (ui->stateLocation == UserInfo::STATE_DONE) continue;
+			IpAddress ip = ui->getIp();
+			if (Util::isValidIp(ip)) ips.push_back(ip);
+		}
+		else
+		{
+			if (ui->stateP2PGuard == UserInfo::STATE_DONE) continue;
+			IpAddress ip;
+			ip.data.v4 = ui->getIdentity().getIP4();
+			ip.type = AF_INET;
+			if (ip.data.v4) ips.push_back(ip);
+		}
+	}
+	if (ips.size() < 2) return;
+	// Resolve all missing addresses at once, sorting and filtering will find them in the cache
+	vector<IPInfo> results;
+	Util::getIpInfo(ips, results, column == COLUMN_GEO_LOCATION ?
+		IPInfo::FLAG_COUNTRY | IPInfo::FLAG_LOCATION : IPInfo::FLAG_P2P_GUARD);
+}
+
 bool UserListWindow::updateUser(const OnlineUserPtr& ou, uint32_t columnMask, bool isConnected)
 {
 	ASSERT_MAIN_THREAD();
@@ -499,12 +531,14 @@ void UserListWindow::insertDHTUsers()
 	vector<CID> cidList;
 	{
 		dht::DHT::LockInstanceNodes lock(d);
-		const auto nodes = lock.getNodes();
-		if (nodes)
+		const auto table = lock.getRoutingTable();
+		if (table)
 		{
-			for (const auto& node : *nodes)
+			table->forEachNode([&cidList](const dht::Node::Ptr& node)
+			{
 				if (node->getType() < 4 && node->getUser()->hasNick())
 					cidList.push_back(node->getUser()->getCID());
+			});
 		}
 	}
 	for (const CID& cid : cidList)
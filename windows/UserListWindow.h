@@ -146,6 +146,7 @@ class UserListWindow : public CWindowImpl<UserListWindow>
 
 		bool parseFilter(FilterModes& mode, int64_t& size);
 		bool matchFilter(UserInfo& ui, int sel, bool doSizeCompare = false, FilterModes mode = NONE, int64_t size = 0);
+		void prefetchIpInfo(int column);
 };
 
 #endif // USER_LIST_WINDOW_H_